@@ -17,9 +17,11 @@
 #include <fcntl.h>
 #include <ctype.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <net/if.h>
 
 #include <plugins/lcpng/lcpng.h>
+#include <vppinfra/linux/netns.h>
 
 lcp_main_t lcp_main;
 
@@ -31,20 +33,14 @@ u8 *lcp_get_default_ns(void) {
   return lcpm->default_namespace;
 }
 
-int lcp_get_default_ns_fd(void) {
-  lcp_main_t *lcpm = &lcp_main;
-
-  return lcpm->default_ns_fd;
-}
-
 /*
- * ns is expected to be or look like a NUL-terminated C string.
+ * ns is expected to be or look like a NUL-terminated C string. Its fd is
+ * opened by lcp_ns_enter(), like that of any other namespace.
  */
 int lcp_set_default_ns(u8 *ns) {
   lcp_main_t *lcpm = &lcp_main;
   char *p;
   int len;
-  u8 *s;
 
   p = (char *) ns;
   len = clib_strnlen (p, LCP_NS_LEN);
@@ -54,21 +50,133 @@ int lcp_set_default_ns(u8 *ns) {
   if (!p || *p == 0)
     {
       lcpm->default_namespace = NULL;
-      if (lcpm->default_ns_fd > 0)
-	close (lcpm->default_ns_fd);
-      lcpm->default_ns_fd = 0;
       return 0;
     }
 
   vec_validate_init_c_string (lcpm->default_namespace, p,
 			      clib_strnlen (p, LCP_NS_LEN));
-  s = format (0, "/var/run/netns/%s%c", (char *) lcpm->default_namespace, 0);
-  lcpm->default_ns_fd = open ((char *) s, O_RDONLY);
-  vec_free (s);
 
   return 0;
 }
 
+static u8 *
+lcp_ns_path (const u8 *ns)
+{
+  if (!ns[0])
+    return format (0, "/proc/self/ns/net%c", 0);
+  if (ns[0] == '/')
+    return format (0, "%s%c", ns, 0);
+  return format (0, "/var/run/netns/%s%c", ns, 0);
+}
+
+/* Open the namespace again if its name now refers to another one, as
+ * happens when it is deleted and created again. VPP's own cannot change. */
+static int
+lcp_ns_open (lcp_ns_t *lns)
+{
+  struct stat st;
+  u8 *path;
+  int rv = 0;
+
+  if (lns->fd != -1 && !lns->name[0])
+    return 0;
+
+  path = lcp_ns_path (lns->name);
+  if (stat ((char *) path, &st) < 0)
+    rv = -1;
+  else if (lns->fd == -1 || st.st_dev != lns->dev || st.st_ino != lns->ino)
+    {
+      if (lns->fd != -1)
+	close (lns->fd);
+      lns->fd = open ((char *) path, O_RDONLY | O_CLOEXEC);
+      lns->dev = st.st_dev;
+      lns->ino = st.st_ino;
+      if (lns->fd == -1)
+	rv = -1;
+    }
+  vec_free (path);
+
+  return rv;
+}
+
+static lcp_ns_t *
+lcp_ns_get (const u8 *ns)
+{
+  lcp_main_t *lcpm = &lcp_main;
+  lcp_ns_t *lns;
+  uword *p;
+
+  if (!lcpm->namespace_by_name)
+    {
+      lcpm->namespace_by_name = hash_create_string (0, sizeof (uword));
+      /* ours first, this is the namespace we are in */
+      vec_add2 (lcpm->namespaces, lns, 1);
+      lns->name = format (0, "%c", 0);
+      lns->fd = -1;
+      hash_set_mem (lcpm->namespace_by_name, lns->name, 0);
+      lcpm->namespace_current = 0;
+    }
+
+  if (!ns)
+    ns = (const u8 *) "";
+  if ((p = hash_get_mem (lcpm->namespace_by_name, ns)))
+    return vec_elt_at_index (lcpm->namespaces, p[0]);
+
+  vec_add2 (lcpm->namespaces, lns, 1);
+  lns->name = format (0, "%s%c", ns, 0);
+  lns->fd = -1;
+  hash_set_mem (lcpm->namespace_by_name, lns->name,
+		lns - lcpm->namespaces);
+
+  return lns;
+}
+
+static int
+lcp_ns_switch (u32 index)
+{
+  lcp_main_t *lcpm = &lcp_main;
+  lcp_ns_t *lns = vec_elt_at_index (lcpm->namespaces, index);
+
+  if (lcp_ns_open (lns) < 0 || clib_setns (lns->fd) < 0)
+    return -1;
+  lcpm->namespace_current = index;
+
+  return 0;
+}
+
+int
+lcp_ns_enter (const u8 *ns)
+{
+  lcp_main_t *lcpm = &lcp_main;
+  lcp_ns_t *lns;
+  u32 prev;
+
+  lns = lcp_ns_get (ns);
+  prev = lcpm->namespace_current;
+  if (lns - lcpm->namespaces == prev)
+    return prev;
+
+  /* to come back, ours has to be open before we leave it */
+  if (lcp_ns_open (vec_elt_at_index (lcpm->namespaces, 0)) < 0)
+    return -1;
+  if (lcp_ns_switch (lns - lcpm->namespaces) < 0)
+    return -1;
+
+  return prev;
+}
+
+void
+lcp_ns_leave (int prev)
+{
+  lcp_main_t *lcpm = &lcp_main;
+
+  if (prev < 0 || prev == lcpm->namespace_current)
+    return;
+  if (lcp_ns_switch (prev) < 0)
+    clib_warning ("unable to go back to netns '%s'",
+		  lcpm->namespaces[prev].name);
+}
+
 void
 lcp_set_sync (u8 is_auto)
 {
@@ -97,6 +205,24 @@ lcp_set_auto_subint (u8 is_auto)
   lcpm->lcp_auto_subint = (is_auto != 0);
 }
 
+void
+lcp_set_arp_mirror_rate (u32 rate, u32 burst)
+{
+  lcp_main_t *lcpm = &lcp_main;
+
+  lcpm->arp_mirror_burst = burst ? burst : clib_max (rate, 1);
+  lcpm->arp_mirror_rate = rate;
+}
+
+void
+lcp_set_punt_rate (lcp_punt_class_t pc, u32 rate, u32 burst)
+{
+  lcp_main_t *lcpm = &lcp_main;
+
+  lcpm->punt_burst[pc] = burst ? burst : clib_max (rate, 1);
+  lcpm->punt_rate[pc] = rate;
+}
+
 int
 lcp_auto_subint (void)
 {
@@ -20,13 +20,46 @@
 #define LCP_NS_LEN 32
 #define LCP_HAVE_VRF_SYNC 1
 
+/* Classes of the traffic punted to the host, see lcp_punt_classify() in
+ * lcpng_if_node.c. Each is policed on its own, per pair.
+ */
+#define foreach_lcp_punt_class                                                \
+  _ (CONTROL, "control") /* BGP, OSPF, BFD, VRRP, IKE */                      \
+  _ (ICMP, "icmp")	 /* ICMP and ICMPv6, including ND */                  \
+  _ (OTHER, "other")
+
+typedef enum lcp_punt_class_t_
+{
+#define _(sym, str) LCP_PUNT_CLASS_##sym,
+  foreach_lcp_punt_class
+#undef _
+    LCP_PUNT_N_CLASS,
+} lcp_punt_class_t;
+
+/* A network namespace LCP entered, see lcp_ns_enter() */
+typedef struct lcp_ns_s
+{
+  u8 *name; /* NUL terminated, empty for the namespace VPP runs in */
+  int fd;
+  u64 dev; /* of the namespace file the fd was opened from */
+  u64 ino;
+} lcp_ns_t;
+
 typedef struct lcp_main_s
 {
   u16 msg_id_base;		    /* API message ID base */
   u8 *default_namespace;	    /* default namespace if set */
-  int default_ns_fd;
+  lcp_ns_t *namespaces;	    /* namespaces entered, VPP's own first */
+  uword *namespace_by_name;
+  u32 namespace_current;	    /* index in namespaces */
   u8 lcp_auto_subint; /* Automatically create/delete LCP sub-interfaces */
   u8 lcp_sync;	      /* Automatically sync VPP changes to LCP */
+  u32 arp_mirror_rate;  /* ARP replies mirrored to the host per second, per
+			   phy and thread. 0 for no limit */
+  u32 arp_mirror_burst; /* ARP replies mirrored back to back */
+  u32 punt_rate[LCP_PUNT_N_CLASS];  /* packets punted to the host per second,
+				       per pair and thread. 0 for no limit */
+  u32 punt_burst[LCP_PUNT_N_CLASS]; /* packets punted back to back */
   /* Set when Unit testing */
   u8 test_mode;
 } lcp_main_t;
@@ -38,7 +71,16 @@ extern lcp_main_t lcp_main;
  */
 int lcp_set_default_ns(u8 *ns);
 u8 *lcp_get_default_ns(void); /* Returns NULL or shared string */
-int lcp_get_default_ns_fd(void);
+
+/*
+ * Enter namespace ns, NULL or empty for the one VPP runs in. The fd of each
+ * namespace is opened once and kept, and nothing is done if ns is the
+ * current namespace already, so nested and repeated calls are cheap.
+ * Returns what to pass to lcp_ns_leave() to go back to the namespace that
+ * was current, or -1 if ns cannot be entered. Main thread only.
+ */
+int lcp_ns_enter (const u8 *ns);
+void lcp_ns_leave (int prev);
 
 /*
  * Sync state from VPP into all LCP devices
@@ -18,22 +18,56 @@
 #include <lcpng/lcpng_interface.h>
 #include <lcpng/lcpng_adj.h>
 
+#include <vppinfra/bihash_24_8.h>
+#include <vppinfra/bihash_template.c>
 #include <vppinfra/bihash_32_8.h>
 #include <vppinfra/bihash_template.c>
 
+/* The key an adjacency is stored under, and which table it is in */
+typedef struct lcp_adj_stored_key_t_
+{
+  lcp_adj_key_t key;
+  u8 len;
+} lcp_adj_stored_key_t;
+
 static adj_delegate_type_t adj_type;
-static lcp_adj_key_t *adj_keys;
+static lcp_adj_stored_key_t *adj_keys;
 
 /**
- * The table of adjacencies indexed by the rewrite string
+ * The tables of adjacencies indexed by the rewrite string
  */
-BVT (clib_bihash) lcp_adj_tbl;
+clib_bihash_32_8_t lcp_adj_tbl;
+clib_bihash_24_8_t lcp_adj_short_tbl;
 
 static_always_inline void
-lcp_adj_mk_key_adj (const ip_adjacency_t *adj, lcp_adj_key_t *key)
+lcp_adj_mk_key_adj (const ip_adjacency_t *adj, lcp_adj_stored_key_t *key)
 {
   lcp_adj_mk_key (adj->rewrite_header.data, adj->rewrite_header.data_bytes,
-		  adj->rewrite_header.sw_if_index, key);
+		  adj->rewrite_header.sw_if_index, &key->key);
+  key->len = adj->rewrite_header.data_bytes;
+}
+
+static void
+lcp_adj_tbl_add_del (const lcp_adj_stored_key_t *key, adj_index_t ai,
+		     int is_add)
+{
+  if (key->len <= LCP_ADJ_SHORT_REWRITE)
+    {
+      lcp_adj_short_kv_t skv;
+
+      lcp_adj_mk_short_key (key->key.rewrite, key->len, key->key.sw_if_index,
+			    &skv.k);
+      skv.v = ai;
+      clib_bihash_add_del_24_8 (&lcp_adj_short_tbl, &skv.kv, is_add);
+    }
+  else
+    {
+      lcp_adj_kv_t kv;
+
+      kv.k = key->key;
+      kv.v = ai;
+      clib_bihash_add_del_32_8 (&lcp_adj_tbl, &kv.kv, is_add);
+    }
 }
 
 static u8 *
@@ -46,13 +80,13 @@ static void
 lcp_adj_delegate_adj_deleted (adj_delegate_t *aed)
 {
   ip_adjacency_t *adj;
-  lcp_adj_kv_t kv;
+  lcp_adj_stored_key_t key;
 
   adj = adj_get (aed->ad_adj_index);
 
-  lcp_adj_mk_key_adj (adj, &kv.k);
+  lcp_adj_mk_key_adj (adj, &key);
 
-  BV (clib_bihash_add_del) (&lcp_adj_tbl, &kv.kv, 0);
+  lcp_adj_tbl_add_del (&key, aed->ad_adj_index, 0);
 
   if (aed->ad_index != INDEX_INVALID)
     pool_put_index (adj_keys, aed->ad_index);
@@ -72,8 +106,8 @@ static void
 lcp_adj_delegate_adj_modified (adj_delegate_t *aed)
 {
   ip_adjacency_t *adj;
-  lcp_adj_kv_t kv;
-  lcp_adj_key_t *adj_key = NULL;
+  lcp_adj_stored_key_t key;
+  lcp_adj_stored_key_t *adj_key = NULL;
   u8 save_adj, key_changed;
 
   key_changed = 0;
@@ -88,24 +122,20 @@ lcp_adj_delegate_adj_modified (adj_delegate_t *aed)
   if (!adj_key && !save_adj)
     return;
 
-  /* build kv if a new entry should be stored */
+  /* build the key if a new entry should be stored */
   if (save_adj)
     {
-      lcp_adj_mk_key_adj (adj, &kv.k);
-      kv.v = aed->ad_adj_index;
+      lcp_adj_mk_key_adj (adj, &key);
       if (adj_key)
-	key_changed = (clib_memcmp (adj_key, &kv.k, sizeof (*adj_key)) != 0);
+	key_changed =
+	  (adj_key->len != key.len ||
+	   clib_memcmp (&adj_key->key, &key.key, sizeof (key.key)) != 0);
     }
 
   /* delete old entry if needed */
   if (adj_key && ((save_adj && key_changed) || (!save_adj)))
     {
-      lcp_adj_kv_t old_kv;
-
-      clib_memcpy_fast (&old_kv.k, adj_key, sizeof (*adj_key));
-      old_kv.v = 0;
-
-      BV (clib_bihash_add_del) (&lcp_adj_tbl, &old_kv.kv, 0);
+      lcp_adj_tbl_add_del (adj_key, 0, 0);
 
       if (!save_adj)
 	{
@@ -117,14 +147,14 @@ lcp_adj_delegate_adj_modified (adj_delegate_t *aed)
   /* add new entry if needed */
   if (save_adj)
     {
-      BV (clib_bihash_add_del) (&lcp_adj_tbl, &kv.kv, 1);
+      lcp_adj_tbl_add_del (&key, aed->ad_adj_index, 1);
 
       if (!adj_key)
 	{
 	  pool_get (adj_keys, adj_key);
 	  aed->ad_index = adj_key - adj_keys;
 	}
-      clib_memcpy_fast (adj_key, &kv.k, sizeof (*adj_key));
+      *adj_key = key;
     }
 }
 
@@ -132,9 +162,9 @@ static void
 lcp_adj_delegate_adj_created (adj_index_t ai)
 {
   ip_adjacency_t *adj;
-  lcp_adj_kv_t kv;
+  lcp_adj_stored_key_t key;
   index_t lai = INDEX_INVALID;
-  lcp_adj_key_t *adj_key;
+  lcp_adj_stored_key_t *adj_key;
   index_t lipi;
   lcp_itf_pair_t *lip;
 
@@ -150,12 +180,11 @@ lcp_adj_delegate_adj_created (adj_index_t ai)
 
   if (IP_LOOKUP_NEXT_REWRITE == adj->lookup_next_index)
     {
-      lcp_adj_mk_key_adj (adj, &kv.k);
+      lcp_adj_mk_key_adj (adj, &key);
       pool_get (adj_keys, adj_key);
-      clib_memcpy_fast (adj_key, &kv.k, sizeof (*adj_key));
-      kv.v = ai;
+      *adj_key = key;
 
-      BV (clib_bihash_add_del) (&lcp_adj_tbl, &kv.kv, 1);
+      lcp_adj_tbl_add_del (&key, ai, 1);
       lai = adj_key - adj_keys;
     }
 
@@ -165,13 +194,29 @@ lcp_adj_delegate_adj_created (adj_index_t ai)
 u8 *
 format_lcp_adj_kvp (u8 *s, va_list *args)
 {
-  BVT (clib_bihash_kv) *kv = va_arg (*args, BVT (clib_bihash_kv) *);
+  clib_bihash_kv_32_8_t *kv = va_arg (*args, clib_bihash_kv_32_8_t *);
   CLIB_UNUSED (int verbose) = va_arg (*args, int);
   lcp_adj_kv_t *akv = (lcp_adj_kv_t *) kv;
 
   s = format (s, "  %U:%U\n    %U", format_vnet_sw_if_index_name,
 	      vnet_get_main (), akv->k.sw_if_index, format_hex_bytes,
-	      akv->k.rewrite, 18, format_adj_nbr, akv->v, 4);
+	      akv->k.rewrite, sizeof (akv->k.rewrite), format_adj_nbr, akv->v,
+	      4);
+
+  return (s);
+}
+
+u8 *
+format_lcp_adj_short_kvp (u8 *s, va_list *args)
+{
+  clib_bihash_kv_24_8_t *kv = va_arg (*args, clib_bihash_kv_24_8_t *);
+  CLIB_UNUSED (int verbose) = va_arg (*args, int);
+  lcp_adj_short_kv_t *akv = (lcp_adj_short_kv_t *) kv;
+
+  s = format (s, "  %U:%U\n    %U", format_vnet_sw_if_index_name,
+	      vnet_get_main (), akv->k.sw_if_index, format_hex_bytes,
+	      akv->k.rewrite, sizeof (akv->k.rewrite), format_adj_nbr, akv->v,
+	      4);
 
   return (s);
 }
@@ -185,8 +230,10 @@ lcp_adj_show_cmd (vlib_main_t *vm, unformat_input_t *input,
   if (unformat (input, "verbose"))
     verbose = 1;
 
-  vlib_cli_output(vm, "lcp Adjs:\n%U", BV(format_bihash), &lcp_adj_tbl,
-                  verbose);
+  vlib_cli_output (vm, "lcp Adjs:\n%U", format_bihash_24_8, &lcp_adj_short_tbl,
+		   verbose);
+  vlib_cli_output (vm, "lcp Adjs, long rewrites:\n%U", format_bihash_32_8,
+		   &lcp_adj_tbl, verbose);
 
   return 0;
 }
@@ -210,8 +257,12 @@ lcp_adj_init (vlib_main_t *vm)
 {
   adj_type = adj_delegate_register_new_type (&lcp_adj_vft);
 
-  BV(clib_bihash_init)(&lcp_adj_tbl, "lcp ADJ table", 1024, 1 << 24);
-  BV (clib_bihash_set_kvp_format_fn) (&lcp_adj_tbl, format_lcp_adj_kvp);
+  clib_bihash_init_24_8 (&lcp_adj_short_tbl, "lcp ADJ table", 1024, 1 << 24);
+  clib_bihash_set_kvp_format_fn_24_8 (&lcp_adj_short_tbl,
+				      format_lcp_adj_short_kvp);
+  clib_bihash_init_32_8 (&lcp_adj_tbl, "lcp ADJ table, long rewrites", 1024,
+			 1 << 24);
+  clib_bihash_set_kvp_format_fn_32_8 (&lcp_adj_tbl, format_lcp_adj_kvp);
 
   return (NULL);
 }
@@ -16,8 +16,18 @@
 #ifndef __LCP_ADJ_DELEGATE_H__
 #define __LCP_ADJ_DELEGATE_H__
 
+#include <vppinfra/bihash_24_8.h>
 #include <vppinfra/bihash_32_8.h>
 
+/*
+ * Adjacencies are found by their MAC rewrite. Rewrites of up to
+ * LCP_ADJ_SHORT_REWRITE bytes, which covers untagged and single tagged
+ * Ethernet, are kept in a table with a 24 byte key, longer ones in a table
+ * with a 32 byte key. The BV() macros would pick whichever bihash was
+ * included last, so the functions of each table are spelled out.
+ */
+#define LCP_ADJ_SHORT_REWRITE 20
+
 typedef struct lcp_adj_key_t_
 {
   u32 sw_if_index;
@@ -26,11 +36,20 @@ typedef struct lcp_adj_key_t_
 
 STATIC_ASSERT (sizeof (lcp_adj_key_t) == 32, "LCP ADJ Key size changed");
 
+typedef struct lcp_adj_short_key_t_
+{
+  u32 sw_if_index;
+  u8 rewrite[LCP_ADJ_SHORT_REWRITE];
+} lcp_adj_short_key_t;
+
+STATIC_ASSERT (sizeof (lcp_adj_short_key_t) == 24,
+	       "LCP ADJ short Key size changed");
+
 typedef struct lcp_adj_kv_t_
 {
   union
   {
-    BVT (clib_bihash_kv) kv;
+    clib_bihash_kv_32_8_t kv;
     struct
     {
       lcp_adj_key_t k;
@@ -39,13 +58,30 @@ typedef struct lcp_adj_kv_t_
   };
 } lcp_adj_kv_t;
 
-STATIC_ASSERT (sizeof (lcp_adj_kv_t) == sizeof (BVT (clib_bihash_kv)),
+STATIC_ASSERT (sizeof (lcp_adj_kv_t) == sizeof (clib_bihash_kv_32_8_t),
 	       "LCP ADJ Key size changed");
 
+typedef struct lcp_adj_short_kv_t_
+{
+  union
+  {
+    clib_bihash_kv_24_8_t kv;
+    struct
+    {
+      lcp_adj_short_key_t k;
+      u64 v;
+    };
+  };
+} lcp_adj_short_kv_t;
+
+STATIC_ASSERT (sizeof (lcp_adj_short_kv_t) == sizeof (clib_bihash_kv_24_8_t),
+	       "LCP ADJ short Key size changed");
+
 /**
- * The table of adjacencies indexed by the rewrite string
+ * The tables of adjacencies indexed by the rewrite string
  */
-extern BVT (clib_bihash) lcp_adj_tbl;
+extern clib_bihash_32_8_t lcp_adj_tbl;
+extern clib_bihash_24_8_t lcp_adj_short_tbl;
 
 static_always_inline void
 lcp_adj_mk_key (const u8 *rewrite, u8 len, u32 sw_if_index, lcp_adj_key_t *key)
@@ -60,19 +96,85 @@ lcp_adj_mk_key (const u8 *rewrite, u8 len, u32 sw_if_index, lcp_adj_key_t *key)
   key->sw_if_index = sw_if_index;
 }
 
-static_always_inline adj_index_t
-lcp_adj_lkup (const u8 *rewrite, u8 len, u32 sw_if_index)
+static_always_inline void
+lcp_adj_mk_short_key (const u8 *rewrite, u8 len, u32 sw_if_index,
+		      lcp_adj_short_key_t *key)
 {
-  lcp_adj_kv_t kv;
+  u64 *k = (u64 *) key;
 
-  lcp_adj_mk_key (rewrite, len, sw_if_index, &kv.k);
+  /* three stores to clear the padding are cheaper than a memset */
+  ASSERT (len <= sizeof (key->rewrite));
+  k[0] = k[1] = k[2] = 0;
+  clib_memcpy_fast (key->rewrite, rewrite, len);
+  key->sw_if_index = sw_if_index;
+}
 
-  if (!BV (clib_bihash_search_inline) (&lcp_adj_tbl, &kv.kv))
-    return (kv.v);
+/**
+ * A lookup split in two, so that a node can hash the keys of a whole frame
+ * and prefetch their buckets before it searches any of them.
+ */
+typedef struct lcp_adj_lkup_t_
+{
+  union
+  {
+    lcp_adj_short_kv_t skv;
+    lcp_adj_kv_t kv;
+  };
+  u64 hash;
+  u8 is_short;
+  u8 is_active; // set by lcp_adj_lkup_prep()
+} lcp_adj_lkup_t;
+
+static_always_inline void
+lcp_adj_lkup_prep (lcp_adj_lkup_t *l, const u8 *rewrite, u8 len,
+		   u32 sw_if_index)
+{
+  l->is_short = (len <= LCP_ADJ_SHORT_REWRITE);
+  l->is_active = 1;
+
+  if (PREDICT_TRUE (l->is_short))
+    {
+      lcp_adj_mk_short_key (rewrite, len, sw_if_index, &l->skv.k);
+      l->hash = clib_bihash_hash_24_8 (&l->skv.kv);
+      clib_bihash_prefetch_bucket_24_8 (&lcp_adj_short_tbl, l->hash);
+    }
+  else
+    {
+      lcp_adj_mk_key (rewrite, len, sw_if_index, &l->kv.k);
+      l->hash = clib_bihash_hash_32_8 (&l->kv.kv);
+      clib_bihash_prefetch_bucket_32_8 (&lcp_adj_tbl, l->hash);
+    }
+}
+
+static_always_inline adj_index_t
+lcp_adj_lkup_finish (lcp_adj_lkup_t *l)
+{
+  if (PREDICT_TRUE (l->is_short))
+    {
+      if (!clib_bihash_search_inline_with_hash_24_8 (&lcp_adj_short_tbl,
+						     l->hash, &l->skv.kv))
+	return (l->skv.v);
+    }
+  else
+    {
+      if (!clib_bihash_search_inline_with_hash_32_8 (&lcp_adj_tbl, l->hash,
+						     &l->kv.kv))
+	return (l->kv.v);
+    }
 
   return (ADJ_INDEX_INVALID);
 }
 
+static_always_inline adj_index_t
+lcp_adj_lkup (const u8 *rewrite, u8 len, u32 sw_if_index)
+{
+  lcp_adj_lkup_t l;
+
+  lcp_adj_lkup_prep (&l, rewrite, len, sw_if_index);
+
+  return (lcp_adj_lkup_finish (&l));
+}
+
 /*
  * fd.io coding-style-patch-verification: ON
  *
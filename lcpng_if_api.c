@@ -45,6 +45,7 @@ static int
 vl_api_lcp_itf_pair_add (u32 phy_sw_if_index, lip_host_type_t lip_host_type,
 			 u8 *mp_host_if_name, size_t sizeof_host_if_name,
 			 u8 *mp_netns, size_t sizeof_mp_netns,
+			 const lcp_itf_tap_opts_t *opts,
 			 u32 *host_sw_if_index_p)
 {
   u8 *host_if_name, *netns;
@@ -61,8 +62,9 @@ vl_api_lcp_itf_pair_add (u32 phy_sw_if_index, lip_host_type_t lip_host_type,
   vec_add (netns, mp_netns, netns_len);
   vec_add1 (netns, 0);
 
-  rv = lcp_itf_pair_create (phy_sw_if_index, host_if_name, lip_host_type,
-			    netns, host_sw_if_index_p);
+  rv = lcp_itf_pair_create_opts (phy_sw_if_index, host_if_name,
+				 lip_host_type, netns, opts,
+				 host_sw_if_index_p);
 
   vec_free (host_if_name);
   vec_free (netns);
@@ -86,7 +88,7 @@ vl_api_lcp_itf_pair_add_del_t_handler (vl_api_lcp_itf_pair_add_del_t *mp)
     {
       rv = vl_api_lcp_itf_pair_add (
 	phy_sw_if_index, lip_host_type, mp->host_if_name,
-	sizeof (mp->host_if_name), mp->netns, sizeof (mp->netns), NULL);
+	sizeof (mp->host_if_name), mp->netns, sizeof (mp->netns), NULL, NULL);
     }
   else
     {
@@ -114,7 +116,8 @@ vl_api_lcp_itf_pair_add_del_v2_t_handler (vl_api_lcp_itf_pair_add_del_v2_t *mp)
       rv = vl_api_lcp_itf_pair_add (phy_sw_if_index, lip_host_type,
 				    mp->host_if_name,
 				    sizeof (mp->host_if_name), mp->netns,
-				    sizeof (mp->netns), &host_sw_if_index);
+				    sizeof (mp->netns), NULL,
+				    &host_sw_if_index);
     }
   else
     {
@@ -126,6 +129,121 @@ vl_api_lcp_itf_pair_add_del_v2_t_handler (vl_api_lcp_itf_pair_add_del_v2_t *mp)
 		    { rmp->host_sw_if_index = host_sw_if_index; });
 }
 
+static void
+vl_api_lcp_itf_pair_add_del_v3_t_handler (vl_api_lcp_itf_pair_add_del_v3_t *mp)
+{
+  u32 phy_sw_if_index, host_sw_if_index = ~0;
+  vl_api_lcp_itf_pair_add_del_v3_reply_t *rmp;
+  lip_host_type_t lip_host_type;
+  lcp_itf_tap_opts_t opts = {};
+  int rv;
+
+  VALIDATE_SW_IF_INDEX_END (mp);
+
+  phy_sw_if_index = mp->sw_if_index;
+  lip_host_type = api_decode_host_type (mp->host_if_type);
+  if (mp->is_add)
+    {
+      opts.num_queues = mp->num_queues;
+      opts.rx_ring_sz = mp->rx_ring_sz;
+      opts.tx_ring_sz = mp->tx_ring_sz;
+      if (mp->tap_flags & LCP_API_ITF_TAP_F_GSO)
+	opts.flags |= LCP_ITF_TAP_F_GSO;
+      if (mp->tap_flags & LCP_API_ITF_TAP_F_CSUM_OFFLOAD)
+	opts.flags |= LCP_ITF_TAP_F_CSUM_OFFLOAD;
+
+      rv = vl_api_lcp_itf_pair_add (phy_sw_if_index, lip_host_type,
+				    mp->host_if_name,
+				    sizeof (mp->host_if_name), mp->netns,
+				    sizeof (mp->netns), &opts,
+				    &host_sw_if_index);
+    }
+  else
+    {
+      rv = lcp_itf_pair_delete (phy_sw_if_index);
+    }
+
+  BAD_SW_IF_INDEX_LABEL;
+  REPLY_MACRO2_END (VL_API_LCP_ITF_PAIR_ADD_DEL_V3_REPLY,
+		    { rmp->host_sw_if_index = host_sw_if_index; });
+}
+
+static u8 *
+api_decode_string (u8 *str, size_t sizeof_str)
+{
+  u8 *s = NULL;
+  int len;
+
+  len = clib_strnlen ((char *) str, sizeof_str - 1);
+  vec_add (s, str, len);
+  vec_add1 (s, 0);
+
+  return s;
+}
+
+static void
+vl_api_lcp_itf_pair_add_del_bulk_t_handler (
+  vl_api_lcp_itf_pair_add_del_bulk_t *mp)
+{
+  vl_api_lcp_itf_pair_add_del_bulk_reply_t *rmp;
+  vl_api_lcp_itf_pair_bulk_entry_t *e;
+  lcp_itf_pair_bulk_t *items = NULL, *b;
+  u32 n_pairs, i;
+  int rv = 0;
+
+  n_pairs = ntohl (mp->n_pairs);
+  if (vl_msg_api_get_msg_length (mp) <
+      sizeof (*mp) + n_pairs * sizeof (mp->pairs[0]))
+    {
+      rv = VNET_API_ERROR_INVALID_VALUE;
+      n_pairs = 0;
+      goto reply;
+    }
+  /* an empty request is valid, it gets an empty reply */
+  if (!n_pairs)
+    goto reply;
+
+  vec_validate (items, n_pairs - 1);
+  for (i = 0; i < n_pairs; i++)
+    {
+      e = &mp->pairs[i];
+      b = &items[i];
+      b->is_add = e->is_add;
+      b->phy_sw_if_index = ntohl (e->sw_if_index);
+      b->host_if_type = api_decode_host_type (e->host_if_type);
+      if (b->is_add)
+	{
+	  b->host_if_name =
+	    api_decode_string (e->host_if_name, sizeof (e->host_if_name));
+	  b->netns = api_decode_string (e->netns, sizeof (e->netns));
+	}
+    }
+
+  if (lcp_itf_pair_add_del_bulk (items))
+    rv = VNET_API_ERROR_UNSPECIFIED;
+
+reply:
+  REPLY_MACRO3 (VL_API_LCP_ITF_PAIR_ADD_DEL_BULK_REPLY,
+		n_pairs * sizeof (rmp->results[0]), ({
+		  rmp->n_pairs = htonl (n_pairs);
+		  for (i = 0; i < n_pairs; i++)
+		    {
+		      rmp->results[i].sw_if_index =
+			htonl (items[i].phy_sw_if_index);
+		      rmp->results[i].retval = htonl (items[i].rv);
+		      rmp->results[i].host_sw_if_index =
+			htonl (items[i].host_sw_if_index);
+		    }
+		}));
+
+  vec_foreach (b, items)
+    {
+      vec_free (b->host_if_name);
+      vec_free (b->netns);
+    }
+  vec_free (items);
+}
+
 static void
 send_lcp_itf_pair_details (index_t lipi, vl_api_registration_t *rp,
 			   u32 context)
@@ -34,7 +34,8 @@ lcp_itf_pair_create_command_fn (vlib_main_t *vm, unformat_input_t *input,
 {
   unformat_input_t _line_input, *line_input = &_line_input;
   vnet_main_t *vnm = vnet_get_main ();
-  u32 sw_if_index;
+  lcp_itf_tap_opts_t opts = {};
+  u32 sw_if_index, val;
   u8 *host_if_name;
   lip_host_type_t host_if_type;
   u8 *ns;
@@ -60,6 +61,16 @@ lcp_itf_pair_create_command_fn (vlib_main_t *vm, unformat_input_t *input,
 	;
       else if (unformat (line_input, "tun"))
 	host_if_type = LCP_ITF_HOST_TUN;
+      else if (unformat (line_input, "num-queues %u", &val))
+	opts.num_queues = val;
+      else if (unformat (line_input, "rx-ring-size %u", &val))
+	opts.rx_ring_sz = val;
+      else if (unformat (line_input, "tx-ring-size %u", &val))
+	opts.tx_ring_sz = val;
+      else if (unformat (line_input, "gso"))
+	opts.flags |= LCP_ITF_TAP_F_GSO;
+      else if (unformat (line_input, "csum-offload"))
+	opts.flags |= LCP_ITF_TAP_F_CSUM_OFFLOAD;
       else
 	{
 	  unformat_free (line_input);
@@ -93,7 +104,8 @@ lcp_itf_pair_create_command_fn (vlib_main_t *vm, unformat_input_t *input,
 	0, "Namespace name should be fewer than %d characters", LCP_NS_LEN);
     }
 
-  r = lcp_itf_pair_create (sw_if_index, host_if_name, host_if_type, ns, NULL);
+  r = lcp_itf_pair_create_opts (sw_if_index, host_if_name, host_if_type, ns,
+				&opts, NULL);
 
   vec_free (host_if_name);
   vec_free (ns);
@@ -107,7 +119,8 @@ lcp_itf_pair_create_command_fn (vlib_main_t *vm, unformat_input_t *input,
 VLIB_CLI_COMMAND(lcp_itf_pair_create_command, static) = {
     .path = "lcp create",
     .short_help = "lcp create <sw_if_index>|<if-name> host-if <host-if-name> "
-                  "netns <namespace> [tun]",
+                  "netns <namespace> [tun] [num-queues <n>] "
+                  "[rx-ring-size <n>] [tx-ring-size <n>] [gso] [csum-offload]",
     .function = lcp_itf_pair_create_command_fn,
 };
 
@@ -142,6 +155,99 @@ VLIB_CLI_COMMAND (lcp_sync_command, static) = {
   .function = lcp_sync_command_fn,
 };
 
+static clib_error_t *
+lcp_arp_mirror_rate_command_fn (vlib_main_t *vm, unformat_input_t *input,
+				vlib_cli_command_t *cmd)
+{
+  unformat_input_t _line_input, *line_input = &_line_input;
+  clib_error_t *error = NULL;
+  u32 rate = ~0, burst = 0;
+
+  if (!unformat_user (input, unformat_line_input, line_input))
+    return 0;
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (line_input, "off") || unformat (line_input, "disable"))
+	rate = 0;
+      else if (unformat (line_input, "burst %u", &burst))
+	;
+      else if (unformat (line_input, "%u", &rate))
+	;
+      else
+	{
+	  error = clib_error_return (0, "unknown input `%U'",
+				     format_unformat_error, line_input);
+	  goto done;
+	}
+    }
+
+  if (rate == ~0)
+    error = clib_error_return (0, "rate or 'off' required");
+  else
+    lcp_set_arp_mirror_rate (rate, burst);
+
+done:
+  unformat_free (line_input);
+  return error;
+}
+
+VLIB_CLI_COMMAND (lcp_arp_mirror_rate_command, static) = {
+  .path = "lcp arp-mirror-rate",
+  .short_help = "lcp arp-mirror-rate [<pps> [burst <n>]|off]",
+  .function = lcp_arp_mirror_rate_command_fn,
+};
+
+static clib_error_t *
+lcp_punt_rate_command_fn (vlib_main_t *vm, unformat_input_t *input,
+			  vlib_cli_command_t *cmd)
+{
+  unformat_input_t _line_input, *line_input = &_line_input;
+  lcp_punt_class_t pc = LCP_PUNT_N_CLASS;
+  clib_error_t *error = NULL;
+  u32 rate = ~0, burst = 0;
+
+  if (!unformat_user (input, unformat_line_input, line_input))
+    return 0;
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (line_input, "%U", unformat_lcp_punt_class, &pc))
+	;
+      else if (unformat (line_input, "off") ||
+	       unformat (line_input, "disable"))
+	rate = 0;
+      else if (unformat (line_input, "burst %u", &burst))
+	;
+      else if (unformat (line_input, "%u", &rate))
+	;
+      else
+	{
+	  error = clib_error_return (0, "unknown input `%U'",
+				     format_unformat_error, line_input);
+	  goto done;
+	}
+    }
+
+  if (pc == LCP_PUNT_N_CLASS)
+    error = clib_error_return (0, "class required");
+  else if (rate == ~0)
+    error = clib_error_return (0, "rate or 'off' required");
+  else
+    lcp_set_punt_rate (pc, rate, burst);
+
+done:
+  unformat_free (line_input);
+  return error;
+}
+
+VLIB_CLI_COMMAND (lcp_punt_rate_command, static) = {
+  .path = "lcp punt-rate",
+  .short_help =
+    "lcp punt-rate [control|icmp|other] [<pps> [burst <n>]|off]",
+  .function = lcp_punt_rate_command_fn,
+};
+
 static clib_error_t *
 lcp_auto_subint_command_fn (vlib_main_t *vm, unformat_input_t *input,
 			    vlib_cli_command_t *cmd)
@@ -263,6 +369,153 @@ VLIB_CLI_COMMAND(lcp_itf_pair_delete_command, static) = {
     .function = lcp_itf_pair_delete_command_fn,
 };
 
+static clib_error_t *
+lcp_itf_pair_bulk_command_fn (vlib_main_t *vm, unformat_input_t *input,
+			      vlib_cli_command_t *cmd)
+{
+  unformat_input_t _line_input, *line_input = &_line_input;
+  vnet_main_t *vnm = vnet_get_main ();
+  lcp_itf_pair_bulk_t *items = NULL, *b;
+  lip_host_type_t host_if_type;
+  clib_error_t *error = NULL;
+  u8 *host_if_name, *ns;
+  u32 sw_if_index;
+  int is_add = 1;
+
+  if (!unformat_user (input, unformat_line_input, line_input))
+    return 0;
+
+  ns = NULL;
+  host_if_type = LCP_ITF_HOST_TAP;
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      host_if_name = NULL;
+      if (unformat (line_input, "create"))
+	is_add = 1;
+      else if (unformat (line_input, "delete"))
+	is_add = 0;
+      else if (unformat (line_input, "netns %s", &ns))
+	;
+      else if (unformat (line_input, "tun"))
+	host_if_type = LCP_ITF_HOST_TUN;
+      else if (is_add && unformat (line_input, "%U host-if %s",
+				   unformat_vnet_sw_interface, vnm,
+				   &sw_if_index, &host_if_name))
+	{
+	  vec_add1 (host_if_name, 0);
+	  vec_add2 (items, b, 1);
+	  clib_memset (b, 0, sizeof (*b));
+	  b->is_add = 1;
+	  b->phy_sw_if_index = sw_if_index;
+	  b->host_if_name = host_if_name;
+	}
+      else if (!is_add && unformat (line_input, "%U",
+				    unformat_vnet_sw_interface, vnm,
+				    &sw_if_index))
+	{
+	  vec_add2 (items, b, 1);
+	  clib_memset (b, 0, sizeof (*b));
+	  b->phy_sw_if_index = sw_if_index;
+	}
+      else
+	{
+	  error = clib_error_return (0, "unknown input `%U'",
+				     format_unformat_error, line_input);
+	  goto done;
+	}
+    }
+
+  if (vec_len (ns) >= LCP_NS_LEN)
+    {
+      error = clib_error_return (
+	0, "Namespace name should be fewer than %d characters", LCP_NS_LEN);
+      goto done;
+    }
+  if (ns)
+    vec_add1 (ns, 0);
+
+  /* netns and tun apply to all the pairs on the line */
+  vec_foreach (b, items)
+    {
+      b->host_if_type = host_if_type;
+      if (b->is_add)
+	b->netns = ns;
+    }
+
+  lcp_itf_pair_add_del_bulk (items);
+
+  vec_foreach (b, items)
+    {
+      if (b->rv)
+	vlib_cli_output (vm, "%U: %s failed (%d)",
+			 format_vnet_sw_if_index_name, vnm, b->phy_sw_if_index,
+			 b->is_add ? "create" : "delete", b->rv);
+      else if (b->is_add)
+	vlib_cli_output (vm, "%U: created %U", format_vnet_sw_if_index_name,
+			 vnm, b->phy_sw_if_index, format_vnet_sw_if_index_name,
+			 vnm, b->host_sw_if_index);
+      else
+	vlib_cli_output (vm, "%U: deleted", format_vnet_sw_if_index_name, vnm,
+			 b->phy_sw_if_index);
+    }
+
+done:
+  unformat_free (line_input);
+  vec_foreach (b, items)
+    vec_free (b->host_if_name);
+  vec_free (items);
+  vec_free (ns);
+
+  return error;
+}
+
+VLIB_CLI_COMMAND (lcp_itf_pair_bulk_command, static) = {
+  .path = "lcp bulk",
+  .short_help = "lcp bulk [create] <if-name> host-if <host-if-name> ... "
+		"[netns <namespace>] [tun] | delete <if-name> ...",
+  .function = lcp_itf_pair_bulk_command_fn,
+};
+
+static clib_error_t *
+lcp_itf_pair_replace_command_fn (vlib_main_t *vm, unformat_input_t *input,
+				 vlib_cli_command_t *cmd)
+{
+  unformat_input_t _line_input, *line_input = &_line_input;
+  clib_error_t *error = NULL;
+  int r = 0;
+
+  if (!unformat_user (input, unformat_line_input, line_input))
+    return 0;
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (line_input, "begin"))
+	r = lcp_itf_pair_replace_begin ();
+      else if (unformat (line_input, "end"))
+	r = lcp_itf_pair_replace_end ();
+      else
+	{
+	  error = clib_error_return (0, "unknown input `%U'",
+				     format_unformat_error, line_input);
+	  break;
+	}
+    }
+
+  unformat_free (line_input);
+
+  if (!error && r)
+    error = clib_error_return (0, "lcp replace failed (%d)", r);
+
+  return error;
+}
+
+VLIB_CLI_COMMAND (lcp_itf_pair_replace_command, static) = {
+  .path = "lcp replace",
+  .short_help = "lcp replace [begin|end]",
+  .function = lcp_itf_pair_replace_command_fn,
+};
+
 static clib_error_t *
 lcp_itf_pair_show_cmd (vlib_main_t *vm, unformat_input_t *input,
 		       vlib_cli_command_t *cmd)
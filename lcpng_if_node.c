@@ -31,6 +31,143 @@
 #include <vnet/ip/ip4.h>
 #include <vnet/ip/ip6.h>
 #include <vnet/l2/l2_input.h>
+#include <vnet/udp/udp_packet.h>
+
+/* Token bucket, as used to police what the nodes below send to the host.
+ * The nodes keep one per thread, so a configured rate applies to each
+ * thread on its own.
+ */
+typedef struct lcp_tb_t_
+{
+  f64 tokens;
+  f64 last;
+} lcp_tb_t;
+
+static_always_inline int
+lcp_tb_admit (lcp_tb_t *tb, f64 now, u32 rate, u32 burst)
+{
+  tb->tokens += (now - tb->last) * rate;
+  tb->tokens = clib_min (tb->tokens, (f64) burst);
+  tb->last = now;
+
+  if (tb->tokens < 1.0)
+    return 0;
+
+  tb->tokens -= 1.0;
+  return 1;
+}
+
+/* Account a packet to or from the host of the pair of phy_sw_if_index */
+static_always_inline void
+lcp_itf_count (vlib_main_t *vm, lcp_itf_combined_counter_t c,
+	       u32 phy_sw_if_index, vlib_buffer_t *b0)
+{
+  vlib_increment_combined_counter (&lcp_itf_combined_counters[c],
+				   vm->thread_index, phy_sw_if_index, 1,
+				   vlib_buffer_length_in_chain (vm, b0));
+}
+
+#define LCP_PUNT_IP_PROTO_OSPF	89
+#define LCP_PUNT_PORT_BGP	179
+#define LCP_PUNT_PORT_BFD	3784
+#define LCP_PUNT_PORT_BFD_ECHO	3785
+#define LCP_PUNT_PORT_BFD_MHOP	4784
+#define LCP_PUNT_PORT_IKE	500
+#define LCP_PUNT_PORT_IKE_NATT	4500
+
+/**
+ * Tell routing protocol traffic, which must make it to the host even
+ * while it is flooded, from the rest. l3 is the IPv4 or IPv6 header,
+ * extension headers are not looked into.
+ */
+static_always_inline lcp_punt_class_t
+lcp_punt_classify (const u8 *l3)
+{
+  /* TCP and UDP have their ports in the same place */
+  const udp_header_t *l4;
+  u8 proto;
+
+  if ((l3[0] & 0xf0) == 0x40)
+    {
+      const ip4_header_t *ip4 = (const ip4_header_t *) l3;
+
+      if (ip4_get_fragment_offset (ip4))
+	return LCP_PUNT_CLASS_OTHER;
+      proto = ip4->protocol;
+      l4 = (const udp_header_t *) (l3 + ip4_header_bytes (ip4));
+    }
+  else
+    {
+      const ip6_header_t *ip6 = (const ip6_header_t *) l3;
+
+      proto = ip6->protocol;
+      l4 = (const udp_header_t *) (ip6 + 1);
+    }
+
+  switch (proto)
+    {
+    case LCP_PUNT_IP_PROTO_OSPF:
+    case IP_PROTOCOL_VRRP:
+      return LCP_PUNT_CLASS_CONTROL;
+    case IP_PROTOCOL_ICMP:
+    case IP_PROTOCOL_ICMP6:
+      return LCP_PUNT_CLASS_ICMP;
+    case IP_PROTOCOL_TCP:
+      if (l4->src_port == clib_host_to_net_u16 (LCP_PUNT_PORT_BGP) ||
+	  l4->dst_port == clib_host_to_net_u16 (LCP_PUNT_PORT_BGP))
+	return LCP_PUNT_CLASS_CONTROL;
+      break;
+    case IP_PROTOCOL_UDP:
+      switch (clib_net_to_host_u16 (l4->dst_port))
+	{
+	case LCP_PUNT_PORT_BFD:
+	case LCP_PUNT_PORT_BFD_ECHO:
+	case LCP_PUNT_PORT_BFD_MHOP:
+	case LCP_PUNT_PORT_IKE:
+	case LCP_PUNT_PORT_IKE_NATT:
+	  return LCP_PUNT_CLASS_CONTROL;
+	}
+      break;
+    }
+
+  return LCP_PUNT_CLASS_OTHER;
+}
+
+/* Policers of the punted traffic, per thread and indexed by
+ * lcp_punt_counter_index(). Sized by lcp_if_node_validate().
+ */
+static lcp_tb_t **lcp_punt_tbs;
+
+/**
+ * Account a packet of class pc punted to the host of the phy's pair.
+ * Returns 0 if its policer drops it.
+ */
+static_always_inline int
+lcp_punt_police (vlib_main_t *vm, u32 phy_sw_if_index, lcp_punt_class_t pc,
+		 f64 now)
+{
+  lcp_main_t *lcpm = &lcp_main;
+  u32 ci, ti = vm->thread_index;
+  lcp_tb_t *tb;
+
+  ci = lcp_punt_counter_index (phy_sw_if_index, pc);
+
+  if (lcpm->punt_rate[pc])
+    {
+      tb = vec_elt_at_index (lcp_punt_tbs[ti], ci);
+
+      if (!lcp_tb_admit (tb, now, lcpm->punt_rate[pc], lcpm->punt_burst[pc]))
+	{
+	  vlib_increment_simple_counter (
+	    &lcp_punt_counters[LCP_PUNT_COUNTER_POLICED], ti, ci, 1);
+	  return 0;
+	}
+    }
+
+  vlib_increment_simple_counter (&lcp_punt_counters[LCP_PUNT_COUNTER_PUNTED],
+				 ti, ci, 1);
+  return 1;
+}
 
 #define foreach_lip_punt                                                      \
   _ (IO, "punt to host")                                                      \
@@ -64,83 +201,110 @@ format_lip_punt_trace (u8 *s, va_list *args)
   return s;
 }
 
-/**
- * Pass punted packets from the PHY to the HOST.
- */
-VLIB_NODE_FN (lip_punt_node)
-(vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame)
+static_always_inline void
+lip_punt_one (vlib_main_t *vm, vlib_node_runtime_t *node, vlib_buffer_t *b0,
+	      u16 *next0, u32 *n_punted, f64 now)
 {
-  u32 n_left_from, *from, *to_next, n_left_to_next;
-  lip_punt_next_t next_index;
+  const lcp_itf_fast_t *lip0;
+  u32 sw_if_index0;
+  u8 len0;
 
-  next_index = node->cached_next_index;
-  n_left_from = frame->n_vectors;
-  from = vlib_frame_vector_args (frame);
+  *next0 = LIP_PUNT_NEXT_DROP;
 
-  while (n_left_from > 0)
+  sw_if_index0 = vnet_buffer (b0)->sw_if_index[VLIB_RX];
+  lip0 = lcp_itf_fast_find (sw_if_index0, LCP_ITF_FAST_F_PHY);
+  if (PREDICT_FALSE (!lip0))
     {
-      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
-
-      while (n_left_from > 0 && n_left_to_next > 0)
-	{
-	  vlib_buffer_t *b0;
-	  const lcp_itf_pair_t *lip0 = NULL;
-	  u32 next0 = ~0;
-	  u32 bi0, lipi0;
-	  u32 sw_if_index0;
-	  u8 len0;
-
-	  bi0 = to_next[0] = from[0];
+      b0->error = node->errors[LINUXCP_PUNT_ERROR_NO_PAIR];
+      goto trace0;
+    }
 
-	  from += 1;
-	  to_next += 1;
-	  n_left_from -= 1;
-	  n_left_to_next -= 1;
-	  next0 = LIP_PUNT_NEXT_DROP;
+  /* only IKE is punted here */
+  if (PREDICT_FALSE (
+	!lcp_punt_police (vm, sw_if_index0, LCP_PUNT_CLASS_CONTROL, now)))
+    {
+      b0->error = node->errors[LINUXCP_PUNT_ERROR_POLICED];
+      lip0 = NULL;
+      goto trace0;
+    }
 
-	  b0 = vlib_get_buffer (vm, bi0);
+  *next0 = LIP_PUNT_NEXT_IO;
+  *n_punted += 1;
+  vnet_buffer (b0)->sw_if_index[VLIB_TX] = lip0->peer_sw_if_index;
 
-	  sw_if_index0 = vnet_buffer (b0)->sw_if_index[VLIB_RX];
-	  lipi0 = lcp_itf_pair_find_by_phy (sw_if_index0);
-	  if (PREDICT_FALSE (lipi0 == INDEX_INVALID))
-	    goto trace0;
+  if (PREDICT_TRUE (lip0->host_type == LCP_ITF_HOST_TAP))
+    {
+      /*
+       * rewind to ethernet header
+       */
+      len0 = ((u8 *) vlib_buffer_get_current (b0) -
+	      (u8 *) ethernet_buffer_get_header (b0));
+      vlib_buffer_advance (b0, -len0);
+    }
+  lcp_itf_count (vm, LCP_ITF_COUNTER_TO_HOST, sw_if_index0, b0);
+  /* Tun packets don't need any special treatment, just need to
+   * be escorted past the TTL decrement. If we still want to use
+   * ip[46]-punt-redirect with these, we could just set the
+   * VNET_BUFFER_F_LOCALLY_ORIGINATED in an 'else {}' here and
+   * then pass to the next node on the ip[46]-punt feature arc
+   */
+
+trace0:
+  if (PREDICT_FALSE ((b0->flags & VLIB_BUFFER_IS_TRACED)))
+    {
+      lip_punt_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
+      t->phy_sw_if_index = sw_if_index0;
+      t->host_sw_if_index = lip0 ? lip0->peer_sw_if_index : ~0;
+    }
+}
 
-	  lip0 = lcp_itf_pair_get (lipi0);
-	  next0 = LIP_PUNT_NEXT_IO;
-	  vnet_buffer (b0)->sw_if_index[VLIB_TX] = lip0->lip_host_sw_if_index;
+/**
+ * Pass punted packets from the PHY to the HOST.
+ */
+VLIB_NODE_FN (lip_punt_node)
+(vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame)
+{
+  vlib_buffer_t *bufs[VLIB_FRAME_SIZE], **b = bufs;
+  u16 nexts[VLIB_FRAME_SIZE], *next = nexts;
+  u32 n_left, n_punted = 0, *from;
+  f64 now;
 
-	  if (PREDICT_TRUE (lip0->lip_host_type == LCP_ITF_HOST_TAP))
-	    {
-	      /*
-	       * rewind to ethernet header
-	       */
-	      len0 = ((u8 *) vlib_buffer_get_current (b0) -
-		      (u8 *) ethernet_buffer_get_header (b0));
-	      vlib_buffer_advance (b0, -len0);
-	    }
-	  /* Tun packets don't need any special treatment, just need to
-	   * be escorted past the TTL decrement. If we still want to use
-	   * ip[46]-punt-redirect with these, we could just set the
-	   * VNET_BUFFER_F_LOCALLY_ORIGINATED in an 'else {}' here and
-	   * then pass to the next node on the ip[46]-punt feature arc
-	   */
+  from = vlib_frame_vector_args (frame);
+  n_left = frame->n_vectors;
+  now = vlib_time_now (vm);
+  vlib_get_buffers (vm, from, bufs, n_left);
 
-	trace0:
-	  if (PREDICT_FALSE ((b0->flags & VLIB_BUFFER_IS_TRACED)))
-	    {
-	      lip_punt_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
-	      t->phy_sw_if_index = sw_if_index0;
-	      t->host_sw_if_index =
-		(lipi0 == INDEX_INVALID) ? ~0 : lip0->lip_host_sw_if_index;
-	    }
+  while (n_left >= 8)
+    {
+      /* only the buffer metadata is touched */
+      vlib_prefetch_buffer_header (b[4], STORE);
+      vlib_prefetch_buffer_header (b[5], STORE);
+      vlib_prefetch_buffer_header (b[6], STORE);
+      vlib_prefetch_buffer_header (b[7], STORE);
+
+      lip_punt_one (vm, node, b[0], &next[0], &n_punted, now);
+      lip_punt_one (vm, node, b[1], &next[1], &n_punted, now);
+      lip_punt_one (vm, node, b[2], &next[2], &n_punted, now);
+      lip_punt_one (vm, node, b[3], &next[3], &n_punted, now);
+
+      b += 4;
+      next += 4;
+      n_left -= 4;
+    }
 
-	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index, to_next,
-					   n_left_to_next, bi0, next0);
-	}
+  while (n_left > 0)
+    {
+      lip_punt_one (vm, node, b[0], &next[0], &n_punted, now);
 
-      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+      b += 1;
+      next += 1;
+      n_left -= 1;
     }
 
+  vlib_buffer_enqueue_to_next (vm, node, from, nexts, frame->n_vectors);
+  vlib_node_increment_counter (vm, node->node_index,
+			       LINUXCP_PUNT_ERROR_PUNTED, n_punted);
+
   return frame->n_vectors;
 }
 
@@ -150,6 +314,9 @@ VLIB_REGISTER_NODE(lip_punt_node) = {
     .format_trace = format_lip_punt_trace,
     .type = VLIB_NODE_TYPE_INTERNAL,
 
+    .n_errors = LINUXCP_PUNT_N_ERROR,
+    .error_counters = linuxcp_punt_error_counters,
+
     .n_next_nodes = LIP_PUNT_N_NEXT,
     .next_nodes =
         {
@@ -171,6 +338,8 @@ typedef enum
 typedef struct lcp_punt_l3_trace_t_
 {
   u32 phy_sw_if_index;
+  u8 punt_class;
+  u8 is_policed;
 } lcp_punt_l3_trace_t;
 
 /* packet trace format function */
@@ -181,70 +350,110 @@ format_lcp_punt_l3_trace (u8 *s, va_list *args)
   CLIB_UNUSED (vlib_node_t * node) = va_arg (*args, vlib_node_t *);
   lcp_punt_l3_trace_t *t = va_arg (*args, lcp_punt_l3_trace_t *);
 
-  s = format(s, "linux-cp-punt-l3: %u", t->phy_sw_if_index);
+  s = format (s, "linux-cp-punt-l3: %u class %U%s", t->phy_sw_if_index,
+	      format_lcp_punt_class, t->punt_class,
+	      t->is_policed ? " policed" : "");
 
   return s;
 }
 
-VLIB_NODE_FN (lcp_punt_l3_node)
-(vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame)
+static_always_inline void
+lcp_punt_l3_one (vlib_main_t *vm, vlib_node_runtime_t *node,
+		 vlib_buffer_t *b0, u16 *next0, u32 *n_punted, f64 now)
 {
-  u32 n_left_from, *from, *to_next, n_left_to_next;
-  lip_punt_next_t next_index;
+  const lcp_itf_fast_t *lip0;
+  lcp_punt_class_t pc0;
+  u32 next, sw_if_index0;
+  u8 is_policed0 = 0;
 
-  next_index = node->cached_next_index;
-  n_left_from = frame->n_vectors;
-  from = vlib_frame_vector_args (frame);
+  vnet_feature_next (&next, b0);
+  *next0 = next;
 
-  while (n_left_from > 0)
-    {
-      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+  sw_if_index0 = vnet_buffer (b0)->sw_if_index[VLIB_RX];
+  lip0 = lcp_itf_fast_find (sw_if_index0, LCP_ITF_FAST_F_PHY);
 
-      while (n_left_from > 0 && n_left_to_next > 0)
-	{
-	  vlib_buffer_t *b0;
-	  u32 next0 = LCP_LOCAL_NEXT_DROP;
-	  u32 bi0;
-	  index_t lipi0;
-	  lcp_itf_pair_t *lip0;
+  /* not punted to a host interface, leave it to the next feature */
+  if (!lip0)
+    return;
 
-	  bi0 = to_next[0] = from[0];
+  pc0 = lcp_punt_classify (vlib_buffer_get_current (b0));
+  if (PREDICT_FALSE (!lcp_punt_police (vm, sw_if_index0, pc0, now)))
+    {
+      b0->error = node->errors[LINUXCP_PUNT_ERROR_POLICED];
+      *next0 = LCP_LOCAL_NEXT_DROP;
+      is_policed0 = 1;
+    }
+  else
+    {
+      lcp_itf_count (vm, LCP_ITF_COUNTER_TO_HOST, sw_if_index0, b0);
+      *n_punted += 1;
+    }
 
-	  from += 1;
-	  to_next += 1;
-	  n_left_from -= 1;
-	  n_left_to_next -= 1;
+  /*
+   * Avoid TTL check for packets which arrived on a tunnel and
+   * are being punted to the local host.
+   */
+  if (lip0->host_type == LCP_ITF_HOST_TUN)
+    b0->flags |= VNET_BUFFER_F_LOCALLY_ORIGINATED;
 
-	  b0 = vlib_get_buffer (vm, bi0);
-	  vnet_feature_next (&next0, b0);
+  if (PREDICT_FALSE ((b0->flags & VLIB_BUFFER_IS_TRACED)))
+    {
+      lcp_punt_l3_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
+      t->phy_sw_if_index = sw_if_index0;
+      t->punt_class = pc0;
+      t->is_policed = is_policed0;
+    }
+}
 
-	  lipi0 =
-	    lcp_itf_pair_find_by_phy (vnet_buffer (b0)->sw_if_index[VLIB_RX]);
-	  if (lipi0 != INDEX_INVALID)
-	    {
-	      /*
-	       * Avoid TTL check for packets which arrived on a tunnel and
-	       * are being punted to the local host.
-	       */
-	      lip0 = lcp_itf_pair_get (lipi0);
-	      if (lip0->lip_host_type == LCP_ITF_HOST_TUN)
-		b0->flags |= VNET_BUFFER_F_LOCALLY_ORIGINATED;
-	    }
+/**
+ * Classify and police what is punted to the host of a pair, ahead of
+ * ip[46]-punt-redirect sending it there.
+ */
+VLIB_NODE_FN (lcp_punt_l3_node)
+(vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame)
+{
+  vlib_buffer_t *bufs[VLIB_FRAME_SIZE], **b = bufs;
+  u16 nexts[VLIB_FRAME_SIZE], *next = nexts;
+  u32 n_left, n_punted = 0, *from;
+  f64 now;
 
-	  if (PREDICT_FALSE ((b0->flags & VLIB_BUFFER_IS_TRACED)))
-	    {
-	      lcp_punt_l3_trace_t *t =
-		vlib_add_trace (vm, node, b0, sizeof (*t));
-	      t->phy_sw_if_index = vnet_buffer (b0)->sw_if_index[VLIB_RX];
-	    }
+  from = vlib_frame_vector_args (frame);
+  n_left = frame->n_vectors;
+  now = vlib_time_now (vm);
+  vlib_get_buffers (vm, from, bufs, n_left);
 
-	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index, to_next,
-					   n_left_to_next, bi0, next0);
+  while (n_left >= 4)
+    {
+      /* the IP and L4 headers are classified */
+      if (n_left >= 6)
+	{
+	  vlib_prefetch_buffer_header (b[4], STORE);
+	  vlib_prefetch_buffer_header (b[5], STORE);
 	}
+      vlib_prefetch_buffer_data (b[2], LOAD);
+      vlib_prefetch_buffer_data (b[3], LOAD);
 
-      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+      lcp_punt_l3_one (vm, node, b[0], &next[0], &n_punted, now);
+      lcp_punt_l3_one (vm, node, b[1], &next[1], &n_punted, now);
+
+      b += 2;
+      next += 2;
+      n_left -= 2;
+    }
+
+  while (n_left > 0)
+    {
+      lcp_punt_l3_one (vm, node, b[0], &next[0], &n_punted, now);
+
+      b += 1;
+      next += 1;
+      n_left -= 1;
     }
 
+  vlib_buffer_enqueue_to_next (vm, node, from, nexts, frame->n_vectors);
+  vlib_node_increment_counter (vm, node->node_index,
+			       LINUXCP_PUNT_ERROR_PUNTED, n_punted);
+
   return frame->n_vectors;
 }
 
@@ -254,6 +463,9 @@ VLIB_REGISTER_NODE(lcp_punt_l3_node) = {
     .format_trace = format_lcp_punt_l3_trace,
     .type = VLIB_NODE_TYPE_INTERNAL,
 
+    .n_errors = LINUXCP_PUNT_N_ERROR,
+    .error_counters = linuxcp_punt_error_counters,
+
     .n_next_nodes = 1,
     .next_nodes =
         {
@@ -305,6 +517,103 @@ format_lcp_xc_trace (u8 *s, va_list *args)
   return s;
 }
 
+/* The first next of ip4-rewrite and ip6-rewrite, which the x-connect is a
+ * sibling of, is their drop */
+#define LCP_XC_NEXT_DROP 0
+
+/* First pass of the x-connect of one packet: rewind to the MAC rewrite and
+ * start the lookup of the adjacency it belongs to. Multicast uses the
+ * phy's adjacency, as does a rewrite that is not found. A packet whose
+ * pair is being withdrawn gets no adjacency, and is dropped. */
+static_always_inline void
+lcp_xc_prep_one (vlib_node_runtime_t *node, vlib_buffer_t *b0,
+		 ip_address_family_t af, lcp_adj_lkup_t *l0, adj_index_t *ai0)
+{
+  const ethernet_header_t *eth;
+  const lcp_itf_fast_t *lip;
+
+  l0->is_active = 0;
+  lip = lcp_itf_fast_find (vnet_buffer (b0)->sw_if_index[VLIB_RX],
+			   LCP_ITF_FAST_F_HOST);
+  if (PREDICT_FALSE (!lip))
+    {
+      b0->error = node->errors[LINUXCP_XC_ERROR_NO_PAIR];
+      *ai0 = ADJ_INDEX_INVALID;
+      return;
+    }
+
+  vnet_buffer (b0)->sw_if_index[VLIB_TX] = lip->peer_sw_if_index;
+  vnet_buffer (b0)->ip.save_rewrite_length = lip->rewrite_len;
+  vlib_buffer_advance (b0, -lip->rewrite_len);
+  eth = vlib_buffer_get_current (b0);
+
+  *ai0 = lip->adj_index[af];
+  if (!ethernet_address_cast (eth->dst_address))
+    lcp_adj_lkup_prep (l0, (u8 *) eth, lip->rewrite_len,
+		       vnet_buffer (b0)->sw_if_index[VLIB_TX]);
+}
+
+/* Second pass: finish the lookup and prefetch the adjacency */
+static_always_inline void
+lcp_xc_lkup_one (vlib_main_t *vm, vlib_buffer_t *b0, lcp_adj_lkup_t *l0,
+		 adj_index_t *ai0)
+{
+  lcp_itf_simple_counter_t c;
+  adj_index_t ai;
+
+  if (l0->is_active)
+    {
+      ai = lcp_adj_lkup_finish (l0);
+      c = LCP_ITF_COUNTER_ADJ_MISS;
+      if (ai != ADJ_INDEX_INVALID)
+	{
+	  *ai0 = ai;
+	  c = LCP_ITF_COUNTER_ADJ_HIT;
+	}
+      vlib_increment_simple_counter (&lcp_itf_simple_counters[c],
+				     vm->thread_index,
+				     vnet_buffer (b0)->sw_if_index[VLIB_TX], 1);
+    }
+  if (PREDICT_TRUE (*ai0 != ADJ_INDEX_INVALID))
+    CLIB_PREFETCH (adj_get (*ai0), CLIB_CACHE_LINE_BYTES, LOAD);
+}
+
+/* Third pass: send the packet on to the adjacency's rewrite */
+static_always_inline void
+lcp_xc_next_one (vlib_main_t *vm, vlib_node_runtime_t *node,
+		 ip_lookup_main_t *lm, vlib_buffer_t *b0, adj_index_t ai,
+		 u16 *next0)
+{
+  const ip_adjacency_t *adj;
+  u32 next;
+
+  if (PREDICT_FALSE (ai == ADJ_INDEX_INVALID))
+    {
+      *next0 = LCP_XC_NEXT_DROP;
+      return;
+    }
+
+  adj = adj_get (ai);
+  vnet_buffer (b0)->ip.adj_index[VLIB_TX] = ai;
+  next = adj->rewrite_header.next_index;
+  lcp_itf_count (vm, LCP_ITF_COUNTER_FROM_HOST,
+		 vnet_buffer (b0)->sw_if_index[VLIB_TX], b0);
+
+  if (PREDICT_FALSE (adj->rewrite_header.flags & VNET_REWRITE_HAS_FEATURES))
+    vnet_feature_arc_start_w_cfg_index (
+      lm->output_feature_arc_index, vnet_buffer (b0)->sw_if_index[VLIB_TX],
+      &next, b0, adj->ia_cfg_index);
+
+  if (PREDICT_FALSE ((b0->flags & VLIB_BUFFER_IS_TRACED)))
+    {
+      lcp_xc_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
+      t->phy_sw_if_index = vnet_buffer (b0)->sw_if_index[VLIB_TX];
+      t->adj_index = ai;
+    }
+
+  *next0 = next;
+}
+
 /**
  * X-connect all packets from the HOST to the PHY.
  *
@@ -313,86 +622,112 @@ format_lcp_xc_trace (u8 *s, va_list *args)
  * This allows this code to start the feature arc on that adjacency.
  * Consequently, all packet sent from the host are also subject to output
  * features, which is symmetric w.r.t. to input features.
+ *
+ * The frame is done in three passes: the first hashes every rewrite and
+ * prefetches its bucket, the second searches and prefetches the
+ * adjacencies, the third reads them.
  */
 static_always_inline u32
 lcp_xc_inline (vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame,
 	       ip_address_family_t af)
 {
-  u32 n_left_from, *from, *to_next, n_left_to_next;
-  lcp_xc_next_t next_index;
+  vlib_buffer_t *bufs[VLIB_FRAME_SIZE], **b;
+  u16 nexts[VLIB_FRAME_SIZE], *next;
+  lcp_adj_lkup_t lkups[VLIB_FRAME_SIZE], *l;
+  adj_index_t ais[VLIB_FRAME_SIZE], *ai;
   ip_lookup_main_t *lm;
+  u32 n_left, *from;
 
-  next_index = 0;
-  n_left_from = frame->n_vectors;
   from = vlib_frame_vector_args (frame);
+  vlib_get_buffers (vm, from, bufs, frame->n_vectors);
 
   if (AF_IP4 == af)
     lm = &ip4_main.lookup_main;
   else
     lm = &ip6_main.lookup_main;
 
-  while (n_left_from > 0)
+  b = bufs;
+  l = lkups;
+  ai = ais;
+  n_left = frame->n_vectors;
+  while (n_left >= 8)
     {
-      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
-
-      while (n_left_from > 0 && n_left_to_next > 0)
-	{
-	  const ethernet_header_t *eth;
-	  const lcp_itf_pair_t *lip;
-	  u32 next0, bi0, lipi, ai;
-	  vlib_buffer_t *b0;
-	  const ip_adjacency_t *adj;
-
-	  bi0 = to_next[0] = from[0];
-
-	  from += 1;
-	  to_next += 1;
-	  n_left_from -= 1;
-	  n_left_to_next -= 1;
+      /* the MAC rewrite just before the IP header is the lookup key */
+      vlib_prefetch_buffer_header (b[4], STORE);
+      vlib_prefetch_buffer_header (b[5], STORE);
+      vlib_prefetch_buffer_header (b[6], STORE);
+      vlib_prefetch_buffer_header (b[7], STORE);
+      CLIB_PREFETCH (vlib_buffer_get_current (b[4]) - CLIB_CACHE_LINE_BYTES,
+		     2 * CLIB_CACHE_LINE_BYTES, LOAD);
+      CLIB_PREFETCH (vlib_buffer_get_current (b[5]) - CLIB_CACHE_LINE_BYTES,
+		     2 * CLIB_CACHE_LINE_BYTES, LOAD);
+      CLIB_PREFETCH (vlib_buffer_get_current (b[6]) - CLIB_CACHE_LINE_BYTES,
+		     2 * CLIB_CACHE_LINE_BYTES, LOAD);
+      CLIB_PREFETCH (vlib_buffer_get_current (b[7]) - CLIB_CACHE_LINE_BYTES,
+		     2 * CLIB_CACHE_LINE_BYTES, LOAD);
+
+      lcp_xc_prep_one (node, b[0], af, &l[0], &ai[0]);
+      lcp_xc_prep_one (node, b[1], af, &l[1], &ai[1]);
+      lcp_xc_prep_one (node, b[2], af, &l[2], &ai[2]);
+      lcp_xc_prep_one (node, b[3], af, &l[3], &ai[3]);
+
+      b += 4;
+      l += 4;
+      ai += 4;
+      n_left -= 4;
+    }
+  while (n_left > 0)
+    {
+      lcp_xc_prep_one (node, b[0], af, &l[0], &ai[0]);
 
-	  b0 = vlib_get_buffer (vm, bi0);
+      b += 1;
+      l += 1;
+      ai += 1;
+      n_left -= 1;
+    }
 
-	  lipi =
-	    lcp_itf_pair_find_by_host (vnet_buffer (b0)->sw_if_index[VLIB_RX]);
-	  lip = lcp_itf_pair_get (lipi);
-
-	  vnet_buffer (b0)->sw_if_index[VLIB_TX] = lip->lip_phy_sw_if_index;
-	  vlib_buffer_advance (b0, -lip->lip_rewrite_len);
-	  eth = vlib_buffer_get_current (b0);
-
-	  ai = ADJ_INDEX_INVALID;
-	  if (!ethernet_address_cast (eth->dst_address))
-	    ai = lcp_adj_lkup ((u8 *) eth, lip->lip_rewrite_len,
-			       vnet_buffer (b0)->sw_if_index[VLIB_TX]);
-	  if (ai == ADJ_INDEX_INVALID)
-	    ai = lip->lip_phy_adjs.adj_index[af];
-
-	  adj = adj_get (ai);
-	  vnet_buffer (b0)->ip.adj_index[VLIB_TX] = ai;
-	  next0 = adj->rewrite_header.next_index;
-	  vnet_buffer (b0)->ip.save_rewrite_length = lip->lip_rewrite_len;
-
-	  if (PREDICT_FALSE (adj->rewrite_header.flags &
-			     VNET_REWRITE_HAS_FEATURES))
-	    vnet_feature_arc_start_w_cfg_index (
-	      lm->output_feature_arc_index,
-	      vnet_buffer (b0)->sw_if_index[VLIB_TX], &next0, b0,
-	      adj->ia_cfg_index);
+  b = bufs;
+  l = lkups;
+  ai = ais;
+  n_left = frame->n_vectors;
+  while (n_left > 0)
+    {
+      lcp_xc_lkup_one (vm, b[0], &l[0], &ai[0]);
 
-	  if (PREDICT_FALSE ((b0->flags & VLIB_BUFFER_IS_TRACED)))
-	    {
-	      lcp_xc_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
-	      t->phy_sw_if_index = lip->lip_phy_sw_if_index;
-	      t->adj_index = vnet_buffer (b0)->ip.adj_index[VLIB_TX];
-	    }
+      b += 1;
+      l += 1;
+      ai += 1;
+      n_left -= 1;
+    }
 
-	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index, to_next,
-					   n_left_to_next, bi0, next0);
-	}
+  b = bufs;
+  ai = ais;
+  next = nexts;
+  n_left = frame->n_vectors;
+  while (n_left >= 4)
+    {
+      lcp_xc_next_one (vm, node, lm, b[0], ai[0], &next[0]);
+      lcp_xc_next_one (vm, node, lm, b[1], ai[1], &next[1]);
+      lcp_xc_next_one (vm, node, lm, b[2], ai[2], &next[2]);
+      lcp_xc_next_one (vm, node, lm, b[3], ai[3], &next[3]);
+
+      b += 4;
+      ai += 4;
+      next += 4;
+      n_left -= 4;
+    }
+  while (n_left > 0)
+    {
+      lcp_xc_next_one (vm, node, lm, b[0], ai[0], &next[0]);
 
-      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+      b += 1;
+      ai += 1;
+      next += 1;
+      n_left -= 1;
     }
 
+  vlib_buffer_enqueue_to_next (vm, node, from, nexts, frame->n_vectors);
+
   return frame->n_vectors;
 }
 
@@ -412,6 +747,8 @@ VLIB_REGISTER_NODE(lcp_xc_ip4) = {.name = "linux-cp-xc-ip4",
                                   .vector_size = sizeof(u32),
                                   .format_trace = format_lcp_xc_trace,
                                   .type = VLIB_NODE_TYPE_INTERNAL,
+                                  .n_errors = LINUXCP_XC_N_ERROR,
+                                  .error_counters = linuxcp_xc_error_counters,
                                   .sibling_of = "ip4-rewrite"};
 
 VNET_FEATURE_INIT(lcp_xc_ip4_ucast_node, static) = {
@@ -427,6 +764,8 @@ VLIB_REGISTER_NODE(lcp_xc_ip6) = {.name = "linux-cp-xc-ip6",
                                   .vector_size = sizeof(u32),
                                   .format_trace = format_lcp_xc_trace,
                                   .type = VLIB_NODE_TYPE_INTERNAL,
+                                  .n_errors = LINUXCP_XC_N_ERROR,
+                                  .error_counters = linuxcp_xc_error_counters,
                                   .sibling_of = "ip6-rewrite"};
 
 VNET_FEATURE_INIT(lcp_xc_ip6_ucast_node, static) = {
@@ -442,9 +781,55 @@ typedef enum
 {
   LCP_XC_L3_NEXT_XC,
   LCP_XC_L3_NEXT_LOOKUP,
+  LCP_XC_L3_NEXT_DROP,
   LCP_XC_L3_N_NEXT,
 } lcp_xc_l3_next_t;
 
+static_always_inline void
+lcp_xc_l3_one (vlib_main_t *vm, vlib_node_runtime_t *node, vnet_main_t *vnm,
+	       vlib_buffer_t *b0, ip_address_family_t af, u16 *next0)
+{
+  const lcp_itf_fast_t *lip;
+
+  /* Flag buffers as locally originated. Otherwise their TTL will
+   * be checked & decremented. That would break services like BGP
+   * which set a TTL of 1 by default.
+   */
+  b0->flags |= VNET_BUFFER_F_LOCALLY_ORIGINATED;
+
+  lip = lcp_itf_fast_find (vnet_buffer (b0)->sw_if_index[VLIB_RX],
+			   LCP_ITF_FAST_F_HOST);
+  if (PREDICT_FALSE (!lip))
+    {
+      b0->error = node->errors[LINUXCP_XC_ERROR_NO_PAIR];
+      *next0 = LCP_XC_L3_NEXT_DROP;
+      return;
+    }
+  lcp_itf_count (vm, LCP_ITF_COUNTER_FROM_HOST, lip->peer_sw_if_index, b0);
+
+  /* P2P tunnels can use generic adjacency */
+  if (PREDICT_TRUE (vnet_sw_interface_is_p2p (vnm, lip->peer_sw_if_index)))
+    {
+      vnet_buffer (b0)->sw_if_index[VLIB_TX] = lip->peer_sw_if_index;
+      vnet_buffer (b0)->ip.adj_index[VLIB_TX] = lip->adj_index[af];
+      *next0 = LCP_XC_L3_NEXT_XC;
+    }
+  /* P2MP tunnels require a fib lookup to find the right adjacency */
+  else
+    {
+      /* lookup should use FIB table associated with phy interface */
+      vnet_buffer (b0)->sw_if_index[VLIB_RX] = lip->peer_sw_if_index;
+      *next0 = LCP_XC_L3_NEXT_LOOKUP;
+    }
+
+  if (PREDICT_FALSE ((b0->flags & VLIB_BUFFER_IS_TRACED)))
+    {
+      lcp_xc_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
+      t->phy_sw_if_index = lip->peer_sw_if_index;
+      t->adj_index = vnet_buffer (b0)->ip.adj_index[VLIB_TX];
+    }
+}
+
 /**
  * X-connect all packets from the HOST to the PHY on L3 interfaces
  *
@@ -454,77 +839,44 @@ static_always_inline u32
 lcp_xc_l3_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 		  vlib_frame_t *frame, ip_address_family_t af)
 {
-  u32 n_left_from, *from, *to_next, n_left_to_next;
-  lcp_xc_next_t next_index;
+  vlib_buffer_t *bufs[VLIB_FRAME_SIZE], **b = bufs;
+  u16 nexts[VLIB_FRAME_SIZE], *next = nexts;
   vnet_main_t *vnm = vnet_get_main ();
+  u32 n_left, *from;
 
-  next_index = 0;
-  n_left_from = frame->n_vectors;
   from = vlib_frame_vector_args (frame);
+  n_left = frame->n_vectors;
+  vlib_get_buffers (vm, from, bufs, n_left);
 
-  while (n_left_from > 0)
+  while (n_left >= 8)
     {
-      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
-
-      while (n_left_from > 0 && n_left_to_next > 0)
-	{
-	  vlib_buffer_t *b0;
-	  const lcp_itf_pair_t *lip;
-	  u32 next0 = ~0;
-	  u32 bi0, lipi;
-
-	  bi0 = to_next[0] = from[0];
-
-	  from += 1;
-	  to_next += 1;
-	  n_left_from -= 1;
-	  n_left_to_next -= 1;
-
-	  b0 = vlib_get_buffer (vm, bi0);
-
-	  /* Flag buffers as locally originated. Otherwise their TTL will
-	   * be checked & decremented. That would break services like BGP
-	   * which set a TTL of 1 by default.
-	   */
-	  b0->flags |= VNET_BUFFER_F_LOCALLY_ORIGINATED;
-
-	  lipi =
-	    lcp_itf_pair_find_by_host (vnet_buffer (b0)->sw_if_index[VLIB_RX]);
-	  lip = lcp_itf_pair_get (lipi);
-
-	  /* P2P tunnels can use generic adjacency */
-	  if (PREDICT_TRUE (
-		vnet_sw_interface_is_p2p (vnm, lip->lip_phy_sw_if_index)))
-	    {
-	      vnet_buffer (b0)->sw_if_index[VLIB_TX] =
-		lip->lip_phy_sw_if_index;
-	      vnet_buffer (b0)->ip.adj_index[VLIB_TX] =
-		lip->lip_phy_adjs.adj_index[af];
-	      next0 = LCP_XC_L3_NEXT_XC;
-	    }
-	  /* P2MP tunnels require a fib lookup to find the right adjacency */
-	  else
-	    {
-	      /* lookup should use FIB table associated with phy interface */
-	      vnet_buffer (b0)->sw_if_index[VLIB_RX] =
-		lip->lip_phy_sw_if_index;
-	      next0 = LCP_XC_L3_NEXT_LOOKUP;
-	    }
-
-	  if (PREDICT_FALSE ((b0->flags & VLIB_BUFFER_IS_TRACED)))
-	    {
-	      lcp_xc_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
-	      t->phy_sw_if_index = lip->lip_phy_sw_if_index;
-	      t->adj_index = vnet_buffer (b0)->ip.adj_index[VLIB_TX];
-	    }
+      /* only the buffer metadata is touched */
+      vlib_prefetch_buffer_header (b[4], STORE);
+      vlib_prefetch_buffer_header (b[5], STORE);
+      vlib_prefetch_buffer_header (b[6], STORE);
+      vlib_prefetch_buffer_header (b[7], STORE);
+
+      lcp_xc_l3_one (vm, node, vnm, b[0], af, &next[0]);
+      lcp_xc_l3_one (vm, node, vnm, b[1], af, &next[1]);
+      lcp_xc_l3_one (vm, node, vnm, b[2], af, &next[2]);
+      lcp_xc_l3_one (vm, node, vnm, b[3], af, &next[3]);
+
+      b += 4;
+      next += 4;
+      n_left -= 4;
+    }
 
-	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index, to_next,
-					   n_left_to_next, bi0, next0);
-	}
+  while (n_left > 0)
+    {
+      lcp_xc_l3_one (vm, node, vnm, b[0], af, &next[0]);
 
-      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
+      b += 1;
+      next += 1;
+      n_left -= 1;
     }
 
+  vlib_buffer_enqueue_to_next (vm, node, from, nexts, frame->n_vectors);
+
   return frame->n_vectors;
 }
 
@@ -549,11 +901,15 @@ VLIB_REGISTER_NODE(lcp_xc_l3_ip4_node) = {
     .format_trace = format_lcp_xc_trace,
     .type = VLIB_NODE_TYPE_INTERNAL,
 
+    .n_errors = LINUXCP_XC_N_ERROR,
+    .error_counters = linuxcp_xc_error_counters,
+
     .n_next_nodes = LCP_XC_L3_N_NEXT,
     .next_nodes =
         {
             [LCP_XC_L3_NEXT_XC] = "ip4-midchain",
             [LCP_XC_L3_NEXT_LOOKUP] = "ip4-lookup",
+            [LCP_XC_L3_NEXT_DROP] = "error-drop",
         },
 };
 
@@ -573,11 +929,15 @@ VLIB_REGISTER_NODE(lcp_xc_l3_ip6_node) = {
     .format_trace = format_lcp_xc_trace,
     .type = VLIB_NODE_TYPE_INTERNAL,
 
+    .n_errors = LINUXCP_XC_N_ERROR,
+    .error_counters = linuxcp_xc_error_counters,
+
     .n_next_nodes = LCP_XC_L3_N_NEXT,
     .next_nodes =
         {
             [LCP_XC_L3_NEXT_XC] = "ip6-midchain",
             [LCP_XC_L3_NEXT_LOOKUP] = "ip6-lookup",
+            [LCP_XC_L3_NEXT_DROP] = "error-drop",
         },
 };
 
@@ -623,212 +983,165 @@ format_lcp_arp_trace (u8 *s, va_list *args)
   return s;
 }
 
-/**
- * punt ARP replies to the host
+/* Token buckets that cap the ARP replies mirrored to the host, per thread
+ * and indexed by the phy's sw_if_index. Sized by lcp_if_node_validate().
  */
-VLIB_NODE_FN (lcp_arp_phy_node)
-(vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame)
-{
-  u32 n_left_from, *from, *to_next, n_left_to_next;
-  lcp_arp_next_t next_index;
-  u32 reply_copies[VLIB_FRAME_SIZE];
-  u32 n_copies = 0;
+static lcp_tb_t **lcp_arp_mirror_tbs;
 
-  next_index = node->cached_next_index;
-  n_left_from = frame->n_vectors;
-  from = vlib_frame_vector_args (frame);
+static_always_inline int
+lcp_arp_mirror_admit (u32 thread_index, u32 sw_if_index, f64 now)
+{
+  lcp_main_t *lcpm = &lcp_main;
+  lcp_tb_t *tb;
 
-  while (n_left_from > 0)
-    {
-      vlib_get_next_frame (vm, node, next_index, to_next, n_left_to_next);
+  if (PREDICT_TRUE (lcpm->arp_mirror_rate == 0))
+    return 1;
 
-      while (n_left_from >= 2 && n_left_to_next >= 2)
-	{
-	  u32 next0, next1, bi0, bi1;
-	  vlib_buffer_t *b0, *b1;
-	  ethernet_arp_header_t *arp0, *arp1;
+  tb = vec_elt_at_index (lcp_arp_mirror_tbs[thread_index], sw_if_index);
 
-	  bi0 = to_next[0] = from[0];
-	  bi1 = to_next[1] = from[1];
+  return (lcp_tb_admit (tb, now, lcpm->arp_mirror_rate,
+			lcpm->arp_mirror_burst));
+}
 
-	  from += 2;
-	  n_left_from -= 2;
-	  to_next += 2;
-	  n_left_to_next -= 2;
+typedef enum lcp_arp_mirror_count_t_
+{
+  LCP_ARP_MIRROR_COPIED,
+  LCP_ARP_MIRROR_SUPPRESSED,
+  LCP_ARP_MIRROR_NO_BUFFER,
+  LCP_ARP_MIRROR_N_COUNT,
+} lcp_arp_mirror_count_t;
+
+static_always_inline void
+lcp_arp_phy_one (vlib_main_t *vm, vlib_node_runtime_t *node, vlib_buffer_t *b0,
+		 u16 *next0, u32 *mirrors, u32 *n_mirrors, u32 *counts, f64 now)
+{
+  const lcp_itf_fast_t *lip0;
+  ethernet_arp_header_t *arp0;
+  vlib_buffer_t *c0;
+  u32 next, sw_if_index0;
+  u8 len0;
 
-	  next0 = next1 = LCP_ARP_NEXT_DROP;
+  arp0 = vlib_buffer_get_current (b0);
+  sw_if_index0 = vnet_buffer (b0)->sw_if_index[VLIB_RX];
 
-	  b0 = vlib_get_buffer (vm, bi0);
-	  b1 = vlib_get_buffer (vm, bi1);
+  vnet_feature_next (&next, b0);
+  *next0 = next;
 
-	  arp0 = vlib_buffer_get_current (b0);
-	  arp1 = vlib_buffer_get_current (b1);
+  if (PREDICT_FALSE ((b0->flags & VLIB_BUFFER_IS_TRACED)))
+    {
+      lcp_arp_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
+      t->rx_sw_if_index = sw_if_index0;
+      t->arp_opcode = clib_net_to_host_u16 (arp0->opcode);
+    }
 
-	  vnet_feature_next (&next0, b0);
-	  vnet_feature_next (&next1, b1);
+  /*
+   * Replies might need to be received by the host, so we
+   * mirror them.
+   */
+  if (arp0->opcode != clib_host_to_net_u16 (ETHERNET_ARP_OPCODE_reply))
+    return;
 
-	  /*
-	   * Replies might need to be received by the host, so we
-	   * make a copy of them.
-	   */
-	  if (arp0->opcode == clib_host_to_net_u16 (ETHERNET_ARP_OPCODE_reply))
-	    {
-	      lcp_itf_pair_t *lip0 = 0;
-	      u32 lipi0;
-	      vlib_buffer_t *c0;
-	      u8 len0;
-
-	      lipi0 = lcp_itf_pair_find_by_phy (
-		vnet_buffer (b0)->sw_if_index[VLIB_RX]);
-	      lip0 = lcp_itf_pair_get (lipi0);
-
-	      if (lip0)
-		{
-		  /*
-		   * rewind to eth header, copy, advance back to current
-		   */
-		  len0 = ((u8 *) vlib_buffer_get_current (b0) -
-			  (u8 *) ethernet_buffer_get_header (b0));
-		  vlib_buffer_advance (b0, -len0);
-		  c0 = vlib_buffer_copy (vm, b0);
-		  vlib_buffer_advance (b0, len0);
-
-		  if (c0)
-		    {
-		      /* Send to the host */
-		      vnet_buffer (c0)->sw_if_index[VLIB_TX] =
-			lip0->lip_host_sw_if_index;
-		      reply_copies[n_copies++] =
-			vlib_get_buffer_index (vm, c0);
-		    }
-		}
-	    }
-	  if (arp1->opcode == clib_host_to_net_u16 (ETHERNET_ARP_OPCODE_reply))
-	    {
-	      lcp_itf_pair_t *lip1 = 0;
-	      u32 lipi1;
-	      vlib_buffer_t *c1;
-	      u8 len1;
-
-	      lipi1 = lcp_itf_pair_find_by_phy (
-		vnet_buffer (b1)->sw_if_index[VLIB_RX]);
-	      lip1 = lcp_itf_pair_get (lipi1);
-
-	      if (lip1)
-		{
-		  /*
-		   * rewind to reveal the ethernet header
-		   */
-		  len1 = ((u8 *) vlib_buffer_get_current (b1) -
-			  (u8 *) ethernet_buffer_get_header (b1));
-		  vlib_buffer_advance (b1, -len1);
-		  c1 = vlib_buffer_copy (vm, b1);
-		  vlib_buffer_advance (b1, len1);
-
-		  if (c1)
-		    {
-		      /* Send to the host */
-		      vnet_buffer (c1)->sw_if_index[VLIB_TX] =
-			lip1->lip_host_sw_if_index;
-		      reply_copies[n_copies++] =
-			vlib_get_buffer_index (vm, c1);
-		    }
-		}
-	    }
+  lip0 = lcp_itf_fast_find (sw_if_index0, LCP_ITF_FAST_F_PHY);
+  if (!lip0)
+    return;
 
-	  if (PREDICT_FALSE ((b0->flags & VLIB_BUFFER_IS_TRACED)))
-	    {
-	      lcp_arp_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
-	      t->rx_sw_if_index = vnet_buffer (b0)->sw_if_index[VLIB_RX];
-	    }
-	  if (PREDICT_FALSE ((b1->flags & VLIB_BUFFER_IS_TRACED)))
-	    {
-	      lcp_arp_trace_t *t = vlib_add_trace (vm, node, b1, sizeof (*t));
-	      t->rx_sw_if_index = vnet_buffer (b1)->sw_if_index[VLIB_RX];
-	    }
+  if (!lcp_arp_mirror_admit (vm->thread_index, sw_if_index0, now))
+    {
+      counts[LCP_ARP_MIRROR_SUPPRESSED]++;
+      return;
+    }
 
-	  vlib_validate_buffer_enqueue_x2 (vm, node, next_index, to_next,
-					   n_left_to_next, bi0, bi1, next0,
-					   next1);
-	}
+  /*
+   * rewind to the ethernet header and copy it all: the original continues
+   * along the arp arc, the copy goes to the host. A reply is far shorter
+   * than what vlib_buffer_clone() would share a tail of.
+   */
+  len0 = ((u8 *) vlib_buffer_get_current (b0) -
+	  (u8 *) ethernet_buffer_get_header (b0));
+  vlib_buffer_advance (b0, -len0);
+  c0 = vlib_buffer_copy (vm, b0);
+  vlib_buffer_advance (b0, len0);
+
+  if (PREDICT_FALSE (!c0))
+    {
+      counts[LCP_ARP_MIRROR_NO_BUFFER]++;
+      return;
+    }
+  counts[LCP_ARP_MIRROR_COPIED]++;
+
+  /* Send to the host */
+  vnet_buffer (c0)->sw_if_index[VLIB_TX] = lip0->peer_sw_if_index;
+  mirrors[(*n_mirrors)++] = vlib_get_buffer_index (vm, c0);
+  lcp_itf_count (vm, LCP_ITF_COUNTER_TO_HOST, sw_if_index0, c0);
+  vlib_increment_simple_counter (
+    &lcp_itf_simple_counters[LCP_ITF_COUNTER_ARP_MIRRORED], vm->thread_index,
+    sw_if_index0, 1);
+}
 
-      while (n_left_from > 0 && n_left_to_next > 0)
-	{
-	  u32 next0, bi0;
-	  vlib_buffer_t *b0;
-	  ethernet_arp_header_t *arp0;
-	  u16 arp_opcode;
+/**
+ * punt ARP replies to the host
+ */
+VLIB_NODE_FN (lcp_arp_phy_node)
+(vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame)
+{
+  vlib_buffer_t *bufs[VLIB_FRAME_SIZE], **b = bufs;
+  u16 nexts[VLIB_FRAME_SIZE], *next = nexts;
+  u32 mirrors[VLIB_FRAME_SIZE];
+  u32 counts[LCP_ARP_MIRROR_N_COUNT] = { 0 };
+  u32 n_left, n_mirrors = 0, *from;
+  f64 now;
 
-	  bi0 = to_next[0] = from[0];
+  from = vlib_frame_vector_args (frame);
+  n_left = frame->n_vectors;
+  now = vlib_time_now (vm);
 
-	  from += 1;
-	  n_left_from -= 1;
-	  to_next += 1;
-	  n_left_to_next -= 1;
-	  next0 = LCP_ARP_NEXT_DROP;
+  vlib_get_buffers (vm, from, bufs, n_left);
 
-	  b0 = vlib_get_buffer (vm, bi0);
-	  arp0 = vlib_buffer_get_current (b0);
+  while (n_left >= 4)
+    {
+      /* the ARP opcode is in the first cache line of data */
+      if (n_left >= 6)
+	{
+	  vlib_prefetch_buffer_header (b[4], LOAD);
+	  vlib_prefetch_buffer_header (b[5], LOAD);
+	}
+      vlib_prefetch_buffer_data (b[2], LOAD);
+      vlib_prefetch_buffer_data (b[3], LOAD);
 
-	  vnet_feature_next (&next0, b0);
+      lcp_arp_phy_one (vm, node, b[0], &next[0], mirrors, &n_mirrors, counts,
+		       now);
+      lcp_arp_phy_one (vm, node, b[1], &next[1], mirrors, &n_mirrors, counts,
+		       now);
 
-	  /*
-	   * Replies might need to be received by the host, so we
-	   * make a copy of them.
-	   */
-	  arp_opcode = clib_host_to_net_u16 (arp0->opcode);
+      b += 2;
+      next += 2;
+      n_left -= 2;
+    }
 
-	  if (arp_opcode == ETHERNET_ARP_OPCODE_reply)
-	    {
-	      lcp_itf_pair_t *lip0 = 0;
-	      vlib_buffer_t *c0;
-	      u32 lipi0;
-	      u8 len0;
-
-	      lipi0 = lcp_itf_pair_find_by_phy (
-		vnet_buffer (b0)->sw_if_index[VLIB_RX]);
-	      lip0 = lcp_itf_pair_get (lipi0);
-
-	      if (lip0)
-		{
-
-		  /*
-		   * rewind to reveal the ethernet header
-		   */
-		  len0 = ((u8 *) vlib_buffer_get_current (b0) -
-			  (u8 *) ethernet_buffer_get_header (b0));
-		  vlib_buffer_advance (b0, -len0);
-		  c0 = vlib_buffer_copy (vm, b0);
-		  vlib_buffer_advance (b0, len0);
-
-		  if (c0)
-		    {
-		      /* Send to the host */
-		      vnet_buffer (c0)->sw_if_index[VLIB_TX] =
-			lip0->lip_host_sw_if_index;
-		      reply_copies[n_copies++] =
-			vlib_get_buffer_index (vm, c0);
-		    }
-		}
-	    }
+  while (n_left > 0)
+    {
+      lcp_arp_phy_one (vm, node, b[0], &next[0], mirrors, &n_mirrors, counts,
+		       now);
 
-	  if (PREDICT_FALSE ((b0->flags & VLIB_BUFFER_IS_TRACED)))
-	    {
-	      lcp_arp_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
-	      t->rx_sw_if_index = vnet_buffer (b0)->sw_if_index[VLIB_RX];
-	      t->arp_opcode = arp_opcode;
-	    }
+      b += 1;
+      next += 1;
+      n_left -= 1;
+    }
 
-	  vlib_validate_buffer_enqueue_x1 (vm, node, next_index, to_next,
-					   n_left_to_next, bi0, next0);
-	}
+  vlib_buffer_enqueue_to_next (vm, node, from, nexts, frame->n_vectors);
 
-      vlib_put_next_frame (vm, node, next_index, n_left_to_next);
-    }
+  if (n_mirrors)
+    vlib_buffer_enqueue_to_single_next (vm, node, mirrors, LCP_ARP_NEXT_IO,
+					n_mirrors);
 
-  if (n_copies)
-    vlib_buffer_enqueue_to_single_next (vm, node, reply_copies,
-					LCP_ARP_NEXT_IO, n_copies);
+  vlib_node_increment_counter (vm, node->node_index, LINUXCP_ERROR_PACKETS,
+			       frame->n_vectors);
+  vlib_node_increment_counter (vm, node->node_index, LINUXCP_ERROR_COPIES,
+			       counts[LCP_ARP_MIRROR_COPIED]);
+  vlib_node_increment_counter (vm, node->node_index, LINUXCP_ERROR_SUPPRESSED,
+			       counts[LCP_ARP_MIRROR_SUPPRESSED]);
+  vlib_node_increment_counter (vm, node->node_index, LINUXCP_ERROR_NO_BUFFER,
+			       counts[LCP_ARP_MIRROR_NO_BUFFER]);
 
   return frame->n_vectors;
 }
@@ -875,10 +1188,10 @@ VLIB_NODE_FN (lcp_arp_host_node)
 
       while (n_left_from > 0 && n_left_to_next > 0)
 	{
-	  const lcp_itf_pair_t *lip0;
+	  const lcp_itf_fast_t *lip0;
 	  lcp_arp_next_t next0;
 	  vlib_buffer_t *b0;
-	  u32 bi0, lipi0;
+	  u32 bi0;
 	  u8 len0;
 
 	  bi0 = to_next[0] = from[0];
@@ -891,17 +1204,25 @@ VLIB_NODE_FN (lcp_arp_host_node)
 
 	  b0 = vlib_get_buffer (vm, bi0);
 
-	  lipi0 =
-	    lcp_itf_pair_find_by_host (vnet_buffer (b0)->sw_if_index[VLIB_RX]);
-	  lip0 = lcp_itf_pair_get (lipi0);
+	  lip0 = lcp_itf_fast_find (vnet_buffer (b0)->sw_if_index[VLIB_RX],
+				    LCP_ITF_FAST_F_HOST);
+	  if (PREDICT_FALSE (!lip0))
+	    {
+	      b0->error = node->errors[LINUXCP_ERROR_NO_PAIR];
+	      next0 = LCP_ARP_NEXT_DROP;
+	      goto trace0;
+	    }
 
 	  /* Send to the phy */
-	  vnet_buffer (b0)->sw_if_index[VLIB_TX] = lip0->lip_phy_sw_if_index;
+	  vnet_buffer (b0)->sw_if_index[VLIB_TX] = lip0->peer_sw_if_index;
 
 	  len0 = ((u8 *) vlib_buffer_get_current (b0) -
 		  (u8 *) ethernet_buffer_get_header (b0));
 	  vlib_buffer_advance (b0, -len0);
+	  lcp_itf_count (vm, LCP_ITF_COUNTER_FROM_HOST,
+			 lip0->peer_sw_if_index, b0);
 
+	trace0:
 	  if (PREDICT_FALSE ((b0->flags & VLIB_BUFFER_IS_TRACED)))
 	    {
 	      lcp_arp_trace_t *t = vlib_add_trace (vm, node, b0, sizeof (*t));
@@ -941,6 +1262,41 @@ VNET_FEATURE_INIT(lcp_arp_host_arp_feat, static) = {
     .runs_before = VNET_FEATURES("arp-reply"),
 };
 
+static u32 lcp_if_node_max_sw_if_index = ~0;
+
+void
+lcp_if_node_validate (u32 max_sw_if_index)
+{
+  u32 n_threads, ti;
+
+  /* the workers are counted once the config is read, and they are started
+   * after the init functions ran. Pairs made before that are sized again
+   * from lcp_if_node_main_loop_enter() */
+  n_threads = clib_max (vlib_thread_main.n_vlib_mains, 1);
+  lcp_if_node_max_sw_if_index = max_sw_if_index;
+
+  vec_validate (lcp_arp_mirror_tbs, n_threads - 1);
+  vec_validate (lcp_punt_tbs, n_threads - 1);
+  for (ti = 0; ti < n_threads; ti++)
+    {
+      vec_validate (lcp_arp_mirror_tbs[ti], max_sw_if_index);
+      vec_validate (
+	lcp_punt_tbs[ti],
+	lcp_punt_counter_index (max_sw_if_index, LCP_PUNT_N_CLASS - 1));
+    }
+}
+
+static clib_error_t *
+lcp_if_node_main_loop_enter (vlib_main_t *vm)
+{
+  if (lcp_if_node_max_sw_if_index != ~0)
+    lcp_if_node_validate (lcp_if_node_max_sw_if_index);
+
+  return NULL;
+}
+
+VLIB_MAIN_LOOP_ENTER_FUNCTION (lcp_if_node_main_loop_enter);
+
 /*
  * fd.io coding-style-patch-verification: ON
  *
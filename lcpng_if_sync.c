@@ -16,35 +16,94 @@
  */
 
 #include <net/if.h>
+#include <sys/socket.h>
 
 #include <linux/rtnetlink.h>
 
 #include <vnet/vnet.h>
 #include <vnet/plugin/plugin.h>
-#include <vnet/devices/netlink.h>
+#include <vlib/unix/unix.h>
 #include <vnet/ip/ip.h>
 #include <vnet/fib/fib_table.h>
 #include <vppinfra/linux/netns.h>
 
 #include <plugins/lcpng/lcpng_interface.h>
 
-/* helper function to copy forward all sw interface link state flags
- * MTU, and IP addresses into their counterpart LIP interface.
+/*
+ * Deferred sync of VPP state into Linux.
  *
- * This is called upon MTU changes and state changes.
+ * State changes in VPP do not go to Linux right away. They mark what
+ * changed for the pair (admin state, MTU, addresses) in a dirty mask by
+ * phy sw_if_index, and the linux-cp-itf-sync-process node applies the
+ * dirty pairs shortly after, in a burst of pipelined netlink requests. A
+ * change that touches the same pair many times, like an MTU change on a
+ * parent with many sub-interfaces, is sent once per pair. Address
+ * deletes cannot be derived from VPP's state once the address is gone, so
+ * they are queued on their own and applied first.
  */
-void
-lcp_itf_pair_sync_state (lcp_itf_pair_t *lip)
+typedef enum lcp_itf_sync_flags_t_
+{
+  LCP_ITF_SYNC_ADMIN = (1 << 0),
+  LCP_ITF_SYNC_MTU = (1 << 1),
+  LCP_ITF_SYNC_ADDR = (1 << 2),
+} lcp_itf_sync_flags_t;
+
+#define LCP_ITF_SYNC_ALL                                                      \
+  (LCP_ITF_SYNC_ADMIN | LCP_ITF_SYNC_MTU | LCP_ITF_SYNC_ADDR)
+
+typedef struct lcp_itf_sync_addr_del_t_
+{
+  u32 phy_sw_if_index;
+  u8 is_ip6;
+  u8 pfx_len;
+  ip46_address_t addr;
+} lcp_itf_sync_addr_del_t;
+
+typedef struct lcp_itf_sync_pending_t_
+{
+  u32 phy_sw_if_index;
+  u8 flags;
+  u8 depth; // 0 for a phy, 1 for a sub-int, 2 for the inner vlan of a QinQ
+} lcp_itf_sync_pending_t;
+
+static u8 *lcp_itf_sync_dirty;	      // lcp_itf_sync_flags_t by phy
+static u32 *lcp_itf_sync_queue;	      // phys with a dirty mask
+static lcp_itf_sync_addr_del_t *lcp_itf_sync_addr_dels;
+static u8 lcp_itf_sync_kicked;
+static vlib_node_registration_t lcp_itf_sync_process_node;
+
+#define LCP_ITF_SYNC_DELAY 1e-3 // seconds, to collect a burst of changes
+#define LCP_ITF_SYNC_BATCH 256	// pairs applied between suspends
+
+static void
+lcp_itf_sync_kick (void)
+{
+  if (lcp_itf_sync_kicked)
+    return;
+  lcp_itf_sync_kicked = 1;
+  vlib_process_signal_event (vlib_get_main (),
+			     lcp_itf_sync_process_node.index, 0, 0);
+}
+
+static void
+lcp_itf_sync_mark (u32 phy_sw_if_index, u8 flags)
+{
+  vec_validate (lcp_itf_sync_dirty, phy_sw_if_index);
+  if (!lcp_itf_sync_dirty[phy_sw_if_index])
+    vec_add1 (lcp_itf_sync_queue, phy_sw_if_index);
+  lcp_itf_sync_dirty[phy_sw_if_index] |= flags;
+  lcp_itf_sync_kick ();
+}
+
+/* Copy forward the parts of the sw interface's state that are set in flags
+ * into its counterpart LIP interface.
+ */
+static void
+lcp_itf_pair_sync_apply (lcp_itf_pair_t *lip, u8 flags)
 {
   vnet_sw_interface_t *sw;
   vnet_sw_interface_t *sup_sw;
-  int curr_ns_fd = -1;
-  int vif_ns_fd = -1;
   u32 mtu;
-  u32 netlink_mtu;
-
-  if (!lcp_sync ())
-    return;
 
   sw =
     vnet_get_sw_interface_or_null (vnet_get_main (), lip->lip_phy_sw_if_index);
@@ -53,77 +112,170 @@ lcp_itf_pair_sync_state (lcp_itf_pair_t *lip)
   sup_sw =
     vnet_get_sw_interface_or_null (vnet_get_main (), sw->sup_sw_if_index);
 
-  if (lip->lip_namespace)
-    {
-      curr_ns_fd = clib_netns_open (NULL /* self */);
-      vif_ns_fd = clib_netns_open (lip->lip_namespace);
-      if (vif_ns_fd != -1)
-	clib_setns (vif_ns_fd);
-    }
-
   LCP_IF_INFO ("sync_state: %U flags %u sup-flags %u mtu %u sup-mtu %u",
 	       format_lcp_itf_pair, lip, sw->flags, sup_sw->flags,
 	       sw->mtu[VNET_MTU_L3], sup_sw->mtu[VNET_MTU_L3]);
 
-  /* Linux will not allow children to be admin-up if their parent is
-   * admin-down. If child is up but parent is not, force it down.
-   */
-  int state = sw->flags & VNET_SW_INTERFACE_FLAG_ADMIN_UP;
+  if (flags & LCP_ITF_SYNC_ADMIN)
+    {
+      /* Linux will not allow children to be admin-up if their parent is
+       * admin-down. If child is up but parent is not, force it down.
+       */
+      int state = sw->flags & VNET_SW_INTERFACE_FLAG_ADMIN_UP;
+
+      if (state && !(sup_sw->flags & VNET_SW_INTERFACE_FLAG_ADMIN_UP))
+	{
+	  LCP_IF_WARN (
+	    "sync_state: %U flags %u sup-flags %u mtu %u sup-mtu %u: "
+	    "forcing state to sup-flags to satisfy netlink",
+	    format_lcp_itf_pair, lip, sw->flags, sup_sw->flags,
+	    sw->mtu[VNET_MTU_L3], sup_sw->mtu[VNET_MTU_L3]);
+	  state = 0;
+	}
+      lcp_itf_set_link_state (lip, state);
+    }
+
+  if (flags & LCP_ITF_SYNC_MTU)
+    {
+      /* Linux will clamp MTU of children when the parent is lower. VPP is
+       * fine with differing MTUs. VPP assumes that if a subint has MTU of 0,
+       * that it inherits from its parent. Linux likes to be more explicit,
+       * so we reconcile any differences.
+       */
+      mtu = sw->mtu[VNET_MTU_L3];
+      if (mtu == 0)
+	mtu = sup_sw->mtu[VNET_MTU_L3];
+
+      if (sup_sw->mtu[VNET_MTU_L3] < sw->mtu[VNET_MTU_L3])
+	{
+	  LCP_IF_WARN ("sync_state: %U flags %u mtu %u sup-mtu %u: "
+		       "clamping to sup-mtu to satisfy netlink",
+		       format_lcp_itf_pair, lip, sw->flags,
+		       sw->mtu[VNET_MTU_L3], sup_sw->mtu[VNET_MTU_L3]);
+	  mtu = sup_sw->mtu[VNET_MTU_L3];
+	}
+
+      /* Set MTU on all of {sw, tap, netlink}. Linux ignores a request for
+       * the MTU the device already has, so there is no need to ask first.
+       */
+      vnet_sw_interface_set_mtu (vnet_get_main (), lip->lip_phy_sw_if_index,
+				 mtu);
+      vnet_sw_interface_set_mtu (vnet_get_main (), lip->lip_host_sw_if_index,
+				 mtu);
+      lcp_itf_nl_set_link_mtu (lip, mtu);
+    }
+
+  if (flags & LCP_ITF_SYNC_ADDR)
+    lcp_itf_set_interface_addr (lip);
+}
+
+static int
+lcp_itf_sync_pending_cmp (void *a1, void *a2)
+{
+  lcp_itf_sync_pending_t *p1 = a1, *p2 = a2;
+
+  return ((int) p1->depth - (int) p2->depth);
+}
+
+/* Apply all queued changes. Parents go before their children, which Linux
+ * needs for the admin state and the MTU of a child to stick. */
+static void
+lcp_itf_sync_flush (vlib_main_t *vm)
+{
+  vnet_main_t *vnm = vnet_get_main ();
+  lcp_itf_sync_pending_t *pending = NULL, *p;
+  lcp_itf_sync_addr_del_t *dels, *d;
+  vnet_sw_interface_t *sw;
+  lcp_itf_pair_t *lip;
+  u32 *phy, n = 0;
 
-  if (state && !(sup_sw->flags & VNET_SW_INTERFACE_FLAG_ADMIN_UP))
+  dels = lcp_itf_sync_addr_dels;
+  lcp_itf_sync_addr_dels = NULL;
+  vec_foreach (phy, lcp_itf_sync_queue)
     {
-      LCP_IF_WARN ("sync_state: %U flags %u sup-flags %u mtu %u sup-mtu %u: "
-		   "forcing state to sup-flags to satisfy netlink",
-		   format_lcp_itf_pair, lip, sw->flags, sup_sw->flags,
-		   sw->mtu[VNET_MTU_L3], sup_sw->mtu[VNET_MTU_L3]);
-      state = 0;
+      u8 flags = lcp_itf_sync_dirty[*phy];
+
+      lcp_itf_sync_dirty[*phy] = 0;
+      if (!(sw = vnet_get_sw_interface_or_null (vnm, *phy)))
+	continue;
+      vec_add2 (pending, p, 1);
+      p->phy_sw_if_index = *phy;
+      p->flags = flags;
+      p->depth = 0;
+      if (sw->type == VNET_SW_INTERFACE_TYPE_SUB)
+	p->depth = sw->sub.eth.flags.two_tags ? 2 : 1;
     }
-  lcp_itf_set_link_state (lip, state);
-
-  /* Linux will clamp MTU of children when the parent is lower. VPP is fine
-   * with differing MTUs. VPP assumes that if a subint has MTU of 0, that it
-   * inherits from its parent. Linux likes to be more explicit, so we
-   * reconcile any differences.
-   */
-  mtu = sw->mtu[VNET_MTU_L3];
-  if (mtu == 0)
-    mtu = sup_sw->mtu[VNET_MTU_L3];
-
-  if (sup_sw->mtu[VNET_MTU_L3] < sw->mtu[VNET_MTU_L3])
+  vec_reset_length (lcp_itf_sync_queue);
+
+  if (!lcp_sync ())
+    goto done;
+
+  vec_foreach (d, dels)
     {
-      LCP_IF_WARN ("sync_state: %U flags %u mtu %u sup-mtu %u: "
-		   "clamping to sup-mtu to satisfy netlink",
-		   format_lcp_itf_pair, lip, sw->flags, sw->mtu[VNET_MTU_L3],
-		   sup_sw->mtu[VNET_MTU_L3]);
-      mtu = sup_sw->mtu[VNET_MTU_L3];
+      lip = lcp_itf_pair_get (lcp_itf_pair_find_by_phy (d->phy_sw_if_index));
+      if (!lip)
+	continue;
+      if (d->is_ip6)
+	lcp_itf_nl_add_del_ip6_addr (lip, &d->addr.ip6, d->pfx_len,
+				     1 /* is_del */);
+      else
+	lcp_itf_nl_add_del_ip4_addr (lip, &d->addr.ip4, d->pfx_len,
+				     1 /* is_del */);
     }
 
-  /* Set MTU on all of {sw, tap, netlink}. Only send a netlink message if we
-   * really do want to change the MTU.
-   */
-  vnet_sw_interface_set_mtu (vnet_get_main (), lip->lip_phy_sw_if_index, mtu);
-  vnet_sw_interface_set_mtu (vnet_get_main (), lip->lip_host_sw_if_index, mtu);
-  if (NULL == vnet_netlink_get_link_mtu (lip->lip_vif_index, &netlink_mtu))
+  vec_sort_with_function (pending, lcp_itf_sync_pending_cmp);
+  vec_foreach (p, pending)
     {
-      if (netlink_mtu != mtu)
-	vnet_netlink_set_link_mtu (lip->lip_vif_index, mtu);
+      lip = lcp_itf_pair_get (lcp_itf_pair_find_by_phy (p->phy_sw_if_index));
+      if (!lip)
+	continue;
+      lcp_itf_pair_sync_apply (lip, p->flags);
+
+      /* let the main loop read the ACKs, and whatever else it has to do */
+      if (++n % LCP_ITF_SYNC_BATCH == 0)
+	vlib_process_suspend (vm, 1e-4);
     }
 
-  /* Linux will remove IPv6 addresses on children when the parent state
-   * goes down, so we ensure all IPv4/IPv6 addresses are synced.
-   */
-  lcp_itf_set_interface_addr (lip);
+  if (vec_len (pending) > 1)
+    LCP_IF_DBG ("sync_flush: synced %u pairs, %u address deletes",
+		vec_len (pending), vec_len (dels));
 
-  if (vif_ns_fd != -1)
-    close (vif_ns_fd);
+done:
+  vec_free (pending);
+  vec_free (dels);
+}
 
-  if (curr_ns_fd != -1)
+static uword
+lcp_itf_sync_process (vlib_main_t *vm, vlib_node_runtime_t *node,
+		      vlib_frame_t *frame)
+{
+  while (1)
     {
-      clib_setns (curr_ns_fd);
-      close (curr_ns_fd);
+      vlib_process_wait_for_event (vm);
+      vlib_process_get_events (vm, NULL);
+
+      vlib_process_suspend (vm, LCP_ITF_SYNC_DELAY);
+      lcp_itf_sync_kicked = 0;
+      lcp_itf_sync_flush (vm);
     }
 
-  return;
+  return 0;
+}
+
+VLIB_REGISTER_NODE (lcp_itf_sync_process_node, static) = {
+  .function = lcp_itf_sync_process,
+  .name = "linux-cp-itf-sync-process",
+  .type = VLIB_NODE_TYPE_PROCESS,
+  .process_log2_n_stack_bytes = 17,
+};
+
+void
+lcp_itf_pair_sync_state (lcp_itf_pair_t *lip)
+{
+  if (!lcp_sync ())
+    return;
+
+  lcp_itf_sync_mark (lip->lip_phy_sw_if_index, LCP_ITF_SYNC_ALL);
 }
 
 static walk_rc_t
@@ -191,9 +343,10 @@ lcp_itf_admin_state_change (vnet_main_t * vnm, u32 sw_if_index, u32 flags)
   LCP_IF_INFO ("admin_state_change: %U flags %u", format_lcp_itf_pair, lip,
 	       flags);
 
+  /* Linux removes the IPv6 addresses of a device that goes down */
   if (vnet_sw_interface_is_sub (vnm, sw_if_index))
     {
-      lcp_itf_pair_sync_state (lip);
+      lcp_itf_sync_mark (sw_if_index, LCP_ITF_SYNC_ADMIN | LCP_ITF_SYNC_ADDR);
       return NULL;
     }
 
@@ -236,7 +389,7 @@ lcp_itf_mtu_change (vnet_main_t *vnm, u32 sw_if_index, u32 flags)
       lcp_itf_pair_t *lip;
       lip = lcp_itf_pair_get (lcp_itf_pair_find_by_phy (sw_if_index));
       if (lip)
-	lcp_itf_pair_sync_state (lip);
+	lcp_itf_sync_mark (sw_if_index, LCP_ITF_SYNC_MTU);
       return NULL;
     }
 
@@ -298,107 +451,313 @@ vnet_netlink_msg_add_rtattr (vnet_netlink_msg_t *m, u16 rta_type,
   rta->rta_len = RTA_LENGTH (rta_data_len);
   clib_memcpy (RTA_DATA (rta), rta_data, rta_data_len);
 }
-static clib_error_t *
-vnet_netlink_msg_send (vnet_netlink_msg_t *m, vnet_netlink_msg_t **replies)
-{
-  clib_error_t *err = 0;
-  struct sockaddr_nl ra = { 0 };
-  int len, sock;
-  struct nlmsghdr *nh = (struct nlmsghdr *) m->data;
-  nh->nlmsg_len = vec_len (m->data);
-  char buf[4096];
+// TODO(pim) move previous block upstream
 
-  if ((sock = socket (AF_NETLINK, SOCK_RAW, NETLINK_ROUTE)) == -1)
-    return clib_error_return_unix (0, "socket(AF_NETLINK)");
+/*
+ * Netlink TX sockets.
+ *
+ * Requests towards the host side of a pair go out over a netlink socket
+ * per namespace, which is created in that namespace the first time it is
+ * needed and kept for the lifetime of the plugin. Sockets stay in the
+ * namespace they were created in, so the callers need not switch
+ * namespaces. Requests are sent back-to-back, each with its own sequence
+ * number and NLM_F_ACK; the kernel applies them as they are sent. Their
+ * ACKs are read from the main loop by lcp_itf_nl_tx_read_cb() and failed
+ * requests are logged there.
+ */
+typedef struct lcp_itf_nl_tx_t_
+{
+  int fd;
+  u8 *netns_name;	 // NUL terminated, empty for the default namespace
+  uword clib_file_index; // to read ACKs from the main loop
+  u32 seq;		 // of the last request sent
+  u32 n_pending;	 // requests sent, ACK not read yet
+  u64 n_requests;
+  u64 n_errors;
+} lcp_itf_nl_tx_t;
+
+static lcp_itf_nl_tx_t *lcp_itf_nl_tx_pool;
+static uword *lcp_itf_nl_tx_by_ns;
+
+/* Read ACKs synchronously when this many are outstanding, so that they do
+ * not overflow the socket */
+#define LCP_ITF_NL_TX_MAX_PENDING 256
+#define LCP_ITF_NL_TX_RCVBUF	  (1 << 20)
 
-  ra.nl_family = AF_NETLINK;
-  ra.nl_pid = 0;
+static void
+lcp_itf_nl_tx_ack (lcp_itf_nl_tx_t *tx, struct nlmsghdr *nh)
+{
+  struct nlmsgerr *e = (struct nlmsgerr *) NLMSG_DATA (nh);
 
-  if ((bind (sock, (struct sockaddr *) &ra, sizeof (ra))) == -1)
+  if (tx->n_pending)
+    tx->n_pending--;
+  if (e->error)
     {
-      err = clib_error_return_unix (0, "bind");
-      goto done;
+      tx->n_errors++;
+      LCP_IF_ERROR ("nl_tx_ack: netns '%s' request type %u seq %u: %s",
+		    tx->netns_name, e->msg.nlmsg_type, nh->nlmsg_seq,
+		    strerror (-e->error));
     }
+}
 
-  if ((send (sock, m->data, vec_len (m->data), 0)) == -1)
-    err = clib_error_return_unix (0, "send");
+/* Read ACKs until the ACK of request seq, or until the socket is empty if
+ * seq is 0 */
+static clib_error_t *
+lcp_itf_nl_tx_recv (lcp_itf_nl_tx_t *tx, u32 seq)
+{
+  clib_error_t *err = NULL;
+  struct nlmsghdr *nh;
+  u8 buf[16384];
+  int len;
 
-  if ((len = recv (sock, buf, sizeof (buf), 0)) == -1)
-    err = clib_error_return_unix (0, "recv");
-  for (nh = (struct nlmsghdr *) buf; NLMSG_OK (nh, len);
-       nh = NLMSG_NEXT (nh, len))
+  while (1)
     {
-      if (nh->nlmsg_type == NLMSG_DONE)
-	goto done;
-
-      if (nh->nlmsg_type == NLMSG_ERROR)
+      len = recv (tx->fd, buf, sizeof (buf), seq ? 0 : MSG_DONTWAIT);
+      if (len == -1)
 	{
-	  struct nlmsgerr *e = (struct nlmsgerr *) NLMSG_DATA (nh);
-	  if (e->error)
-	    err = clib_error_return (0, "netlink error %d", e->error);
-	  goto done;
+	  if (!seq && (errno == EAGAIN || errno == EWOULDBLOCK))
+	    return NULL;
+	  /* what is outstanding is lost, on a timeout or an overflow */
+	  tx->n_pending = 0;
+	  return clib_error_return_unix (0, "recv");
 	}
 
-      if (replies)
+      for (nh = (struct nlmsghdr *) buf; NLMSG_OK (nh, len);
+	   nh = NLMSG_NEXT (nh, len))
 	{
-	  vnet_netlink_msg_t msg = { NULL };
-	  u8 *p;
-	  vec_add2 (msg.data, p, nh->nlmsg_len);
-	  clib_memcpy (p, nh, nh->nlmsg_len);
-	  vec_add1 (*replies, msg);
+	  if (nh->nlmsg_type == NLMSG_ERROR)
+	    {
+	      struct nlmsgerr *e = (struct nlmsgerr *) NLMSG_DATA (nh);
+
+	      lcp_itf_nl_tx_ack (tx, nh);
+	      if (seq && nh->nlmsg_seq == seq)
+		{
+		  if (e->error)
+		    err = clib_error_return (0, "netlink error %d", e->error);
+		  return err;
+		}
+	    }
 	}
     }
 
+  return err;
+}
+
+static clib_error_t *
+lcp_itf_nl_tx_read_cb (clib_file_t *f)
+{
+  lcp_itf_nl_tx_t *tx = pool_elt_at_index (lcp_itf_nl_tx_pool, f->private_data);
+  clib_error_t *err;
+
+  if ((err = lcp_itf_nl_tx_recv (tx, 0)))
+    {
+      LCP_IF_ERROR ("nl_tx_read_cb: netns '%s': %U", tx->netns_name,
+		    format_clib_error, err);
+      clib_error_free (err);
+    }
+
+  return NULL;
+}
+
+/* Create a netlink socket in namespace ns, the default one if empty */
+static int
+lcp_itf_nl_tx_open (const char *ns)
+{
+  struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+  struct timeval tv = { .tv_sec = 1 };
+  int rcvbuf = LCP_ITF_NL_TX_RCVBUF;
+  int prev_ns, fd = -1;
+
+  if ((prev_ns = lcp_ns_enter ((const u8 *) ns)) == -1)
+    {
+      LCP_IF_ERROR ("nl_tx_open: Unable to enter netns '%s'", ns);
+      return -1;
+    }
+
+  if ((fd = socket (AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE)) ==
+	-1 ||
+      bind (fd, (struct sockaddr *) &sa, sizeof (sa)) == -1)
+    {
+      LCP_IF_ERROR ("nl_tx_open: Unable to open netlink socket in netns "
+		    "'%s': %s",
+		    ns, strerror (errno));
+      if (fd != -1)
+	close (fd);
+      fd = -1;
+      goto done;
+    }
+  setsockopt (fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof (rcvbuf));
+  setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv));
+
 done:
-  close (sock);
+  lcp_ns_leave (prev_ns);
+
+  return fd;
+}
+
+static lcp_itf_nl_tx_t *
+lcp_itf_nl_tx_get (const u8 *ns)
+{
+  const char *name = (ns && ns[0]) ? (const char *) ns : "";
+  clib_file_t template = { 0 };
+  lcp_itf_nl_tx_t *tx;
+  uword *p;
+  int fd;
+
+  if ((p = hash_get_mem (lcp_itf_nl_tx_by_ns, name)))
+    return (pool_elt_at_index (lcp_itf_nl_tx_pool, p[0]));
+
+  if ((fd = lcp_itf_nl_tx_open (name)) == -1)
+    return (NULL);
+
+  pool_get_zero (lcp_itf_nl_tx_pool, tx);
+  tx->fd = fd;
+  tx->netns_name = format (0, "%s%c", name, 0);
+  hash_set_mem (lcp_itf_nl_tx_by_ns, tx->netns_name,
+		tx - lcp_itf_nl_tx_pool);
+
+  template.read_function = lcp_itf_nl_tx_read_cb;
+  template.private_data = tx - lcp_itf_nl_tx_pool;
+  template.file_descriptor = fd;
+  template.description = format (0, "linux-cp netlink tx netns '%s'", name);
+  tx->clib_file_index = clib_file_add (&file_main, &template);
+
+  LCP_IF_INFO ("nl_tx_get: Opened netlink fd %d netns '%s'", fd, name);
+  return (tx);
+}
+
+/* Send request m, which is consumed. Returns its sequence number, or 0 if
+ * it could not be sent. */
+static u32
+lcp_itf_nl_tx_send (lcp_itf_nl_tx_t *tx, vnet_netlink_msg_t *m)
+{
+  struct nlmsghdr *nh = (struct nlmsghdr *) m->data;
+  clib_error_t *err;
+  u32 seq;
+
+  nh->nlmsg_len = vec_len (m->data);
+  nh->nlmsg_seq = seq = ++tx->seq;
+  if (seq == 0) // 0 means none to lcp_itf_nl_tx_recv()
+    nh->nlmsg_seq = seq = ++tx->seq;
+  tx->n_requests++;
+
+  if (send (tx->fd, m->data, vec_len (m->data), 0) == -1)
+    {
+      tx->n_errors++;
+      LCP_IF_ERROR ("nl_tx_send: netns '%s' request type %u: %s",
+		    tx->netns_name, nh->nlmsg_type, strerror (errno));
+      seq = 0;
+    }
+  else if (++tx->n_pending >= LCP_ITF_NL_TX_MAX_PENDING)
+    {
+      /* wait for the ACK of this one, which comes after all the others */
+      if ((err = lcp_itf_nl_tx_recv (tx, seq)))
+	clib_error_free (err);
+    }
   vec_free (m->data);
-  return err;
+
+  return seq;
 }
 
-clib_error_t *
-vnet_netlink_del_ip4_addr (int ifindex, void *addr, int pfx_len)
+static void
+lcp_itf_nl_link_msg_init (vnet_netlink_msg_t *m, u16 type, u32 ifindex,
+			  u32 change, u32 flags)
 {
+  struct ifinfomsg ifi = { 0 };
+
+  ifi.ifi_family = AF_UNSPEC;
+  ifi.ifi_index = ifindex;
+  ifi.ifi_change = change;
+  ifi.ifi_flags = flags;
+
+  vnet_netlink_msg_init (m, type, NLM_F_REQUEST, &ifi,
+			 sizeof (struct ifinfomsg));
+}
+
+void
+lcp_itf_nl_set_link_state (const lcp_itf_pair_t *lip, u8 state)
+{
+  lcp_itf_nl_tx_t *tx;
   vnet_netlink_msg_t m;
-  struct ifaddrmsg ifa = { 0 };
-  clib_error_t *err = 0;
 
-  ifa.ifa_family = AF_INET;
-  ifa.ifa_prefixlen = pfx_len;
-  ifa.ifa_index = ifindex;
+  if (!(tx = lcp_itf_nl_tx_get (lip->lip_namespace)))
+    return;
 
-  vnet_netlink_msg_init (&m, RTM_DELADDR, NLM_F_REQUEST, &ifa,
-			 sizeof (struct ifaddrmsg));
+  lcp_itf_nl_link_msg_init (&m, RTM_NEWLINK, lip->lip_vif_index, IFF_UP,
+			    state ? IFF_UP : 0);
+  lcp_itf_nl_tx_send (tx, &m);
+}
 
-  vnet_netlink_msg_add_rtattr (&m, IFA_LOCAL, addr, 4);
-  vnet_netlink_msg_add_rtattr (&m, IFA_ADDRESS, addr, 4);
-  err = vnet_netlink_msg_send (&m, NULL);
-  if (err)
-    err = clib_error_return (0, "del ip4 addr %U", format_clib_error, err);
-  return err;
+void
+lcp_itf_nl_set_link_mtu (const lcp_itf_pair_t *lip, u32 mtu)
+{
+  lcp_itf_nl_tx_t *tx;
+  vnet_netlink_msg_t m;
+
+  if (!(tx = lcp_itf_nl_tx_get (lip->lip_namespace)))
+    return;
+
+  lcp_itf_nl_link_msg_init (&m, RTM_NEWLINK, lip->lip_vif_index, 0, 0);
+  vnet_netlink_msg_add_rtattr (&m, IFLA_MTU, &mtu, sizeof (u32));
+  lcp_itf_nl_tx_send (tx, &m);
 }
 
-clib_error_t *
-vnet_netlink_del_ip6_addr (int ifindex, void *addr, int pfx_len)
+void
+lcp_itf_nl_set_link_master (const lcp_itf_pair_t *lip, u32 master_ifindex)
 {
+  lcp_itf_nl_tx_t *tx;
   vnet_netlink_msg_t m;
+
+  if (!(tx = lcp_itf_nl_tx_get (lip->lip_namespace)))
+    return;
+
+  lcp_itf_nl_link_msg_init (&m, RTM_NEWLINK, lip->lip_vif_index, 0, 0);
+  vnet_netlink_msg_add_rtattr (&m, IFLA_MASTER, &master_ifindex,
+			       sizeof (u32));
+  lcp_itf_nl_tx_send (tx, &m);
+}
+
+static void
+lcp_itf_nl_add_del_addr (const lcp_itf_pair_t *lip, int family, void *addr,
+			 int addr_len, int pfx_len, int is_del)
+{
   struct ifaddrmsg ifa = { 0 };
-  clib_error_t *err = 0;
+  lcp_itf_nl_tx_t *tx;
+  vnet_netlink_msg_t m;
 
-  ifa.ifa_family = AF_INET6;
+  if (!(tx = lcp_itf_nl_tx_get (lip->lip_namespace)))
+    return;
+
+  ifa.ifa_family = family;
   ifa.ifa_prefixlen = pfx_len;
-  ifa.ifa_index = ifindex;
+  ifa.ifa_index = lip->lip_vif_index;
 
-  vnet_netlink_msg_init (&m, RTM_DELADDR, NLM_F_REQUEST, &ifa,
-			 sizeof (struct ifaddrmsg));
+  /* an address that is already there is not an error */
+  vnet_netlink_msg_init (&m, is_del ? RTM_DELADDR : RTM_NEWADDR,
+			 is_del ? NLM_F_REQUEST :
+				  NLM_F_REQUEST | NLM_F_CREATE | NLM_F_REPLACE,
+			 &ifa, sizeof (struct ifaddrmsg));
 
-  vnet_netlink_msg_add_rtattr (&m, IFA_LOCAL, addr, 16);
-  vnet_netlink_msg_add_rtattr (&m, IFA_ADDRESS, addr, 16);
-  err = vnet_netlink_msg_send (&m, NULL);
-  if (err)
-    err = clib_error_return (0, "del ip6 addr %U", format_clib_error, err);
-  return err;
+  vnet_netlink_msg_add_rtattr (&m, IFA_LOCAL, addr, addr_len);
+  vnet_netlink_msg_add_rtattr (&m, IFA_ADDRESS, addr, addr_len);
+  lcp_itf_nl_tx_send (tx, &m);
+}
+
+void
+lcp_itf_nl_add_del_ip4_addr (const lcp_itf_pair_t *lip, ip4_address_t *addr,
+			     u8 pfx_len, int is_del)
+{
+  lcp_itf_nl_add_del_addr (lip, AF_INET, addr, sizeof (*addr), pfx_len,
+			   is_del);
+}
+
+void
+lcp_itf_nl_add_del_ip6_addr (const lcp_itf_pair_t *lip, ip6_address_t *addr,
+			     u8 pfx_len, int is_del)
+{
+  lcp_itf_nl_add_del_addr (lip, AF_INET6, addr, sizeof (*addr), pfx_len,
+			   is_del);
 }
-// TODO(pim) move previous block upstream
 
 static void
 lcp_itf_ip4_add_del_interface_addr (ip4_main_t *im, uword opaque,
@@ -407,8 +766,6 @@ lcp_itf_ip4_add_del_interface_addr (ip4_main_t *im, uword opaque,
 				    u32 is_del)
 {
   const lcp_itf_pair_t *lip;
-  int curr_ns_fd = -1;
-  int vif_ns_fd = -1;
 
   if (!lcp_sync ())
     return;
@@ -421,32 +778,23 @@ lcp_itf_ip4_add_del_interface_addr (ip4_main_t *im, uword opaque,
   if (!lip)
     return;
 
-  if (lip->lip_namespace)
-    {
-      curr_ns_fd = clib_netns_open (NULL /* self */);
-      vif_ns_fd = clib_netns_open (lip->lip_namespace);
-      if (vif_ns_fd != -1)
-	clib_setns (vif_ns_fd);
-    }
-
   LCP_IF_DBG ("ip4_addr_%s: %U ip4 %U/%u", is_del ? "del" : "add",
 	      format_lcp_itf_pair, lip, format_ip4_address, address,
 	      address_length);
 
   if (is_del)
-    vnet_netlink_del_ip4_addr (lip->lip_vif_index, address, address_length);
-  else
-    vnet_netlink_add_ip4_addr (lip->lip_vif_index, address, address_length);
-
-  if (vif_ns_fd != -1)
-    close (vif_ns_fd);
-
-  if (curr_ns_fd != -1)
     {
-      clib_setns (curr_ns_fd);
-      close (curr_ns_fd);
+      lcp_itf_sync_addr_del_t *d;
+
+      vec_add2 (lcp_itf_sync_addr_dels, d, 1);
+      clib_memset (d, 0, sizeof (*d));
+      d->phy_sw_if_index = sw_if_index;
+      d->pfx_len = address_length;
+      d->addr.ip4 = *address;
+      lcp_itf_sync_kick ();
     }
-  return;
+  else
+    lcp_itf_sync_mark (sw_if_index, LCP_ITF_SYNC_ADDR);
 }
 
 static void
@@ -456,8 +804,6 @@ lcp_itf_ip6_add_del_interface_addr (ip6_main_t *im, uword opaque,
 				    u32 is_del)
 {
   const lcp_itf_pair_t *lip;
-  int curr_ns_fd = -1;
-  int vif_ns_fd = -1;
 
   if (!lcp_sync ())
     return;
@@ -470,29 +816,23 @@ lcp_itf_ip6_add_del_interface_addr (ip6_main_t *im, uword opaque,
   if (!lip)
     return;
 
-  if (lip->lip_namespace)
-    {
-      curr_ns_fd = clib_netns_open (NULL /* self */);
-      vif_ns_fd = clib_netns_open (lip->lip_namespace);
-      if (vif_ns_fd != -1)
-	clib_setns (vif_ns_fd);
-    }
-  LCP_IF_DBG ("ip6_addr_%s: %U ip4 %U/%u", is_del ? "del" : "add",
+  LCP_IF_DBG ("ip6_addr_%s: %U ip6 %U/%u", is_del ? "del" : "add",
 	      format_lcp_itf_pair, lip, format_ip6_address, address,
 	      address_length);
   if (is_del)
-    vnet_netlink_del_ip6_addr (lip->lip_vif_index, address, address_length);
-  else
-    vnet_netlink_add_ip6_addr (lip->lip_vif_index, address, address_length);
-
-  if (vif_ns_fd != -1)
-    close (vif_ns_fd);
-
-  if (curr_ns_fd != -1)
     {
-      clib_setns (curr_ns_fd);
-      close (curr_ns_fd);
+      lcp_itf_sync_addr_del_t *d;
+
+      vec_add2 (lcp_itf_sync_addr_dels, d, 1);
+      clib_memset (d, 0, sizeof (*d));
+      d->phy_sw_if_index = sw_if_index;
+      d->is_ip6 = 1;
+      d->pfx_len = address_length;
+      d->addr.ip6 = *address;
+      lcp_itf_sync_kick ();
     }
+  else
+    lcp_itf_sync_mark (sw_if_index, LCP_ITF_SYNC_ADDR);
 }
 
 #ifdef LCP_HAVE_VRF_SYNC
@@ -500,11 +840,8 @@ static void
 lcp_itf_ipX_table_bind (fib_protocol_t proto,
                         u32 sw_if_index, u32 new_fib_index, u32 old_fib_index)
 {
-  u32 new_table_id;
-  char if_name_buf[IF_NAMESIZE];
-  char *if_name;
+  u32 new_table_id, vrf_if_index;
   const lcp_itf_pair_t *lip;
-  lcp_nl_table_t *nlt;
 
   if (!lcp_sync ())
     return;
@@ -522,19 +859,16 @@ lcp_itf_ipX_table_bind (fib_protocol_t proto,
 
   if (new_table_id)
     {
-      nlt = lcp_nl_table_find (new_table_id, FIB_PROTOCOL_IP4);
-      if (!nlt || nlt->nlt_if_index == ~0)
+      vrf_if_index =
+	lcp_nl_vrf_find_if_index (lip->lip_namespace, new_table_id);
+      if (vrf_if_index == ~0)
         return;
 
-      if_name = if_indextoname(nlt->nlt_if_index, if_name_buf);
-      if (!if_name)
-        return;
-
-      LCP_IF_DBG ("ip%s_table_bind: %U master:%s",
+      LCP_IF_DBG ("ip%s_table_bind: %U master:%u",
                   proto == FIB_PROTOCOL_IP4 ? "4" : "6",
-                  format_lcp_itf_pair, lip, if_name);
+                  format_lcp_itf_pair, lip, vrf_if_index);
 
-      vnet_netlink_set_link_master (lip->lip_vif_index, if_name);
+      lcp_itf_nl_set_link_master (lip, vrf_if_index);
     }
   else
     {
@@ -542,7 +876,7 @@ lcp_itf_ipX_table_bind (fib_protocol_t proto,
                   proto == FIB_PROTOCOL_IP4 ? "4" : "6",
                   format_lcp_itf_pair, lip);
 
-      vnet_netlink_set_link_master (lip->lip_vif_index, "");
+      lcp_itf_nl_set_link_master (lip, 0);
     }
 }
 
@@ -642,6 +976,8 @@ lcp_itf_sync_init (vlib_main_t *vm)
   ip4_add_del_interface_address_callback_t add_del_cb4;
   ip6_add_del_interface_address_callback_t add_del_cb6;
 
+  lcp_itf_nl_tx_by_ns = hash_create_string (0, sizeof (uword));
+
   add_del_cb4.function = lcp_itf_ip4_add_del_interface_addr;
   add_del_cb4.function_opaque = 0;
   vec_add1 (im4->add_del_interface_address_callbacks, add_del_cb4);
@@ -36,6 +36,8 @@
 #include <vnet/tcp/tcp.h>
 #include <vnet/devices/tap/tap.h>
 #include <vnet/devices/virtio/virtio.h>
+#include <vnet/interface/rx_queue_funcs.h>
+#include <vnet/gso/gso.h>
 #include <vnet/devices/netlink.h>
 #include <vlibapi/api_helper_macros.h>
 #include <vnet/ipsec/ipsec_punt.h>
@@ -51,6 +53,12 @@ lcp_nl_table_t *lcp_nl_table_pool = NULL;
 
 uword *lcp_nl_table_db[FIB_PROTOCOL_MAX] = { NULL };
 
+#ifdef LCP_HAVE_VRF_SYNC
+/* VRF device if_index to table id, and back */
+static uword *lcp_nl_vrf_by_if_index;
+static uword *lcp_nl_vrf_by_table_id;
+#endif // LCP_HAVE_VRF_SYNC
+
 u32
 lcp_itf_num_pairs (void)
 {
@@ -59,13 +67,52 @@ lcp_itf_num_pairs (void)
 
 /**
  * DBs of interface-pair objects:
- *  - key'd by VIF (linux ID)
+ *  - key'd by namespace and VIF (linux ID), see lcp_itf_vif_key()
  *  - key'd by VPP's physical interface
  *  - number of shared uses of VPP's tap/host interface
  */
 static uword *lip_db_by_vif;
+static uword *lip_ns_ids; /* netns name -> id, for lcp_itf_vif_key() */
 index_t *lip_db_by_phy;
 u32 *lip_db_by_host;
+lcp_itf_fast_t *lcp_itf_fast_db;
+
+vlib_simple_counter_main_t lcp_punt_counters[LCP_PUNT_N_COUNTER] = {
+#define _(sym, str) [LCP_PUNT_COUNTER_##sym] = { .name = "linux-cp-" str },
+  foreach_lcp_punt_counter
+#undef _
+};
+
+vlib_combined_counter_main_t
+  lcp_itf_combined_counters[LCP_ITF_N_COMBINED_COUNTER] = {
+#define _(sym, str)                                                           \
+  [LCP_ITF_COUNTER_##sym] = { .name = "linux-cp-" str,                        \
+			      .stat_segment_name = "/lcp/if/" str },
+    foreach_lcp_itf_combined_counter
+#undef _
+  };
+
+vlib_simple_counter_main_t lcp_itf_simple_counters[LCP_ITF_N_SIMPLE_COUNTER] = {
+#define _(sym, str)                                                           \
+  [LCP_ITF_COUNTER_##sym] = { .name = "linux-cp-" str,                        \
+			      .stat_segment_name = "/lcp/if/" str },
+  foreach_lcp_itf_simple_counter
+#undef _
+};
+
+static const char *lcp_punt_class_names[LCP_PUNT_N_CLASS] = {
+#define _(sym, str) [LCP_PUNT_CLASS_##sym] = str,
+  foreach_lcp_punt_class
+#undef _
+};
+
+/**
+ * DBs of VPP's sub-interfaces, kept up to date by lcp_itf_interface_add_del:
+ *  - sw_if_index key'd by (hw_if_index, sub flags, outer vlan, inner vlan)
+ *  - bitmap of the sub-ids in use, by sup sw_if_index
+ */
+static uword *lcp_itf_sub_db_by_vlan;
+static uword **lcp_itf_subid_db;
 
 /**
  * vector of virtual function table
@@ -78,6 +125,82 @@ lcp_itf_pair_register_vft (lcp_itf_pair_vft_t *lcp_itf_vft)
   vec_add1 (lcp_itf_vfts, *lcp_itf_vft);
 }
 
+u8 *
+format_lcp_punt_class (u8 *s, va_list *args)
+{
+  lcp_punt_class_t pc = va_arg (*args, int);
+
+  if (pc >= LCP_PUNT_N_CLASS)
+    return format (s, "unknown-%d", pc);
+
+  return format (s, "%s", lcp_punt_class_names[pc]);
+}
+
+uword
+unformat_lcp_punt_class (unformat_input_t *input, va_list *args)
+{
+  lcp_punt_class_t *pc = va_arg (*args, lcp_punt_class_t *);
+  lcp_punt_class_t i;
+
+  for (i = 0; i < LCP_PUNT_N_CLASS; i++)
+    if (unformat (input, lcp_punt_class_names[i]))
+      {
+	*pc = i;
+	return 1;
+      }
+
+  return 0;
+}
+
+static u8 *
+format_lcp_itf_pair_punt (u8 *s, va_list *args)
+{
+  lcp_itf_pair_t *lip = va_arg (*args, lcp_itf_pair_t *);
+  lcp_punt_class_t pc;
+  u32 ci;
+
+  s = format (s, "punt (punted/policed):");
+  for (pc = 0; pc < LCP_PUNT_N_CLASS; pc++)
+    {
+      ci = lcp_punt_counter_index (lip->lip_phy_sw_if_index, pc);
+      s = format (
+	s, " %U %llu/%llu", format_lcp_punt_class, pc,
+	vlib_get_simple_counter (&lcp_punt_counters[LCP_PUNT_COUNTER_PUNTED],
+				 ci),
+	vlib_get_simple_counter (&lcp_punt_counters[LCP_PUNT_COUNTER_POLICED],
+				 ci));
+    }
+
+  return s;
+}
+
+static u8 *
+format_lcp_itf_pair_counters (u8 *s, va_list *args)
+{
+  lcp_itf_pair_t *lip = va_arg (*args, lcp_itf_pair_t *);
+  u32 phy = lip->lip_phy_sw_if_index;
+  vlib_counter_t to, from;
+
+  vlib_get_combined_counter (
+    &lcp_itf_combined_counters[LCP_ITF_COUNTER_TO_HOST], phy, &to);
+  vlib_get_combined_counter (
+    &lcp_itf_combined_counters[LCP_ITF_COUNTER_FROM_HOST], phy, &from);
+
+  s = format (
+    s,
+    "to-host %llu packets %llu bytes, from-host %llu packets %llu bytes, "
+    "adj hit/miss %llu/%llu, arp-mirrored %llu",
+    to.packets, to.bytes, from.packets, from.bytes,
+    vlib_get_simple_counter (&lcp_itf_simple_counters[LCP_ITF_COUNTER_ADJ_HIT],
+			     phy),
+    vlib_get_simple_counter (
+      &lcp_itf_simple_counters[LCP_ITF_COUNTER_ADJ_MISS], phy),
+    vlib_get_simple_counter (
+      &lcp_itf_simple_counters[LCP_ITF_COUNTER_ARP_MIRRORED], phy));
+
+  return s;
+}
+
 u8 *
 format_lcp_itf_pair (u8 *s, va_list *args)
 {
@@ -106,6 +229,15 @@ format_lcp_itf_pair (u8 *s, va_list *args)
   if (lip->lip_namespace)
     s = format (s, " netns %v", lip->lip_namespace);
 
+  if (lip->lip_tap_opts.num_queues)
+    s = format (s, " queues %u rx-ring %u tx-ring %u%s%s",
+		lip->lip_tap_opts.num_queues, lip->lip_tap_opts.rx_ring_sz,
+		lip->lip_tap_opts.tx_ring_sz,
+		(lip->lip_tap_opts.flags & LCP_ITF_TAP_F_GSO) ? " gso" : "",
+		(lip->lip_tap_opts.flags & LCP_ITF_TAP_F_CSUM_OFFLOAD) ?
+		  " csum-offload" :
+		  "");
+
   return s;
 }
 
@@ -120,7 +252,9 @@ lcp_itf_pair_walk_show_cb (index_t api, void *ctx)
     return WALK_STOP;
 
   vm = vlib_get_main ();
-  vlib_cli_output (vm, "%U\n", format_lcp_itf_pair, lip);
+  vlib_cli_output (vm, "%U\n  %U\n  %U\n", format_lcp_itf_pair, lip,
+		   format_lcp_itf_pair_punt, lip, format_lcp_itf_pair_counters,
+		   lip);
 
   return WALK_CONTINUE;
 }
@@ -129,6 +263,7 @@ void
 lcp_itf_pair_show (u32 phy_sw_if_index)
 {
   vlib_main_t *vm;
+  lcp_punt_class_t pc;
   u8 *ns;
   index_t api;
 
@@ -138,6 +273,16 @@ lcp_itf_pair_show (u32 phy_sw_if_index)
   vlib_cli_output (vm, "lcp lcp-auto-subint %s\n",
 		   lcp_auto_subint () ? "on" : "off");
   vlib_cli_output (vm, "lcp lcp-sync %s\n", lcp_sync () ? "on" : "off");
+  if (lcp_main.arp_mirror_rate)
+    vlib_cli_output (vm, "lcp arp-mirror-rate %u burst %u\n",
+		     lcp_main.arp_mirror_rate, lcp_main.arp_mirror_burst);
+  else
+    vlib_cli_output (vm, "lcp arp-mirror-rate off\n");
+  for (pc = 0; pc < LCP_PUNT_N_CLASS; pc++)
+    if (lcp_main.punt_rate[pc])
+      vlib_cli_output (vm, "lcp punt-rate %U %u burst %u\n",
+		       format_lcp_punt_class, pc, lcp_main.punt_rate[pc],
+		       lcp_main.punt_burst[pc]);
 
   if (phy_sw_if_index == ~0)
     {
@@ -160,12 +305,45 @@ lcp_itf_pair_get (u32 index)
   return pool_elt_at_index (lcp_itf_pair_pool, index);
 }
 
+/* Kernel ifindexes are only unique within a namespace. Namespace names
+ * are given small ids, which are never reused, to key the VIF DB with.
+ * No namespace is the default one.
+ */
+static u64
+lcp_itf_vif_key (u32 vif_index, const u8 *ns)
+{
+  uword *p;
+  u8 *name;
+
+  if (ns == 0 || ns[0] == 0)
+    ns = lcp_get_default_ns ();
+  if (ns == 0)
+    ns = (const u8 *) "";
+
+  if (!lip_ns_ids)
+    lip_ns_ids = hash_create_string (0, sizeof (uword));
+  if (!(p = hash_get_mem (lip_ns_ids, ns)))
+    {
+      name = format (0, "%s%c", ns, 0);
+      hash_set_mem (lip_ns_ids, name, hash_elts (lip_ns_ids));
+      p = hash_get_mem (lip_ns_ids, ns);
+    }
+
+  return ((u64) p[0] << 32 | vif_index);
+}
+
 index_t
 lcp_itf_pair_find_by_vif (u32 vif_index)
+{
+  return lcp_itf_pair_find_by_vif_ns (vif_index, NULL);
+}
+
+index_t
+lcp_itf_pair_find_by_vif_ns (u32 vif_index, const u8 *ns)
 {
   uword *p;
 
-  p = hash_get (lip_db_by_vif, vif_index);
+  p = hash_get (lip_db_by_vif, lcp_itf_vif_key (vif_index, ns));
 
   if (p)
     return p[0];
@@ -223,12 +401,330 @@ lcp_itf_set_adjs (lcp_itf_pair_t *lip)
   lip->lip_rewrite_len = adj->rewrite_header.data_bytes;
 }
 
-int
-lcp_itf_pair_add (u32 host_sw_if_index, u32 phy_sw_if_index, u8 *host_name,
-		  u32 host_index, lip_host_type_t host_type, u8 *ns)
+static void
+lcp_itf_fast_set (u32 sw_if_index, const lcp_itf_fast_t *src)
 {
-  index_t lipi;
+  lcp_itf_fast_t *f = &lcp_itf_fast_db[sw_if_index];
+
+  /* the workers look at the flags first, so they go last on the way in and
+   * first on the way out */
+  clib_atomic_store_rel_n (&f->flags, 0);
+  if (!src)
+    return;
+  f->peer_sw_if_index = src->peer_sw_if_index;
+  clib_memcpy (f->adj_index, src->adj_index, sizeof (f->adj_index));
+  f->rewrite_len = src->rewrite_len;
+  f->host_type = src->host_type;
+  clib_atomic_store_rel_n (&f->flags, src->flags);
+}
+
+/* Publish a pair to, or withdraw it from, the dataplane view */
+static void
+lcp_itf_fast_update (const lcp_itf_pair_t *lip, int is_add)
+{
+  lcp_itf_fast_t phy = {}, host = {};
+  lcp_punt_class_t pc;
+  u32 max, i;
+
+  max = clib_max (lip->lip_phy_sw_if_index, lip->lip_host_sw_if_index);
+  if (max >= vec_len (lcp_itf_fast_db))
+    {
+      /* the table moves, keep the workers out while it does. So do the
+       * punt and pair counters, which are sized along with it */
+      vlib_worker_thread_barrier_sync (vlib_get_main ());
+      vec_validate_aligned (lcp_itf_fast_db, max, CLIB_CACHE_LINE_BYTES);
+      for (i = 0; i < LCP_PUNT_N_COUNTER; i++)
+	vlib_validate_simple_counter (
+	  &lcp_punt_counters[i],
+	  lcp_punt_counter_index (max, LCP_PUNT_N_CLASS - 1));
+      for (i = 0; i < LCP_ITF_N_COMBINED_COUNTER; i++)
+	vlib_validate_combined_counter (&lcp_itf_combined_counters[i], max);
+      for (i = 0; i < LCP_ITF_N_SIMPLE_COUNTER; i++)
+	vlib_validate_simple_counter (&lcp_itf_simple_counters[i], max);
+      lcp_if_node_validate (max);
+      vlib_worker_thread_barrier_release (vlib_get_main ());
+    }
+
+  if (!is_add)
+    {
+      lcp_itf_fast_set (lip->lip_phy_sw_if_index, NULL);
+      lcp_itf_fast_set (lip->lip_host_sw_if_index, NULL);
+      return;
+    }
+
+  for (i = 0; i < LCP_PUNT_N_COUNTER; i++)
+    for (pc = 0; pc < LCP_PUNT_N_CLASS; pc++)
+      vlib_zero_simple_counter (
+	&lcp_punt_counters[i],
+	lcp_punt_counter_index (lip->lip_phy_sw_if_index, pc));
+  for (i = 0; i < LCP_ITF_N_COMBINED_COUNTER; i++)
+    vlib_zero_combined_counter (&lcp_itf_combined_counters[i],
+				lip->lip_phy_sw_if_index);
+  for (i = 0; i < LCP_ITF_N_SIMPLE_COUNTER; i++)
+    vlib_zero_simple_counter (&lcp_itf_simple_counters[i],
+			      lip->lip_phy_sw_if_index);
+
+  phy.peer_sw_if_index = lip->lip_host_sw_if_index;
+  phy.host_type = lip->lip_host_type;
+  phy.flags = LCP_ITF_FAST_F_PHY;
+
+  host.peer_sw_if_index = lip->lip_phy_sw_if_index;
+  host.adj_index[AF_IP4] = lip->lip_phy_adjs.adj_index[AF_IP4];
+  host.adj_index[AF_IP6] = lip->lip_phy_adjs.adj_index[AF_IP6];
+  host.rewrite_len = lip->lip_rewrite_len;
+  host.host_type = lip->lip_host_type;
+  host.flags = LCP_ITF_FAST_F_HOST;
+
+  lcp_itf_fast_set (lip->lip_phy_sw_if_index, &phy);
+  lcp_itf_fast_set (lip->lip_host_sw_if_index, &host);
+}
+
+/*
+ * Warm restart.
+ *
+ * With a state file configured, the host interfaces are created
+ * persistent, so that they and the VLAN links on them survive a restart
+ * of VPP. The file records the pairs. On start, the records are loaded by
+ * lcp_itf_pair_replace_begin(), and creating a pair whose host interface
+ * is recorded attaches to the surviving netdev instead of making a new
+ * one. lcp_itf_pair_replace_end() removes the netdevs whose pair was not
+ * created again, if they still have the recorded ifindex. The replace that
+ * lcp_itf_pair_init() begins is not ended automatically, VPP cannot tell
+ * when the startup config is done creating pairs: it has to end with
+ * 'lcp replace end'. Until then the stale pairs and records are kept.
+ */
+typedef struct lcp_itf_state_t_
+{
+  u8 *host_name;
+  u8 *netns;
+  u32 vif_index;
+  lip_host_type_t host_type;
+  u8 claimed; // a pair uses this host interface again
+} lcp_itf_state_t;
+
+static u8 *lcp_itf_state_file;
+static lcp_itf_state_t *lcp_itf_states;
+static uword *lcp_itf_state_db; // "netns:host-name" -> index in the above
+static u8 lcp_itf_state_replacing;
+static u8 lcp_itf_state_dirty;
+static vlib_node_registration_t lcp_itf_state_process_node;
+
+#define LCP_ITF_STATE_WRITE_DELAY 1.0 // seconds, to write a burst once
+
+static const char *
+lcp_itf_state_ns (const u8 *ns)
+{
+  return ((ns && ns[0]) ? (const char *) ns : "-");
+}
+
+static uword *
+lcp_itf_state_get (const u8 *host_name, const u8 *ns)
+{
+  uword *p;
+  u8 *key;
+
+  key = format (0, "%s:%s%c", lcp_itf_state_ns (ns), host_name, 0);
+  p = hash_get_mem (lcp_itf_state_db, key);
+  vec_free (key);
+
+  return (p);
+}
+
+static lcp_itf_state_t *
+lcp_itf_state_find (const u8 *host_name, const u8 *ns)
+{
+  uword *p = lcp_itf_state_get (host_name, ns);
+
+  return (p ? &lcp_itf_states[p[0]] : NULL);
+}
+
+static void
+lcp_itf_state_free (void)
+{
+  lcp_itf_state_t *st;
+  hash_pair_t *hp;
+  u8 **keys = NULL, **key;
+
+  hash_foreach_pair (hp, lcp_itf_state_db,
+		     ({ vec_add1 (keys, (u8 *) hp->key); }));
+  vec_foreach (key, keys)
+    vec_free (*key);
+  vec_free (keys);
+  hash_free (lcp_itf_state_db);
+
+  vec_foreach (st, lcp_itf_states)
+    {
+      vec_free (st->host_name);
+      vec_free (st->netns);
+    }
+  vec_free (lcp_itf_states);
+}
+
+static u8 *
+format_lcp_itf_state_line (u8 *s, va_list *args)
+{
+  lip_host_type_t host_type = va_arg (*args, int);
+  u32 vif_index = va_arg (*args, u32);
+  u8 *host_name = va_arg (*args, u8 *);
+  u8 *ns = va_arg (*args, u8 *);
+
+  return (format (s, "%s %u %s %s\n",
+		  host_type == LCP_ITF_HOST_TUN ? "tun" : "tap", vif_index,
+		  host_name, lcp_itf_state_ns (ns)));
+}
+
+/* Write all pairs, and while a replace is ongoing the records that have
+ * not been claimed yet, so that a restart in between loses nothing.
+ */
+static void
+lcp_itf_state_write (void)
+{
+  lcp_itf_state_t *st;
+  lcp_itf_pair_t *lip;
+  u8 *s = 0, *tmp;
+  int fd;
+
+  pool_foreach (lip, lcp_itf_pair_pool)
+    s = format (s, "%U", format_lcp_itf_state_line, lip->lip_host_type,
+		lip->lip_vif_index, lip->lip_host_name, lip->lip_namespace);
+  if (lcp_itf_state_replacing)
+    vec_foreach (st, lcp_itf_states)
+      if (!st->claimed)
+	s = format (s, "%U", format_lcp_itf_state_line, st->host_type,
+		    st->vif_index, st->host_name, st->netns);
+
+  tmp = format (0, "%s.tmp%c", lcp_itf_state_file, 0);
+  fd = open ((char *) tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || write (fd, s, vec_len (s)) != vec_len (s) || fsync (fd) < 0 ||
+      rename ((char *) tmp, (char *) lcp_itf_state_file) < 0)
+    LCP_IF_ERROR ("state_write: Cannot write %s: %s", lcp_itf_state_file,
+		  strerror (errno));
+  if (fd >= 0)
+    close (fd);
+
+  vec_free (tmp);
+  vec_free (s);
+}
+
+static void
+lcp_itf_state_changed (void)
+{
+  if (!lcp_itf_state_file || lcp_itf_state_dirty)
+    return;
+
+  lcp_itf_state_dirty = 1;
+  vlib_process_signal_event (vlib_get_main (),
+			     lcp_itf_state_process_node.index, 0, 0);
+}
+
+static uword
+lcp_itf_state_process (vlib_main_t *vm, vlib_node_runtime_t *node,
+		       vlib_frame_t *frame)
+{
+  while (1)
+    {
+      vlib_process_wait_for_event (vm);
+      vlib_process_get_events (vm, NULL);
+
+      vlib_process_suspend (vm, LCP_ITF_STATE_WRITE_DELAY);
+      lcp_itf_state_dirty = 0;
+      lcp_itf_state_write ();
+    }
+
+  return 0;
+}
+
+VLIB_REGISTER_NODE (lcp_itf_state_process_node, static) = {
+  .function = lcp_itf_state_process,
+  .name = "linux-cp-itf-state-process",
+  .type = VLIB_NODE_TYPE_PROCESS,
+};
+
+/* Load the records of the state file. Host interfaces that belong to a
+ * pair already are claimed right away.
+ */
+static void
+lcp_itf_state_load (void)
+{
+  unformat_input_t input;
+  u8 *contents = NULL, *host_name, *ns, *type, *key;
+  lcp_itf_state_t *st;
+  clib_error_t *err;
+  lcp_itf_pair_t *lip;
+  u32 vif_index;
+
+  lcp_itf_state_free ();
+  lcp_itf_state_db = hash_create_string (0, sizeof (uword));
+
+  err = clib_file_contents ((char *) lcp_itf_state_file, &contents);
+  if (err)
+    {
+      /* nothing to adopt on the first start */
+      LCP_IF_INFO ("state_load: %U", format_clib_error, err);
+      clib_error_free (err);
+      return;
+    }
+
+  unformat_init_vector (&input, contents);
+  while (unformat_check_input (&input) != UNFORMAT_END_OF_INPUT)
+    {
+      host_name = ns = type = NULL;
+      if (!unformat (&input, "%s %u %s %s", &type, &vif_index, &host_name,
+		     &ns))
+	{
+	  LCP_IF_ERROR ("state_load: %s: parse error `%U'", lcp_itf_state_file,
+			format_unformat_error, &input);
+	  vec_free (type);
+	  vec_free (host_name);
+	  vec_free (ns);
+	  break;
+	}
+
+      vec_add2 (lcp_itf_states, st, 1);
+      clib_memset (st, 0, sizeof (*st));
+      st->host_type =
+	strncmp ((char *) type, "tun", 3) ? LCP_ITF_HOST_TAP : LCP_ITF_HOST_TUN;
+      st->vif_index = vif_index;
+      st->host_name = host_name;
+      vec_add1 (st->host_name, 0);
+      if (vec_len (ns) != 1 || ns[0] != '-')
+	{
+	  st->netns = ns;
+	  vec_add1 (st->netns, 0);
+	}
+      else
+	vec_free (ns);
+      vec_free (type);
+
+      key = format (0, "%s:%s%c", lcp_itf_state_ns (st->netns),
+		    st->host_name, 0);
+      hash_set_mem (lcp_itf_state_db, key, st - lcp_itf_states);
+    }
+  unformat_free (&input);
+
+  pool_foreach (lip, lcp_itf_pair_pool)
+    {
+      st = lcp_itf_state_find (lip->lip_host_name, lip->lip_namespace);
+      if (st)
+	st->claimed = 1;
+    }
+
+  LCP_IF_NOTICE ("state_load: %u host interfaces in %s",
+		 vec_len (lcp_itf_states), lcp_itf_state_file);
+}
+
+/* Add a pair, with the options its host tap was created with if any. The
+ * pair is complete before anything can look it up. */
+static int
+lcp_itf_pair_add_opts (u32 host_sw_if_index, u32 phy_sw_if_index,
+		       u8 *host_name, u32 host_index,
+		       lip_host_type_t host_type, u8 *ns,
+		       const lcp_itf_tap_opts_t *tap_opts)
+{
+  vnet_sw_interface_t *sup;
+  index_t lipi, sup_lipi;
   lcp_itf_pair_t *lip;
+  u8 gso;
 
   lipi = lcp_itf_pair_find_by_phy (phy_sw_if_index);
 
@@ -262,7 +758,7 @@ lcp_itf_pair_add (u32 host_sw_if_index, u32 phy_sw_if_index, u8 *host_name,
   vec_validate_init_empty (lip_db_by_host, host_sw_if_index, INDEX_INVALID);
   lip_db_by_phy[phy_sw_if_index] = lipi;
   lip_db_by_host[host_sw_if_index] = lipi;
-  hash_set (lip_db_by_vif, host_index, lipi);
+  hash_set (lip_db_by_vif, lcp_itf_vif_key (host_index, ns), lipi);
 
   lip->lip_host_sw_if_index = host_sw_if_index;
   lip->lip_phy_sw_if_index = phy_sw_if_index;
@@ -270,6 +766,32 @@ lcp_itf_pair_add (u32 host_sw_if_index, u32 phy_sw_if_index, u8 *host_name,
   lip->lip_host_type = host_type;
   lip->lip_vif_index = host_index;
   lip->lip_namespace = vec_dup (ns);
+  lip->lip_flags = 0;
+  if (tap_opts)
+    lip->lip_tap_opts = *tap_opts;
+  else
+    clib_memset (&lip->lip_tap_opts, 0, sizeof (lip->lip_tap_opts));
+
+  /* what the host sends as one GSO packet is segmented on the way out of
+   * the phy, unless the phy can do it. Remember whether it is us who turned
+   * it on, to leave it as it was when the pair goes. The host of a
+   * sub-interface pair is a VLAN on the tap of its parent's pair, so it
+   * sends GSO packets if that tap does. */
+  gso = (lip->lip_tap_opts.flags & LCP_ITF_TAP_F_GSO) != 0;
+  sup = vnet_get_sup_sw_interface (vnet_get_main (), phy_sw_if_index);
+  if (!gso && sup->sw_if_index != phy_sw_if_index)
+    {
+      sup_lipi = lcp_itf_pair_find_by_phy (sup->sw_if_index);
+      gso = (sup_lipi != INDEX_INVALID &&
+	     (lcp_itf_pair_get (sup_lipi)->lip_tap_opts.flags &
+	      LCP_ITF_TAP_F_GSO));
+    }
+  if (gso &&
+      !vnet_feature_is_enabled ("ip4-output", "gso-ip4", phy_sw_if_index))
+    {
+      vnet_sw_interface_gso_enable_disable (phy_sw_if_index, 1);
+      lip->lip_flags |= LIP_FLAG_PHY_GSO;
+    }
 
   /*
    * First use of this host interface.
@@ -305,6 +827,7 @@ lcp_itf_pair_add (u32 host_sw_if_index, u32 phy_sw_if_index, u8 *host_name,
   vec_free (rpaths);
 
   lcp_itf_set_adjs (lip);
+  lcp_itf_fast_update (lip, 1 /* is_add */);
 
   /* enable ARP feature node for broadcast interfaces */
   if (lip->lip_host_type != LCP_ITF_HOST_TUN)
@@ -314,15 +837,15 @@ lcp_itf_pair_add (u32 host_sw_if_index, u32 phy_sw_if_index, u8 *host_name,
     vnet_feature_enable_disable("arp", "linux-cp-arp-host",
                                 lip->lip_host_sw_if_index, 1, NULL, 0);
     }
-  else
+
+  /* the punt arcs classify and police what is punted to any pair, they
+   * are on as long as there is one */
+  if (pool_elts (lcp_itf_pair_pool) == 1)
     {
-      if (hash_elts (lip_db_by_vif) == 1)
-	{
-	  vnet_feature_enable_disable ("ip4-punt", "linux-cp-punt-l3", 0, 1,
-				       NULL, 0);
-	  vnet_feature_enable_disable ("ip6-punt", "linux-cp-punt-l3", 0, 1,
-				       NULL, 0);
-	}
+      vnet_feature_enable_disable ("ip4-punt", "linux-cp-punt-l3", 0, 1, NULL,
+				   0);
+      vnet_feature_enable_disable ("ip6-punt", "linux-cp-punt-l3", 0, 1, NULL,
+				   0);
     }
 
   /* invoke registered callbacks for pair addition */
@@ -337,9 +860,25 @@ lcp_itf_pair_add (u32 host_sw_if_index, u32 phy_sw_if_index, u8 *host_name,
   /* set timestamp when pair entered service */
   lip->lip_create_ts = vlib_time_now (vlib_get_main ());
 
+  if (lcp_itf_state_replacing)
+    {
+      lcp_itf_state_t *st = lcp_itf_state_find (host_name, ns);
+      if (st)
+	st->claimed = 1;
+    }
+  lcp_itf_state_changed ();
+
   return 0;
 }
 
+int
+lcp_itf_pair_add (u32 host_sw_if_index, u32 phy_sw_if_index, u8 *host_name,
+		  u32 host_index, lip_host_type_t host_type, u8 *ns)
+{
+  return (lcp_itf_pair_add_opts (host_sw_if_index, phy_sw_if_index,
+				 host_name, host_index, host_type, ns, NULL));
+}
+
 static clib_error_t *
 lcp_netlink_add_link_vlan (int parent, u32 vlan, u16 proto, const char *name)
 {
@@ -429,11 +968,15 @@ lcp_itf_pair_del (u32 phy_sw_if_index)
 			     lcp_itf_l3_feat_names[lip->lip_host_type][af],
 			     lip->lip_host_sw_if_index, 0, NULL, 0);
 
+  lcp_itf_fast_update (lip, 0 /* is_add */);
   lcp_itf_unset_adjs (lip);
 
   ip4_punt_redirect_del (lip->lip_phy_sw_if_index);
   ip6_punt_redirect_del (lip->lip_phy_sw_if_index);
 
+  if (lip->lip_flags & LIP_FLAG_PHY_GSO)
+    vnet_sw_interface_gso_enable_disable (lip->lip_phy_sw_if_index, 0);
+
   /* disable ARP feature node for broadcast interfaces */
   if (lip->lip_host_type != LCP_ITF_HOST_TUN)
     {
@@ -442,28 +985,50 @@ lcp_itf_pair_del (u32 phy_sw_if_index)
     vnet_feature_enable_disable("arp", "linux-cp-arp-host",
                                 lip->lip_host_sw_if_index, 0, NULL, 0);
     }
-  else
+
+  /* the last pair goes, it is still in the pool */
+  if (pool_elts (lcp_itf_pair_pool) == 1)
     {
-      if (hash_elts (lip_db_by_vif) == 1)
-	{
-	  vnet_feature_enable_disable ("ip4-punt", "linux-cp-punt-l3", 0, 0,
-				       NULL, 0);
-	  vnet_feature_enable_disable ("ip6-punt", "linux-cp-punt-l3", 0, 0,
-				       NULL, 0);
-	}
+      vnet_feature_enable_disable ("ip4-punt", "linux-cp-punt-l3", 0, 0, NULL,
+				   0);
+      vnet_feature_enable_disable ("ip6-punt", "linux-cp-punt-l3", 0, 0, NULL,
+				   0);
     }
 
   lip_db_by_phy[phy_sw_if_index] = INDEX_INVALID;
   lip_db_by_host[lip->lip_host_sw_if_index] = INDEX_INVALID;
-  hash_unset (lip_db_by_vif, lip->lip_vif_index);
+  hash_unset (lip_db_by_vif,
+	      lcp_itf_vif_key (lip->lip_vif_index, lip->lip_namespace));
 
   vec_free (lip->lip_host_name);
   vec_free (lip->lip_namespace);
   pool_put (lcp_itf_pair_pool, lip);
 
+  lcp_itf_state_changed ();
+
   return 0;
 }
 
+/* Delete a link in Linux, in its namespace */
+static void
+lcp_itf_del_host_link (const u8 *host_name, u8 *ns)
+{
+  clib_error_t *err;
+  int prev_ns;
+
+  if ((prev_ns = lcp_ns_enter (ns)) == -1)
+    LCP_IF_WARN ("del_host_link: Unable to enter netns '%s'", ns);
+
+  err = lcp_netlink_del_link ((const char *) host_name);
+  if (err)
+    {
+      LCP_IF_DBG ("del_host_link: %U", format_clib_error, err);
+      clib_error_free (err);
+    }
+
+  lcp_ns_leave (prev_ns);
+}
+
 static void
 lcp_itf_pair_delete_by_index (index_t lipi)
 {
@@ -482,30 +1047,16 @@ lcp_itf_pair_delete_by_index (index_t lipi)
 
   if (vnet_sw_interface_is_sub (vnet_get_main (), host_sw_if_index))
     {
-      int curr_ns_fd = -1;
-      int vif_ns_fd = -1;
-      if (ns)
-	{
-	  curr_ns_fd = clib_netns_open (NULL /* self */);
-	  vif_ns_fd = clib_netns_open ((u8 *) ns);
-	  if (vif_ns_fd != -1)
-	    clib_setns (vif_ns_fd);
-	}
-
-      lcp_netlink_del_link ((const char *) host_name);
-      if (vif_ns_fd != -1)
-	close (vif_ns_fd);
-
-      if (curr_ns_fd != -1)
-	{
-	  clib_setns (curr_ns_fd);
-	  close (curr_ns_fd);
-	}
-
+      lcp_itf_del_host_link (host_name, (u8 *) ns);
       vnet_delete_sub_interface (host_sw_if_index);
     }
   else
-    tap_delete_if (vlib_get_main (), host_sw_if_index);
+    {
+      tap_delete_if (vlib_get_main (), host_sw_if_index);
+      /* a persistent TAP outlives its VPP interface */
+      if (lcp_itf_state_file)
+	lcp_itf_del_host_link (host_name, (u8 *) ns);
+    }
 
   vec_free (host_name);
   free (ns);
@@ -541,7 +1092,9 @@ lcp_itf_pair_walk (lcp_itf_pair_walk_cb_t cb, void *ctx)
 static clib_error_t *
 lcp_itf_pair_config (vlib_main_t *vm, unformat_input_t *input)
 {
+  lcp_punt_class_t pc;
   u8 *default_ns;
+  u32 rate, burst, val;
 
   default_ns = NULL;
 
@@ -561,6 +1114,28 @@ lcp_itf_pair_config (vlib_main_t *vm, unformat_input_t *input)
 	lcp_set_auto_subint (1 /* is_auto */);
       else if (unformat (input, "lcp-sync"))
 	lcp_set_sync (1 /* is_auto */);
+      else if (unformat (input, "state-file %s", &lcp_itf_state_file))
+	vec_add1 (lcp_itf_state_file, 0);
+      else if (unformat (input, "arp-mirror-rate %u burst %u", &rate, &burst))
+	lcp_set_arp_mirror_rate (rate, burst);
+      else if (unformat (input, "arp-mirror-rate %u", &rate))
+	lcp_set_arp_mirror_rate (rate, 0);
+      else if (unformat (input, "tap-num-queues %u", &val))
+	lcp_itf_tap_default_opts.num_queues = val;
+      else if (unformat (input, "tap-rx-ring-size %u", &val))
+	lcp_itf_tap_default_opts.rx_ring_sz = val;
+      else if (unformat (input, "tap-tx-ring-size %u", &val))
+	lcp_itf_tap_default_opts.tx_ring_sz = val;
+      else if (unformat (input, "tap-gso"))
+	lcp_itf_tap_default_opts.flags |= LCP_ITF_TAP_F_GSO;
+      else if (unformat (input, "tap-csum-offload"))
+	lcp_itf_tap_default_opts.flags |= LCP_ITF_TAP_F_CSUM_OFFLOAD;
+      else if (unformat (input, "punt-rate %U %u burst %u",
+			 unformat_lcp_punt_class, &pc, &rate, &burst))
+	lcp_set_punt_rate (pc, rate, burst);
+      else if (unformat (input, "punt-rate %U %u", unformat_lcp_punt_class,
+			 &pc, &rate))
+	lcp_set_punt_rate (pc, rate, 0);
       else
 	return clib_error_return (0, "unknown input `%U'",
 				  format_unformat_error, input);
@@ -614,20 +1189,9 @@ void
 lcp_itf_set_link_state (const lcp_itf_pair_t *lip, u8 state)
 {
   vnet_main_t *vnm = vnet_get_main ();
-  int curr_ns_fd, vif_ns_fd;
 
   if (!lip) return;
 
-  curr_ns_fd = vif_ns_fd = -1;
-
-  if (lip->lip_namespace)
-    {
-      curr_ns_fd = clib_netns_open (NULL /* self */);
-      vif_ns_fd = clib_netns_open (lip->lip_namespace);
-      if (vif_ns_fd != -1)
-	clib_setns (vif_ns_fd);
-    }
-
   /* Set the same link state on all three (TAP, sw, netlink)
    */
   if (state)
@@ -638,16 +1202,7 @@ lcp_itf_set_link_state (const lcp_itf_pair_t *lip, u8 state)
     {
       vnet_sw_interface_admin_down (vnm, lip->lip_phy_sw_if_index);
     }
-  vnet_netlink_set_link_state (lip->lip_vif_index, state);
-
-  if (vif_ns_fd != -1)
-    close (vif_ns_fd);
-
-  if (curr_ns_fd != -1)
-    {
-      clib_setns (curr_ns_fd);
-      close (curr_ns_fd);
-    }
+  lcp_itf_nl_set_link_state (lip, state);
 
   return;
 }
@@ -660,20 +1215,10 @@ lcp_itf_set_interface_addr (const lcp_itf_pair_t *lip)
   ip_lookup_main_t *lm4 = &im4->lookup_main;
   ip_lookup_main_t *lm6 = &im6->lookup_main;
   ip_interface_address_t *ia = 0;
-  int vif_ns_fd = -1;
-  int curr_ns_fd = -1;
 
   if (!lip)
     return;
 
-  if (lip->lip_namespace)
-    {
-      curr_ns_fd = clib_netns_open (NULL /* self */);
-      vif_ns_fd = clib_netns_open (lip->lip_namespace);
-      if (vif_ns_fd != -1)
-	clib_setns (vif_ns_fd);
-    }
-
   /* Sync any IP4 addressing info into LCP */
   foreach_ip_interface_address (
     lm4, ia, lip->lip_phy_sw_if_index, 1 /* honor unnumbered */, ({
@@ -681,7 +1226,8 @@ lcp_itf_set_interface_addr (const lcp_itf_pair_t *lip)
       LCP_IF_NOTICE ("set_interface_addr: %U add ip4 %U/%d",
 		     format_lcp_itf_pair, lip, format_ip4_address, r4,
 		     ia->address_length);
-      vnet_netlink_add_ip4_addr (lip->lip_vif_index, r4, ia->address_length);
+      lcp_itf_nl_add_del_ip4_addr (lip, r4, ia->address_length,
+				   0 /* is_del */);
     }));
 
   /* Sync any IP6 addressing info into LCP */
@@ -691,49 +1237,94 @@ lcp_itf_set_interface_addr (const lcp_itf_pair_t *lip)
       LCP_IF_NOTICE ("set_interface_addr: %U add ip6 %U/%d",
 		     format_lcp_itf_pair, lip, format_ip6_address, r6,
 		     ia->address_length);
-      vnet_netlink_add_ip6_addr (lip->lip_vif_index, r6, ia->address_length);
+      lcp_itf_nl_add_del_ip6_addr (lip, r6, ia->address_length,
+				   0 /* is_del */);
     }));
+}
 
-  if (vif_ns_fd != -1)
-    close (vif_ns_fd);
+/* The flags are those of sub.eth, so that 'dot1q 100', 'dot1q 100
+ * exact-match' and 'dot1q 100 inner-dot1q any' do not share a key */
+static uword
+lcp_itf_sub_vlan_key (u32 hw_if_index, u8 raw_flags, u16 outer_vlan,
+		      u16 inner_vlan)
+{
+  return (((u64) hw_if_index << 32) | ((u64) raw_flags << 24) |
+	  ((u64) (outer_vlan & 0xfff) << 12) | (inner_vlan & 0xfff));
+}
 
-  if (curr_ns_fd != -1)
-    {
-      clib_setns (curr_ns_fd);
-      close (curr_ns_fd);
-    }
+u32
+lcp_itf_sub_find_by_vlan (u32 hw_if_index, u16 outer_vlan, u16 inner_vlan,
+			  bool dot1ad)
+{
+  vnet_sw_interface_t sw = { 0 };
+  uword *p;
+
+  /* the only kind of sub-interface an LCP pair is created for */
+  sw.sub.eth.flags.exact_match = 1;
+  sw.sub.eth.flags.dot1ad = dot1ad;
+  if (inner_vlan)
+    sw.sub.eth.flags.two_tags = 1;
+  else
+    sw.sub.eth.flags.one_tag = 1;
+
+  p = hash_get (lcp_itf_sub_db_by_vlan,
+		lcp_itf_sub_vlan_key (hw_if_index, sw.sub.eth.raw_flags,
+				      outer_vlan, inner_vlan));
+  if (!p)
+    return INDEX_INVALID;
+
+  return (p[0]);
 }
 
-typedef struct
+int
+lcp_itf_sub_get_available_subid (u32 sup_sw_if_index, u32 *id)
 {
-  u32 vlan;
-  bool dot1ad;
+  uword *bm = NULL;
+  uword i;
 
-  u32 matched_sw_if_index;
-} lcp_itf_match_t;
+  if (sup_sw_if_index < vec_len (lcp_itf_subid_db))
+    bm = lcp_itf_subid_db[sup_sw_if_index];
 
-static walk_rc_t
-lcp_itf_pair_find_walk (vnet_main_t *vnm, u32 sw_if_index, void *arg)
+  /* sub-id 0 is never handed out */
+  i = clib_bitmap_next_clear (bm, 1);
+  if (i >= LCP_ITF_N_SUBIDS)
+    {
+      *id = -1;
+      return 1;
+    }
+
+  *id = i;
+  return 0;
+}
+
+static void
+lcp_itf_sub_db_add_del (vnet_main_t *vnm, u32 sw_if_index, u32 is_add)
 {
-  lcp_itf_match_t *match = arg;
   const vnet_sw_interface_t *sw;
+  uword key, *p;
 
-  sw = vnet_get_sw_interface (vnm, sw_if_index);
+  sw = vnet_get_sw_interface_or_null (vnm, sw_if_index);
+  if (!sw || sw->type != VNET_SW_INTERFACE_TYPE_SUB)
+    return;
 
-  if (sw && (sw->sub.eth.inner_vlan_id == 0) &&
-      (sw->sub.eth.outer_vlan_id == match->vlan) &&
-      (sw->sub.eth.flags.dot1ad == match->dot1ad))
+  if (sw->sub.id < LCP_ITF_N_SUBIDS)
     {
-      LCP_IF_DBG ("find_walk: found match outer %d dot1ad %d "
-		  "inner-dot1q %d: interface %U",
-		  sw->sub.eth.outer_vlan_id, sw->sub.eth.flags.dot1ad,
-		  sw->sub.eth.inner_vlan_id, format_vnet_sw_if_index_name,
-		  vnet_get_main (), sw->sw_if_index);
-      match->matched_sw_if_index = sw->sw_if_index;
-      return WALK_STOP;
+      vec_validate (lcp_itf_subid_db, sw->sup_sw_if_index);
+      lcp_itf_subid_db[sw->sup_sw_if_index] = clib_bitmap_set (
+	lcp_itf_subid_db[sw->sup_sw_if_index], sw->sub.id, is_add);
     }
 
-  return WALK_CONTINUE;
+  key = lcp_itf_sub_vlan_key (sw->hw_if_index, sw->sub.eth.raw_flags,
+			      sw->sub.eth.outer_vlan_id,
+			      sw->sub.eth.inner_vlan_id);
+  if (is_add)
+    hash_set (lcp_itf_sub_db_by_vlan, key, sw_if_index);
+  else
+    {
+      p = hash_get (lcp_itf_sub_db_by_vlan, key);
+      if (p && p[0] == sw_if_index)
+	hash_unset (lcp_itf_sub_db_by_vlan, key);
+    }
 }
 
 /* Return the index of the sub-int on the phy that has the given vlan and
@@ -742,33 +1333,107 @@ lcp_itf_pair_find_walk (vnet_main_t *vnm, u32 sw_if_index, void *arg)
 static index_t
 lcp_itf_pair_find_by_outer_vlan (u32 sup_if_index, u16 vlan, bool dot1ad)
 {
-  lcp_itf_match_t match;
   const vnet_hw_interface_t *hw;
+  u32 sw_if_index;
 
-  match.vlan = vlan;
-  match.dot1ad = dot1ad;
-  match.matched_sw_if_index = INDEX_INVALID;
   hw = vnet_get_sup_hw_interface (vnet_get_main (), sup_if_index);
+  sw_if_index = lcp_itf_sub_find_by_vlan (hw->hw_if_index, vlan, 0, dot1ad);
 
-  vnet_hw_interface_walk_sw (vnet_get_main (), hw->hw_if_index,
-			     lcp_itf_pair_find_walk, &match);
-
-  if (match.matched_sw_if_index >= vec_len (lip_db_by_phy))
+  if (sw_if_index >= vec_len (lip_db_by_phy))
     return INDEX_INVALID;
 
-  return lip_db_by_phy[match.matched_sw_if_index];
+  return lip_db_by_phy[sw_if_index];
 }
 
 static clib_error_t *lcp_itf_pair_link_up_down (vnet_main_t *vnm,
 						u32 hw_if_index, u32 flags);
 
+/* Options of the host taps of phys created without any, see
+ * lcp_itf_pair_config()
+ */
+static lcp_itf_tap_opts_t lcp_itf_tap_default_opts;
+
+#define LCP_ITF_TAP_RING_SZ_DEF 256
+
+static void
+lcp_itf_tap_opts_resolve (const lcp_itf_tap_opts_t *opts,
+			  lcp_itf_tap_opts_t *r)
+{
+  *r = lcp_itf_tap_default_opts;
+  if (opts)
+    {
+      if (opts->num_queues)
+	r->num_queues = opts->num_queues;
+      if (opts->rx_ring_sz)
+	r->rx_ring_sz = opts->rx_ring_sz;
+      if (opts->tx_ring_sz)
+	r->tx_ring_sz = opts->tx_ring_sz;
+      r->flags |= opts->flags;
+    }
+
+  if (!r->num_queues)
+    r->num_queues = clib_max (1, vlib_num_workers ());
+  if (!r->rx_ring_sz)
+    r->rx_ring_sz = LCP_ITF_TAP_RING_SZ_DEF;
+  if (!r->tx_ring_sz)
+    r->tx_ring_sz = LCP_ITF_TAP_RING_SZ_DEF;
+}
+
+/*
+ * Place the rx queues of a phy's host tap on the workers that poll the same
+ * rx queue of the phy, and round-robin the ones the phy does not have. The
+ * x-connect of what the host sends on a queue then runs on the worker that
+ * receives that queue's share of the phy's RSS, next to the punt path of
+ * the same flows.
+ */
+static void
+lcp_itf_tap_place_rx_queues (vnet_main_t *vnm, u32 tap_hw_if_index,
+			     u32 phy_hw_if_index)
+{
+  const vnet_hw_interface_t *tap_hw;
+  u32 qi, pqi, thread_index, i, n_workers;
+
+  n_workers = vlib_num_workers ();
+  if (!n_workers)
+    return;
+
+  tap_hw = vnet_get_hw_interface (vnm, tap_hw_if_index);
+  for (i = 0; i < vec_len (tap_hw->rx_queue_indices); i++)
+    {
+      qi = tap_hw->rx_queue_indices[i];
+      pqi = vnet_hw_if_get_rx_queue_index_by_id (
+	vnm, phy_hw_if_index, vnet_hw_if_get_rx_queue (vnm, qi)->queue_id);
+
+      if (pqi != ~0)
+	thread_index = vnet_hw_if_get_rx_queue (vnm, pqi)->thread_index;
+      else
+	thread_index = 1 + (i % n_workers);
+
+      vnet_hw_if_set_rx_queue_thread_index (vnm, qi, thread_index);
+    }
+
+  vnet_hw_if_update_runtime_data (vnm, tap_hw_if_index);
+}
+
 int
 lcp_itf_pair_create (u32 phy_sw_if_index, u8 *host_if_name,
 		     lip_host_type_t host_if_type, u8 *ns,
 		     u32 *host_sw_if_indexp)
+{
+  return (lcp_itf_pair_create_opts (phy_sw_if_index, host_if_name,
+				    host_if_type, ns, NULL,
+				    host_sw_if_indexp));
+}
+
+int
+lcp_itf_pair_create_opts (u32 phy_sw_if_index, u8 *host_if_name,
+			  lip_host_type_t host_if_type, u8 *ns,
+			  const lcp_itf_tap_opts_t *opts,
+			  u32 *host_sw_if_indexp)
 {
   vlib_main_t *vm;
   vnet_main_t *vnm;
+  lcp_itf_tap_opts_t tap_opts = {};
   u32 vif_index = 0, host_sw_if_index = ~0;
   const vnet_sw_interface_t *sw;
   const vnet_hw_interface_t *hw;
@@ -804,7 +1469,7 @@ lcp_itf_pair_create (u32 phy_sw_if_index, u8 *host_if_name,
   if (vnet_sw_interface_is_sub (vnm, phy_sw_if_index))
     {
       index_t parent_if_index;
-      int orig_ns_fd, vif_ns_fd;
+      int prev_ns, rv = 0;
       clib_error_t *err;
       u16 outer_vlan, inner_vlan;
       u16 outer_proto, inner_proto;
@@ -848,18 +1513,11 @@ lcp_itf_pair_create (u32 phy_sw_if_index, u8 *host_if_name,
       /*
        * see if the requested host interface has already been created
        */
-      orig_ns_fd = vif_ns_fd = -1;
       err = NULL;
 
-      if (ns && ns[0] != 0)
-	{
-	  orig_ns_fd = clib_netns_open (NULL /* self */);
-	  vif_ns_fd = clib_netns_open (ns);
-	  if (orig_ns_fd == -1 || vif_ns_fd == -1)
-	    goto socket_close;
-
-	  clib_setns (vif_ns_fd);
-	}
+      /* nothing to do when lcp_itf_pair_add_del_bulk() is there already */
+      if ((prev_ns = lcp_ns_enter (ns)) == -1)
+	return VNET_API_ERROR_INVALID_ARGUMENT;
 
       vif_index = if_nametoindex ((const char *) host_if_name);
 
@@ -893,14 +1551,16 @@ lcp_itf_pair_create (u32 phy_sw_if_index, u8 *host_if_name,
 								    "dot1q",
 				format_vnet_sw_if_index_name, vnet_get_main (),
 				hw->sw_if_index);
-		  return VNET_API_ERROR_INVALID_SW_IF_INDEX;
+		  rv = VNET_API_ERROR_INVALID_SW_IF_INDEX;
+		  goto leave_ns;
 		}
 	      llip = lcp_itf_pair_get (linux_parent_if_index);
 	      if (!llip)
 		{
 		  LCP_IF_ERROR ("pair_create: Cannot create LIP for a "
 				"sub-interface without a valid Linux parent");
-		  return VNET_API_ERROR_INVALID_ARGUMENT;
+		  rv = VNET_API_ERROR_INVALID_ARGUMENT;
+		  goto leave_ns;
 		}
 
 	      LCP_IF_DBG ("pair_create: linux parent %U", format_lcp_itf_pair,
@@ -945,34 +1605,43 @@ lcp_itf_pair_create (u32 phy_sw_if_index, u8 *host_if_name,
 	    lip->lip_host_sw_if_index);
 	}
 
-    socket_close:
-      if (orig_ns_fd != -1)
-	{
-	  clib_setns (orig_ns_fd);
-	  close (orig_ns_fd);
-	}
-      if (vif_ns_fd != -1)
-	close (vif_ns_fd);
-
       if (err)
-	return VNET_API_ERROR_INVALID_ARGUMENT;
+	rv = VNET_API_ERROR_INVALID_ARGUMENT;
+
+    leave_ns:
+      lcp_ns_leave (prev_ns);
+
+      if (rv)
+	return rv;
     }
   else
     {
       tap_create_if_args_t args = {
-	.num_rx_queues = 1,
-	.num_tx_queues = 1,
 	.id = hw->hw_if_index,
 	.sw_if_index = ~0,
-	.rx_ring_sz = 256,
-	.tx_ring_sz = 256,
 	.host_if_name = host_if_name,
 	.host_namespace = 0,
 	.rv = 0,
 	.error = NULL,
       };
       ethernet_interface_t *ei;
-      u32 host_sw_mtu_size;
+      u32 host_sw_mtu_size, phy_hw_if_index;
+
+      /* one tx queue per thread, so that none of them takes a lock to punt
+       * to the host */
+      lcp_itf_tap_opts_resolve (opts, &tap_opts);
+      args.num_rx_queues = tap_opts.num_queues;
+      args.num_tx_queues = clib_max (tap_opts.num_queues,
+				     vlib_get_n_threads ());
+      args.rx_ring_sz = tap_opts.rx_ring_sz;
+      args.tx_ring_sz = tap_opts.tx_ring_sz;
+      if (tap_opts.flags & LCP_ITF_TAP_F_GSO)
+	args.tap_flags |= TAP_FLAG_GSO;
+      if (tap_opts.flags & LCP_ITF_TAP_F_CSUM_OFFLOAD)
+	args.tap_flags |= TAP_FLAG_CSUM_OFFLOAD;
+      phy_hw_if_index = hw->hw_if_index;
+
+      const lcp_itf_state_t *st;
 
       if (host_if_type == LCP_ITF_HOST_TUN)
 	args.tap_flags |= TAP_FLAG_TUN;
@@ -1002,8 +1671,27 @@ lcp_itf_pair_create (u32 phy_sw_if_index, u8 *host_if_name,
       if (ns && ns[0] != 0)
 	args.host_namespace = ns;
 
+      /* keep the host interface across restarts of VPP, and adopt the one
+       * that survived the last restart, see lcp_itf_state_load() */
+      if (lcp_itf_state_file)
+	args.tap_flags |= TAP_FLAG_PERSIST;
+      st = lcp_itf_state_replacing ? lcp_itf_state_find (host_if_name, ns) :
+					   NULL;
+      if (st && st->host_type == host_if_type)
+	args.tap_flags |= TAP_FLAG_ATTACH;
+
       vm = vlib_get_main ();
       tap_create_if (vm, &args);
+      if (args.rv < 0 && (args.tap_flags & TAP_FLAG_ATTACH))
+	{
+	  LCP_IF_WARN ("pair_create: Cannot attach to TAP %s: retval:%d, "
+		       "creating it",
+		       host_if_name, args.rv);
+	  clib_error_free (args.error);
+	  args.tap_flags &= ~TAP_FLAG_ATTACH;
+	  args.rv = 0;
+	  tap_create_if (vm, &args);
+	}
       if (args.rv < 0)
 	{
 	  LCP_IF_ERROR ("pair_create: Cannot create TAP: retval:%d", args.rv);
@@ -1017,6 +1705,7 @@ lcp_itf_pair_create (u32 phy_sw_if_index, u8 *host_if_name,
        * get the hw and ethernet of the tap
        */
       hw = vnet_get_sup_hw_interface (vnm, args.sw_if_index);
+      lcp_itf_tap_place_rx_queues (vnm, hw->hw_if_index, phy_hw_if_index);
 
       virtio_main_t *mm = &virtio_main;
       virtio_if_t *vif = pool_elt_at_index (mm->interfaces, hw->dev_instance);
@@ -1044,8 +1733,9 @@ lcp_itf_pair_create (u32 phy_sw_if_index, u8 *host_if_name,
       return -1;
     }
 
-  lcp_itf_pair_add (host_sw_if_index, phy_sw_if_index, host_if_name, vif_index,
-		    host_if_type, ns);
+  lcp_itf_pair_add_opts (host_sw_if_index, phy_sw_if_index, host_if_name,
+			 vif_index, host_if_type, ns,
+			 tap_opts.num_queues ? &tap_opts : NULL);
 
   /*
    * Copy the link state from VPP into the host side, if lcp-sync is on.
@@ -1055,7 +1745,7 @@ lcp_itf_pair_create (u32 phy_sw_if_index, u8 *host_if_name,
   vnet_sw_interface_admin_up (vnm, host_sw_if_index);
   if (lcp_sync ())
     {
-      lip = lcp_itf_pair_get (lcp_itf_pair_find_by_vif (vif_index));
+      lip = lcp_itf_pair_get (lcp_itf_pair_find_by_vif_ns (vif_index, ns));
       lcp_itf_pair_sync_state (lip);
     }
   /*
@@ -1075,6 +1765,130 @@ lcp_itf_pair_create (u32 phy_sw_if_index, u8 *host_if_name,
   return 0;
 }
 
+static int
+lcp_itf_pair_bulk_depth (u32 sw_if_index)
+{
+  const vnet_sw_interface_t *sw;
+
+  sw = vnet_get_sw_interface_or_null (vnet_get_main (), sw_if_index);
+  if (!sw || sw->type != VNET_SW_INTERFACE_TYPE_SUB)
+    return 0;
+  return (sw->sub.eth.flags.two_tags ? 2 : 1);
+}
+
+static const char *
+lcp_itf_pair_bulk_ns (const lcp_itf_pair_bulk_t *b)
+{
+  if (b->netns && b->netns[0])
+    return ((const char *) b->netns);
+  if (lcp_get_default_ns ())
+    return ((const char *) lcp_get_default_ns ());
+  return ("");
+}
+
+static lcp_itf_pair_bulk_t *lcp_itf_pair_bulk_sort_items;
+
+/* Deletes first, children before their parents. Then adds: phys, which
+ * create their TAP, and then sub-interfaces grouped by namespace, parents
+ * before their children.
+ */
+static int
+lcp_itf_pair_bulk_cmp (void *a1, void *a2)
+{
+  lcp_itf_pair_bulk_t *b1, *b2;
+  int d1, d2, rv;
+
+  b1 = &lcp_itf_pair_bulk_sort_items[*(u32 *) a1];
+  b2 = &lcp_itf_pair_bulk_sort_items[*(u32 *) a2];
+
+  if (b1->is_add != b2->is_add)
+    return ((int) b1->is_add - (int) b2->is_add);
+
+  d1 = lcp_itf_pair_bulk_depth (b1->phy_sw_if_index);
+  d2 = lcp_itf_pair_bulk_depth (b2->phy_sw_if_index);
+  if (!b1->is_add)
+    return (d2 - d1);
+
+  if (!d1 != !d2)
+    return (d1 - d2);
+  if (d1 && (rv = strcmp (lcp_itf_pair_bulk_ns (b1), lcp_itf_pair_bulk_ns (b2))))
+    return (rv);
+  if (d1 != d2)
+    return (d1 - d2);
+
+  /* keep the caller's order otherwise */
+  return ((int) (b1 - b2));
+}
+
+int
+lcp_itf_pair_add_del_bulk (lcp_itf_pair_bulk_t *items)
+{
+  lcp_itf_pair_bulk_t *b;
+  u32 *order = NULL, *i;
+  int prev_ns = -1, ns_rv;
+  const char *ns;
+  int n_errors = 0;
+
+  vec_foreach (b, items)
+    {
+      b->rv = 0;
+      b->host_sw_if_index = ~0;
+      vec_add1 (order, b - items);
+    }
+
+  lcp_itf_pair_bulk_sort_items = items;
+  vec_sort_with_function (order, lcp_itf_pair_bulk_cmp);
+  lcp_itf_pair_bulk_sort_items = NULL;
+
+  LCP_IF_NOTICE ("pair_bulk: %u pairs", vec_len (items));
+
+  vec_foreach (i, order)
+    {
+      b = &items[*i];
+
+      if (!b->is_add)
+	{
+	  b->rv = lcp_itf_pair_delete (b->phy_sw_if_index);
+	  goto next;
+	}
+
+      /* Sub-interfaces only need a VLAN link in their namespace. Enter it
+       * once for all the sub-interfaces that go there. */
+      if (lcp_itf_pair_bulk_depth (b->phy_sw_if_index))
+	{
+	  ns = lcp_itf_pair_bulk_ns (b);
+	  if ((ns_rv = lcp_ns_enter ((const u8 *) ns)) == -1)
+	    {
+	      LCP_IF_ERROR ("pair_bulk: Cannot enter netns '%s'", ns);
+	      b->rv = VNET_API_ERROR_INVALID_ARGUMENT;
+	      goto next;
+	    }
+	  if (prev_ns == -1)
+	    prev_ns = ns_rv;
+	}
+
+      b->rv = lcp_itf_pair_create (b->phy_sw_if_index, b->host_if_name,
+				   b->host_if_type, b->netns,
+				   &b->host_sw_if_index);
+
+    next:
+      if (b->rv)
+	{
+	  LCP_IF_WARN ("pair_bulk: %s %U failed: %d",
+		       b->is_add ? "add" : "del", format_vnet_sw_if_index_name,
+		       vnet_get_main (), b->phy_sw_if_index, b->rv);
+	  n_errors++;
+	}
+    }
+
+  lcp_ns_leave (prev_ns);
+  vec_free (order);
+
+  /* The state of the new pairs is synced into Linux by the sync process
+   * in one go, see lcp_itf_pair_sync_state(). */
+  return (n_errors);
+}
+
 static walk_rc_t
 lcp_itf_pair_walk_mark (index_t lipi, void *ctx)
 {
@@ -1092,9 +1906,56 @@ lcp_itf_pair_replace_begin (void)
 {
   lcp_itf_pair_walk (lcp_itf_pair_walk_mark, NULL);
 
+  if (lcp_itf_state_file)
+    {
+      lcp_itf_state_load ();
+      lcp_itf_state_replacing = 1;
+    }
+
   return (0);
 }
 
+/* Remove the host interfaces that no pair claimed during the replace. A
+ * name that has another ifindex than the recorded one is not the netdev
+ * VPP left behind, it is not ours to delete. */
+static void
+lcp_itf_state_sweep (void)
+{
+  lcp_itf_state_t *st;
+  u32 ifindex;
+  int prev_ns;
+
+  vec_foreach (st, lcp_itf_states)
+    {
+      if (st->claimed)
+	continue;
+
+      if ((prev_ns = lcp_ns_enter (st->netns)) == -1)
+	{
+	  LCP_IF_WARN ("state_sweep: Unable to enter netns '%s'",
+		       lcp_itf_state_ns (st->netns));
+	  continue;
+	}
+      ifindex = if_nametoindex ((char *) st->host_name);
+      lcp_ns_leave (prev_ns);
+      if (ifindex != st->vif_index)
+	{
+	  if (ifindex)
+	    LCP_IF_NOTICE ("state_sweep: Keeping host interface %s netns %s, "
+			   "ifindex %u is not the recorded %u",
+			   st->host_name, lcp_itf_state_ns (st->netns),
+			   ifindex, st->vif_index);
+	  continue;
+	}
+
+      LCP_IF_NOTICE ("state_sweep: Deleting stale host interface %s netns %s",
+		     st->host_name, lcp_itf_state_ns (st->netns));
+
+      /* VLAN links go with their TAP, don't mind if they are gone */
+      lcp_itf_del_host_link (st->host_name, st->netns);
+    }
+}
+
 typedef struct lcp_itf_pair_sweep_ctx_t_
 {
   index_t *indicies;
@@ -1127,6 +1988,14 @@ lcp_itf_pair_replace_end (void)
   vec_foreach (lipi, ctx.indicies)
     lcp_itf_pair_delete_by_index (*lipi);
 
+  if (lcp_itf_state_replacing)
+    {
+      lcp_itf_state_sweep ();
+      lcp_itf_state_free ();
+      lcp_itf_state_replacing = 0;
+      lcp_itf_state_changed ();
+    }
+
   vec_free (ctx.indicies);
   return (0);
 }
@@ -1143,6 +2012,8 @@ lcp_itf_interface_add_del (vnet_main_t *vnm, u32 sw_if_index, u32 is_add)
     /* remove any interface pair we have for this interface */
     lcp_itf_pair_delete (sw_if_index);
 
+  lcp_itf_sub_db_add_del (vnm, sw_if_index, is_add);
+
   return (NULL);
 }
 
@@ -1202,9 +2073,21 @@ lcp_itf_pair_init (vlib_main_t *vm)
   tcp_punt_unknown (vm, 0, 1);
   tcp_punt_unknown (vm, 1, 1);
 
+  /* the pairs created by the startup config adopt their host interfaces,
+   * until the operator runs 'lcp replace end', see lcp_itf_state_t */
+  if (lcp_itf_state_file)
+    {
+      lcp_itf_pair_replace_begin ();
+      LCP_IF_NOTICE ("pair_init: Adopting host interfaces from %s until "
+		     "'lcp replace end'",
+		     lcp_itf_state_file);
+    }
+
   return NULL;
 }
 
+/* id is the VPP table id, which tells the namespaces apart, see
+ * lcp_nl_table_k2f() */
 lcp_nl_table_t *
 lcp_nl_table_find (uint32_t id, fib_protocol_t fproto)
 {
@@ -1219,17 +2102,46 @@ lcp_nl_table_find (uint32_t id, fib_protocol_t fproto)
 }
 
 #ifdef LCP_HAVE_VRF_SYNC
-lcp_nl_table_t *
-lcp_nl_table_find_by_if_index (u32 if_index)
+/* Both ifindexes and VRF devices are per namespace, the keys are made the
+ * same way as those of the VIF DB */
+void
+lcp_nl_vrf_add (const u8 *ns, u32 if_index, u32 table_id)
 {
-  lcp_nl_table_t *nlt;
+  hash_set (lcp_nl_vrf_by_if_index, lcp_itf_vif_key (if_index, ns),
+	    table_id);
+  hash_set (lcp_nl_vrf_by_table_id, lcp_itf_vif_key (table_id, ns),
+	    if_index);
+}
 
-  pool_foreach (nlt, lcp_nl_table_pool)
-    {
-      if (nlt->nlt_proto == FIB_PROTOCOL_IP4 && nlt->nlt_if_index == if_index)
-        return nlt;
-    }
-  return NULL;
+void
+lcp_nl_vrf_del (const u8 *ns, u32 if_index)
+{
+  uword *p;
+
+  p = hash_get (lcp_nl_vrf_by_if_index, lcp_itf_vif_key (if_index, ns));
+  if (!p)
+    return;
+
+  hash_unset (lcp_nl_vrf_by_table_id, lcp_itf_vif_key (p[0], ns));
+  hash_unset (lcp_nl_vrf_by_if_index, lcp_itf_vif_key (if_index, ns));
+}
+
+u32
+lcp_nl_vrf_find_table_id (const u8 *ns, u32 if_index)
+{
+  uword *p;
+
+  p = hash_get (lcp_nl_vrf_by_if_index, lcp_itf_vif_key (if_index, ns));
+  return p ? p[0] : ~0;
+}
+
+u32
+lcp_nl_vrf_find_if_index (const u8 *ns, u32 table_id)
+{
+  uword *p;
+
+  p = hash_get (lcp_nl_vrf_by_table_id, lcp_itf_vif_key (table_id, ns));
+  return p ? p[0] : ~0;
 }
 
 clib_error_t *
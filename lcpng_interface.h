@@ -33,7 +33,9 @@ extern vlib_log_class_t lcp_itf_pair_logger;
 
 #define LCP_IF_ERROR(...) vlib_log_err (lcp_itf_pair_logger, __VA_ARGS__);
 
-#define foreach_lcp_itf_pair_flag _ (STALE, 0, "stale")
+#define foreach_lcp_itf_pair_flag                                             \
+  _ (STALE, 0, "stale")                                                       \
+  _ (PHY_GSO, 1, "phy-gso") /* GSO enabled on the phy for the host */
 
 typedef enum lip_flag_t_
 {
@@ -55,6 +57,22 @@ typedef struct lcp_itf_phy_adj
   adj_index_t adj_index[N_AF];
 } lcp_itf_phy_adj_t;
 
+/**
+ * Options of the host TAP (or TUN) of a phy, see lcp_itf_pair_create_opts().
+ * Fields left 0 take the defaults set in the lcpng startup section, and the
+ * flags add to the default ones.
+ */
+#define LCP_ITF_TAP_F_GSO	   (1 << 0)
+#define LCP_ITF_TAP_F_CSUM_OFFLOAD (1 << 1)
+
+typedef struct lcp_itf_tap_opts_t_
+{
+  u16 num_queues; /* rx queues, 0 for one per worker */
+  u16 rx_ring_sz;
+  u16 tx_ring_sz;
+  u8 flags; /* LCP_ITF_TAP_F_* */
+} lcp_itf_tap_opts_t;
+
 /**
  * A pair of interfaces
  */
@@ -70,6 +88,7 @@ typedef struct lcp_itf_pair_t_
   lip_flag_t lip_flags;		  /* Flags */
   u8 lip_rewrite_len;		  /* The length of an L2 MAC rewrite */
   f64 lip_create_ts;		  /* Timestamp of creation */
+  lcp_itf_tap_opts_t lip_tap_opts; /* Options of the host tap, phys only */
 } lcp_itf_pair_t;
 extern lcp_itf_pair_t *lcp_itf_pair_pool;
 
@@ -78,9 +97,11 @@ typedef struct lcp_nl_table_t_
   uint32_t nlt_id;
   fib_protocol_t nlt_proto;
   u32 nlt_fib_index;
-  u32 nlt_mfib_index;
-  u32 nlt_refs;
-  u32 nlt_if_index;
+  u32 nlt_mfib_index; /* ~0 until the first multicast use */
+  u32 nlt_refs;	      /* interfaces bound to the table */
+  u32 nlt_n_mroutes;  /* multicast routes in the mfib */
+  u8 nlt_gc_pending;
+  f64 nlt_create_ts;
 } lcp_nl_table_t;
 extern lcp_nl_table_t *lcp_nl_table_pool;
 
@@ -100,10 +121,12 @@ extern lcp_itf_pair_t *lcp_itf_pair_get (index_t index);
 /**
  * Find a interface-pair object from the host interface
  *
- * @param host_sw_if_index host interface
+ * @param vif_index kernel ifindex of the host interface
+ * @param ns namespace of the host interface, NULL for the default one
  * @return VPP's object index
  */
 extern index_t lcp_itf_pair_find_by_vif (u32 vif_index);
+extern index_t lcp_itf_pair_find_by_vif_ns (u32 vif_index, const u8 *ns);
 
 /**
  * Create an interface-pair
@@ -124,11 +147,63 @@ extern int lcp_itf_pair_create (u32 phy_sw_if_index, u8 *host_if_name,
 				lip_host_type_t host_if_type, u8 *ns,
 				u32 *host_sw_if_indexp);
 
+/**
+ * Create an interface-pair, with options for the host tap of a phy.
+ * opts may be NULL for the defaults, and is ignored for sub-interfaces,
+ * which share their parent's tap.
+ *
+ * @return error code
+ */
+extern int lcp_itf_pair_create_opts (u32 phy_sw_if_index, u8 *host_if_name,
+				     lip_host_type_t host_if_type, u8 *ns,
+				     const lcp_itf_tap_opts_t *opts,
+				     u32 *host_sw_if_indexp);
+
 /**
  * Delete a LCP_ITF_PAIR
  */
 extern int lcp_itf_pair_delete (u32 phy_sw_if_index);
 
+/**
+ * One pair of a bulk add/delete, see lcp_itf_pair_add_del_bulk()
+ */
+typedef struct lcp_itf_pair_bulk_t_
+{
+  u8 is_add;
+  u32 phy_sw_if_index;
+  u8 *host_if_name; // adds only, NUL terminated
+  lip_host_type_t host_if_type;
+  u8 *netns; // adds only, NUL terminated, NULL for the default netns
+  /* results */
+  int rv;
+  u32 host_sw_if_index;
+} lcp_itf_pair_bulk_t;
+
+/**
+ * Create and delete a vector of interface-pairs in one go. The phys are
+ * created first, then the sub-interfaces, entering each namespace once.
+ *
+ * @return number of pairs that failed, see rv of each item
+ */
+extern int lcp_itf_pair_add_del_bulk (lcp_itf_pair_bulk_t *items);
+
+/**
+ * Find VPP's exact-match sub-interface on a hardware interface by its tags.
+ *
+ * @param inner_vlan 0 for a single-tagged sub-interface
+ * @return sw_if_index, or INDEX_INVALID if there is none
+ */
+extern u32 lcp_itf_sub_find_by_vlan (u32 hw_if_index, u16 outer_vlan,
+				     u16 inner_vlan, bool dot1ad);
+
+/**
+ * Get the lowest sub-id that is not in use on an interface.
+ *
+ * @return 0 on success, 1 if all of them are taken
+ */
+#define LCP_ITF_N_SUBIDS 4096
+extern int lcp_itf_sub_get_available_subid (u32 sup_sw_if_index, u32 *id);
+
 /**
  * Callback function invoked during a walk of all interface-pairs
  */
@@ -145,6 +220,42 @@ extern void lcp_itf_pair_walk (lcp_itf_pair_walk_cb_t cb, void *ctx);
 extern int lcp_itf_pair_replace_begin (void);
 extern int lcp_itf_pair_replace_end (void);
 
+/**
+ * Dataplane view of the pairs, a dense table by sw_if_index of either side.
+ * The nodes read this instead of the pool, so that the cache lines they
+ * pull in hold only what they use. It is kept in step with the pool by
+ * lcp_itf_pair_add() and lcp_itf_pair_del().
+ */
+typedef struct lcp_itf_fast_t_
+{
+  u32 peer_sw_if_index;		/* sw_if_index of the other side */
+  adj_index_t adj_index[N_AF];	/* host side only, see lip_phy_adjs */
+  u8 flags;			/* LCP_ITF_FAST_F_*, written last */
+  u8 rewrite_len;		/* host side only, see lip_rewrite_len */
+  u8 host_type;			/* lip_host_type_t */
+  u8 __pad;
+} lcp_itf_fast_t;
+
+STATIC_ASSERT_SIZEOF (lcp_itf_fast_t, 16);
+
+#define LCP_ITF_FAST_F_PHY  (1 << 0)
+#define LCP_ITF_FAST_F_HOST (1 << 1)
+
+extern lcp_itf_fast_t *lcp_itf_fast_db;
+
+always_inline const lcp_itf_fast_t *
+lcp_itf_fast_find (u32 sw_if_index, u8 side)
+{
+  const lcp_itf_fast_t *f;
+
+  if (sw_if_index >= vec_len (lcp_itf_fast_db))
+    return NULL;
+  f = &lcp_itf_fast_db[sw_if_index];
+  if (PREDICT_FALSE (!(clib_atomic_load_acq_n (&f->flags) & side)))
+    return NULL;
+  return f;
+}
+
 /**
  * Retreive the pair in the DP
  */
@@ -179,6 +290,86 @@ int lcp_auto_subint (void);
 void lcp_set_sync (u8 is_auto);
 int lcp_sync (void);
 
+/**
+ * cap the ARP replies linux-cp-arp-phy mirrors to the host, rate 0 lifts
+ * the cap and burst 0 defaults to one second worth of replies
+ */
+void lcp_set_arp_mirror_rate (u32 rate, u32 burst);
+
+/**
+ * police a class of the traffic punted to the host, per pair. rate 0 lifts
+ * the limit and burst 0 defaults to one second worth of packets
+ */
+void lcp_set_punt_rate (lcp_punt_class_t pc, u32 rate, u32 burst);
+uword unformat_lcp_punt_class (unformat_input_t *input, va_list *args);
+u8 *format_lcp_punt_class (u8 *s, va_list *args);
+
+/**
+ * Per pair and class punt counters, indexed by the phy's sw_if_index and
+ * the class, see lcp_punt_counter_index()
+ */
+#define foreach_lcp_punt_counter                                              \
+  _ (PUNTED, "punted")                                                        \
+  _ (POLICED, "policed")
+
+typedef enum lcp_punt_counter_t_
+{
+#define _(sym, str) LCP_PUNT_COUNTER_##sym,
+  foreach_lcp_punt_counter
+#undef _
+    LCP_PUNT_N_COUNTER,
+} lcp_punt_counter_t;
+
+extern vlib_simple_counter_main_t lcp_punt_counters[LCP_PUNT_N_COUNTER];
+
+always_inline u32
+lcp_punt_counter_index (u32 phy_sw_if_index, lcp_punt_class_t pc)
+{
+  return (phy_sw_if_index * LCP_PUNT_N_CLASS + pc);
+}
+
+/**
+ * Per pair dataplane counters, indexed by the phy's sw_if_index: what the
+ * host is sent and what it sends, whether the x-connect found the
+ * adjacency of a rewrite or fell back to the phy's, and the ARP replies
+ * mirrored to the host.
+ */
+#define foreach_lcp_itf_combined_counter                                      \
+  _ (TO_HOST, "to-host")                                                      \
+  _ (FROM_HOST, "from-host")
+
+typedef enum lcp_itf_combined_counter_t_
+{
+#define _(sym, str) LCP_ITF_COUNTER_##sym,
+  foreach_lcp_itf_combined_counter
+#undef _
+    LCP_ITF_N_COMBINED_COUNTER,
+} lcp_itf_combined_counter_t;
+
+#define foreach_lcp_itf_simple_counter                                        \
+  _ (ADJ_HIT, "adj-hit")                                                      \
+  _ (ADJ_MISS, "adj-miss")                                                    \
+  _ (ARP_MIRRORED, "arp-mirrored")
+
+typedef enum lcp_itf_simple_counter_t_
+{
+#define _(sym, str) LCP_ITF_COUNTER_##sym,
+  foreach_lcp_itf_simple_counter
+#undef _
+    LCP_ITF_N_SIMPLE_COUNTER,
+} lcp_itf_simple_counter_t;
+
+extern vlib_combined_counter_main_t
+  lcp_itf_combined_counters[LCP_ITF_N_COMBINED_COUNTER];
+extern vlib_simple_counter_main_t
+  lcp_itf_simple_counters[LCP_ITF_N_SIMPLE_COUNTER];
+
+/**
+ * Size the per thread state of the nodes for sw_if_indices up to max. The
+ * nodes do not allocate, this is called with the workers stopped.
+ */
+void lcp_if_node_validate (u32 max_sw_if_index);
+
 clib_error_t *lcp_netlink_del_link (const char *name);
 
 typedef void (*lcp_itf_pair_add_cb_t) (lcp_itf_pair_t *);
@@ -198,12 +389,29 @@ void lcp_itf_set_link_state (const lcp_itf_pair_t *lip, u8 state);
 /* Set any VPP L3 addresses on Linux host device */
 void lcp_itf_set_interface_addr (const lcp_itf_pair_t *lip);
 
+/* Netlink requests for the Linux host device of a pair. They are sent
+ * over a socket in the pair's namespace without waiting for the kernel's
+ * ACK, failures are logged. See lcpng_if_sync.c.
+ */
+void lcp_itf_nl_set_link_state (const lcp_itf_pair_t *lip, u8 state);
+void lcp_itf_nl_set_link_mtu (const lcp_itf_pair_t *lip, u32 mtu);
+void lcp_itf_nl_set_link_master (const lcp_itf_pair_t *lip,
+				 u32 master_ifindex);
+void lcp_itf_nl_add_del_ip4_addr (const lcp_itf_pair_t *lip,
+				  ip4_address_t *addr, u8 pfx_len, int is_del);
+void lcp_itf_nl_add_del_ip6_addr (const lcp_itf_pair_t *lip,
+				  ip6_address_t *addr, u8 pfx_len, int is_del);
+
 /* Sync all state from VPP to a specific Linux device, all sub-interfaces
  * of a hardware interface, or all interfaces in the system.
  *
  * Note: in some circumstances, this syncer will (have to) make changes to
  * the VPP interface, for example if its MTU is greater than its parent.
  * See the function for rationale.
+ *
+ * The sync is deferred: these mark the pairs dirty, and the
+ * linux-cp-itf-sync-process node applies them shortly after, parents
+ * before their sub-interfaces, in one burst of netlink requests.
  */
 void lcp_itf_pair_sync_state (lcp_itf_pair_t *lip);
 void lcp_itf_pair_sync_state_hw (vnet_hw_interface_t *hi);
@@ -212,7 +420,15 @@ void lcp_itf_pair_sync_state_all ();
 lcp_nl_table_t *lcp_nl_table_find (uint32_t id, fib_protocol_t fproto);
 
 #ifdef LCP_HAVE_VRF_SYNC
-lcp_nl_table_t *lcp_nl_table_find_by_if_index (u32 if_index);
+/*
+ * The table of each linux VRF device, by namespace and ifindex. The
+ * lcp_nl_table_t of a VRF is only created once an interface is enslaved to
+ * it or a route is added to it.
+ */
+void lcp_nl_vrf_add (const u8 *ns, u32 if_index, u32 table_id);
+void lcp_nl_vrf_del (const u8 *ns, u32 if_index);
+u32 lcp_nl_vrf_find_table_id (const u8 *ns, u32 if_index);
+u32 lcp_nl_vrf_find_if_index (const u8 *ns, u32 table_id);
 clib_error_t *lcp_netlink_add_link_vrf (u32 table_id, const char *name);
 #endif // LCP_HAVE_VRF_SYNC
 
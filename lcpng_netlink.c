@@ -16,6 +16,9 @@
 #define _GNU_SOURCE
 #include <sched.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
 
 #include <netlink/route/rule.h>
 #include <netlink/msg.h>
@@ -26,6 +29,7 @@
 #include <netlink/route/route.h>
 #include <netlink/route/neighbour.h>
 #include <netlink/route/addr.h>
+#include <netlink/route/rtnl.h>
 
 #include <vlib/vlib.h>
 #include <vlib/unix/unix.h>
@@ -40,8 +44,12 @@
 #include <plugins/lcpng/lcpng_netlink.h>
 #include <plugins/lcpng/lcpng_interface.h>
 
-static void lcp_nl_open_socket (u8 *ns);
-static void lcp_nl_close_socket (void);
+static void lcp_nl_open_socket (lcp_nl_netlink_namespace_t *nlns);
+static void lcp_nl_close_socket (lcp_nl_netlink_namespace_t *nlns);
+static void lcp_nl_resync_begin (void);
+static void lcp_nl_resync_next (lcp_nl_netlink_namespace_t *nlns, u32 id);
+static int lcp_nl_callback (struct nl_msg *msg, void *arg);
+static void lcp_nl_decoders_wakeup (lcp_nl_netlink_namespace_t *nlns);
 
 lcp_nl_main_t lcp_nl_main = {
   .rx_buf_size = NL_RX_BUF_SIZE_DEF,
@@ -49,8 +57,203 @@ lcp_nl_main_t lcp_nl_main = {
   .batch_size = NL_BATCH_SIZE_DEF,
   .batch_work_ms = NL_BATCH_WORK_MS_DEF,
   .batch_delay_ms = NL_BATCH_DELAY_MS_DEF,
+  .batch_barrier_ms = NL_BATCH_BARRIER_MS_DEF,
+  .ring_size = NL_RING_SIZE_DEF,
+  .reader_cpu = ~0,
+  .nl_ns_current = ~0,
+  .record_fd = -1,
+  .hists = {
+#define _(sym, str)                                                           \
+  [LCP_NL_HIST_##sym] = { .name = "linux-cp-nl-" str,                         \
+			  .stat_segment_name = "/lcp/nl/" str },
+    foreach_lcp_nl_hist
+#undef _
+  },
+  .msg_counters = {
+#define _(sym, str)                                                           \
+  [LCP_NL_MSG_COUNTER_##sym] = { .name = "linux-cp-nl-" str,                  \
+				 .stat_segment_name = "/lcp/nl/msgs/" str },
+    foreach_lcp_nl_msg_counter
+#undef _
+  },
+  .ns_gauges = {
+#define _(sym, str)                                                           \
+  [LCP_NL_NS_GAUGE_##sym] = { .name = "linux-cp-nl-" str,                     \
+			      .stat_segment_name = "/lcp/nl/" str },
+    foreach_lcp_nl_ns_gauge
+#undef _
+  },
 };
 
+static const char *lcp_nl_hist_names[LCP_NL_N_HIST] = {
+#define _(sym, str) [LCP_NL_HIST_##sym] = str,
+  foreach_lcp_nl_hist
+#undef _
+};
+
+static const char *lcp_nl_msg_counter_names[LCP_NL_N_MSG_COUNTER] = {
+#define _(sym, str) [LCP_NL_MSG_COUNTER_##sym] = str,
+  foreach_lcp_nl_msg_counter
+#undef _
+};
+
+/*
+ * Statistics.
+ *
+ * Everything is exported to the stats segment as simple counters, which
+ * are only ever touched from the main thread: the message counters are
+ * indexed by RTM type, the histograms by bucket and the queue gauges by
+ * namespace.
+ */
+static void
+lcp_nl_stats_init (void)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  int i;
+
+  for (i = 0; i < LCP_NL_N_HIST; i++)
+    vlib_validate_simple_counter (&nm->hists[i], NL_HIST_N_BUCKETS - 1);
+  for (i = 0; i < LCP_NL_N_MSG_COUNTER; i++)
+    vlib_validate_simple_counter (&nm->msg_counters[i], RTM_MAX);
+}
+
+static_always_inline void
+lcp_nl_hist_add (lcp_nl_hist_t h, f64 secs)
+{
+  u64 usecs = secs > 0 ? (u64) (1e6 * secs) : 0;
+  u32 bucket = usecs ? min_log2 (usecs) : 0;
+
+  if (bucket >= NL_HIST_N_BUCKETS)
+    bucket = NL_HIST_N_BUCKETS - 1;
+  vlib_increment_simple_counter (&lcp_nl_main.hists[h], 0, bucket, 1);
+}
+
+static_always_inline void
+lcp_nl_msg_count (lcp_nl_msg_counter_t c, u32 type)
+{
+  vlib_increment_simple_counter (&lcp_nl_main.msg_counters[c], 0,
+				 clib_min (type, RTM_MAX), 1);
+}
+
+static void
+lcp_nl_ns_gauges_update (lcp_nl_netlink_namespace_t *nlns)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+
+  vlib_set_simple_counter (&nm->ns_gauges[LCP_NL_NS_GAUGE_QUEUE_DEPTH], 0,
+			   nlns->index,
+			   clib_atomic_load_acq_n (&nlns->nl_msg_tail) -
+			     nlns->nl_msg_head);
+  vlib_set_simple_counter (&nm->ns_gauges[LCP_NL_NS_GAUGE_QUEUE_HWM], 0,
+			   nlns->index, nlns->nl_msg_hwm);
+}
+
+/* Pairs created without a namespace are in the default one, and the
+ * default namespace may be 'self' */
+static const u8 *
+lcp_nl_ns_name (const u8 *ns)
+{
+  if (ns == 0 || ns[0] == 0)
+    ns = lcp_get_default_ns ();
+  return ns ? ns : (const u8 *) "";
+}
+
+static lcp_nl_netlink_namespace_t *
+lcp_nl_ns_get (u32 index)
+{
+  return lcp_nl_main.nl_ns_pool[index];
+}
+
+static lcp_nl_netlink_namespace_t *
+lcp_nl_ns_find (const u8 *ns)
+{
+  uword *p = hash_get_mem (lcp_nl_main.nl_ns_by_name, lcp_nl_ns_name (ns));
+
+  return p ? lcp_nl_ns_get (p[0]) : NULL;
+}
+
+static lcp_nl_netlink_namespace_t *
+lcp_nl_ns_find_or_create (const u8 *ns)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  lcp_nl_netlink_namespace_t *nlns, **nlnsp;
+  uword *p;
+  int i;
+
+  if ((nlns = lcp_nl_ns_find (ns)))
+    return nlns;
+
+  nlns = clib_mem_alloc_aligned (sizeof (*nlns), CLIB_CACHE_LINE_BYTES);
+  clib_memset (nlns, 0, sizeof (*nlns));
+  pool_get (nm->nl_ns_pool, nlnsp);
+  *nlnsp = nlns;
+
+  nlns->index = nlnsp - nm->nl_ns_pool;
+  nlns->netns_name = format (0, "%s%c", lcp_nl_ns_name (ns), 0);
+  p = nm->nl_ns_weights ? hash_get_mem (nm->nl_ns_weights, nlns->netns_name) :
+			  NULL;
+  nlns->weight = p ? p[0] : 1;
+  /* the default namespace keeps the kernel's table ids, the others get a
+   * range of their own unless one is configured */
+  p = nm->nl_ns_table_bases ?
+	hash_get_mem (nm->nl_ns_table_bases, nlns->netns_name) :
+	NULL;
+  if (p)
+    nlns->table_base = p[0];
+  else if (strcmp ((char *) nlns->netns_name, (char *) lcp_nl_ns_name (0)))
+    nlns->table_base = (nlns->index + 1) * LCP_NL_NS_TABLE_STRIDE;
+  nlns->clib_file_index = ~0;
+  nlns->reader_file_index = ~0;
+  nlns->reader_efd = -1;
+  nlns->reader_space_efd = -1;
+  /* for the decoder threads of every reader thread of the namespace */
+  pthread_mutex_init (&nlns->decode_lock, NULL);
+  pthread_cond_init (&nlns->decode_cond, NULL);
+  mhash_init (&nlns->nl_coalesce_db, sizeof (u64),
+	      sizeof (lcp_nl_coalesce_key_t));
+  hash_set_mem (nm->nl_ns_by_name, nlns->netns_name, nlns->index);
+
+  for (i = 0; i < LCP_NL_N_NS_GAUGE; i++)
+    vlib_validate_simple_counter (&nm->ns_gauges[i], nlns->index);
+
+  return nlns;
+}
+
+/* Kernel ifindexes are only unique within a namespace */
+const u8 *
+lcp_nl_ns_current_name (void)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+
+  if (nm->nl_ns_current == ~0)
+    return NULL;
+  return lcp_nl_ns_index_name (nm->nl_ns_current);
+}
+
+const u8 *
+lcp_nl_ns_index_name (u32 ns_index)
+{
+  return lcp_nl_ns_get (ns_index)->netns_name;
+}
+
+/* So are the kernel's table ids, see lcp_nl_table_k2f() */
+u32
+lcp_nl_ns_current_table_base (void)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+
+  if (nm->nl_ns_current == ~0)
+    return 0;
+  return lcp_nl_ns_get (nm->nl_ns_current)->table_base;
+}
+
+lcp_itf_pair_t *
+lcp_nl_lip_find_by_vif (u32 vif_index)
+{
+  return lcp_itf_pair_get (
+    lcp_itf_pair_find_by_vif_ns (vif_index, lcp_nl_ns_current_name ()));
+}
+
 u8 *
 format_nl_object (u8 *s, va_list *args)
 {
@@ -207,8 +410,9 @@ format_nl_object (u8 *s, va_list *args)
 static void
 lcp_nl_dispatch (struct nl_object *obj, void *arg)
 {
-  /* Here is where we'll sync the netlink messages into VPP */
-  vlib_worker_thread_barrier_sync (vlib_get_main ());
+  /* Here is where we'll sync the netlink messages into VPP. The caller,
+   * lcp_nl_process_msgs(), holds the worker barrier for us.
+   */
   switch (nl_object_get_msgtype (obj))
     {
     case RTM_NEWNEIGH:
@@ -236,20 +440,323 @@ lcp_nl_dispatch (struct nl_object *obj, void *arg)
       lcp_nl_route_del ((struct rtnl_route *) obj);
       break;
     default:
+      ((nl_msg_info_t *) arg)->flags |= NL_MSG_F_IGNORED;
       LCP_NL_WARN ("dispatch: Ignored %U", format_nl_object, obj);
       break;
     }
-  vlib_worker_thread_barrier_release (vlib_get_main ());
 }
 
+/*
+ * Route messages make up most of the netlink traffic during a full table
+ * load, so they are decoded straight from the netlink message instead of
+ * going through nl_msg_parse(), which allocates a libnl route object, its
+ * nexthops and addresses for each of them. Returns 0 if the message was
+ * handled, and -1 if it is to be given to libnl instead.
+ */
+static int
+lcp_nl_dispatch_raw (nl_msg_info_t *msg_info)
+{
+  struct nlmsghdr *hdr = nlmsg_hdr (msg_info->msg);
+
+  switch (hdr->nlmsg_type)
+    {
+    case RTM_NEWROUTE:
+    case RTM_DELROUTE:
+      return lcp_nl_route_raw (hdr);
+    case RTM_NEWNEXTHOP:
+    case RTM_DELNEXTHOP:
+      lcp_nl_route_flush ();
+      return lcp_nl_nexthop_raw (hdr);
+    default:
+      return -1;
+    }
+}
+
+static void
+lcp_nl_barrier_sync (vlib_main_t *vm, f64 *barrier_start)
+{
+  vlib_worker_thread_barrier_sync (vm);
+  *barrier_start = vlib_time_now (vm);
+}
+
+static void
+lcp_nl_barrier_release (vlib_main_t *vm, f64 barrier_start)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  f64 held = vlib_time_now (vm) - barrier_start;
+
+  vlib_worker_thread_barrier_release (vm);
+
+  lcp_nl_hist_add (LCP_NL_HIST_BARRIER, held);
+  nm->barrier_n_holds++;
+  nm->barrier_hold_total += held;
+  if (held > nm->barrier_hold_max)
+    nm->barrier_hold_max = held;
+}
+
+static_always_inline nl_msg_info_t *
+lcp_nl_msg_at (lcp_nl_netlink_namespace_t *nlns, u64 seq)
+{
+  return (nlns->nl_msg_queue + (seq & (vec_len (nlns->nl_msg_queue) - 1)));
+}
+
+static_always_inline u64
+lcp_nl_queue_len (lcp_nl_netlink_namespace_t *nlns)
+{
+  return (clib_atomic_load_acq_n (&nlns->nl_msg_tail) - nlns->nl_msg_head);
+}
+
+/* Slots the producer may not write to, processed or not */
+static_always_inline u64
+lcp_nl_queue_used (lcp_nl_netlink_namespace_t *nlns)
+{
+  return (clib_atomic_load_acq_n (&nlns->nl_msg_tail) -
+	  nlns->nl_msg_released);
+}
+
+/*
+ * Coalescing of queued netlink messages.
+ *
+ * A route or neighbor that flaps while messages are waiting in the queue
+ * shows up as a sequence of add/del messages for the same key. Only the
+ * latest one is needed to bring VPP in line with the kernel, as long as it
+ * fully defines the state of its key:
+ *  - an IPv4 RTM_NEWROUTE replaces all paths of the prefix,
+ *    (fib_table_entry_update), an IPv4 RTM_DELROUTE only removes paths;
+ *  - an IPv6 RTM_DELROUTE removes the prefix (fib_table_entry_delete), an
+ *    IPv6 RTM_NEWROUTE only appends paths;
+ *  - an RTM_DELNEIGH, or an RTM_NEWNEIGH with a valid lladdr, replaces
+ *    the neighbor.
+ * Such a message elides all earlier queued messages with the same key, so
+ * that N updates of a flapping prefix cost one FIB operation. A route
+ * message only does if it will be applied: one with no path through a pair
+ * installs or removes nothing, and what the messages it would elide did to
+ * VPP would stay, see lcp_nl_route_raw_applies(). The pairs are taken as
+ * they are when the batch is scanned.
+ *
+ * Messages are numbered by their position in the queue, and each keyed
+ * message links to the previous queued message with the same key.
+ */
+static int
+lcp_nl_coalesce_mk_key (struct nlmsghdr *hdr, lcp_nl_coalesce_key_t *key,
+			u8 *defines_state)
+{
+  struct nlattr *na;
+
+  clib_memset (key, 0, sizeof (*key));
+
+  switch (hdr->nlmsg_type)
+    {
+    case RTM_NEWROUTE:
+    case RTM_DELROUTE:
+      {
+	struct rtmsg *rtm;
+	u32 table_id;
+
+	if (!nlmsg_valid_hdr (hdr, sizeof (*rtm)))
+	  return 0;
+	rtm = nlmsg_data (hdr);
+
+	/* Only unicast (and blackhole/unreachable/prohibit) routes from
+	 * protocols that lcp_nl_route_add() does not skip */
+	if (rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6)
+	  return 0;
+	if (rtm->rtm_type != RTN_UNICAST && rtm->rtm_type != RTN_BLACKHOLE &&
+	    rtm->rtm_type != RTN_UNREACHABLE && rtm->rtm_type != RTN_PROHIBIT)
+	  return 0;
+	if (rtm->rtm_protocol == RTPROT_KERNEL || rtm->rtm_src_len != 0)
+	  return 0;
+
+	table_id = rtm->rtm_table;
+	if ((na = nlmsg_find_attr (hdr, sizeof (*rtm), RTA_TABLE)))
+	  table_id = nla_get_u32 (na);
+	if (table_id == RT_TABLE_LOCAL)
+	  return 0;
+
+	if ((na = nlmsg_find_attr (hdr, sizeof (*rtm), RTA_DST)))
+	  clib_memcpy (&key->addr, nla_data (na),
+		       clib_min (nla_len (na), sizeof (key->addr)));
+
+	if (rtm->rtm_family == AF_INET6 &&
+	    (ip6_address_is_multicast (&key->addr.ip6) ||
+	     ip6_address_is_link_local_unicast (&key->addr.ip6)))
+	  return 0;
+
+	key->kind = LCP_NL_COALESCE_ROUTE;
+	key->family = rtm->rtm_family;
+	key->plen = rtm->rtm_dst_len;
+	key->proto = rtm->rtm_protocol;
+	key->id = table_id;
+
+	if (rtm->rtm_family == AF_INET)
+	  *defines_state = (hdr->nlmsg_type == RTM_NEWROUTE);
+	else
+	  *defines_state = (hdr->nlmsg_type == RTM_DELROUTE);
+	if (*defines_state)
+	  *defines_state = lcp_nl_route_raw_applies (hdr);
+	return 1;
+      }
+
+    case RTM_NEWNEIGH:
+    case RTM_DELNEIGH:
+      {
+	struct ndmsg *ndm;
+
+	if (!nlmsg_valid_hdr (hdr, sizeof (*ndm)))
+	  return 0;
+	ndm = nlmsg_data (hdr);
+
+	if (ndm->ndm_family != AF_INET && ndm->ndm_family != AF_INET6)
+	  return 0;
+	if (!(na = nlmsg_find_attr (hdr, sizeof (*ndm), NDA_DST)))
+	  return 0;
+	clib_memcpy (&key->addr, nla_data (na),
+		     clib_min (nla_len (na), sizeof (key->addr)));
+
+	key->kind = LCP_NL_COALESCE_NEIGH;
+	key->family = ndm->ndm_family;
+	key->id = ndm->ndm_ifindex;
+
+	*defines_state =
+	  (hdr->nlmsg_type == RTM_DELNEIGH) ||
+	  ((ndm->ndm_state & NUD_VALID) &&
+	   nlmsg_find_attr (hdr, sizeof (*ndm), NDA_LLADDR) != NULL);
+	return 1;
+      }
+    }
+
+  return 0;
+}
+
+static void
+lcp_nl_coalesce (lcp_nl_netlink_namespace_t *nlns, u64 tail)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  nl_msg_info_t *msg_info, *prev;
+  u64 seq, prev_seq;
+  u8 defines_state;
+  uword *p;
+
+  for (seq = nlns->nl_msg_scanned; seq < tail; seq++)
+    {
+      msg_info = lcp_nl_msg_at (nlns, seq);
+      defines_state = 0;
+
+      if (!msg_info->msg)
+	continue;
+      if (!lcp_nl_coalesce_mk_key (nlmsg_hdr (msg_info->msg),
+				   &msg_info->coalesce_key, &defines_state))
+	continue;
+
+      p = mhash_get (&nlns->nl_coalesce_db, &msg_info->coalesce_key);
+      msg_info->coalesce_prev = p ? p[0] : ~0ULL;
+      msg_info->flags |= NL_MSG_F_KEYED;
+      mhash_set (&nlns->nl_coalesce_db, &msg_info->coalesce_key, seq, NULL);
+
+      if (!defines_state)
+	continue;
+
+      /* elide everything still queued for this key */
+      prev_seq = msg_info->coalesce_prev;
+      while (prev_seq != ~0ULL && prev_seq >= nlns->nl_msg_head)
+	{
+	  prev = lcp_nl_msg_at (nlns, prev_seq);
+	  if (prev->flags & NL_MSG_F_ELIDED)
+	    break;
+	  prev->flags |= NL_MSG_F_ELIDED;
+	  nm->n_elided++;
+	  prev_seq = prev->coalesce_prev;
+	}
+    }
+
+  nlns->nl_msg_scanned = tail;
+}
+
+/* Called for every message leaving the head of the queue. Returns 1 if the
+ * message was elided and must not be dispatched.
+ */
+static int
+lcp_nl_coalesce_retire (lcp_nl_netlink_namespace_t *nlns,
+			nl_msg_info_t *msg_info, u64 seq)
+{
+  lcp_nl_coalesce_key_t *key = &msg_info->coalesce_key;
+  uword *p;
+
+  if (!(msg_info->flags & NL_MSG_F_KEYED))
+    return 0;
+
+  p = mhash_get (&nlns->nl_coalesce_db, key);
+  if (p && p[0] == seq)
+    mhash_unset (&nlns->nl_coalesce_db, key, NULL);
+
+  return (msg_info->flags & NL_MSG_F_ELIDED) ? 1 : 0;
+}
+
+/* Append a message to the recording. The buffer is written out after each
+ * batch, see lcp_nl_record_flush(). */
+static void
+lcp_nl_record (nl_msg_info_t *msg_info)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  struct nlmsghdr *hdr = nlmsg_hdr (msg_info->msg);
+  lcp_nl_record_msg_t *rec;
+  u8 *p;
+
+  vec_add2 (nm->record_buf, p, sizeof (*rec) + hdr->nlmsg_len);
+  rec = (lcp_nl_record_msg_t *) p;
+  rec->ts = msg_info->ts;
+  rec->len = hdr->nlmsg_len;
+  rec->pad = 0;
+  clib_memcpy_fast (rec + 1, hdr, hdr->nlmsg_len);
+  nm->record_n_msgs++;
+}
+
+static void
+lcp_nl_record_flush (void)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+
+  if (nm->record_fd < 0 || !vec_len (nm->record_buf))
+    return;
+
+  if (write (nm->record_fd, nm->record_buf, vec_len (nm->record_buf)) !=
+      vec_len (nm->record_buf))
+    {
+      LCP_NL_ERROR ("record_flush: Unable to write recording, stopping: %s",
+		    strerror (errno));
+      close (nm->record_fd);
+      nm->record_fd = -1;
+    }
+  vec_reset_length (nm->record_buf);
+}
+
+static lcp_nl_route_op_t *
+lcp_nl_decode_claim (lcp_nl_netlink_namespace_t *nlns, u64 seq,
+		     nl_msg_info_t *msg_info);
+static void lcp_nl_queue_release (lcp_nl_netlink_namespace_t *nlns);
+
 static int
-lcp_nl_process_msgs (void)
+lcp_nl_process_msgs (lcp_nl_netlink_namespace_t *nlns, u32 max_msgs,
+		     u32 max_ms)
 {
   lcp_nl_main_t *nm = &lcp_nl_main;
+  vlib_main_t *vm = vlib_get_main ();
   nl_msg_info_t *msg_info;
-  int err, n_msgs = 0;
-  f64 start = vlib_time_now (vlib_get_main ());
-  u64 usecs = 0;
+  lcp_nl_route_op_t *op;
+  lcp_nl_msg_counter_t counter;
+  int err, n_msgs = 0, n_holds = 0, n_elided = 0;
+  u32 type;
+  f64 start = vlib_time_now (vm), now, barrier_start = 0;
+  u8 have_barrier = 0, in_dump = (nlns->resync_step != 0), unchanged;
+  u64 usecs = 0, seq, tail;
+
+  tail = clib_atomic_load_acq_n (&nlns->nl_msg_tail);
+  if (tail == nlns->nl_msg_head)
+    return 0;
+
+  /* the namespace's pairs are looked up while coalescing */
+  nm->nl_ns_current = nlns->index;
+  lcp_nl_coalesce (nlns, tail);
 
   /* To avoid loops where VPP->LCP sync fights with LCP->VPP
    * sync, we turn off the former if it's enabled, while we consume
@@ -260,219 +767,1289 @@ lcp_nl_process_msgs (void)
   u8 old_lcp_sync = lcpm->lcp_sync;
   lcpm->lcp_sync = 0;
 
-  /* process a batch of messages. break if we hit our batch_size
-   * count limit or batch_work_ms time limit.
+  /* process a batch of messages. break if we hit our max_msgs count limit
+   * or max_ms time limit, this namespace's share of batch_size and
+   * batch_work_ms.
    *
    * We do this, because netlink messages will continue to be sourced
    * by the kernel, and we need to periodically read them before they
    * overflow the netlink socket size. So, only consume a few messages
    * before returning to allow lcp_nl_callback() to read more onto the
    * queue.
+   *
+   * The worker barrier is taken once for the batch rather than once per
+   * netlink object. If the batch runs longer than batch_barrier_ms, the
+   * barrier is released and re-taken, so that workers get to drain their
+   * rx queues in between.
    */
-  vec_foreach (msg_info, nm->nl_ns.nl_msg_queue)
+  for (seq = nlns->nl_msg_head; seq < tail; seq++)
     {
-      if ((err = nl_msg_parse (msg_info->msg, lcp_nl_dispatch, msg_info)) < 0)
-	LCP_NL_ERROR ("process_msgs: Unable to parse object: %s",
-		      nl_geterror (err));
-      nlmsg_free (msg_info->msg);
+      msg_info = lcp_nl_msg_at (nlns, seq);
+      op = lcp_nl_decode_claim (nlns, seq, msg_info);
+
+      /* The barrier is only taken for a message that changes something:
+       * an elided message of any kind, and neighbor churn, leave the
+       * workers alone.
+       */
+      unchanged = 0;
+      if (msg_info->msg && !(msg_info->flags & NL_MSG_F_ELIDED))
+	unchanged = lcp_nl_neigh_raw_unchanged (nlmsg_hdr (msg_info->msg));
+      if (!have_barrier && !unchanged &&
+	  !(msg_info->flags & NL_MSG_F_ELIDED))
+	{
+	  lcp_nl_barrier_sync (vm, &barrier_start);
+	  have_barrier = 1;
+	  n_holds++;
+	}
+
+      /* Routes may be held back by lcp_nl_route_raw() to be merged with
+       * the next message, they are flushed before anything else is
+       * applied */
+      if (msg_info->flags & NL_MSG_F_DUMP_DONE)
+	{
+	  lcp_nl_route_flush ();
+	  lcp_nl_resync_next (nlns, msg_info->dump_id);
+	}
+      else
+	{
+	  if (PREDICT_FALSE (nm->record_fd >= 0))
+	    lcp_nl_record (msg_info);
+
+	  type = nlmsg_hdr (msg_info->msg)->nlmsg_type;
+	  counter = LCP_NL_MSG_COUNTER_APPLIED;
+	  lcp_nl_msg_count (LCP_NL_MSG_COUNTER_RECEIVED, type);
+	  lcp_nl_hist_add (LCP_NL_HIST_QUEUE_LATENCY,
+			   vlib_time_now (vm) - msg_info->ts);
+
+	  if (lcp_nl_coalesce_retire (nlns, msg_info, seq))
+	    {
+	      counter = LCP_NL_MSG_COUNTER_ELIDED;
+	      n_elided++;
+	    }
+	  else if (unchanged)
+	    counter = LCP_NL_MSG_COUNTER_UNCHANGED;
+	  else if (op)
+	    lcp_nl_route_op_raw (op);
+	  else if (lcp_nl_dispatch_raw (msg_info) < 0)
+	    {
+	      lcp_nl_route_flush ();
+	      if ((err = nl_msg_parse (msg_info->msg, lcp_nl_dispatch,
+				       msg_info)) < 0)
+		{
+		  LCP_NL_ERROR ("process_msgs: Unable to parse object: %s",
+				nl_geterror (err));
+		  counter = LCP_NL_MSG_COUNTER_FAILED;
+		}
+	      else if (msg_info->flags & NL_MSG_F_IGNORED)
+		counter = LCP_NL_MSG_COUNTER_IGNORED;
+	    }
+	  lcp_nl_msg_count (counter, type);
+	}
+      if (msg_info->msg && !(msg_info->flags & NL_MSG_F_SLOT))
+	nlmsg_free (msg_info->msg);
+      msg_info->msg = NULL;
 
-      if (++n_msgs >= nm->batch_size)
+      if (++n_msgs >= max_msgs)
 	{
-	  LCP_NL_INFO ("process_msgs: batch_size %u reached, yielding",
-		       nm->batch_size);
+	  LCP_NL_INFO ("process_msgs: netns '%s' batch of %u reached, "
+		       "yielding",
+		       nlns->netns_name, max_msgs);
 	  break;
 	}
-      usecs = (u64) (1e6 * (vlib_time_now (vlib_get_main ()) - start));
-      if (usecs >= 1e3 * nm->batch_work_ms)
+      now = vlib_time_now (vm);
+      usecs = (u64) (1e6 * (now - start));
+      if (usecs >= 1e3 * max_ms)
 	{
-	  LCP_NL_INFO ("process_msgs: batch_work_ms %u reached, yielding",
-		       nm->batch_work_ms);
+	  LCP_NL_INFO ("process_msgs: netns '%s' work of %u ms reached, "
+		       "yielding",
+		       nlns->netns_name, max_ms);
 	  break;
 	}
+      if (have_barrier && !in_dump &&
+	  (now - barrier_start) >= 1e-3 * nm->batch_barrier_ms)
+	{
+	  lcp_nl_route_flush ();
+	  lcp_nl_table_gc ();
+	  lcp_nl_barrier_release (vm, barrier_start);
+	  have_barrier = 0;
+	}
+    }
+
+  if (have_barrier)
+    {
+      lcp_nl_route_flush ();
+      lcp_nl_table_gc ();
+      lcp_nl_barrier_release (vm, barrier_start);
     }
+  usecs = (u64) (1e6 * (vlib_time_now (vm) - start));
+  lcp_nl_hist_add (LCP_NL_HIST_BATCH, vlib_time_now (vm) - start);
 
-  /* remove the messages we processed from the head of the queue */
-  if (n_msgs)
-    vec_delete (nm->nl_ns.nl_msg_queue, n_msgs, 0);
+  /* hand the slots we processed back to the producer */
+  nlns->nl_msg_head += n_msgs;
+  lcp_nl_queue_release (nlns);
 
-  if (n_msgs > 0)
+  if (in_dump)
     {
-      if (vec_len (nm->nl_ns.nl_msg_queue))
-	{
-	  LCP_NL_WARN ("process_msgs: Processed %u messages in %llu usecs, %u "
-		       "left in queue",
-		       n_msgs, usecs, vec_len (nm->nl_ns.nl_msg_queue));
-	}
-      else
-	{
-	  LCP_NL_DBG ("process_msgs: Processed %u messages in %llu usecs",
-		      n_msgs, usecs);
-	}
+      nlns->dump_n_msgs += n_msgs;
+      LCP_NL_DBG ("process_msgs: Processed %u messages (%u elided) in "
+		  "%llu usecs, %llu since start of dump",
+		  n_msgs, n_elided, usecs, nlns->dump_n_msgs);
+    }
+  else if (lcp_nl_queue_len (nlns))
+    {
+      LCP_NL_WARN ("process_msgs: Processed %u messages (%u elided) in "
+		   "%llu usecs (%u barrier holds), %llu left in queue",
+		   n_msgs, n_elided, usecs, n_holds, lcp_nl_queue_len (nlns));
+    }
+  else
+    {
+      LCP_NL_DBG ("process_msgs: Processed %u messages (%u elided) in "
+		  "%llu usecs (%u barrier holds)",
+		  n_msgs, n_elided, usecs, n_holds);
     }
 
+  nm->nl_ns_current = ~0;
   lcpm->lcp_sync = old_lcp_sync;
+  lcp_nl_record_flush ();
 
   return n_msgs;
 }
 
 #define LCP_NL_PROCESS_WAIT 10.0 // seconds
 
-static uword
-lcp_nl_process (vlib_main_t *vm, vlib_node_runtime_t *node,
-		vlib_frame_t *frame)
+/* One round over the namespaces with queued messages. Each of them gets
+ * a share of batch_size and batch_work_ms in proportion to its weight
+ * among the backlogged ones, so that a namespace loading a full table
+ * does not hold back the route updates of another. The round starts one
+ * namespace further every time. Returns how long the process node may
+ * sleep before the next round.
+ */
+static f64
+lcp_nl_process_all (void)
 {
   lcp_nl_main_t *nm = &lcp_nl_main;
-  uword event_type;
-  uword *event_data = 0;
+  lcp_nl_netlink_namespace_t *nlns, **nlnsp;
+  u32 *ready = 0, total = 0, n_pool, i, j;
+  u8 in_dump = 0;
   f64 wait_time = LCP_NL_PROCESS_WAIT;
 
-  while (1)
+  pool_foreach (nlnsp, nm->nl_ns_pool)
     {
-      /* If we process a batch of messages and stop because we reached the
-       * batch size limit, we want to wake up after the batch delay and
-       * process more. Otherwise we just want to wait for a read event.
-       */
-      vlib_process_wait_for_event_or_clock (vm, wait_time);
-      event_type = vlib_process_get_events (vm, &event_data);
+      /* slots a decoder was still busy with at the end of the last batch,
+       * the reader may be waiting for them with nothing left to consume */
+      lcp_nl_queue_release (*nlnsp);
+      if (!lcp_nl_queue_len (*nlnsp))
+	continue;
+      vec_add1 (ready, (*nlnsp)->index);
+      total += (*nlnsp)->weight;
+    }
 
-      switch (event_type)
-	{
-	/* process batch of queued messages on timeout or read event signal */
-	case ~0:
-	case NL_EVENT_READ:
-	  lcp_nl_process_msgs ();
-	  wait_time = (vec_len (nm->nl_ns.nl_msg_queue) != 0) ?
-			nm->batch_delay_ms * 1e-3 :
-			LCP_NL_PROCESS_WAIT;
-	  break;
+  n_pool = vec_len (nm->nl_ns_pool);
+  for (i = 0; i < n_pool && total; i++)
+    {
+      u32 index = (nm->nl_ns_next + i) % n_pool;
 
-	/* reopen the socket if there was an error polling/reading it */
-	case NL_EVENT_READ_ERR:
-	  lcp_nl_close_socket ();
-	  lcp_nl_open_socket (nm->nl_ns.netns_name);
+      for (j = 0; j < vec_len (ready); j++)
+	if (ready[j] == index)
 	  break;
+      if (j == vec_len (ready))
+	continue;
 
-	default:
-	  LCP_NL_ERROR ("process: Unknown event type: %u", (u32) event_type);
-	}
+      nlns = lcp_nl_ns_get (index);
+      lcp_nl_process_msgs (
+	nlns, clib_max (1, (u64) nm->batch_size * nlns->weight / total),
+	clib_max (1, (u64) nm->batch_work_ms * nlns->weight / total));
+    }
+  if (n_pool)
+    nm->nl_ns_next = (nm->nl_ns_next + 1) % n_pool;
+  vec_free (ready);
 
-      vec_reset_length (event_data);
+  pool_foreach (nlnsp, nm->nl_ns_pool)
+    {
+      lcp_nl_ns_gauges_update (*nlnsp);
+      if (!lcp_nl_queue_len (*nlnsp))
+	continue;
+      wait_time = nm->batch_delay_ms * 1e-3;
+      in_dump |= ((*nlnsp)->resync_step != 0);
     }
-  return frame->n_vectors;
+
+  return in_dump ? 0 : wait_time;
 }
 
-VLIB_REGISTER_NODE (lcp_nl_process_node, static) = {
-  .function = lcp_nl_process,
-  .name = "linux-cp-netlink-process",
-  .type = VLIB_NODE_TYPE_PROCESS,
-  .process_log2_n_stack_bytes = 17,
+int
+lcp_nl_replay_inject (const u8 *ns, const struct nlmsghdr *hdr)
+{
+  lcp_nl_netlink_namespace_t *nlns = lcp_nl_ns_find_or_create (ns);
+  struct nl_msg *msg;
+
+  /* the queue of a reader thread has a single producer already */
+  if (nlns->reader_file_index != ~0)
+    return -1;
+  if (!nlns->nl_msg_queue)
+    vec_validate (nlns->nl_msg_queue, lcp_nl_main.ring_size - 1);
+  if (!(msg = nlmsg_convert ((struct nlmsghdr *) hdr)))
+    return -1;
+  nlmsg_set_proto (msg, NETLINK_ROUTE);
+
+  /* the queue takes its own reference */
+  lcp_nl_callback (msg, nlns);
+  nlmsg_free (msg);
+
+  return 0;
+}
+
+u64
+lcp_nl_replay_run (void)
+{
+  lcp_nl_netlink_namespace_t **nlnsp;
+  u64 n_left = 0;
+
+  lcp_nl_process_all ();
+  pool_foreach (nlnsp, lcp_nl_main.nl_ns_pool)
+    n_left += lcp_nl_queue_len (*nlnsp);
+
+  return n_left;
+}
+
+/*
+ * Resync and import.
+ *
+ * When the socket overflows (ENOBUFS), the kernel drops notifications and
+ * VPP can't recover them from the notification stream. lcp_nl_resync_begin()
+ * marks all routes and neighbors learned from netlink as stale, then asks
+ * the kernel to dump links, addresses, neighbors and routes. The dumps are
+ * queued behind pending notifications and go through the normal batch
+ * pipeline, refreshing what VPP already has. The end of every dump is
+ * queued as a marker. When lcp_nl_process_msgs() reaches the marker it calls
+ * lcp_nl_resync_next(), which requests the next dump. After the last dump it
+ * sweeps whatever is still stale. Only one dump can run at a time on a
+ * socket.
+ *
+ * Routes, neighbors and nexthops are not kept per namespace, so a resync
+ * dumps every namespace that has a listener and only sweeps once all of
+ * them are done.
+ *
+ * When the socket is first opened, the addresses, neighbors and routes that
+ * already exist in the namespace are imported the same way, without the
+ * mark and sweep. While a dump is being applied, lcp_nl_process_msgs()
+ * holds the barrier for a whole batch and the process node does not wait
+ * between batches.
+ */
+static const struct
+{
+  int type;
+  int family;
+} lcp_nl_resync_dumps[] = {
+  { RTM_GETLINK, AF_UNSPEC }, { RTM_GETADDR, AF_UNSPEC },
+  { RTM_GETNEIGH, AF_INET },  { RTM_GETNEIGH, AF_INET6 },
+  { RTM_GETNEXTHOP, AF_UNSPEC }, { RTM_GETROUTE, AF_INET },
+  { RTM_GETROUTE, AF_INET6 },
 };
 
+#define LCP_NL_RESYNC_TIMEOUT 60.0 // seconds
+
 static int
-lcp_nl_callback (struct nl_msg *msg, void *arg)
+lcp_nl_resync_request (lcp_nl_netlink_namespace_t *nlns)
 {
-  lcp_nl_main_t *nm = &lcp_nl_main;
-  nl_msg_info_t *msg_info = 0;
+  int err, i = nlns->resync_step - 1;
 
-  /* Add messages to a netlink message queue.
-   * We do this so that we can process the messages
-   * in batches and ensure we periodically read the
-   * netlink socket in case more messages are available
-   * from the Kernel.
-   */
-  vec_add2 (nm->nl_ns.nl_msg_queue, msg_info, 1);
+  nlns->resync_dump_done = clib_atomic_load_acq_n (&nlns->n_dump_done) + 1;
+  nlns->resync_step_start = vlib_time_now (vlib_get_main ());
 
-  /* store a timestamp for the message */
-  msg_info->ts = vlib_time_now (vlib_get_main ());
-  msg_info->msg = msg;
-  nlmsg_get (msg);
+  /* nexthop dumps take a struct nhmsg rather than a struct rtgenmsg */
+  if (lcp_nl_resync_dumps[i].type == RTM_GETNEXTHOP)
+    {
+      struct nhmsg nhm = { .nh_family = lcp_nl_resync_dumps[i].family };
+
+      err = nl_send_simple (nlns->sk_route, RTM_GETNEXTHOP, NLM_F_DUMP, &nhm,
+			    sizeof (nhm));
+    }
+  else
+    err = nl_rtgen_request (nlns->sk_route, lcp_nl_resync_dumps[i].type,
+			    lcp_nl_resync_dumps[i].family, NLM_F_DUMP);
+  if (err < 0)
+    {
+      LCP_NL_ERROR ("resync_request: Unable to request dump of type %d "
+		    "family %d: %s",
+		    lcp_nl_resync_dumps[i].type, lcp_nl_resync_dumps[i].family,
+		    nl_geterror (err));
+      nlns->resync_step = 0;
+      return err;
+    }
 
+  LCP_NL_DBG ("resync_request: Requested dump of type %d family %d",
+	      lcp_nl_resync_dumps[i].type, lcp_nl_resync_dumps[i].family);
   return 0;
 }
 
-static void
-lcp_nl_pair_add_cb (lcp_itf_pair_t *lip)
-{
-  lcp_nl_main_t *nm = &lcp_nl_main;
+/* Import skips the link dump: links are picked up as the pairs are
+ * created */
+#define LCP_NL_IMPORT_FIRST_STEP 2
 
-  // NOTE(pim) - this is where we might add multiple filedescriptors, if the
-  // lip->lip_namespace is on a namespace we haven't seen before. An issue
-  // with the original plugin is that it will only listen to the one namespace
-  // noted in startup.conf (linux-cp default netns foo) so interfaces added
-  // with a unique namespace (lcp create X host-if e0 netns bar) will not
-  // be able to participate in netlink updates.
-  // In future work, this plugin should be able to maintain a list of
-  // namespaces to listen on, adding/deleting listeners dynamically, ie every
-  // time this callback is invoked.
-  LCP_NL_DBG ("pair_add_cb: %U refcnt %u", format_lcp_itf_pair, lip,
-	      nm->nl_ns.clib_file_lcp_refcnt);
-
-  if ((nm->nl_ns.clib_file_lcp_refcnt > 0) &&
-      vec_cmp(nm->nl_ns.netns_name, lip->lip_namespace))
-    {
-      LCP_NL_WARN (
-	"pair_add_cb: Existing netlink listener for netns %v -- this "
-	"itf-pair is in netns %v, will not be listened!",
-	nm->nl_ns.netns_name, lip->lip_namespace);
-      return;
-    }
+static u8
+lcp_nl_dump_in_progress (void)
+{
+  lcp_nl_netlink_namespace_t **nlnsp;
 
-  nm->nl_ns.clib_file_lcp_refcnt++;
-  if (nm->nl_ns.clib_file_index == ~0)
-    {
-      LCP_NL_INFO ("pair_add_cb: Adding netlink listener for netns %v",
-		   lip->lip_namespace);
-      lcp_nl_open_socket (lip->lip_namespace);
-    }
+  pool_foreach (nlnsp, lcp_nl_main.nl_ns_pool)
+    if ((*nlnsp)->resync_step)
+      return 1;
+  return 0;
 }
 
 static void
-lcp_nl_pair_del_cb (lcp_itf_pair_t *lip)
+lcp_nl_dump_start (lcp_nl_netlink_namespace_t *nlns, u8 is_resync)
 {
   lcp_nl_main_t *nm = &lcp_nl_main;
 
-  // See NOTE in lcp_nl_pair_add_cb().
-  LCP_NL_DBG ("pair_del_cb: %U refcnt %u", format_lcp_itf_pair, lip,
-	      nm->nl_ns.clib_file_lcp_refcnt);
+  nlns->resync_sweep = is_resync;
+  nlns->resync_start = vlib_time_now (vlib_get_main ());
+  nlns->dump_n_msgs = 0;
 
-  nm->nl_ns.clib_file_lcp_refcnt--;
-  if (nm->nl_ns.clib_file_lcp_refcnt == 0)
+  if (is_resync)
     {
-      LCP_NL_INFO ("pair_del_cb: Removing netlink listener for netns %v",
-		   lip->lip_namespace);
-      lcp_nl_close_socket ();
-      return;
+      LCP_NL_NOTICE ("dump_start: Resyncing netns '%s'", nlns->netns_name);
+      nlns->n_resyncs++;
+      nlns->resync_step = 1;
+      nm->resync_n_pending++;
     }
+  else
+    {
+      LCP_NL_NOTICE ("dump_start: Importing kernel state of netns '%s'",
+		     nlns->netns_name);
+      nlns->n_imports++;
+      nlns->resync_step = LCP_NL_IMPORT_FIRST_STEP;
+    }
+
+  if (lcp_nl_resync_request (nlns) < 0 && is_resync)
+    {
+      nm->resync_n_pending--;
+      nm->resync_failed = 1;
+    }
+}
+
+static void
+lcp_nl_resync_begin (void)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  lcp_nl_netlink_namespace_t **nlnsp;
+  vlib_main_t *vm = vlib_get_main ();
+
+  /* a dump is in progress, start a resync over when it is done */
+  if (lcp_nl_dump_in_progress ())
+    {
+      nm->resync_restart = 1;
+      return;
+    }
+
+  nm->resync_restart = 0;
+  nm->resync_failed = 0;
+  nm->resync_n_pending = 0;
+
+  vlib_worker_thread_barrier_sync (vm);
+  lcp_nl_resync_mark ();
+  vlib_worker_thread_barrier_release (vm);
+
+  pool_foreach (nlnsp, nm->nl_ns_pool)
+    if ((*nlnsp)->sk_route)
+      lcp_nl_dump_start (*nlnsp, 1 /* is_resync */);
+}
+
+static void
+lcp_nl_import_begin (lcp_nl_netlink_namespace_t *nlns)
+{
+  if (!nlns->sk_route || nlns->resync_step)
+    return;
+  lcp_nl_dump_start (nlns, 0 /* is_resync */);
+}
+
+/* Import the namespace being applied again, for what its kernel kept but
+ * VPP withdrew, see lcp_nl_link_purge() */
+void
+lcp_nl_ns_current_import (void)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  lcp_nl_netlink_namespace_t *nlns;
+
+  if (nm->nl_ns_current == ~0)
+    return;
+  nlns = lcp_nl_ns_get (nm->nl_ns_current);
+  if (nlns->resync_step)
+    nlns->import_pending = 1;
+  else
+    lcp_nl_import_begin (nlns);
+}
+
+/* The dump of a namespace is over, or was given up on. Sweep after the
+ * last namespace of a resync, unless one of them did not complete.
+ */
+static void
+lcp_nl_dump_end (lcp_nl_netlink_namespace_t *nlns, u8 complete)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  u8 is_resync = nlns->resync_sweep;
+
+  nlns->resync_step = 0;
+  if (complete)
+    LCP_NL_NOTICE ("dump_end: %s netns '%s': %llu messages in %.3f sec",
+		   is_resync ? "Resynced" : "Imported", nlns->netns_name,
+		   nlns->dump_n_msgs,
+		   vlib_time_now (vlib_get_main ()) - nlns->resync_start);
+
+  if (is_resync)
+    {
+      if (!complete)
+	nm->resync_failed = 1;
+      /* Stale entries stay marked, the next resync will sweep them */
+      if (--nm->resync_n_pending == 0 && !nm->resync_failed &&
+	  !nm->resync_restart)
+	lcp_nl_resync_sweep ();
+    }
+
+  if (nm->resync_restart && !lcp_nl_dump_in_progress ())
+    lcp_nl_resync_begin ();
+
+  /* a resync begun above refreshes it all the same */
+  if (nlns->import_pending)
+    {
+      nlns->import_pending = 0;
+      lcp_nl_import_begin (nlns);
+    }
+}
+
+/* Called by lcp_nl_process_msgs(), with the barrier held, when it reaches
+ * the marker at the end of a dump */
+static void
+lcp_nl_resync_next (lcp_nl_netlink_namespace_t *nlns, u32 dump_id)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+
+  /* marker of an aborted resync */
+  if (!nlns->resync_step || dump_id != nlns->resync_dump_done)
+    return;
+
+  if (nm->resync_restart)
+    {
+      lcp_nl_dump_end (nlns, 0 /* complete */);
+      return;
+    }
+
+  if (nlns->resync_step < ARRAY_LEN (lcp_nl_resync_dumps))
+    {
+      nlns->resync_step++;
+      if (lcp_nl_resync_request (nlns) < 0)
+	lcp_nl_dump_end (nlns, 0 /* complete */);
+      return;
+    }
+
+  lcp_nl_dump_end (nlns, 1 /* complete */);
+}
+
+static void
+lcp_nl_resync_check_timeout (lcp_nl_netlink_namespace_t *nlns)
+{
+  if (!nlns->resync_step || 
+      clib_atomic_load_acq_n (&nlns->n_dump_done) == nlns->resync_dump_done)
+    return;
+  if (vlib_time_now (vlib_get_main ()) - nlns->resync_step_start <
+      LCP_NL_RESYNC_TIMEOUT)
+    return;
+
+  LCP_NL_ERROR ("resync_check_timeout: No end of dump of type %d family %d "
+		"in netns '%s' after %.0f sec, giving up",
+		lcp_nl_resync_dumps[nlns->resync_step - 1].type,
+		lcp_nl_resync_dumps[nlns->resync_step - 1].family,
+		nlns->netns_name, LCP_NL_RESYNC_TIMEOUT);
+  lcp_nl_dump_end (nlns, 0 /* complete */);
+}
+
+static uword
+lcp_nl_process (vlib_main_t *vm, vlib_node_runtime_t *node,
+		vlib_frame_t *frame)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  lcp_nl_netlink_namespace_t *nlns, **nlnsp;
+  uword event_type;
+  uword *event_data = 0;
+  f64 wait_time = LCP_NL_PROCESS_WAIT;
+  int i;
+
+  while (1)
+    {
+      /* If we process a batch of messages and stop because we reached the
+       * batch size limit, we want to wake up after the batch delay and
+       * process more. Otherwise we just want to wait for a read event.
+       */
+      vlib_process_wait_for_event_or_clock (vm, wait_time);
+      event_type = vlib_process_get_events (vm, &event_data);
+
+      switch (event_type)
+	{
+	/* process batch of queued messages on timeout or read event signal */
+	case ~0:
+	case NL_EVENT_READ:
+	  wait_time = lcp_nl_process_all ();
+	  break;
+
+	/* reopen the socket if there was an error polling/reading it, and
+	 * resync what may have been lost. The event data are the indices of
+	 * the namespaces. */
+	case NL_EVENT_READ_ERR:
+	  for (i = 0; i < vec_len (event_data); i++)
+	    {
+	      nlns = lcp_nl_ns_get (event_data[i]);
+	      if (!nlns->sk_route)
+		continue;
+	      lcp_nl_close_socket (nlns);
+	      lcp_nl_open_socket (nlns);
+	    }
+	  lcp_nl_resync_begin ();
+	  break;
+
+	/* the kernel dropped messages, resync */
+	case NL_EVENT_RESYNC:
+	  lcp_nl_resync_begin ();
+	  break;
+
+	default:
+	  LCP_NL_ERROR ("process: Unknown event type: %u", (u32) event_type);
+	}
+
+      pool_foreach (nlnsp, nm->nl_ns_pool)
+	lcp_nl_resync_check_timeout (*nlnsp);
+      vec_reset_length (event_data);
+    }
+  return frame->n_vectors;
+}
+
+VLIB_REGISTER_NODE (lcp_nl_process_node, static) = {
+  .function = lcp_nl_process,
+  .name = "linux-cp-netlink-process",
+  .type = VLIB_NODE_TYPE_PROCESS,
+  .process_log2_n_stack_bytes = 17,
+};
+
+/* Double the size of the queue. Only used when the main thread is the
+ * producer, the reader thread waits for the consumer instead.
+ */
+static void
+lcp_nl_queue_grow (lcp_nl_netlink_namespace_t *nlns)
+{
+  nl_msg_info_t *old = nlns->nl_msg_queue, *new = 0;
+  u64 old_mask = vec_len (old) - 1, seq;
+
+  vec_validate (new, 2 * vec_len (old) - 1);
+  for (seq = nlns->nl_msg_released; seq < nlns->nl_msg_tail; seq++)
+    new[seq & (vec_len (new) - 1)] = old[seq & old_mask];
+
+  nlns->nl_msg_queue = new;
+  vec_free (old);
+  LCP_NL_INFO ("queue_grow: Queue size is now %u", vec_len (new));
+}
+
+static_always_inline void
+lcp_nl_queue_push (lcp_nl_netlink_namespace_t *nlns, struct nl_msg *msg,
+		   f64 ts, u8 flags)
+{
+  nl_msg_info_t *msg_info = lcp_nl_msg_at (nlns, nlns->nl_msg_tail);
+  u64 depth;
+
+  msg_info->ts = ts;
+  msg_info->msg = msg;
+  msg_info->flags = flags;
+  if (flags & NL_MSG_F_DUMP_DONE)
+    {
+      msg_info->dump_id = nlns->n_dump_done + 1;
+      clib_atomic_store_rel_n (&nlns->n_dump_done, msg_info->dump_id);
+    }
+  clib_atomic_store_rel_n (&nlns->nl_msg_tail, nlns->nl_msg_tail + 1);
+
+  depth =
+    nlns->nl_msg_tail - clib_atomic_load_acq_n (&nlns->nl_msg_released);
+  if (depth > nlns->nl_msg_hwm)
+    nlns->nl_msg_hwm = depth;
+}
+
+static int
+lcp_nl_callback (struct nl_msg *msg, void *arg)
+{
+  lcp_nl_netlink_namespace_t *nlns = arg;
+
+  /* Add messages to a netlink message queue.
+   * We do this so that we can process the messages
+   * in batches and ensure we periodically read the
+   * netlink socket in case more messages are available
+   * from the Kernel.
+   */
+  if (lcp_nl_queue_used (nlns) == vec_len (nlns->nl_msg_queue))
+    lcp_nl_queue_grow (nlns);
+
+  /* store a timestamp for the message */
+  nlmsg_get (msg);
+  lcp_nl_queue_push (nlns, msg, vlib_time_now (vlib_get_main ()), 0);
+
+  return 0;
+}
+
+/* NLMSG_DONE of a dump: queue a marker behind the dumped messages */
+static int
+lcp_nl_finish_callback (struct nl_msg *msg, void *arg)
+{
+  lcp_nl_netlink_namespace_t *nlns = arg;
+
+  if (lcp_nl_queue_used (nlns) == vec_len (nlns->nl_msg_queue))
+    lcp_nl_queue_grow (nlns);
+  lcp_nl_queue_push (nlns, NULL, vlib_time_now (vlib_get_main ()),
+		     NL_MSG_F_DUMP_DONE);
+
+  return NL_STOP;
+}
+
+/* The kernel answers a dump it does not support, like the nexthop dump on
+ * kernels before 5.3, with an error instead of NLMSG_DONE. End the dump
+ * with a marker all the same, rather than waiting for the resync timeout.
+ */
+static int
+lcp_nl_error_callback (struct sockaddr_nl *nla, struct nlmsgerr *nlerr,
+		       void *arg)
+{
+  lcp_nl_netlink_namespace_t *nlns = arg;
+
+  LCP_NL_WARN ("error_callback: Request type %d failed in netns '%s': %s",
+	       nlerr->msg.nlmsg_type, nlns->netns_name,
+	       strerror (-nlerr->error));
+  lcp_nl_finish_callback (NULL, arg);
+
+  return NL_SKIP;
+}
+
+/*
+ * Reader thread.
+ *
+ * In this mode the netlink socket is not polled by the main thread. A
+ * dedicated thread reads it with recvmmsg(), splits the datagrams into
+ * messages and pushes them onto the queue. It wakes up the main thread
+ * through an eventfd, see lcp_nl_reader_wakeup_cb(). This keeps the socket
+ * drained while the main thread is busy applying a large batch. When the
+ * queue is full, the reader sleeps on a second eventfd until the main thread
+ * hands slots back, see lcp_nl_reader_wait().
+ */
+#define NL_READER_N_BUFS  32
+#define NL_READER_BUF_SIZE (1 << 16)
+
+/* Each slot of the queue owns a message this large, the reader copies into
+ * it instead of allocating. Route and neighbor messages fit, larger ones
+ * (links mostly) are allocated as before. */
+#define NL_READER_SLOT_SIZE 512
+
+/* vlib_time_now() for a thread that must not write to the main thread's
+ * clib_time_t */
+static f64
+lcp_nl_reader_time_now (vlib_main_t *vm)
+{
+  clib_time_t *ct = &vm->clib_time;
+
+  return (vm->time_offset +
+	  (clib_cpu_time_now () - ct->init_cpu_time) * ct->seconds_per_clock);
+}
+
+static void
+lcp_nl_reader_wakeup (lcp_nl_netlink_namespace_t *nlns)
+{
+  if (eventfd_write (nlns->reader_efd, 1) < 0)
+    ; /* an overflowing eventfd is as good as a wakeup */
+}
+
+/* Wake up a reader thread waiting for the main thread to free slots */
+static void
+lcp_nl_reader_space (lcp_nl_netlink_namespace_t *nlns)
+{
+  clib_atomic_store_rel_n (&nlns->reader_waiting, 0);
+  if (eventfd_write (nlns->reader_space_efd, 1) < 0)
+    ;
+}
+
+/* Block until the ring has a free slot. Returns 0 if the reader is told to
+ * stop meanwhile. */
+static int
+lcp_nl_reader_wait (lcp_nl_netlink_namespace_t *nlns)
+{
+  u64 len = vec_len (nlns->nl_msg_queue);
+  eventfd_t val;
+
+  while (nlns->nl_msg_tail -
+	   clib_atomic_load_acq_n (&nlns->nl_msg_released) >=
+	 len)
+    {
+      struct pollfd pfd = { .fd = nlns->reader_space_efd, .events = POLLIN };
+
+      if (nlns->reader_stop)
+	return 0;
+      nlns->reader_n_full++;
+      /* announce ourselves before the last look at the ring, the main
+       * thread looks at reader_waiting after it released slots */
+      clib_atomic_store_seq_cst (&nlns->reader_waiting, 1);
+      if (nlns->nl_msg_tail -
+	    clib_atomic_load_seq_cst (&nlns->nl_msg_released) <
+	  len)
+	break;
+      lcp_nl_reader_wakeup (nlns);
+      /* the timeout only bounds the time to notice reader_stop */
+      if (poll (&pfd, 1, 100 /* ms */) > 0)
+	if (eventfd_read (nlns->reader_space_efd, &val) < 0)
+	  ;
+    }
+  clib_atomic_store_rel_n (&nlns->reader_waiting, 0);
+
+  return 1;
+}
+
+/* Queue a copy of hdr, or a dump marker if hdr is NULL */
+static void
+lcp_nl_reader_push (lcp_nl_netlink_namespace_t *nlns, struct nlmsghdr *hdr,
+		    f64 ts, u8 flags)
+{
+  struct nl_msg *msg = NULL;
+
+  if (!lcp_nl_reader_wait (nlns))
+    return;
+
+  if (hdr && hdr->nlmsg_len <= NL_READER_SLOT_SIZE)
+    {
+      msg = nlns->reader_slots[nlns->nl_msg_tail &
+			       (vec_len (nlns->nl_msg_queue) - 1)];
+      clib_memcpy_fast (nlmsg_hdr (msg), hdr, hdr->nlmsg_len);
+      flags |= NL_MSG_F_SLOT;
+    }
+  else if (hdr)
+    {
+      if (!(msg = nlmsg_convert (hdr)))
+	return;
+      nlmsg_set_proto (msg, NETLINK_ROUTE);
+    }
+
+  lcp_nl_queue_push (nlns, msg, ts, flags);
+}
+
+static void
+lcp_nl_reader_split (lcp_nl_netlink_namespace_t *nlns, u8 *buf, int len,
+		     f64 ts)
+{
+  struct nlmsghdr *hdr;
+
+  for (hdr = (struct nlmsghdr *) buf; NLMSG_OK (hdr, len);
+       hdr = NLMSG_NEXT (hdr, len))
+    {
+      /* same as lcp_nl_finish_callback() */
+      if (hdr->nlmsg_type == NLMSG_DONE)
+	{
+	  lcp_nl_reader_push (nlns, NULL, ts, NL_MSG_F_DUMP_DONE);
+	  continue;
+	}
+      /* same as lcp_nl_error_callback() */
+      if (hdr->nlmsg_type == NLMSG_ERROR &&
+	  hdr->nlmsg_len >= NLMSG_LENGTH (sizeof (struct nlmsgerr)) &&
+	  ((struct nlmsgerr *) NLMSG_DATA (hdr))->error)
+	{
+	  lcp_nl_reader_push (nlns, NULL, ts, NL_MSG_F_DUMP_DONE);
+	  continue;
+	}
+      /* same as libnl's NL_CB_VALID: skip NOOP, ACK and OVERRUN */
+      if (hdr->nlmsg_type < NLMSG_MIN_TYPE)
+	continue;
+      lcp_nl_reader_push (nlns, hdr, ts, 0);
+    }
+}
+
+static void *
+lcp_nl_reader_thread (void *arg)
+{
+  lcp_nl_netlink_namespace_t *nlns = arg;
+  vlib_main_t *vm = vlib_get_main ();
+  struct mmsghdr msgs[NL_READER_N_BUFS];
+  struct iovec iovs[NL_READER_N_BUFS];
+  int fd = nl_socket_get_fd (nlns->sk_route);
+  int i, n;
+
+  while (!nlns->reader_stop)
+    {
+      struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+      if (poll (&pfd, 1, 100 /* ms */) <= 0)
+	continue;
+
+      for (i = 0; i < NL_READER_N_BUFS; i++)
+	{
+	  iovs[i].iov_base = nlns->reader_bufs + i * NL_READER_BUF_SIZE;
+	  iovs[i].iov_len = NL_READER_BUF_SIZE;
+	  clib_memset (&msgs[i], 0, sizeof (msgs[i]));
+	  msgs[i].msg_hdr.msg_iov = &iovs[i];
+	  msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+      n = recvmmsg (fd, msgs, NL_READER_N_BUFS, MSG_DONTWAIT, NULL);
+      if (n < 0)
+	{
+	  if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	    continue;
+	  /* as in lcp_nl_read_cb(), keep reading after an overflow and let
+	   * the main thread resync */
+	  if (errno == ENOBUFS)
+	    {
+	      nlns->reader_n_enobufs++;
+	      nlns->overflowed = 1;
+	      lcp_nl_reader_wakeup (nlns);
+	      continue;
+	    }
+	  nlns->reader_errno = errno;
+	  lcp_nl_reader_wakeup (nlns);
+	  break;
+	}
+
+      for (i = 0; i < n; i++)
+	{
+	  if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+	    nlns->reader_n_truncated++;
+	  lcp_nl_reader_split (nlns, iovs[i].iov_base, msgs[i].msg_len,
+			       lcp_nl_reader_time_now (vm));
+	}
+      if (n > 0)
+	{
+	  lcp_nl_reader_wakeup (nlns);
+	  lcp_nl_decoders_wakeup (nlns);
+	}
+    }
+
+  return NULL;
+}
+
+/*
+ * Decoder threads.
+ *
+ * With a reader thread, route messages can also be decoded off the main
+ * thread. Decoder i of n takes the messages whose sequence number is i
+ * modulo n, and turns the route messages among them into a
+ * lcp_nl_route_op_t kept next to the slot. The main thread still applies
+ * them in sequence order, so the order of the updates of a prefix is that
+ * of the kernel whatever decoder handled them.
+ *
+ * A slot is claimed by whoever gets to it first: decode_tag is 2 * seq + 1
+ * while message seq is being decoded and 2 * seq + 2 once its op is ready.
+ * The main thread never waits for a decoder: it decodes the message itself
+ * if its op is not ready, see lcp_nl_decode_claim(). Idle decoders sleep
+ * until the reader thread queued more.
+ */
+#define LCP_NL_DECODE_TAG_BUSY(seq) (2 * (seq) + 1)
+#define LCP_NL_DECODE_TAG_DONE(seq) (2 * (seq) + 2)
+
+/* Decoders only look at messages held in a slot: those stay put until the
+ * main thread releases the slot, see lcp_nl_queue_release(), while an
+ * allocated one is freed as soon as it is applied. */
+static int
+lcp_nl_decode_is_route (nl_msg_info_t *msg_info, struct nl_msg *msg)
+{
+  u16 type;
+
+  if (!msg || !(msg_info->flags & NL_MSG_F_SLOT))
+    return 0;
+  type = nlmsg_hdr (msg)->nlmsg_type;
+  return (type == RTM_NEWROUTE || type == RTM_DELROUTE);
+}
+
+/* Called by the reader thread once it queued a batch */
+static void
+lcp_nl_decoders_wakeup (lcp_nl_netlink_namespace_t *nlns)
+{
+  if (!vec_len (nlns->decoders))
+    return;
+  pthread_mutex_lock (&nlns->decode_lock);
+  pthread_cond_broadcast (&nlns->decode_cond);
+  pthread_mutex_unlock (&nlns->decode_lock);
+}
+
+static void *
+lcp_nl_decoder_thread (void *arg)
+{
+  lcp_nl_decoder_t *d = arg;
+  lcp_nl_netlink_namespace_t *nlns = d->nlns;
+  u32 n = vec_len (nlns->decoders), index = d->index;
+  u64 mask = vec_len (nlns->nl_msg_queue) - 1, seq, tail, tag, next = index;
+  nl_msg_info_t *msg_info;
+  lcp_nl_route_op_t *op;
+  struct nl_msg *msg;
+
+  while (!nlns->decode_stop)
+    {
+      tail = clib_atomic_load_acq_n (&nlns->nl_msg_tail);
+      seq = clib_atomic_load_acq_n (&nlns->nl_msg_head);
+      /* our first message at or after the head */
+      if (next < seq)
+	next = seq + (index + n - seq % n) % n;
+      if (next >= tail)
+	{
+	  /* sleep until the reader queued more, the tail is looked at again
+	   * under the lock so that its wakeup cannot be missed */
+	  pthread_mutex_lock (&nlns->decode_lock);
+	  while (!nlns->decode_stop &&
+		 clib_atomic_load_acq_n (&nlns->nl_msg_tail) == tail)
+	    pthread_cond_wait (&nlns->decode_cond, &nlns->decode_lock);
+	  pthread_mutex_unlock (&nlns->decode_lock);
+	  continue;
+	}
+
+      for (seq = next; seq < tail; seq += n)
+	{
+	  msg_info = &nlns->nl_msg_queue[seq & mask];
+	  tag = msg_info->decode_tag;
+	  if (tag >= LCP_NL_DECODE_TAG_BUSY (seq) ||
+	      clib_atomic_cmp_and_swap (&msg_info->decode_tag, tag,
+					LCP_NL_DECODE_TAG_BUSY (seq)) != tag)
+	    continue;
+
+	  op = &nlns->decode_ops[seq & mask];
+	  msg = msg_info->msg;
+	  op->is_valid =
+	    (lcp_nl_decode_is_route (msg_info, msg) &&
+	     0 == lcp_nl_route_op_decode (nlmsg_hdr (msg), op));
+	  clib_atomic_store_rel_n (&msg_info->decode_tag,
+				   LCP_NL_DECODE_TAG_DONE (seq));
+	}
+      next = seq;
+    }
+
+  return NULL;
+}
+
+/* Take message seq from the decoders. If none of them got to it, it is
+ * marked done and the main thread decodes it. If one is still at it, the
+ * main thread does not wait either: it decodes the message itself and
+ * ignores the op, the slot is released once the decoder is done with it.
+ * Every message of the queue goes through here before it is applied.
+ * Returns the op to apply instead of the message, if any. */
+static lcp_nl_route_op_t *
+lcp_nl_decode_claim (lcp_nl_netlink_namespace_t *nlns, u64 seq,
+		     nl_msg_info_t *msg_info)
+{
+  lcp_nl_route_op_t *op;
+  u64 tag;
+
+  if (!vec_len (nlns->decoders))
+    return NULL;
+
+  tag = msg_info->decode_tag;
+  if (tag < LCP_NL_DECODE_TAG_BUSY (seq) &&
+      clib_atomic_cmp_and_swap (&msg_info->decode_tag, tag,
+				LCP_NL_DECODE_TAG_DONE (seq)) == tag)
+    {
+      if (lcp_nl_decode_is_route (msg_info, msg_info->msg))
+	nlns->decode_n_self++;
+      return NULL;
+    }
+  if (clib_atomic_load_acq_n (&msg_info->decode_tag) !=
+      LCP_NL_DECODE_TAG_DONE (seq))
+    {
+      nlns->decode_n_skips++;
+      return NULL;
+    }
+
+  op = &nlns->decode_ops[seq & (vec_len (nlns->nl_msg_queue) - 1)];
+  if (!op->is_valid)
+    return NULL;
+
+  nlns->decode_n_taken++;
+  return op;
+}
+
+/* Hand the slots before the head back to the producer, up to the first
+ * one a decoder still works on. */
+static void
+lcp_nl_queue_release (lcp_nl_netlink_namespace_t *nlns)
+{
+  u64 seq = nlns->nl_msg_released;
+
+  if (vec_len (nlns->decoders))
+    while (seq < nlns->nl_msg_head &&
+	   clib_atomic_load_acq_n (&lcp_nl_msg_at (nlns, seq)->decode_tag) ==
+	     LCP_NL_DECODE_TAG_DONE (seq))
+      seq++;
+  else
+    seq = nlns->nl_msg_head;
+
+  if (seq == nlns->nl_msg_released)
+    return;
+  clib_atomic_store_seq_cst (&nlns->nl_msg_released, seq);
+  if (clib_atomic_load_seq_cst (&nlns->reader_waiting))
+    lcp_nl_reader_space (nlns);
+}
+
+static void
+lcp_nl_decoders_stop (lcp_nl_netlink_namespace_t *nlns)
+{
+  lcp_nl_decoder_t *d;
+
+  nlns->decode_stop = 1;
+  lcp_nl_decoders_wakeup (nlns);
+  vec_foreach (d, nlns->decoders)
+    pthread_join (d->thread, NULL);
+  vec_reset_length (nlns->decoders);
+  /* every slot is done now */
+  lcp_nl_queue_release (nlns);
+}
+
+/* Called once the reader thread runs, the queue does not change size any
+ * more */
+static void
+lcp_nl_decoders_start (lcp_nl_netlink_namespace_t *nlns)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  lcp_nl_decoder_t *d;
+  u32 i;
+  int rv;
+
+  if (!nm->decode_n_threads)
+    return;
+
+  nlns->decode_stop = 0;
+  if (!nlns->decode_ops)
+    vec_validate_aligned (nlns->decode_ops, vec_len (nlns->nl_msg_queue) - 1,
+			  CLIB_CACHE_LINE_BYTES);
+
+  /* every thread shards on the full count, so they all start or none */
+  vec_validate (nlns->decoders, nm->decode_n_threads - 1);
+  for (i = 0; i < nm->decode_n_threads; i++)
+    {
+      d = &nlns->decoders[i];
+      d->nlns = nlns;
+      d->index = i;
+      if ((rv = pthread_create (&d->thread, NULL, lcp_nl_decoder_thread, d)))
+	{
+	  LCP_NL_ERROR ("decoders_start: Unable to create decoder thread: %s",
+			strerror (rv));
+	  nlns->decode_stop = 1;
+	  lcp_nl_decoders_wakeup (nlns);
+	  while (i--)
+	    pthread_join (nlns->decoders[i].thread, NULL);
+	  vec_reset_length (nlns->decoders);
+	  return;
+	}
+      pthread_setname_np (d->thread, "lcp-nl-decode");
+    }
+
+  LCP_NL_INFO ("decoders_start: Started %u decoder threads netns '%s'",
+	       nm->decode_n_threads, nlns->netns_name);
 }
 
 static clib_error_t *
-lcp_nl_read_cb (clib_file_t *f)
+lcp_nl_reader_wakeup_cb (clib_file_t *f)
+{
+  lcp_nl_netlink_namespace_t *nlns = lcp_nl_ns_get (f->private_data);
+  eventfd_t val;
+
+  if (eventfd_read (f->file_descriptor, &val) < 0)
+    ;
+
+  if (nlns->reader_errno)
+    {
+      LCP_NL_ERROR ("reader_wakeup_cb: Reader thread stopped on netlink "
+		    "socket of netns '%s': %s (%d)",
+		    nlns->netns_name, strerror (nlns->reader_errno),
+		    nlns->reader_errno);
+      vlib_process_signal_event (vlib_get_main (), lcp_nl_process_node.index,
+				 NL_EVENT_READ_ERR, nlns->index);
+    }
+  else
+    vlib_process_signal_event (vlib_get_main (), lcp_nl_process_node.index,
+			       NL_EVENT_READ, nlns->index);
+
+  if (nlns->overflowed)
+    {
+      nlns->overflowed = 0;
+      vlib_process_signal_event (vlib_get_main (), lcp_nl_process_node.index,
+				 NL_EVENT_RESYNC, nlns->index);
+    }
+
+  return 0;
+}
+
+/* Returns -1 if the reader thread could not be started, the socket is then
+ * to be polled by the main thread */
+static int
+lcp_nl_reader_start (lcp_nl_netlink_namespace_t *nlns)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  u32 i;
+  int rv;
+
+  if (!nlns->reader_bufs)
+    nlns->reader_bufs = clib_mem_alloc_aligned (
+      NL_READER_N_BUFS * NL_READER_BUF_SIZE, CLIB_CACHE_LINE_BYTES);
+  /* the ring may have grown while the main thread was reading */
+  for (i = vec_len (nlns->reader_slots); i < vec_len (nlns->nl_msg_queue);
+       i++)
+    {
+      struct nl_msg *msg = nlmsg_alloc_size (NL_READER_SLOT_SIZE);
+
+      if (!msg)
+	{
+	  LCP_NL_ERROR ("reader_start: Unable to allocate the queue slots");
+	  return -1;
+	}
+      nlmsg_set_proto (msg, NETLINK_ROUTE);
+      vec_add1 (nlns->reader_slots, msg);
+    }
+
+  nlns->reader_stop = 0;
+  nlns->reader_errno = 0;
+  if ((rv = pthread_create (&nlns->reader_thread, NULL, lcp_nl_reader_thread,
+			    nlns)))
+    {
+      LCP_NL_ERROR ("reader_start: Unable to create reader thread: %s",
+		    strerror (rv));
+      return -1;
+    }
+  nlns->reader_running = 1;
+  pthread_setname_np (nlns->reader_thread, "lcp-nl-reader");
+
+  /* only now, lcp_nl_replay_inject() takes it for a running reader */
+  if (nlns->reader_file_index == ~0)
+    {
+      clib_file_t efd_file = {
+	.read_function = lcp_nl_reader_wakeup_cb,
+	.file_descriptor = nlns->reader_efd,
+	.private_data = nlns->index,
+	.description = format (0, "linux-cp netlink reader wakeup netns '%s'",
+			       nlns->netns_name),
+      };
+
+      nlns->reader_file_index = clib_file_add (&file_main, &efd_file);
+    }
+
+  if (nm->reader_cpu != ~0)
+    {
+      cpu_set_t cpuset;
+
+      CPU_ZERO (&cpuset);
+      CPU_SET (nm->reader_cpu, &cpuset);
+      if ((rv = pthread_setaffinity_np (nlns->reader_thread, sizeof (cpuset),
+					&cpuset)))
+	LCP_NL_WARN ("reader_start: Unable to pin reader thread to cpu %u: %s",
+		     nm->reader_cpu, strerror (rv));
+    }
+
+  lcp_nl_decoders_start (nlns);
+
+  LCP_NL_INFO ("reader_start: Started reader thread on netlink fd %d "
+	       "netns '%s'",
+	       nl_socket_get_fd (nlns->sk_route), nlns->netns_name);
+  return 0;
+}
+
+static void
+lcp_nl_reader_stop (lcp_nl_netlink_namespace_t *nlns)
+{
+  if (!nlns->reader_running)
+    return;
+
+  nlns->reader_stop = 1;
+  lcp_nl_reader_space (nlns);
+  pthread_join (nlns->reader_thread, NULL);
+  lcp_nl_decoders_stop (nlns);
+  nlns->reader_running = 0;
+  LCP_NL_DBG ("reader_stop: Stopped reader thread");
+}
+
+static void
+lcp_nl_pair_add_cb (lcp_itf_pair_t *lip)
 {
   lcp_nl_main_t *nm = &lcp_nl_main;
+  lcp_nl_netlink_namespace_t *nlns;
+  u32 prev_ns;
+
+  /* Every namespace pairs are created in gets its own listener */
+  nlns = lcp_nl_ns_find_or_create (lip->lip_namespace);
+  LCP_NL_DBG ("pair_add_cb: %U netns '%s' refcnt %u", format_lcp_itf_pair,
+	      lip, nlns->netns_name, nlns->clib_file_lcp_refcnt);
+
+  /* nexthops via the host interface dropped until now, they resolve it in
+   * its namespace */
+  prev_ns = nm->nl_ns_current;
+  nm->nl_ns_current = nlns->index;
+  lcp_nl_nexthop_pair_add (lip->lip_vif_index);
+  nm->nl_ns_current = prev_ns;
+
+  nlns->clib_file_lcp_refcnt++;
+  if (!nlns->sk_route)
+    {
+      LCP_NL_INFO ("pair_add_cb: Adding netlink listener for netns '%s'",
+		   nlns->netns_name);
+      lcp_nl_open_socket (nlns);
+      lcp_nl_import_begin (nlns);
+    }
+}
+
+static void
+lcp_nl_pair_del_cb (lcp_itf_pair_t *lip)
+{
+  lcp_nl_netlink_namespace_t *nlns;
+
+  /* VPP drops the neighbors of the phy, and its sw_if_index may be reused
+   * for an interface the routes do not go via */
+  lcp_nl_neigh_pair_flush (lip->lip_phy_sw_if_index);
+  lcp_nl_route_pair_flush (lip->lip_phy_sw_if_index);
+
+  if (!(nlns = lcp_nl_ns_find (lip->lip_namespace)) ||
+      !nlns->clib_file_lcp_refcnt)
+    return;
+
+  LCP_NL_DBG ("pair_del_cb: %U netns '%s' refcnt %u", format_lcp_itf_pair,
+	      lip, nlns->netns_name, nlns->clib_file_lcp_refcnt);
+
+  /* The namespace keeps its slot, its queue and its counters for when
+   * pairs are created in it again */
+  if (--nlns->clib_file_lcp_refcnt == 0)
+    {
+      LCP_NL_INFO ("pair_del_cb: Removing netlink listener for netns '%s'",
+		   nlns->netns_name);
+      lcp_nl_close_socket (nlns);
+    }
+}
+
+static clib_error_t *
+lcp_nl_read_cb (clib_file_t *f)
+{
+  lcp_nl_netlink_namespace_t *nlns = lcp_nl_ns_get (f->private_data);
   int err;
 
   /* Read until there's an error. Unless the error is ENOBUFS, which means
    * the kernel couldn't send a message due to socket buffer overflow.
-   * Continue reading when that happens.
+   * Continue reading when that happens, and resync afterwards.
    *
    * libnl translates both ENOBUFS and ENOMEM to NLE_NOMEM. So we need to
    * check return status and errno to make sure we should keep going.
    */
-  while ((err = nl_recvmsgs_default (nm->nl_ns.sk_route)) > -1 ||
+  while ((err = nl_recvmsgs_default (nlns->sk_route)) > -1 ||
 	 (err == -NLE_NOMEM && errno == ENOBUFS))
-    ;
+    if (err < 0)
+      nlns->overflowed = 1;
   if (err < 0 && err != -NLE_AGAIN)
     {
       LCP_NL_ERROR ("read_cb: Error reading netlink socket (fd %d): %s (%d)",
 		    f->file_descriptor, nl_geterror (err), err);
       vlib_process_signal_event (vlib_get_main (), lcp_nl_process_node.index,
-				 NL_EVENT_READ_ERR, 0);
+				 NL_EVENT_READ_ERR, nlns->index);
     }
   else
     {
       /* notify process node */
       vlib_process_signal_event (vlib_get_main (), lcp_nl_process_node.index,
-				 NL_EVENT_READ, 0);
+				 NL_EVENT_READ, nlns->index);
+    }
+
+  if (nlns->overflowed)
+    {
+      nlns->overflowed = 0;
+      vlib_process_signal_event (vlib_get_main (), lcp_nl_process_node.index,
+				 NL_EVENT_RESYNC, nlns->index);
     }
 
   return 0;
@@ -486,22 +2063,27 @@ lcp_nl_error_cb (clib_file_t *f)
 
   /* notify process node */
   vlib_process_signal_event (vlib_get_main (), lcp_nl_process_node.index,
-			     NL_EVENT_READ_ERR, 0);
+			     NL_EVENT_READ_ERR, f->private_data);
 
   return clib_error_return (0, "Error polling netlink socket %d",
 			    f->file_descriptor);
 }
 
 static void
-lcp_nl_close_socket (void)
+lcp_nl_close_socket (lcp_nl_netlink_namespace_t *nlns)
 {
-  lcp_nl_main_t *nm = &lcp_nl_main;
+
+  lcp_nl_reader_stop (nlns);
+
+  /* a dump in progress dies with the socket */
+  if (nlns->resync_step)
+    lcp_nl_dump_end (nlns, 0 /* complete */);
 
   /* delete existing fd from epoll fd set */
-  if (nm->nl_ns.clib_file_index != ~0)
+  if (nlns->clib_file_index != ~0)
     {
       clib_file_main_t *fm = &file_main;
-      clib_file_t *f = clib_file_get (fm, nm->nl_ns.clib_file_index);
+      clib_file_t *f = clib_file_get (fm, nlns->clib_file_index);
 
       if (f)
 	{
@@ -509,62 +2091,76 @@ lcp_nl_close_socket (void)
 		      f->file_descriptor);
 	  fm->file_update (f, UNIX_FILE_UPDATE_DELETE);
 	}
-      nm->nl_ns.clib_file_index = ~0;
+      nlns->clib_file_index = ~0;
     }
 
   /* If we created a socket, close/free it */
-  if (nm->nl_ns.sk_route)
+  if (nlns->sk_route)
     {
       LCP_NL_DBG ("close_socket: Closing netlink socket %d",
-		  nl_socket_get_fd (nm->nl_ns.sk_route));
-      nl_socket_free (nm->nl_ns.sk_route);
-      nm->nl_ns.sk_route = NULL;
+		  nl_socket_get_fd (nlns->sk_route));
+      nl_socket_free (nlns->sk_route);
+      nlns->sk_route = NULL;
     }
 }
 
 static void
-lcp_nl_open_socket (u8 *ns)
+lcp_nl_open_socket (lcp_nl_netlink_namespace_t *nlns)
 {
   lcp_nl_main_t *nm = &lcp_nl_main;
-  int dest_ns_fd = -1, orig_ns_fd = -1;
+  u8 *ns = nlns->netns_name;
+  int prev_ns;
   int err;
 
-  /* Switch to the correct network namespace, if specified. Otherwise,
-   * use the default namespace.
-   */
-  if (ns == 0 || ns[0] == 0)
-    ns = lcp_get_default_ns ();
-
-  if (ns && ns[0] != 0)
+  /* The queue is sized once the startup config is known. In reader thread
+   * mode it never grows. */
+  if (!nlns->nl_msg_queue)
+    vec_validate (nlns->nl_msg_queue, nm->ring_size - 1);
+  if (nm->reader_thread && nlns->reader_efd == -1)
+    nlns->reader_efd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (nm->reader_thread && nlns->reader_space_efd == -1)
+    nlns->reader_space_efd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (nm->reader_thread &&
+      (nlns->reader_efd == -1 || nlns->reader_space_efd == -1))
     {
-      orig_ns_fd = clib_netns_open (NULL /* self */);
-      dest_ns_fd = clib_netns_open (ns);
-      clib_setns (dest_ns_fd);
-      nm->nl_ns.netns_name = vec_dup (ns);
+      LCP_NL_ERROR ("open_socket: Unable to create eventfd, reading netlink "
+		    "from the main thread: %s",
+		    strerror (errno));
+      nm->reader_thread = 0;
     }
 
+  /* Switch to the network namespace of the listener, lcp_nl_ns_name()
+   * resolved the default one already.
+   */
+  if ((prev_ns = lcp_ns_enter (ns)) == -1)
+    LCP_NL_ERROR ("open_socket: Unable to enter netns '%s'", ns);
+
   /* Allocate a new socket for netlink messages.
    * Notifications do not use sequence numbers, disable sequence number
    * checking. Define a callback function, which will be called for each
    * notification received.
    */
-  nm->nl_ns.sk_route = nl_socket_alloc ();
-  nl_socket_disable_seq_check (nm->nl_ns.sk_route);
+  nlns->sk_route = nl_socket_alloc ();
+  nl_socket_disable_seq_check (nlns->sk_route);
 
-  nl_connect (nm->nl_ns.sk_route, NETLINK_ROUTE);
+  nl_connect (nlns->sk_route, NETLINK_ROUTE);
 
   /* Subscribe to all the 'routing' notifications on the route socket */
   nl_socket_add_memberships (
-    nm->nl_ns.sk_route, RTNLGRP_LINK, RTNLGRP_IPV6_IFADDR, RTNLGRP_IPV4_IFADDR,
+    nlns->sk_route, RTNLGRP_LINK, RTNLGRP_IPV6_IFADDR, RTNLGRP_IPV4_IFADDR,
     RTNLGRP_IPV4_ROUTE, RTNLGRP_IPV6_ROUTE, RTNLGRP_NEIGH, RTNLGRP_NOTIFY,
+    RTNLGRP_NEXTHOP,
 #ifdef RTNLGRP_MPLS_ROUTE /* not defined on CentOS/RHEL 7 */
     RTNLGRP_MPLS_ROUTE,
 #endif
     RTNLGRP_IPV4_RULE, RTNLGRP_IPV6_RULE, 0);
 
+  /* Drop what the handlers would ignore before it is queued to the socket */
+  lcp_nl_filter_attach (nlns);
+
   /* Set socket in nonblocking mode and increase buffer sizes */
-  nl_socket_set_nonblocking (nm->nl_ns.sk_route);
-  err = nl_socket_set_buffer_size (nm->nl_ns.sk_route, nm->rx_buf_size,
+  nl_socket_set_nonblocking (nlns->sk_route);
+  err = nl_socket_set_buffer_size (nlns->sk_route, nm->rx_buf_size,
 				   nm->tx_buf_size);
   if (err != 0)
     {
@@ -573,47 +2169,417 @@ lcp_nl_open_socket (u8 *ns)
 	nm->tx_buf_size, nm->rx_buf_size, nl_geterror (err));
     }
 
-  if (dest_ns_fd != -1)
-    close (dest_ns_fd);
+  lcp_ns_leave (prev_ns);
 
-  if (orig_ns_fd != -1)
+  if (nm->reader_thread && lcp_nl_reader_start (nlns) < 0)
     {
-      clib_setns (orig_ns_fd);
-      close (orig_ns_fd);
+      LCP_NL_ERROR ("open_socket: Reading netlink from the main thread");
+      nm->reader_thread = 0;
     }
 
-  if (nm->nl_ns.clib_file_index == ~0)
+  /* a reader thread polls the socket, otherwise the main thread does */
+  if (!nm->reader_thread && nlns->clib_file_index == ~0)
     /* add the netlink fd into clib file handler */
     {
       clib_file_t rt_file = {
 	.read_function = lcp_nl_read_cb,
 	.error_function = lcp_nl_error_cb,
-	.file_descriptor = nl_socket_get_fd (nm->nl_ns.sk_route),
-	.description = format (0, "linux-cp netlink route socket"),
+	.file_descriptor = nl_socket_get_fd (nlns->sk_route),
+	.private_data = nlns->index,
+	.description =
+	  format (0, "linux-cp netlink route socket netns '%s'", ns),
       };
 
-      nm->nl_ns.clib_file_index = clib_file_add (&file_main, &rt_file);
+      nlns->clib_file_index = clib_file_add (&file_main, &rt_file);
       LCP_NL_DBG ("open_socket: Added netlink file idx %u fd %u netns %s",
-		  nm->nl_ns.clib_file_index, rt_file.file_descriptor, ns);
+		  nlns->clib_file_index, rt_file.file_descriptor, ns);
     }
-  else
+  else if (!nm->reader_thread)
     /* clib file already created and socket was closed due to error */
     {
       clib_file_main_t *fm = &file_main;
-      clib_file_t *f = clib_file_get (fm, nm->nl_ns.clib_file_index);
+      clib_file_t *f = clib_file_get (fm, nlns->clib_file_index);
 
-      f->file_descriptor = nl_socket_get_fd (nm->nl_ns.sk_route);
+      f->file_descriptor = nl_socket_get_fd (nlns->sk_route);
       fm->file_update (f, UNIX_FILE_UPDATE_ADD);
       LCP_NL_DBG ("open_socket: Updated netlink file idx %u fd %u netns %s",
-		  nm->nl_ns.clib_file_index, f->file_descriptor, ns);
+		  nlns->clib_file_index, f->file_descriptor, ns);
+    }
+
+  nl_socket_modify_cb (nlns->sk_route, NL_CB_VALID, NL_CB_CUSTOM,
+		       lcp_nl_callback, nlns);
+  nl_socket_modify_cb (nlns->sk_route, NL_CB_FINISH, NL_CB_CUSTOM,
+		       lcp_nl_finish_callback, nlns);
+  nl_socket_modify_err_cb (nlns->sk_route, NL_CB_CUSTOM,
+			   lcp_nl_error_callback, nlns);
+  LCP_NL_NOTICE ("open_socket: Started poll of netlink fd %d netns '%s'",
+		 nl_socket_get_fd (nlns->sk_route), nlns->netns_name);
+}
+
+static u8 *
+format_lcp_nl_msg_type (u8 *s, va_list *args)
+{
+  u32 type = va_arg (*args, u32);
+
+  switch (type)
+    {
+#define _(t)                                                                  \
+  case t:                                                                     \
+    return format (s, "%s", #t);
+      _ (RTM_NEWLINK)
+      _ (RTM_DELLINK)
+      _ (RTM_NEWADDR)
+      _ (RTM_DELADDR)
+      _ (RTM_NEWROUTE)
+      _ (RTM_DELROUTE)
+      _ (RTM_NEWNEIGH)
+      _ (RTM_DELNEIGH)
+      _ (RTM_NEWRULE)
+      _ (RTM_DELRULE)
+      _ (RTM_NEWNEXTHOP)
+      _ (RTM_DELNEXTHOP)
+#undef _
+    default:
+      return format (s, "type %u", type);
+    }
+}
+
+static void
+lcp_nl_show_hist (vlib_main_t *vm, lcp_nl_hist_t h)
+{
+  vlib_simple_counter_main_t *cm = &lcp_nl_main.hists[h];
+  u64 n;
+  int i;
+
+  for (i = 0; i < NL_HIST_N_BUCKETS; i++)
+    {
+      if (!(n = vlib_get_simple_counter (cm, i)))
+	continue;
+      if (i == NL_HIST_N_BUCKETS - 1)
+	vlib_cli_output (vm, "  >= %u usec: %llu", 1 << i, n);
+      else
+	vlib_cli_output (vm, "  < %u usec: %llu", 2 << i, n);
+    }
+}
+
+static clib_error_t *
+lcp_nl_show_cmd (vlib_main_t *vm, unformat_input_t *input,
+		 vlib_cli_command_t *cmd)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  lcp_nl_netlink_namespace_t *nlns, **nlnsp;
+
+  pool_foreach (nlnsp, nm->nl_ns_pool)
+    {
+      nlns = *nlnsp;
+      vlib_cli_output (vm,
+		       "netns '%s' fd %d refcnt %u weight %u table-base %u",
+		       nlns->netns_name,
+		       nlns->sk_route ? nl_socket_get_fd (nlns->sk_route) : -1,
+		       nlns->clib_file_lcp_refcnt, nlns->weight,
+		       nlns->table_base);
+      vlib_cli_output (vm,
+		       "  queue depth %llu size %u high-water-mark %llu",
+		       lcp_nl_queue_len (nlns), vec_len (nlns->nl_msg_queue),
+		       nlns->nl_msg_hwm);
+      if (nm->reader_thread)
+	vlib_cli_output (vm,
+			 "  reader thread %s cpu %d ring-full %llu enobufs "
+			 "%llu truncated %llu",
+			 nlns->reader_running ? "running" : "stopped",
+			 (int) nm->reader_cpu, nlns->reader_n_full,
+			 nlns->reader_n_enobufs, nlns->reader_n_truncated);
+      if (vec_len (nlns->decoders))
+	vlib_cli_output (vm,
+			 "  decoder threads %u decoded %llu by main thread "
+			 "%llu skipped %llu",
+			 vec_len (nlns->decoders), nlns->decode_n_taken,
+			 nlns->decode_n_self, nlns->decode_n_skips);
+      vlib_cli_output (vm, "  imports %u resyncs %u socket filter %s",
+		       nlns->n_imports, nlns->n_resyncs,
+		       nlns->filter_attached ? "attached" : "none");
+      if (nlns->resync_step)
+	vlib_cli_output (vm,
+			 "  %s in progress: step %u, %llu messages applied",
+			 nlns->resync_sweep ? "resync" : "import",
+			 nlns->resync_step, nlns->dump_n_msgs);
+    }
+  vlib_cli_output (vm,
+		   "rx-buffer-size %u tx-buffer-size %u batch-size %u "
+		   "batch-work-ms %u batch-delay-ms %u batch-barrier-ms %u",
+		   nm->rx_buf_size, nm->tx_buf_size, nm->batch_size,
+		   nm->batch_work_ms, nm->batch_delay_ms, nm->batch_barrier_ms);
+
+  vlib_cli_output (vm, "elided %llu", nm->n_elided);
+  if (nm->link_down_purge)
+    vlib_cli_output (vm, "link-down purges %llu: %llu routes %llu neighbors",
+		     nm->purge_n_links, nm->purge_n_routes,
+		     nm->purge_n_neighbors);
+  if (nm->resync_n_pending)
+    vlib_cli_output (vm, "resync pending in %u netns", nm->resync_n_pending);
+  vlib_cli_output (vm, "barrier holds %llu total %.3f ms max %.3f ms",
+		   nm->barrier_n_holds, 1e3 * nm->barrier_hold_total,
+		   1e3 * nm->barrier_hold_max);
+  lcp_nl_show_hist (vm, LCP_NL_HIST_BARRIER);
+
+  return 0;
+}
+
+VLIB_CLI_COMMAND (lcp_nl_show_cmd_node, static) = {
+  .path = "show lcp netlink",
+  .function = lcp_nl_show_cmd,
+  .short_help = "show lcp netlink",
+  .is_mp_safe = 1,
+};
+
+static clib_error_t *
+lcp_nl_show_stats_cmd (vlib_main_t *vm, unformat_input_t *input,
+		       vlib_cli_command_t *cmd)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  lcp_nl_netlink_namespace_t **nlnsp;
+  u64 n[LCP_NL_N_MSG_COUNTER];
+  u8 *s = 0;
+  u32 type;
+  int i;
+
+  for (i = 0; i < LCP_NL_N_MSG_COUNTER; i++)
+    s = format (s, "%10s", lcp_nl_msg_counter_names[i]);
+  vlib_cli_output (vm, "%-16s%v", "message", s);
+  for (type = 0; type <= RTM_MAX; type++)
+    {
+      for (i = 0; i < LCP_NL_N_MSG_COUNTER; i++)
+	n[i] = vlib_get_simple_counter (&nm->msg_counters[i], type);
+      if (!n[LCP_NL_MSG_COUNTER_RECEIVED])
+	continue;
+      vec_reset_length (s);
+      for (i = 0; i < LCP_NL_N_MSG_COUNTER; i++)
+	s = format (s, "%10llu", n[i]);
+      vlib_cli_output (vm, "%-16U%v", format_lcp_nl_msg_type, type, s);
+    }
+  vec_free (s);
+
+  pool_foreach (nlnsp, nm->nl_ns_pool)
+    vlib_cli_output (vm, "netns '%s' queue depth %llu high-water-mark %llu",
+		     (*nlnsp)->netns_name, lcp_nl_queue_len (*nlnsp),
+		     (*nlnsp)->nl_msg_hwm);
+
+  for (i = 0; i < LCP_NL_N_HIST; i++)
+    {
+      vlib_cli_output (vm, "%s:", lcp_nl_hist_names[i]);
+      lcp_nl_show_hist (vm, i);
+    }
+
+  return 0;
+}
+
+VLIB_CLI_COMMAND (lcp_nl_show_stats_cmd_node, static) = {
+  .path = "show lcp netlink statistics",
+  .function = lcp_nl_show_stats_cmd,
+  .short_help = "show lcp netlink statistics",
+  .is_mp_safe = 1,
+};
+
+static clib_error_t *
+lcp_nl_record_cmd (vlib_main_t *vm, unformat_input_t *input,
+		   vlib_cli_command_t *cmd)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  lcp_nl_record_hdr_t hdr = {
+    .magic = LCP_NL_RECORD_MAGIC,
+    .version = LCP_NL_RECORD_VERSION,
+  };
+  u8 *file = 0, is_stop = 0;
+  int fd;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "stop"))
+	is_stop = 1;
+      else if (unformat (input, "%s", &file))
+	;
+      else
+	return clib_error_return (0, "unknown input `%U'",
+				  format_unformat_error, input);
     }
 
-  nl_socket_modify_cb (nm->nl_ns.sk_route, NL_CB_VALID, NL_CB_CUSTOM,
-		       lcp_nl_callback, NULL);
-  LCP_NL_NOTICE ("open_socket: Started poll of netlink fd %d netns %s",
-		 nl_socket_get_fd (nm->nl_ns.sk_route), nm->nl_ns.netns_name);
+  if (nm->record_fd >= 0)
+    {
+      lcp_nl_record_flush ();
+      close (nm->record_fd);
+      nm->record_fd = -1;
+      vlib_cli_output (vm, "recorded %llu messages", nm->record_n_msgs);
+    }
+  if (is_stop || !file)
+    {
+      vec_free (file);
+      return 0;
+    }
+
+  vec_add1 (file, 0);
+  fd = open ((char *) file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0 || write (fd, &hdr, sizeof (hdr)) != sizeof (hdr))
+    {
+      clib_error_t *error =
+	clib_error_return_unix (0, "unable to write %s", file);
+
+      if (fd >= 0)
+	close (fd);
+      vec_free (file);
+      return error;
+    }
+
+  nm->record_fd = fd;
+  nm->record_n_msgs = 0;
+  vec_free (file);
+
+  return 0;
+}
+
+VLIB_CLI_COMMAND (lcp_nl_record_cmd_node, static) = {
+  .path = "lcp netlink record",
+  .function = lcp_nl_record_cmd,
+  .short_help = "lcp netlink record <file>|stop",
+};
+
+static clib_error_t *
+lcp_nl_show_nexthop_cmd (vlib_main_t *vm, unformat_input_t *input,
+			 vlib_cli_command_t *cmd)
+{
+  lcp_nl_nexthop_t *nh;
+  u32 nh_id = ~0;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "%u", &nh_id))
+	;
+      else
+	return clib_error_return (0, "unknown input `%U'",
+				  format_unformat_error, input);
+    }
+
+  /* nexthop ids are per namespace, show the id of each */
+  pool_foreach (nh, lcp_nl_nexthop_pool)
+    {
+      if (nh_id == ~0 || nh->nh_id == nh_id)
+	vlib_cli_output (vm, "%U", format_lcp_nl_nexthop, nh);
+    }
+
+  return 0;
 }
 
+VLIB_CLI_COMMAND (lcp_nl_show_nexthop_cmd_node, static) = {
+  .path = "show lcp netlink nexthop",
+  .function = lcp_nl_show_nexthop_cmd,
+  .short_help = "show lcp netlink nexthop [<id>]",
+};
+
+static clib_error_t *
+lcp_nl_show_tables_cmd (vlib_main_t *vm, unformat_input_t *input,
+			vlib_cli_command_t *cmd)
+{
+  lcp_nl_table_t *nlt;
+  u32 n_mfibs = 0;
+  uword bytes = 0;
+
+  pool_foreach (nlt, lcp_nl_table_pool)
+    {
+      vlib_cli_output (vm, "%U", format_lcp_nl_table, nlt);
+      bytes += lcp_nl_table_mem_size (nlt);
+      if (~0 != nlt->nlt_mfib_index)
+	n_mfibs++;
+    }
+  vlib_cli_output (vm, "%u tables, %u with an mfib, memory %U",
+		   pool_elts (lcp_nl_table_pool), n_mfibs, format_memory_size,
+		   bytes);
+
+  return 0;
+}
+
+VLIB_CLI_COMMAND (lcp_nl_show_tables_cmd_node, static) = {
+  .path = "show lcp netlink tables",
+  .function = lcp_nl_show_tables_cmd,
+  .short_help = "show lcp netlink tables",
+};
+
+static clib_error_t *
+lcp_nl_config (vlib_main_t *vm, unformat_input_t *input)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  u8 *ns;
+  u32 val;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "nl-rx-buffer-size %u", &val))
+	nm->rx_buf_size = val;
+      else if (unformat (input, "nl-tx-buffer-size %u", &val))
+	nm->tx_buf_size = val;
+      else if (unformat (input, "nl-batch-size %u", &val))
+	nm->batch_size = val;
+      else if (unformat (input, "nl-batch-work-ms %u", &val))
+	nm->batch_work_ms = val;
+      else if (unformat (input, "nl-batch-delay-ms %u", &val))
+	nm->batch_delay_ms = val;
+      else if (unformat (input, "nl-batch-barrier-ms %u", &val))
+	nm->batch_barrier_ms = val;
+      else if (unformat (input, "nl-ring-size %u", &val))
+	nm->ring_size = val;
+      else if (unformat (input, "nl-reader-thread cpu %u", &val))
+	{
+	  nm->reader_thread = 1;
+	  nm->reader_cpu = val;
+	}
+      else if (unformat (input, "nl-reader-thread"))
+	nm->reader_thread = 1;
+      else if (unformat (input, "nl-decode-threads %u", &val))
+	nm->decode_n_threads = val;
+      else if (unformat (input, "nl-filter-ignore-protocol %u", &val))
+	{
+	  if (val > 255)
+	    return clib_error_return (0, "invalid rtm_protocol %u", val);
+	  vec_add1 (nm->filter_protos, val);
+	}
+      else if (unformat (input, "nl-filter-ignore-table %u", &val))
+	vec_add1 (nm->filter_tables, val);
+      else if (unformat (input, "no-nl-filter"))
+	nm->filter_disabled = 1;
+      else if (unformat (input, "nl-link-down-purge"))
+	nm->link_down_purge = 1;
+      else if (unformat (input, "nl-netns-weight %s %u", &ns, &val))
+	{
+	  if (val == 0)
+	    return clib_error_return (0, "nl-netns-weight must be at least 1");
+	  if (!nm->nl_ns_weights)
+	    nm->nl_ns_weights = hash_create_string (0, sizeof (uword));
+	  vec_add1 (ns, 0);
+	  hash_set_mem (nm->nl_ns_weights, ns, val);
+	}
+      else if (unformat (input, "nl-netns-table-base %s %u", &ns, &val))
+	{
+	  if (!nm->nl_ns_table_bases)
+	    nm->nl_ns_table_bases = hash_create_string (0, sizeof (uword));
+	  vec_add1 (ns, 0);
+	  hash_set_mem (nm->nl_ns_table_bases, ns, val);
+	}
+      else
+	return clib_error_return (0, "invalid netlink option: %U",
+				  format_unformat_error, input);
+    }
+
+  if (nm->batch_size == 0)
+    return clib_error_return (0, "nl-batch-size must be at least 1");
+  if (nm->ring_size < 2)
+    return clib_error_return (0, "nl-ring-size must be at least 2");
+  nm->ring_size = max_pow2 (nm->ring_size);
+  if (nm->decode_n_threads && !nm->reader_thread)
+    return clib_error_return (0, "nl-decode-threads needs nl-reader-thread");
+
+  return NULL;
+}
+
+VLIB_CONFIG_FUNCTION (lcp_nl_config, "linux-nl");
+
 #include <vnet/plugin/plugin.h>
 clib_error_t *
 lcp_nl_init (vlib_main_t *vm)
@@ -624,7 +2590,9 @@ lcp_nl_init (vlib_main_t *vm)
     .pair_del_fn = lcp_nl_pair_del_cb,
   };
 
-  nm->nl_ns.clib_file_index = ~0;
+  nm->nl_ns_by_name = hash_create_string (0, sizeof (uword));
+  lcp_nl_stats_init ();
+  lcp_nl_neigh_cache_init ();
   nm->nl_logger = vlib_log_register_class ("linux-cp", "nl");
 
   lcp_itf_pair_register_vft (&nl_itf_pair_vft);
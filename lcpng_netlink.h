@@ -13,8 +13,12 @@
  * limitations under the License.
  */
 
+#include <pthread.h>
+#include <linux/nexthop.h>
+
 #include <vlib/vlib.h>
 #include <plugins/lcpng/lcpng.h>
+#include <plugins/lcpng/lcpng_interface.h>
 
 #include <netlink/msg.h>
 #include <netlink/netlink.h>
@@ -29,10 +33,19 @@
 #include <vnet/fib/fib_table.h>
 #include <vnet/mfib/mfib_table.h>
 
+#include <vppinfra/mhash.h>
+
+#ifndef NUD_VALID
+#define NUD_VALID                                                             \
+  (NUD_PERMANENT | NUD_NOARP | NUD_REACHABLE | NUD_PROBE | NUD_STALE |        \
+   NUD_DELAY)
+#endif
+
 typedef enum nl_event_type_t_
 {
   NL_EVENT_READ,
   NL_EVENT_READ_ERR,
+  NL_EVENT_RESYNC,
 } nl_event_type_t;
 
 #define NL_RX_BUF_SIZE_DEF    (1 << 27) /* 128 MB */
@@ -40,6 +53,58 @@ typedef enum nl_event_type_t_
 #define NL_BATCH_SIZE_DEF     (1 << 13) /* 8192 */
 #define NL_BATCH_WORK_MS_DEF  40	/* 40 ms */
 #define NL_BATCH_DELAY_MS_DEF 10	/* 10 ms, max 20 batch/s */
+#define NL_BATCH_BARRIER_MS_DEF 10	/* 10 ms, max worker barrier hold */
+#define NL_RING_SIZE_DEF	(1 << 16) /* 65536 queued messages */
+
+/* Durations are kept in log2 histograms of microseconds: bucket 0 holds
+ * [0,2) usec, bucket N holds [2^N,2^(N+1)) usec, and the last bucket
+ * collects everything longer than that. See lcp_nl_hist_add().
+ */
+#define NL_HIST_N_BUCKETS 24
+
+/* Histograms in the stats segment, one counter per bucket */
+#define foreach_lcp_nl_hist                                                   \
+  _ (QUEUE_LATENCY, "queue-latency")                                          \
+  _ (BATCH, "batch-duration")                                                 \
+  _ (BARRIER, "barrier-hold")
+
+typedef enum lcp_nl_hist_t_
+{
+#define _(sym, str) LCP_NL_HIST_##sym,
+  foreach_lcp_nl_hist
+#undef _
+    LCP_NL_N_HIST,
+} lcp_nl_hist_t;
+
+/* Counters in the stats segment, indexed by netlink message type */
+#define foreach_lcp_nl_msg_counter                                            \
+  _ (RECEIVED, "received")                                                    \
+  _ (APPLIED, "applied")                                                      \
+  _ (ELIDED, "elided")                                                        \
+  _ (UNCHANGED, "unchanged")                                                  \
+  _ (IGNORED, "ignored")                                                      \
+  _ (FAILED, "failed")
+
+typedef enum lcp_nl_msg_counter_t_
+{
+#define _(sym, str) LCP_NL_MSG_COUNTER_##sym,
+  foreach_lcp_nl_msg_counter
+#undef _
+    LCP_NL_N_MSG_COUNTER,
+} lcp_nl_msg_counter_t;
+
+/* Gauges in the stats segment, indexed by namespace */
+#define foreach_lcp_nl_ns_gauge                                               \
+  _ (QUEUE_DEPTH, "queue-depth")                                              \
+  _ (QUEUE_HWM, "queue-hwm")
+
+typedef enum lcp_nl_ns_gauge_t_
+{
+#define _(sym, str) LCP_NL_NS_GAUGE_##sym,
+  foreach_lcp_nl_ns_gauge
+#undef _
+    LCP_NL_N_NS_GAUGE,
+} lcp_nl_ns_gauge_t;
 
 #define LCP_NL_DBG(...)	 vlib_log_debug (lcp_nl_main.nl_logger, __VA_ARGS__);
 #define LCP_NL_INFO(...) vlib_log_info (lcp_nl_main.nl_logger, __VA_ARGS__);
@@ -48,32 +113,178 @@ typedef enum nl_event_type_t_
 #define LCP_NL_WARN(...)  vlib_log_warn (lcp_nl_main.nl_logger, __VA_ARGS__);
 #define LCP_NL_ERROR(...) vlib_log_err (lcp_nl_main.nl_logger, __VA_ARGS__);
 
+/* Key under which queued netlink messages are coalesced: routes by
+ * (table, prefix, protocol) and neighbors by (ifindex, address). See
+ * lcp_nl_coalesce() in lcpng_netlink.c.
+ */
+typedef enum lcp_nl_coalesce_kind_t_
+{
+  LCP_NL_COALESCE_NONE = 0,
+  LCP_NL_COALESCE_ROUTE,
+  LCP_NL_COALESCE_NEIGH,
+} lcp_nl_coalesce_kind_t;
+
+typedef struct lcp_nl_coalesce_key_t_
+{
+  u8 kind;
+  u8 family;
+  u8 plen;  // routes only
+  u8 proto; // routes only
+  u32 id;   // table id for routes, ifindex for neighbors
+  ip46_address_t addr;
+} lcp_nl_coalesce_key_t;
+
+#define NL_MSG_F_KEYED	(1 << 0) /* coalesce_key is valid */
+#define NL_MSG_F_ELIDED (1 << 1) /* superseded, will not be dispatched */
+#define NL_MSG_F_DUMP_DONE (1 << 2) /* end of a dump, msg is NULL */
+#define NL_MSG_F_IGNORED   (1 << 3) /* not a type lcp_nl_dispatch() syncs */
+#define NL_MSG_F_SLOT	   (1 << 4) /* msg belongs to the slot, not freed */
+
+/* A route decoded by a decoder thread, see lcp_nl_route_op_decode(). The
+ * paths are kept by ifindex, their pairs are looked up when it is applied.
+ */
+#define LCP_NL_ROUTE_OP_N_PATHS 8
+
+typedef struct lcp_nl_route_op_path_t_
+{
+  ip46_address_t addr;
+  u32 ifindex;
+  u16 weight;
+  u8 fproto; // of addr, may differ from the route's (RFC 5549)
+} lcp_nl_route_op_path_t;
+
+typedef struct lcp_nl_route_op_t_
+{
+  u8 is_add;
+  u8 family;
+  u8 rtype;
+  u8 rproto;
+  u8 plen;
+  u8 n_paths;
+  u8 is_valid; // set by the decoder thread, 0 if it left the message
+  u32 table_id;
+  u32 priority;
+  u32 nh_id;
+  ip46_address_t dst;
+  ip46_address_t src; // multicast routes only
+  lcp_nl_route_op_path_t paths[LCP_NL_ROUTE_OP_N_PATHS];
+} lcp_nl_route_op_t;
+
 /* struct type to hold context on the netlink message being processed.
  */
 typedef struct nl_msg_info
 {
   struct nl_msg *msg;
   f64 ts;
+  u8 flags;
+  u32 dump_id;	     // NL_MSG_F_DUMP_DONE only, see lcp_nl_resync_next()
+  u64 coalesce_prev; // sequence number of the previous message with this key
+  lcp_nl_coalesce_key_t coalesce_key;
+  volatile u64 decode_tag; // see lcp_nl_decode_claim()
 } nl_msg_info_t;
 
+/* The VPP table ids of a namespace other than the default one start at a
+ * multiple of this, unless configured with nl-netns-table-base */
+#define LCP_NL_NS_TABLE_STRIDE (1 << 20)
+
 typedef struct lcp_nl_netlink_namespace
 {
   struct nl_sock *sk_route;
-  nl_msg_info_t *nl_msg_queue;
   uword clib_file_index;    // clib file that holds the netlink socket for this
 			    // namespace
   u32 clib_file_lcp_refcnt; // number of interfaces watched in the this netlink
 			    // namespace
-  u8 *netns_name;	    // namespace name (can be empty, for 'self')
+  u8 *netns_name;	    // namespace name, a C string (empty for 'self')
+  u32 index;		    // in lcp_nl_main.nl_ns_pool
+  u32 weight;		    // share of each batch, see lcp_nl_process_all()
+  u32 table_base;	    // VPP table id of its main table, see
+			    // lcp_nl_table_k2f()
+
+  /* The message queue is a ring with a power of 2 number of slots, indexed
+   * by message sequence number. lcp_nl_process_msgs() is the only consumer.
+   * The producer is either lcp_nl_callback() on the main thread, which grows
+   * the ring when it is full, or the reader thread, which waits for the
+   * consumer instead. A slot goes back to the producer once it is consumed
+   * and no decoder thread looks at it any more, see lcp_nl_queue_release().
+   */
+  nl_msg_info_t *nl_msg_queue;
+  volatile u64 nl_msg_head;	 // next message to consume
+  volatile u64 nl_msg_released; // slots before this one are the producer's
+  u64 nl_msg_scanned;		 // messages before this one have been coalesced
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline1);
+  volatile u64 nl_msg_tail; // next slot to produce into
+  u64 nl_msg_hwm;	    // high-water mark of the queue depth
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline2);
+
+  mhash_t nl_coalesce_db; // coalesce key -> sequence number of latest message
+
+  /* Resync and import, see lcp_nl_dump_start() */
+  u8 resync_step;	    // 0 when idle, otherwise 1 + index of the dump
+  u8 resync_sweep;	    // 1 for a resync, 0 for the initial import
+  u8 import_pending;	    // import again once the dump is over
+  volatile u8 overflowed;   // socket overflowed, set by the reader
+  volatile u32 n_dump_done; // dumps completed, counted by the producer
+  u32 resync_dump_done;	    // value of n_dump_done the step is waiting for
+  f64 resync_start;
+  f64 resync_step_start;
+  u64 dump_n_msgs; // messages applied since the dump started
+  u32 n_resyncs;
+  u32 n_imports;
+
+  /* Reader thread, see lcp_nl_reader_thread() */
+  pthread_t reader_thread;
+  u8 reader_running;
+  volatile u8 reader_stop;
+  volatile int reader_errno; // set by the reader thread when it gives up
+  int reader_efd;	     // eventfd the reader thread wakes us up with
+  int reader_space_efd;	     // eventfd we wake up a waiting reader with
+  volatile u8 reader_waiting; // reader blocked on a full ring
+  uword reader_file_index;   // clib file that holds reader_efd
+  u8 *reader_bufs;	     // recvmmsg buffers
+  struct nl_msg **reader_slots; // one message for each slot of the queue
+  u64 reader_n_full;	     // times the reader found the ring full
+  u64 reader_n_enobufs;	     // times the socket overflowed
+  u64 reader_n_truncated;    // datagrams larger than a reader buffer
+
+  /* Decoder threads, see lcp_nl_decoder_thread() */
+  struct lcp_nl_decoder_t_ *decoders;
+  lcp_nl_route_op_t *decode_ops; // one for each slot of the queue
+  volatile u8 decode_stop;
+  pthread_mutex_t decode_lock; // idle decoders wait on decode_cond
+  pthread_cond_t decode_cond;
+  u64 decode_n_taken;		 // ops applied as decoded
+  u64 decode_n_self;		 // messages the main thread got to first
+  u64 decode_n_skips;		 // decoded again, a decoder was at it
+
+  u8 filter_attached; // see lcp_nl_filter_attach()
 } lcp_nl_netlink_namespace_t;
 
+typedef struct lcp_nl_decoder_t_
+{
+  pthread_t thread;
+  lcp_nl_netlink_namespace_t *nlns;
+  u32 index;
+} lcp_nl_decoder_t;
+
 typedef struct lcp_nl_main
 {
   vlib_log_class_t nl_logger;
-  /* TODO(pim): nl_ns should become a list, one for each unique namespace we
-   * created LCP pairs in.
+
+  /* One listener for each namespace LCP pairs were created in. Elements
+   * are allocated separately and never freed: the reader threads, the
+   * libnl callbacks and the coalescing mhash hold pointers to them.
    */
-  lcp_nl_netlink_namespace_t nl_ns;
+  lcp_nl_netlink_namespace_t **nl_ns_pool;
+  uword *nl_ns_by_name;	 // netns name -> index in nl_ns_pool
+  uword *nl_ns_weights;	 // netns name -> configured weight
+  uword *nl_ns_table_bases; // netns name -> configured VPP table id base
+  u32 nl_ns_current;	 // namespace being applied, see lcp_nl_lip_find_by_vif()
+  u32 nl_ns_next;	 // namespace the next batch starts with
+
+  /* A resync dumps every namespace, see lcp_nl_resync_begin() */
+  u32 resync_n_pending; // namespaces still dumping
+  u8 resync_restart;	// overflowed again while resyncing
+  u8 resync_failed;	// a dump was aborted, do not sweep
 
   fib_source_t fib_src; // For static routes set manually
   fib_source_t
@@ -84,11 +295,75 @@ typedef struct lcp_nl_main
   u32 batch_size;
   u32 batch_work_ms;
   u32 batch_delay_ms;
+  u32 batch_barrier_ms;
+  u32 ring_size;
+  u8 reader_thread; // read the netlink socket from a dedicated thread
+  u32 reader_cpu;   // cpu to pin the reader thread to, or ~0
+  u32 decode_n_threads; // decoder threads per reader thread, 0 for none
+
+  /* Withdraw the routes and neighbors of a link taken down, see
+   * lcp_nl_link_purge() */
+  u8 link_down_purge;
+  u64 purge_n_links;
+  u64 purge_n_routes;
+  u64 purge_n_neighbors;
+
+  /* Socket filter, see lcpng_nl_filter.c */
+  u8 filter_disabled;
+  u8 *filter_protos;		  // ignored rtm_protocol values
+  u32 *filter_tables;		  // ignored route tables
+  struct sock_filter *filter_prog; // built on first use
+
+  /* Worker barrier statistics, see lcp_nl_process_msgs() */
+  u64 barrier_n_holds;
+  f64 barrier_hold_total;
+  f64 barrier_hold_max;
+
+  /* see lcp_nl_stats_init() */
+  vlib_simple_counter_main_t hists[LCP_NL_N_HIST];
+  vlib_simple_counter_main_t msg_counters[LCP_NL_N_MSG_COUNTER];
+  vlib_simple_counter_main_t ns_gauges[LCP_NL_N_NS_GAUGE];
+
+  /* Number of messages dropped because a later message superseded them */
+  u64 n_elided;
+
+  /* Recording of the applied messages, see lcp_nl_record() */
+  int record_fd;
+  u8 *record_buf;
+  u64 record_n_msgs;
 
 } lcp_nl_main_t;
 
 extern lcp_nl_main_t lcp_nl_main;
 
+/* A recording of a netlink stream is a lcp_nl_record_hdr_t, followed by
+ * a lcp_nl_record_msg_t and the len bytes of the message for every message.
+ * Timestamps are those of vlib_time_now() when the message was queued.
+ */
+#define LCP_NL_RECORD_MAGIC   0x6c63704e /* "lcpN" */
+#define LCP_NL_RECORD_VERSION 1
+
+typedef struct lcp_nl_record_hdr_t_
+{
+  u32 magic;
+  u32 version;
+} lcp_nl_record_hdr_t;
+
+typedef struct lcp_nl_record_msg_t_
+{
+  f64 ts;
+  u32 len;
+  u32 pad;
+} lcp_nl_record_msg_t;
+
+/* Replay of a recording through the listener of namespace ns, as done by
+ * test/lcpng_nl_bench.c. Inject queues a message as lcp_nl_callback()
+ * would, run applies one round of what is queued and returns how many
+ * messages are left.
+ */
+int lcp_nl_replay_inject (const u8 *ns, const struct nlmsghdr *hdr);
+u64 lcp_nl_replay_run (void);
+
 typedef struct lcp_nl_route_path_parse_t_
 {
   fib_route_path_t *paths;
@@ -98,18 +373,95 @@ typedef struct lcp_nl_route_path_parse_t_
   u8 preference;
 } lcp_nl_route_path_parse_t;
 
+/* A route, decoded from either a raw RTM_NEWROUTE/RTM_DELROUTE or a libnl
+ * route object, see lcp_nl_route_decode().
+ */
+typedef struct lcp_nl_route_t_
+{
+  u8 is_add;
+  u8 rtype;
+  u8 rproto;
+  u32 table_id;
+  u32 priority;
+  fib_prefix_t pfx;
+  mfib_prefix_t mpfx; // multicast routes only
+  u32 nh_id; // RTA_NH_ID, 0 if the route has its own paths
+  lcp_nl_route_path_parse_t np;
+} lcp_nl_route_t;
+
+/* A kernel nexthop object, see lcp_nl_nexthop_program() in lcpng_nl_sync.c
+ */
+typedef struct lcp_nl_nexthop_member_t_
+{
+  u32 nh_id;
+  u16 weight;
+} lcp_nl_nexthop_member_t;
+
+#define LCP_NL_NH_F_BLACKHOLE  (1 << 0)
+#define LCP_NL_NH_F_GROUP      (1 << 1)
+#define LCP_NL_NH_F_PENDING    (1 << 2) /* used by a route, not announced yet */
+#define LCP_NL_NH_F_STALE      (1 << 3) /* not seen in the resync dump yet */
+#define LCP_NL_NH_F_UNRESOLVED (1 << 4) /* its interface has no LCP pair */
+
+typedef struct lcp_nl_nexthop_t_
+{
+  u32 nh_id;
+  u32 ns_index; // nexthop ids are per namespace, in lcp_nl_main.nl_ns_pool
+  u8 flags;
+  u8 family; // of the gateway
+  u32 ifindex;
+  ip46_address_t gw;
+  lcp_nl_nexthop_member_t *members; // groups only
+  fib_node_index_t fib_entry_index[FIB_PROTOCOL_IP_MAX];
+} lcp_nl_nexthop_t;
+
+extern lcp_nl_nexthop_t *lcp_nl_nexthop_pool;
+
 u8 *format_nl_object (u8 *s, va_list *args);
 
+/* The namespace whose messages are being applied, NULL outside of
+ * lcp_nl_process_msgs(), and the pair of a host interface there */
+const u8 *lcp_nl_ns_current_name (void);
+const u8 *lcp_nl_ns_index_name (u32 ns_index);
+u32 lcp_nl_ns_current_table_base (void);
+void lcp_nl_ns_current_import (void);
+lcp_itf_pair_t *lcp_nl_lip_find_by_vif (u32 vif_index);
+
+/* Functions from lcpng_nl_filter.c
+ */
+void lcp_nl_filter_attach (lcp_nl_netlink_namespace_t *nlns);
+int lcp_nl_filter_route_ignored (u8 rproto, u32 table_id);
+
 /* Functions from lcpng_nl_sync.c
  */
 void lcp_nl_neigh_add (struct rtnl_neigh *rn);
 void lcp_nl_neigh_del (struct rtnl_neigh *rn);
+void lcp_nl_neigh_cache_init (void);
+void lcp_nl_neigh_pair_flush (u32 phy_sw_if_index);
+void lcp_nl_route_pair_flush (u32 phy_sw_if_index);
+void lcp_nl_nexthop_pair_add (u32 vif_index);
+int lcp_nl_neigh_raw_unchanged (struct nlmsghdr *hdr);
 void lcp_nl_addr_add (struct rtnl_addr *ra);
 void lcp_nl_addr_del (struct rtnl_addr *ra);
 void lcp_nl_link_add (struct rtnl_link *rl, void *ctx);
 void lcp_nl_link_del (struct rtnl_link *rl);
 void lcp_nl_route_add (struct rtnl_route *rr);
 void lcp_nl_route_del (struct rtnl_route *rr);
+int lcp_nl_route_decode (struct nlmsghdr *hdr, lcp_nl_route_t *r);
+int lcp_nl_route_op_decode (struct nlmsghdr *hdr, lcp_nl_route_op_t *op);
+void lcp_nl_route_op_raw (const lcp_nl_route_op_t *op);
+int lcp_nl_route_raw (struct nlmsghdr *hdr);
+int lcp_nl_route_raw_applies (struct nlmsghdr *hdr);
+void lcp_nl_route_flush (void);
+u8 *format_lcp_nl_route (u8 *s, va_list *args);
+int lcp_nl_nexthop_raw (struct nlmsghdr *hdr);
+lcp_nl_nexthop_t *lcp_nl_nexthop_find (u32 ns_index, u32 nh_id);
+u8 *format_lcp_nl_nexthop (u8 *s, va_list *args);
+void lcp_nl_resync_mark (void);
+void lcp_nl_resync_sweep (void);
+void lcp_nl_table_gc (void);
+uword lcp_nl_table_mem_size (const lcp_nl_table_t *nlt);
+u8 *format_lcp_nl_table (u8 *s, va_list *args);
 
 /*
  * fd.io coding-style-patch-verification: ON
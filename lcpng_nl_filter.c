@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2021 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+
+#include <netlink/socket.h>
+
+#include <vlib/vlib.h>
+#include <vppinfra/error.h>
+
+#include <plugins/lcpng/lcpng_netlink.h>
+
+/*
+ * Classic BPF filter on the netlink route socket.
+ *
+ * The route and neighbor handlers in lcpng_nl_sync.c ignore a good part of
+ * what the kernel announces: interface prefixes (RTPROT_KERNEL), the local
+ * table, IPv6 link-local and multicast prefixes, route types VPP has no use
+ * for and multicast neighbors. The filter drops those notifications in the
+ * kernel, before they take room in the socket buffer.
+ *
+ * Only notifications are filtered. A dump packs many messages in one
+ * datagram and the filter only sees the first, so anything with NLM_F_MULTI
+ * is accepted and left to userspace, which applies the same rules. Netlink
+ * header fields are in host order while BPF loads are big endian, hence the
+ * byte swapped constants.
+ */
+
+/* offsets in a single message datagram */
+#define NL_OFF_TYPE  offsetof (struct nlmsghdr, nlmsg_type)
+#define NL_OFF_FLAGS offsetof (struct nlmsghdr, nlmsg_flags)
+#define NL_OFF_RTM(f)                                                         \
+  (NLMSG_HDRLEN + offsetof (struct rtmsg, f))
+#define NL_OFF_NDM(f)                                                         \
+  (NLMSG_HDRLEN + offsetof (struct ndmsg, f))
+#define NL_OFF_RTA   (NLMSG_HDRLEN + NLMSG_ALIGN (sizeof (struct rtmsg)))
+#define NL_OFF_NDA   (NLMSG_HDRLEN + NLMSG_ALIGN (sizeof (struct ndmsg)))
+
+/* Tables above 255 are only in RTA_TABLE, rtm_table is RT_TABLE_COMPAT */
+#define NL_TABLE_MAX_U8 255
+
+/* Mirrors lcp_nl_route_type_valid[] in lcpng_nl_sync.c */
+static const u8 lcp_nl_filter_route_types[] = {
+  RTN_UNICAST, RTN_MULTICAST, RTN_BLACKHOLE, RTN_UNREACHABLE, RTN_PROHIBIT,
+};
+
+/* A program under construction, jumps go to labels resolved at the end */
+typedef struct lcp_nl_bpf_t_
+{
+  struct sock_filter *insns;
+  u32 *jt; // label of the true branch of each instruction, or ~0
+  u32 *jf;
+  u32 *labels; // label -> instruction index
+} lcp_nl_bpf_t;
+
+#define NL_BPF_NEXT ~0
+
+static u32
+lcp_nl_bpf_label (lcp_nl_bpf_t *b)
+{
+  vec_add1 (b->labels, ~0);
+  return vec_len (b->labels) - 1;
+}
+
+static void
+lcp_nl_bpf_here (lcp_nl_bpf_t *b, u32 label)
+{
+  b->labels[label] = vec_len (b->insns);
+}
+
+static void
+lcp_nl_bpf_jump (lcp_nl_bpf_t *b, u16 code, u32 k, u32 jt, u32 jf)
+{
+  struct sock_filter insn = { .code = code, .k = k };
+
+  vec_add1 (b->insns, insn);
+  vec_add1 (b->jt, jt);
+  vec_add1 (b->jf, jf);
+}
+
+static void
+lcp_nl_bpf_stmt (lcp_nl_bpf_t *b, u16 code, u32 k)
+{
+  lcp_nl_bpf_jump (b, code, k, NL_BPF_NEXT, NL_BPF_NEXT);
+}
+
+static int
+lcp_nl_bpf_resolve (lcp_nl_bpf_t *b)
+{
+  u32 i, off;
+
+  for (i = 0; i < vec_len (b->insns); i++)
+    {
+      if (BPF_CLASS (b->insns[i].code) != BPF_JMP)
+	continue;
+      if (BPF_OP (b->insns[i].code) == BPF_JA)
+	{
+	  b->insns[i].k = b->labels[b->jt[i]] - i - 1;
+	  continue;
+	}
+      if (b->jt[i] != NL_BPF_NEXT)
+	{
+	  off = b->labels[b->jt[i]] - i - 1;
+	  if (off > 255)
+	    return -1;
+	  b->insns[i].jt = off;
+	}
+      if (b->jf[i] != NL_BPF_NEXT)
+	{
+	  off = b->labels[b->jf[i]] - i - 1;
+	  if (off > 255)
+	    return -1;
+	  b->insns[i].jf = off;
+	}
+    }
+  return 0;
+}
+
+/* X = offset of the attribute of the given type, or jump to not_found */
+static void
+lcp_nl_bpf_nlattr (lcp_nl_bpf_t *b, u32 attrs, u32 type, u32 not_found)
+{
+  lcp_nl_bpf_stmt (b, BPF_LD | BPF_IMM, attrs);
+  lcp_nl_bpf_stmt (b, BPF_LDX | BPF_IMM, type);
+  lcp_nl_bpf_stmt (b, BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_NLATTR);
+  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, 0, not_found, NL_BPF_NEXT);
+  lcp_nl_bpf_stmt (b, BPF_MISC | BPF_TAX, 0);
+}
+
+static void
+lcp_nl_bpf_route (lcp_nl_bpf_t *b, u32 accept, u32 drop)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  u32 type_ok = lcp_nl_bpf_label (b), v6 = lcp_nl_bpf_label (b);
+  u32 *table, has_u32_tables = 0, attr_table;
+  u8 *proto;
+  int i;
+
+  /* route types the handlers skip */
+  lcp_nl_bpf_stmt (b, BPF_LD | BPF_B | BPF_ABS, NL_OFF_RTM (rtm_type));
+  for (i = 0; i < ARRAY_LEN (lcp_nl_filter_route_types); i++)
+    lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K,
+		     lcp_nl_filter_route_types[i], type_ok, NL_BPF_NEXT);
+  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JA, 0, drop, NL_BPF_NEXT);
+  lcp_nl_bpf_here (b, type_ok);
+
+  /* interface prefixes and the configured protocols */
+  lcp_nl_bpf_stmt (b, BPF_LD | BPF_B | BPF_ABS, NL_OFF_RTM (rtm_protocol));
+  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, RTPROT_KERNEL, drop,
+		   NL_BPF_NEXT);
+  vec_foreach (proto, nm->filter_protos)
+    lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, *proto, drop, NL_BPF_NEXT);
+
+  /* the local table and the configured tables */
+  lcp_nl_bpf_stmt (b, BPF_LD | BPF_B | BPF_ABS, NL_OFF_RTM (rtm_table));
+  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, RT_TABLE_LOCAL, drop,
+		   NL_BPF_NEXT);
+  vec_foreach (table, nm->filter_tables)
+    if (*table <= NL_TABLE_MAX_U8)
+      lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, *table, drop,
+		       NL_BPF_NEXT);
+    else
+      has_u32_tables = 1;
+  if (has_u32_tables)
+    {
+      attr_table = lcp_nl_bpf_label (b);
+      lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, RT_TABLE_COMPAT,
+		       attr_table, v6);
+      lcp_nl_bpf_here (b, attr_table);
+      lcp_nl_bpf_nlattr (b, NL_OFF_RTA, RTA_TABLE, v6);
+      lcp_nl_bpf_stmt (b, BPF_LD | BPF_W | BPF_IND, NLA_HDRLEN);
+      vec_foreach (table, nm->filter_tables)
+	if (*table > NL_TABLE_MAX_U8)
+	  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K,
+			   clib_host_to_net_u32 (*table), drop, NL_BPF_NEXT);
+    }
+
+  /* IPv6 link-local fe80::/10 and multicast ff00::/8 prefixes */
+  lcp_nl_bpf_here (b, v6);
+  lcp_nl_bpf_stmt (b, BPF_LD | BPF_B | BPF_ABS, NL_OFF_RTM (rtm_family));
+  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, AF_INET6, NL_BPF_NEXT,
+		   accept);
+  lcp_nl_bpf_nlattr (b, NL_OFF_RTA, RTA_DST, accept);
+  lcp_nl_bpf_stmt (b, BPF_LD | BPF_B | BPF_IND, NLA_HDRLEN);
+  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, 0xff, drop, NL_BPF_NEXT);
+  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, 0xfe, NL_BPF_NEXT, accept);
+  lcp_nl_bpf_stmt (b, BPF_LD | BPF_B | BPF_IND, NLA_HDRLEN + 1);
+  lcp_nl_bpf_stmt (b, BPF_ALU | BPF_AND | BPF_K, 0xc0);
+  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, 0x80, drop, accept);
+}
+
+static void
+lcp_nl_bpf_neigh (lcp_nl_bpf_t *b, u32 accept, u32 drop)
+{
+  u32 v4 = lcp_nl_bpf_label (b), v6 = lcp_nl_bpf_label (b);
+
+  /* multicast neighbors: 224.0.0.0/4 and ff00::/8 */
+  lcp_nl_bpf_stmt (b, BPF_LD | BPF_B | BPF_ABS, NL_OFF_NDM (ndm_family));
+  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, AF_INET, v4, NL_BPF_NEXT);
+  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, AF_INET6, v6, accept);
+
+  lcp_nl_bpf_here (b, v4);
+  lcp_nl_bpf_nlattr (b, NL_OFF_NDA, NDA_DST, accept);
+  lcp_nl_bpf_stmt (b, BPF_LD | BPF_B | BPF_IND, NLA_HDRLEN);
+  lcp_nl_bpf_stmt (b, BPF_ALU | BPF_AND | BPF_K, 0xf0);
+  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, 0xe0, drop, accept);
+
+  lcp_nl_bpf_here (b, v6);
+  lcp_nl_bpf_nlattr (b, NL_OFF_NDA, NDA_DST, accept);
+  lcp_nl_bpf_stmt (b, BPF_LD | BPF_B | BPF_IND, NLA_HDRLEN);
+  lcp_nl_bpf_jump (b, BPF_JMP | BPF_JEQ | BPF_K, 0xff, drop, accept);
+}
+
+static int
+lcp_nl_filter_build (struct sock_filter **prog)
+{
+  lcp_nl_bpf_t b = { 0 };
+  u32 accept, drop, route, neigh;
+  int rv;
+
+  accept = lcp_nl_bpf_label (&b);
+  drop = lcp_nl_bpf_label (&b);
+  route = lcp_nl_bpf_label (&b);
+  neigh = lcp_nl_bpf_label (&b);
+
+  /* dumps and anything else go to userspace */
+  lcp_nl_bpf_stmt (&b, BPF_LD | BPF_H | BPF_ABS, NL_OFF_FLAGS);
+  lcp_nl_bpf_jump (&b, BPF_JMP | BPF_JSET | BPF_K,
+		   clib_host_to_net_u16 (NLM_F_MULTI), accept, NL_BPF_NEXT);
+  lcp_nl_bpf_stmt (&b, BPF_LD | BPF_H | BPF_ABS, NL_OFF_TYPE);
+  lcp_nl_bpf_jump (&b, BPF_JMP | BPF_JEQ | BPF_K,
+		   clib_host_to_net_u16 (RTM_NEWROUTE), route, NL_BPF_NEXT);
+  lcp_nl_bpf_jump (&b, BPF_JMP | BPF_JEQ | BPF_K,
+		   clib_host_to_net_u16 (RTM_DELROUTE), route, NL_BPF_NEXT);
+  lcp_nl_bpf_jump (&b, BPF_JMP | BPF_JEQ | BPF_K,
+		   clib_host_to_net_u16 (RTM_NEWNEIGH), neigh, NL_BPF_NEXT);
+  lcp_nl_bpf_jump (&b, BPF_JMP | BPF_JEQ | BPF_K,
+		   clib_host_to_net_u16 (RTM_DELNEIGH), neigh, accept);
+
+  lcp_nl_bpf_here (&b, route);
+  lcp_nl_bpf_route (&b, accept, drop);
+  lcp_nl_bpf_here (&b, neigh);
+  lcp_nl_bpf_neigh (&b, accept, drop);
+
+  lcp_nl_bpf_here (&b, accept);
+  lcp_nl_bpf_stmt (&b, BPF_RET | BPF_K, ~0);
+  lcp_nl_bpf_here (&b, drop);
+  lcp_nl_bpf_stmt (&b, BPF_RET | BPF_K, 0);
+
+  rv = lcp_nl_bpf_resolve (&b);
+  if (rv == 0 && vec_len (b.insns) > BPF_MAXINSNS)
+    rv = -1;
+  if (rv == 0)
+    *prog = b.insns;
+  else
+    vec_free (b.insns);
+  vec_free (b.jt);
+  vec_free (b.jf);
+  vec_free (b.labels);
+
+  return rv;
+}
+
+/*
+ * Attach the filter to the route socket of a namespace. A filter that
+ * cannot be built or attached is not fatal, the socket then gets
+ * everything, as it would without one.
+ */
+void
+lcp_nl_filter_attach (lcp_nl_netlink_namespace_t *nlns)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  struct sock_fprog fprog;
+
+  nlns->filter_attached = 0;
+  if (nm->filter_disabled)
+    return;
+
+  if (!nm->filter_prog && lcp_nl_filter_build (&nm->filter_prog))
+    {
+      LCP_NL_WARN ("filter_attach: Unable to build the socket filter, "
+		   "netlink messages are filtered in userspace only");
+      nm->filter_disabled = 1;
+      return;
+    }
+
+  fprog.len = vec_len (nm->filter_prog);
+  fprog.filter = nm->filter_prog;
+  if (setsockopt (nl_socket_get_fd (nlns->sk_route), SOL_SOCKET,
+		  SO_ATTACH_FILTER, &fprog, sizeof (fprog)) < 0)
+    {
+      LCP_NL_WARN ("filter_attach: Unable to attach the socket filter in "
+		   "netns '%s': %s",
+		   nlns->netns_name, strerror (errno));
+      return;
+    }
+
+  nlns->filter_attached = 1;
+}
+
+int
+lcp_nl_filter_route_ignored (u8 rproto, u32 table_id)
+{
+  lcp_nl_main_t *nm = &lcp_nl_main;
+  u32 *table;
+  u8 *proto;
+
+  vec_foreach (proto, nm->filter_protos)
+    if (*proto == rproto)
+      return 1;
+  vec_foreach (table, nm->filter_tables)
+    if (*table == table_id)
+      return 1;
+
+  return 0;
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
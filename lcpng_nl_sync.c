@@ -32,21 +32,18 @@
 
 #include <vnet/devices/tap/tap.h>
 #include <vnet/fib/fib_table.h>
+#include <vnet/fib/fib_entry.h>
 #include <vnet/mfib/mfib_table.h>
+#include <vnet/mfib/mfib_entry.h>
 
 //#include <vnet/fib/fib_path.h>
 //#include <vnet/fib/fib_path_list.h>
 
 #include <vnet/ip/ip6_ll_table.h>
 #include <vnet/ip-neighbor/ip_neighbor.h>
+#include <vnet/adj/adj_nbr.h>
 #include <vnet/ip/ip6_link.h>
 
-#ifndef NUD_VALID
-#define NUD_VALID                                                             \
-  (NUD_PERMANENT | NUD_NOARP | NUD_REACHABLE | NUD_PROBE | NUD_STALE |        \
-   NUD_DELAY)
-#endif
-
 /*
  * Map of supported route types. Some types are omitted:
  * RTN_LOCAL - interface address addition creates these automatically
@@ -134,25 +131,6 @@ vnet_sw_interface_subid_exists (vnet_main_t *vnm, u32 sw_if_index, u32 id)
   return 0;
 }
 
-static int
-vnet_sw_interface_get_available_subid (vnet_main_t *vnm, u32 sw_if_index,
-				       u32 *id)
-{
-  u32 i;
-
-  for (i = 1; i < 4096; i++)
-    {
-      if (!vnet_sw_interface_subid_exists (vnm, sw_if_index, i))
-	{
-	  *id = i;
-	  return 0;
-	}
-    }
-
-  *id = -1;
-  return 1;
-}
-
 static fib_protocol_t
 lcp_nl_mk_addr46 (const struct nl_addr *rna, ip46_address_t *ia)
 {
@@ -212,309 +190,1903 @@ lcp_nl_mk_route_entry_flags (uint8_t rtype, int table_id, uint8_t rproto)
     /* kernel proto is interface prefixes, 255 is linux's 'local' table */
     fef |= FIB_ENTRY_FLAG_ATTACHED | FIB_ENTRY_FLAG_CONNECTED;
 
-  return (fef);
+  return (fef);
+}
+
+/* The VPP table id of kernel table k of the namespace being applied. The
+ * kernel's table ids are per namespace, so each namespace has a range of
+ * VPP table ids starting at the VPP id of its main table: 0 for the default
+ * namespace, see lcp_nl_ns_find_or_create().
+ */
+static uint32_t
+lcp_nl_table_k2f (uint32_t k)
+{
+  // the kernel's table ID 255 is the default table
+  if (k == 255 || k == 254)
+    k = 0;
+  return lcp_nl_ns_current_table_base () + k;
+}
+
+/*
+ * Tables.
+ *
+ * A table costs a FIB (and its ip4 mtrie or ip6 hash) the first time a route
+ * is added to it. The mFIB, its special entries and the all 1s punt entry
+ * are only made on the first multicast route, or when an interface is
+ * bound to the table, as ip_table_bind() wants both and the interface needs
+ * them. A table nobody uses any more is freed at the end of the batch, see
+ * lcp_nl_table_gc(): it has no interface bound (nlt_refs), no multicast
+ * route and no unicast route from our sources.
+ */
+static u32 *lcp_nl_table_gc_pending;
+
+/* id is a VPP table id, see lcp_nl_table_k2f() */
+static lcp_nl_table_t *
+lcp_nl_table_add (uint32_t id, fib_protocol_t fproto)
+{
+  lcp_nl_table_t *nlt;
+  lcp_nl_main_t *nlm = &lcp_nl_main;
+
+  nlt = lcp_nl_table_find (id, fproto);
+
+  if (NULL == nlt)
+    {
+      pool_get_zero (lcp_nl_table_pool, nlt);
+
+      nlt->nlt_id = id;
+      nlt->nlt_proto = fproto;
+      nlt->nlt_mfib_index = ~0;
+      nlt->nlt_create_ts = vlib_time_now (vlib_get_main ());
+
+      nlt->nlt_fib_index = fib_table_find_or_create_and_lock (
+	nlt->nlt_proto, nlt->nlt_id, nlm->fib_src);
+
+      hash_set (lcp_nl_table_db[fproto], nlt->nlt_id, nlt - lcp_nl_table_pool);
+    }
+
+  return (nlt);
+}
+
+static void
+lcp_nl_table_mfib_add (lcp_nl_table_t *nlt)
+{
+  lcp_nl_main_t *nlm = &lcp_nl_main;
+
+  if (~0 != nlt->nlt_mfib_index)
+    return;
+
+  nlt->nlt_mfib_index = mfib_table_find_or_create_and_lock (
+    nlt->nlt_proto, nlt->nlt_id, MFIB_SOURCE_PLUGIN_LOW);
+
+  if (FIB_PROTOCOL_IP4 == nlt->nlt_proto)
+    {
+      /* Set the all 1s address in this table to punt */
+      fib_table_entry_special_add (nlt->nlt_fib_index, &pfx_all1s,
+				   nlm->fib_src, FIB_ENTRY_FLAG_LOCAL);
+
+      const fib_route_path_t path = {
+	.frp_proto = DPO_PROTO_IP4,
+	.frp_addr = zero_addr,
+	.frp_sw_if_index = ~0,
+	.frp_fib_index = ~0,
+	.frp_weight = 1,
+	.frp_mitf_flags = MFIB_ITF_FLAG_FORWARD,
+	.frp_flags = FIB_ROUTE_PATH_LOCAL,
+      };
+      int ii;
+
+      for (ii = 0; ii < ARRAY_LEN (ip4_specials); ii++)
+	{
+	  mfib_table_entry_path_update (nlt->nlt_mfib_index, &ip4_specials[ii],
+					MFIB_SOURCE_PLUGIN_LOW,
+					MFIB_ENTRY_FLAG_NONE, &path);
+	}
+    }
+  else if (FIB_PROTOCOL_IP6 == nlt->nlt_proto)
+    {
+      const fib_route_path_t path = {
+	.frp_proto = DPO_PROTO_IP6,
+	.frp_addr = zero_addr,
+	.frp_sw_if_index = ~0,
+	.frp_fib_index = ~0,
+	.frp_weight = 1,
+	.frp_mitf_flags = MFIB_ITF_FLAG_FORWARD,
+	.frp_flags = FIB_ROUTE_PATH_LOCAL,
+      };
+      int ii;
+
+      for (ii = 0; ii < ARRAY_LEN (ip6_specials); ii++)
+	{
+	  mfib_table_entry_path_update (nlt->nlt_mfib_index, &ip6_specials[ii],
+					MFIB_SOURCE_PLUGIN_LOW,
+					MFIB_ENTRY_FLAG_NONE, &path);
+	}
+    }
+}
+
+static void
+lcp_nl_table_free (lcp_nl_table_t *nlt)
+{
+  lcp_nl_main_t *nlm = &lcp_nl_main;
+
+  LCP_NL_INFO ("table_free: ip%s table %u after %.1f sec",
+	       nlt->nlt_proto == FIB_PROTOCOL_IP6 ? "6" : "4", nlt->nlt_id,
+	       vlib_time_now (vlib_get_main ()) - nlt->nlt_create_ts);
+
+  if (~0 != nlt->nlt_mfib_index)
+    {
+      if (FIB_PROTOCOL_IP4 == nlt->nlt_proto)
+	{
+	  /* Remove the all 1s address in this table to punt */
+	  fib_table_entry_special_remove (nlt->nlt_fib_index, &pfx_all1s,
+					  nlm->fib_src);
+	}
+      mfib_table_unlock (nlt->nlt_mfib_index, nlt->nlt_proto,
+			 MFIB_SOURCE_PLUGIN_LOW);
+    }
+
+  /* the last lock of a source flushes what is left of its routes */
+  fib_table_unlock (nlt->nlt_fib_index, nlt->nlt_proto, nlm->fib_src);
+
+  hash_unset (lcp_nl_table_db[nlt->nlt_proto], nlt->nlt_id);
+  pool_put (lcp_nl_table_pool, nlt);
+}
+
+/* Unicast routes from our sources, without the all 1s entry */
+static u32
+lcp_nl_table_n_routes (const lcp_nl_table_t *nlt)
+{
+  lcp_nl_main_t *nlm = &lcp_nl_main;
+  u32 n;
+
+  n = fib_table_get_num_entries (nlt->nlt_fib_index, nlt->nlt_proto,
+				 nlm->fib_src) +
+      fib_table_get_num_entries (nlt->nlt_fib_index, nlt->nlt_proto,
+				 nlm->fib_src_dynamic);
+  if (FIB_PROTOCOL_IP4 == nlt->nlt_proto && ~0 != nlt->nlt_mfib_index && n)
+    n--;
+
+  return n;
+}
+
+static int
+lcp_nl_table_is_idle (const lcp_nl_table_t *nlt)
+{
+  return (0 == nlt->nlt_refs && 0 == nlt->nlt_n_mroutes &&
+	  0 == lcp_nl_table_n_routes (nlt));
+}
+
+/* Have lcp_nl_table_gc() look at the table */
+static void
+lcp_nl_table_gc_mark (lcp_nl_table_t *nlt)
+{
+  if (nlt->nlt_gc_pending)
+    return;
+  nlt->nlt_gc_pending = 1;
+  vec_add1 (lcp_nl_table_gc_pending, nlt - lcp_nl_table_pool);
+}
+
+static void
+lcp_nl_table_gc_mark_all (void)
+{
+  lcp_nl_table_t *nlt;
+
+  pool_foreach (nlt, lcp_nl_table_pool)
+    lcp_nl_table_gc_mark (nlt);
+}
+
+/*
+ * Free the marked tables that are idle. Run with the barrier held, at the
+ * end of a batch, so that a route replaced by a delete and an add does not
+ * cost the table.
+ */
+void
+lcp_nl_table_gc (void)
+{
+  lcp_nl_table_t *nlt;
+  u32 *index;
+
+  vec_foreach (index, lcp_nl_table_gc_pending)
+    {
+      if (pool_is_free_index (lcp_nl_table_pool, *index))
+	continue;
+      nlt = pool_elt_at_index (lcp_nl_table_pool, *index);
+      if (!nlt->nlt_gc_pending)
+	continue;
+      nlt->nlt_gc_pending = 0;
+      if (lcp_nl_table_is_idle (nlt))
+	lcp_nl_table_free (nlt);
+    }
+  vec_reset_length (lcp_nl_table_gc_pending);
+}
+
+#ifdef LCP_HAVE_VRF_SYNC
+static void
+lcp_nl_table_lock (lcp_nl_table_t *nlt)
+{
+  nlt->nlt_refs++;
+}
+
+static void
+lcp_nl_table_unlock (lcp_nl_table_t *nlt)
+{
+  ASSERT (nlt->nlt_refs);
+  nlt->nlt_refs--;
+  lcp_nl_table_gc_mark (nlt);
+}
+#endif // LCP_HAVE_VRF_SYNC
+
+/* Memory the table costs us: our entries, paths and adjacencies are shared
+ * with the other tables */
+uword
+lcp_nl_table_mem_size (const lcp_nl_table_t *nlt)
+{
+  uword bytes;
+
+  bytes = sizeof (*nlt) + lcp_nl_table_n_routes (nlt) * sizeof (fib_entry_t);
+  if (~0 != nlt->nlt_mfib_index)
+    bytes += mfib_table_get (nlt->nlt_mfib_index, nlt->nlt_proto)
+	       ->mft_total_route_counts *
+	     sizeof (mfib_entry_t);
+
+  return bytes;
+}
+
+u8 *
+format_lcp_nl_table (u8 *s, va_list *args)
+{
+  lcp_nl_table_t *nlt = va_arg (*args, lcp_nl_table_t *);
+
+  s = format (s, "ip%s table %u: fib %u mfib ",
+	      nlt->nlt_proto == FIB_PROTOCOL_IP6 ? "6" : "4", nlt->nlt_id,
+	      nlt->nlt_fib_index);
+  if (~0 != nlt->nlt_mfib_index)
+    s = format (s, "%u", nlt->nlt_mfib_index);
+  else
+    s = format (s, "none");
+  s = format (s, " interfaces %u routes %u mroutes %u memory %U",
+	      nlt->nlt_refs, lcp_nl_table_n_routes (nlt), nlt->nlt_n_mroutes,
+	      format_memory_size, lcp_nl_table_mem_size (nlt));
+
+  return s;
+}
+
+static int
+lcp_nl_rta_addr46 (struct rtattr *rta, u8 family, ip46_address_t *ia)
+{
+  int len = (family == AF_INET6) ? 16 : 4;
+
+  if (RTA_PAYLOAD (rta) < len)
+    return -1;
+
+  ip46_address_reset (ia);
+  if (family == AF_INET6)
+    clib_memcpy (&ia->ip6, RTA_DATA (rta), len);
+  else
+    clib_memcpy (&ia->ip4, RTA_DATA (rta), len);
+
+  return 0;
+}
+
+/*
+ * Nexthop objects.
+ *
+ * A route that refers to a kernel nexthop object (RTA_NH_ID) is not given
+ * the paths of the nexthop. Instead, each nexthop object is the entry of a
+ * host prefix made from its id, in a private FIB table per protocol and
+ * namespace, as nexthop ids are only unique within a namespace, and
+ * the route gets a single path recursing through that entry. All routes
+ * via the same nexthop share its path-list and load-balance, and a change
+ * of the nexthop is one update of its entry, which the FIB back-walk
+ * propagates to the routes. A group is an entry with a recursive path per
+ * member, so a member change is a single update as well.
+ *
+ * The entries are only created for the protocols that have routes via the
+ * nexthop. A nexthop without a gateway cannot be resolved through a host
+ * prefix, so routes via such a nexthop get its attached path inline.
+ */
+lcp_nl_nexthop_t *lcp_nl_nexthop_pool;
+static uword *lcp_nl_nexthop_db; // (ns_index, nh_id) -> pool index
+static u32 *lcp_nl_nexthop_fib_indexes[FIB_PROTOCOL_IP_MAX]; // by ns_index
+static fib_route_path_t *lcp_nl_nexthop_paths;
+
+static_always_inline u64
+lcp_nl_nexthop_key (u32 ns_index, u32 nh_id)
+{
+  return ((u64) ns_index << 32 | nh_id);
+}
+
+lcp_nl_nexthop_t *
+lcp_nl_nexthop_find (u32 ns_index, u32 nh_id)
+{
+  uword *p;
+
+  p = hash_get (lcp_nl_nexthop_db, lcp_nl_nexthop_key (ns_index, nh_id));
+  if (p == NULL)
+    return (NULL);
+
+  return (pool_elt_at_index (lcp_nl_nexthop_pool, p[0]));
+}
+
+static lcp_nl_nexthop_t *
+lcp_nl_nexthop_find_or_create (u32 ns_index, u32 nh_id)
+{
+  lcp_nl_nexthop_t *nh;
+  fib_protocol_t fproto;
+
+  if ((nh = lcp_nl_nexthop_find (ns_index, nh_id)))
+    return (nh);
+
+  pool_get_zero (lcp_nl_nexthop_pool, nh);
+  nh->nh_id = nh_id;
+  nh->ns_index = ns_index;
+  nh->flags = LCP_NL_NH_F_PENDING;
+  FOR_EACH_FIB_IP_PROTOCOL (fproto)
+    nh->fib_entry_index[fproto] = FIB_NODE_INDEX_INVALID;
+  hash_set (lcp_nl_nexthop_db, lcp_nl_nexthop_key (ns_index, nh_id),
+	    nh - lcp_nl_nexthop_pool);
+
+  return (nh);
+}
+
+static u32
+lcp_nl_nexthop_fib_index (u32 ns_index, fib_protocol_t fproto)
+{
+  u32 *fib_index;
+
+  vec_validate_init_empty (lcp_nl_nexthop_fib_indexes[fproto], ns_index, ~0);
+  fib_index = vec_elt_at_index (lcp_nl_nexthop_fib_indexes[fproto], ns_index);
+  if (*fib_index == ~0)
+    *fib_index = fib_table_create_and_lock (
+      fproto, lcp_nl_main.fib_src_dynamic, "lcp-nexthop-%U-%u",
+      format_fib_protocol, fproto, ns_index);
+
+  return (*fib_index);
+}
+
+static void
+lcp_nl_nexthop_mk_prefix (u32 nh_id, fib_protocol_t fproto, fib_prefix_t *pfx)
+{
+  clib_memset (pfx, 0, sizeof (*pfx));
+  pfx->fp_proto = fproto;
+  if (FIB_PROTOCOL_IP6 == fproto)
+    {
+      pfx->fp_len = 128;
+      pfx->fp_addr.ip6.as_u32[3] = clib_host_to_net_u32 (nh_id);
+    }
+  else
+    {
+      pfx->fp_len = 32;
+      pfx->fp_addr.ip4.as_u32 = clib_host_to_net_u32 (nh_id);
+    }
+}
+
+static int
+lcp_nl_nexthop_is_attached (const lcp_nl_nexthop_t *nh)
+{
+  if (nh->flags &
+      (LCP_NL_NH_F_BLACKHOLE | LCP_NL_NH_F_GROUP | LCP_NL_NH_F_PENDING))
+    return 0;
+
+  return ip46_address_is_zero (&nh->gw);
+}
+
+/* The path of a nexthop with a gateway and/or an interface */
+static int
+lcp_nl_nexthop_mk_path (const lcp_nl_nexthop_t *nh, fib_protocol_t fproto,
+			fib_route_path_t *path)
+{
+  lcp_itf_pair_t *lip;
+
+  lip = lcp_itf_pair_get (lcp_itf_pair_find_by_vif_ns (
+    nh->ifindex, lcp_nl_ns_index_name (nh->ns_index)));
+  if (!lip)
+    return -1;
+
+  /* a gateway may be of the other family than the entry (RFC 5549), an
+   * attached path is of the entry's */
+  if (!ip46_address_is_zero (&nh->gw))
+    fproto = (nh->family == AF_INET6) ? FIB_PROTOCOL_IP6 : FIB_PROTOCOL_IP4;
+
+  path->frp_proto = fib_proto_to_dpo (fproto);
+  path->frp_addr = nh->gw;
+  path->frp_sw_if_index = lip->lip_phy_sw_if_index;
+  path->frp_weight = 1;
+
+  return 0;
+}
+
+/* A path recursing through the entry of a nexthop */
+static void
+lcp_nl_nexthop_mk_recursive_path (u32 ns_index, u32 nh_id,
+				  fib_protocol_t fproto, u32 weight,
+				  fib_route_path_t *path)
+{
+  fib_prefix_t pfx;
+
+  lcp_nl_nexthop_mk_prefix (nh_id, fproto, &pfx);
+  path->frp_proto = fib_proto_to_dpo (fproto);
+  path->frp_addr = pfx.fp_addr;
+  path->frp_sw_if_index = ~0;
+  path->frp_fib_index = lcp_nl_nexthop_fib_index (ns_index, fproto);
+  path->frp_flags |= FIB_ROUTE_PATH_RESOLVE_VIA_HOST;
+  path->frp_weight = weight;
+}
+
+static void lcp_nl_nexthop_install (u32 ns_index, u32 nh_id,
+				    fib_protocol_t fproto);
+
+/* (Re)program the entry of the nexthop at pool index nhi. A nexthop that we
+ * cannot forward through, because it is a blackhole, it is not announced
+ * yet or its interface has no LCP pair, drops. The latter is programmed
+ * again once the pair is created, see lcp_nl_nexthop_pair_add().
+ */
+static void
+lcp_nl_nexthop_program (u32 nhi, fib_protocol_t fproto)
+{
+  lcp_nl_main_t *nlm = &lcp_nl_main;
+  lcp_nl_nexthop_member_t *m;
+  lcp_nl_nexthop_t *nh;
+  fib_route_path_t *path;
+  fib_prefix_t pfx;
+  u32 i;
+
+  /* the members may be created on the way, which moves the pool */
+  nh = pool_elt_at_index (lcp_nl_nexthop_pool, nhi);
+  if (nh->flags & LCP_NL_NH_F_GROUP)
+    for (i = 0; i < vec_len (nh->members); i++)
+      {
+	lcp_nl_nexthop_install (nh->ns_index, nh->members[i].nh_id, fproto);
+	nh = pool_elt_at_index (lcp_nl_nexthop_pool, nhi);
+      }
+
+  vec_reset_length (lcp_nl_nexthop_paths);
+  if (nh->flags & LCP_NL_NH_F_GROUP)
+    {
+      vec_foreach (m, nh->members)
+	{
+	  vec_add2 (lcp_nl_nexthop_paths, path, 1);
+	  clib_memset (path, 0, sizeof (*path));
+	  lcp_nl_nexthop_mk_recursive_path (nh->ns_index, m->nh_id, fproto,
+					    m->weight, path);
+	}
+    }
+  else if (!(nh->flags & (LCP_NL_NH_F_BLACKHOLE | LCP_NL_NH_F_PENDING)))
+    {
+      nh->flags &= ~LCP_NL_NH_F_UNRESOLVED;
+      vec_add2 (lcp_nl_nexthop_paths, path, 1);
+      clib_memset (path, 0, sizeof (*path));
+      if (lcp_nl_nexthop_mk_path (nh, fproto, path) < 0)
+	{
+	  nh->flags |= LCP_NL_NH_F_UNRESOLVED;
+	  vec_reset_length (lcp_nl_nexthop_paths);
+	}
+    }
+
+  if (0 == vec_len (lcp_nl_nexthop_paths))
+    {
+      vec_add2 (lcp_nl_nexthop_paths, path, 1);
+      clib_memset (path, 0, sizeof (*path));
+      path->frp_flags = FIB_ROUTE_PATH_DROP;
+      path->frp_sw_if_index = ~0;
+      path->frp_proto = fib_proto_to_dpo (fproto);
+    }
+
+  lcp_nl_nexthop_mk_prefix (nh->nh_id, fproto, &pfx);
+  nh->fib_entry_index[fproto] = fib_table_entry_update (
+    lcp_nl_nexthop_fib_index (nh->ns_index, fproto), &pfx,
+    nlm->fib_src_dynamic,
+    FIB_ENTRY_FLAG_NONE, lcp_nl_nexthop_paths);
+
+  LCP_NL_DBG ("nexthop_program: %U", format_lcp_nl_nexthop, nh);
+}
+
+static void
+lcp_nl_nexthop_install (u32 ns_index, u32 nh_id, fib_protocol_t fproto)
+{
+  lcp_nl_nexthop_t *nh;
+
+  nh = lcp_nl_nexthop_find_or_create (ns_index, nh_id);
+  if (nh->fib_entry_index[fproto] == FIB_NODE_INDEX_INVALID)
+    lcp_nl_nexthop_program (nh - lcp_nl_nexthop_pool, fproto);
+}
+
+static void
+lcp_nl_nexthop_del (u32 ns_index, u32 nh_id)
+{
+  lcp_nl_main_t *nlm = &lcp_nl_main;
+  lcp_nl_nexthop_t *nh;
+  fib_protocol_t fproto;
+
+  if (!(nh = lcp_nl_nexthop_find (ns_index, nh_id)))
+    return;
+
+  LCP_NL_DBG ("nexthop_del: %U", format_lcp_nl_nexthop, nh);
+
+  /* The kernel deletes the routes via this nexthop. Any that we are not
+   * told about resolve via the default route of the private table, which
+   * drops */
+  FOR_EACH_FIB_IP_PROTOCOL (fproto)
+    {
+      if (nh->fib_entry_index[fproto] != FIB_NODE_INDEX_INVALID)
+	fib_table_entry_delete_index (nh->fib_entry_index[fproto],
+				      nlm->fib_src_dynamic);
+    }
+
+  hash_unset (lcp_nl_nexthop_db, lcp_nl_nexthop_key (ns_index, nh_id));
+  vec_free (nh->members);
+  pool_put (lcp_nl_nexthop_pool, nh);
+}
+
+/* A pair was created for the interface vif_index of the namespace being
+ * applied: program the nexthops that were waiting for it */
+void
+lcp_nl_nexthop_pair_add (u32 vif_index)
+{
+  u32 ns_index = lcp_nl_main.nl_ns_current;
+  lcp_nl_nexthop_t *nh;
+  fib_protocol_t fproto;
+  u32 *nhis = 0, *nhi;
+
+  pool_foreach (nh, lcp_nl_nexthop_pool)
+    {
+      if ((nh->flags & LCP_NL_NH_F_UNRESOLVED) && nh->ns_index == ns_index &&
+	  nh->ifindex == vif_index)
+	vec_add1 (nhis, nh - lcp_nl_nexthop_pool);
+    }
+
+  vec_foreach (nhi, nhis)
+    {
+      FOR_EACH_FIB_IP_PROTOCOL (fproto)
+	{
+	  nh = pool_elt_at_index (lcp_nl_nexthop_pool, *nhi);
+	  if (nh->fib_entry_index[fproto] != FIB_NODE_INDEX_INVALID)
+	    lcp_nl_nexthop_program (*nhi, fproto);
+	}
+    }
+  vec_free (nhis);
+}
+
+/* Give the route r a path via its nexthop object */
+static void
+lcp_nl_route_nexthop_path_add (lcp_nl_route_t *r)
+{
+  u32 ns_index = lcp_nl_main.nl_ns_current;
+  fib_protocol_t fproto = r->pfx.fp_proto;
+  fib_route_path_t *path;
+  lcp_nl_nexthop_t *nh;
+
+  lcp_nl_nexthop_install (ns_index, r->nh_id, fproto);
+  nh = lcp_nl_nexthop_find (ns_index, r->nh_id);
+
+  vec_add2 (r->np.paths, path, 1);
+  clib_memset (path, 0, sizeof (*path));
+  path->frp_flags = r->np.type_flags;
+  path->frp_preference = r->np.preference;
+
+  if (!lcp_nl_nexthop_is_attached (nh))
+    lcp_nl_nexthop_mk_recursive_path (ns_index, r->nh_id, fproto, 1, path);
+  else if (lcp_nl_nexthop_mk_path (nh, fproto, path) < 0)
+    vec_reset_length (r->np.paths);
+}
+
+u8 *
+format_lcp_nl_nexthop (u8 *s, va_list *args)
+{
+  lcp_nl_nexthop_t *nh = va_arg (*args, lcp_nl_nexthop_t *);
+  lcp_nl_nexthop_member_t *m;
+  fib_protocol_t fproto;
+
+  s = format (s, "id %u netns '%s'", nh->nh_id,
+	      lcp_nl_ns_index_name (nh->ns_index));
+  if (nh->flags & LCP_NL_NH_F_PENDING)
+    s = format (s, " pending");
+  else if (nh->flags & LCP_NL_NH_F_BLACKHOLE)
+    s = format (s, " blackhole");
+  else if (nh->flags & LCP_NL_NH_F_GROUP)
+    {
+      s = format (s, " group");
+      vec_foreach (m, nh->members)
+	s = format (s, " %u/%u", m->nh_id, m->weight);
+    }
+  else
+    {
+      if (!ip46_address_is_zero (&nh->gw))
+	s = format (s, " via %U", format_ip46_address, &nh->gw,
+		    IP46_TYPE_ANY);
+      s = format (s, " ifindex %u", nh->ifindex);
+    }
+  if (nh->flags & LCP_NL_NH_F_UNRESOLVED)
+    s = format (s, " unresolved");
+  if (nh->flags & LCP_NL_NH_F_STALE)
+    s = format (s, " stale");
+
+  FOR_EACH_FIB_IP_PROTOCOL (fproto)
+    {
+      if (nh->fib_entry_index[fproto] != FIB_NODE_INDEX_INVALID)
+	s = format (s, "\n  %U", format_fib_entry, nh->fib_entry_index[fproto],
+		    FIB_ENTRY_FORMAT_DETAIL);
+    }
+
+  return s;
+}
+
+/* Handle an RTM_NEWNEXTHOP/RTM_DELNEXTHOP. libnl does not know these. */
+int
+lcp_nl_nexthop_raw (struct nlmsghdr *hdr)
+{
+  struct rtattr *rta, *gw = NULL, *grp = NULL;
+  u32 ns_index = lcp_nl_main.nl_ns_current;
+  u32 nh_id = 0, ifindex = 0, nhi;
+  u8 is_blackhole = 0, is_fdb = 0;
+  lcp_nl_nexthop_t *nh;
+  fib_protocol_t fproto;
+  struct nhmsg *nhm;
+  int len;
+
+  if (hdr->nlmsg_len < NLMSG_LENGTH (sizeof (*nhm)))
+    return -1;
+  nhm = NLMSG_DATA (hdr);
+
+  len = hdr->nlmsg_len - NLMSG_LENGTH (sizeof (*nhm));
+  for (rta = (struct rtattr *) ((u8 *) nhm + NLMSG_ALIGN (sizeof (*nhm)));
+       RTA_OK (rta, len); rta = RTA_NEXT (rta, len))
+    {
+      switch (rta->rta_type)
+	{
+	case NHA_ID:
+	  if (RTA_PAYLOAD (rta) >= sizeof (u32))
+	    nh_id = *(u32 *) RTA_DATA (rta);
+	  break;
+	case NHA_OIF:
+	  if (RTA_PAYLOAD (rta) >= sizeof (u32))
+	    ifindex = *(u32 *) RTA_DATA (rta);
+	  break;
+	case NHA_GATEWAY:
+	  gw = rta;
+	  break;
+	case NHA_GROUP:
+	  grp = rta;
+	  break;
+	case NHA_BLACKHOLE:
+	  is_blackhole = 1;
+	  break;
+	case NHA_FDB:
+	  is_fdb = 1;
+	  break;
+	}
+    }
+
+  /* nexthops of bridge fdb entries are not for routes */
+  if (!nh_id || is_fdb)
+    return 0;
+
+  if (hdr->nlmsg_type == RTM_DELNEXTHOP)
+    {
+      lcp_nl_nexthop_del (ns_index, nh_id);
+      return 0;
+    }
+
+  nh = lcp_nl_nexthop_find_or_create (ns_index, nh_id);
+  nh->flags = 0;
+  nh->family = nhm->nh_family;
+  nh->ifindex = ifindex;
+  ip46_address_reset (&nh->gw);
+  vec_reset_length (nh->members);
+
+  if (is_blackhole)
+    nh->flags |= LCP_NL_NH_F_BLACKHOLE;
+  if (gw)
+    lcp_nl_rta_addr46 (gw, nhm->nh_family, &nh->gw);
+  if (grp)
+    {
+      struct nexthop_grp *g = RTA_DATA (grp);
+      lcp_nl_nexthop_member_t *m;
+      int i;
+
+      nh->flags |= LCP_NL_NH_F_GROUP;
+      for (i = 0; i < RTA_PAYLOAD (grp) / sizeof (*g); i++)
+	{
+	  vec_add2 (nh->members, m, 1);
+	  m->nh_id = g[i].id;
+	  m->weight = g[i].weight + 1;
+	}
+    }
+
+  LCP_NL_DBG ("nexthop_add: %U", format_lcp_nl_nexthop, nh);
+
+  nhi = nh - lcp_nl_nexthop_pool;
+  FOR_EACH_FIB_IP_PROTOCOL (fproto)
+    {
+      nh = pool_elt_at_index (lcp_nl_nexthop_pool, nhi);
+      if (nh->fib_entry_index[fproto] != FIB_NODE_INDEX_INVALID)
+	lcp_nl_nexthop_program (nhi, fproto);
+    }
+
+  return 0;
+}
+
+static void
+lcp_nl_nexthop_mark (void)
+{
+  lcp_nl_nexthop_t *nh;
+
+  pool_foreach (nh, lcp_nl_nexthop_pool)
+    nh->flags |= LCP_NL_NH_F_STALE;
+}
+
+static void
+lcp_nl_nexthop_sweep (void)
+{
+  lcp_nl_nexthop_t *nh;
+  u32 *stale = NULL, *nhi;
+
+  pool_foreach (nh, lcp_nl_nexthop_pool)
+    {
+      if (nh->flags & LCP_NL_NH_F_STALE)
+	vec_add1 (stale, nh - lcp_nl_nexthop_pool);
+    }
+  vec_foreach (nhi, stale)
+    {
+      nh = pool_elt_at_index (lcp_nl_nexthop_pool, *nhi);
+      lcp_nl_nexthop_del (nh->ns_index, nh->nh_id);
+    }
+  vec_free (stale);
+}
+
+/*
+ * Installed neighbors.
+ *
+ * The kernel reports every NUD state change of a neighbor, and on a large
+ * LAN most of them (REACHABLE, STALE, DELAY, PROBE and back) leave the
+ * lladdr alone. The neighbors given to ip_neighbor_add() are kept by
+ * namespace, ifindex and address with their MAC and flags, so that
+ * lcp_nl_process_msgs() can skip those messages, and the worker barrier
+ * with them, see lcp_nl_neigh_raw_unchanged(). VPP may age, flush or
+ * relearn a neighbor on its own, so an entry is only trusted while the
+ * neighbor's adjacency still rewrites to its MAC.
+ *
+ * They are also listed per phy, for what is done to the neighbors of a
+ * pair: they are dropped with it, and purged when its link goes down.
+ */
+typedef struct lcp_nl_neigh_key_t_
+{
+  u32 ns_index;
+  u32 ifindex;
+  u32 af;
+  ip46_address_t ip;
+} lcp_nl_neigh_key_t;
+
+typedef struct lcp_nl_neigh_t_
+{
+  lcp_nl_neigh_key_t key;
+  ip_address_t ip;
+  u32 sw_if_index;
+  u32 pos; /* in lcp_nl_neighs_by_sw_if_index[sw_if_index] */
+  mac_address_t mac;
+  u8 flags;
+  u8 is_stale; /* not refreshed by the resync yet */
+} lcp_nl_neigh_t;
+
+static lcp_nl_neigh_t *lcp_nl_neigh_pool;
+static mhash_t lcp_nl_neigh_db;
+static u32 **lcp_nl_neighs_by_sw_if_index;
+
+void
+lcp_nl_neigh_cache_init (void)
+{
+  mhash_init (&lcp_nl_neigh_db, sizeof (uword), sizeof (lcp_nl_neigh_key_t));
+}
+
+/* The key of a neighbor of host interface ifindex, in the namespace whose
+ * messages are being applied */
+static void
+lcp_nl_neigh_mk_key (u32 ifindex, const ip_address_t *ip,
+		     lcp_nl_neigh_key_t *key)
+{
+  clib_memset (key, 0, sizeof (*key));
+  key->ns_index = lcp_nl_main.nl_ns_current;
+  key->ifindex = ifindex;
+  key->af = ip_addr_version (ip);
+  key->ip = ip_addr_46 (ip);
+}
+
+static lcp_nl_neigh_t *
+lcp_nl_neigh_find (const lcp_nl_neigh_key_t *key)
+{
+  uword *p;
+
+  if (!(p = mhash_get (&lcp_nl_neigh_db, key)))
+    return NULL;
+  return pool_elt_at_index (lcp_nl_neigh_pool, p[0]);
+}
+
+static void
+lcp_nl_neigh_free (lcp_nl_neigh_t *ne)
+{
+  u32 *ids = lcp_nl_neighs_by_sw_if_index[ne->sw_if_index];
+
+  /* the last of the phy's takes its place */
+  pool_elt_at_index (lcp_nl_neigh_pool, vec_elt (ids, vec_len (ids) - 1))
+    ->pos = ne->pos;
+  vec_del1 (ids, ne->pos);
+  lcp_nl_neighs_by_sw_if_index[ne->sw_if_index] = ids;
+
+  mhash_unset (&lcp_nl_neigh_db, &ne->key, NULL);
+  pool_put (lcp_nl_neigh_pool, ne);
+}
+
+static void
+lcp_nl_neigh_set (u32 ifindex, u32 sw_if_index, const ip_address_t *ip,
+		  const mac_address_t *mac, ip_neighbor_flags_t flags)
+{
+  lcp_nl_neigh_key_t key;
+  lcp_nl_neigh_t *ne;
+
+  lcp_nl_neigh_mk_key (ifindex, ip, &key);
+  if ((ne = lcp_nl_neigh_find (&key)) && ne->sw_if_index != sw_if_index)
+    {
+      lcp_nl_neigh_free (ne);
+      ne = NULL;
+    }
+  if (!ne)
+    {
+      pool_get_zero (lcp_nl_neigh_pool, ne);
+      ne->key = key;
+      ne->ip = *ip;
+      ne->sw_if_index = sw_if_index;
+      vec_validate (lcp_nl_neighs_by_sw_if_index, sw_if_index);
+      ne->pos = vec_len (lcp_nl_neighs_by_sw_if_index[sw_if_index]);
+      vec_add1 (lcp_nl_neighs_by_sw_if_index[sw_if_index],
+		ne - lcp_nl_neigh_pool);
+      mhash_set (&lcp_nl_neigh_db, &ne->key, ne - lcp_nl_neigh_pool, NULL);
+    }
+  ne->mac = *mac;
+  ne->flags = flags;
+  ne->is_stale = 0;
+}
+
+static void
+lcp_nl_neigh_unset (u32 ifindex, const ip_address_t *ip)
+{
+  lcp_nl_neigh_key_t key;
+  lcp_nl_neigh_t *ne;
+
+  lcp_nl_neigh_mk_key (ifindex, ip, &key);
+  if ((ne = lcp_nl_neigh_find (&key)))
+    lcp_nl_neigh_free (ne);
+}
+
+/* The neighbors installed on a phy, to be walked from the last */
+static u32 *
+lcp_nl_neighs_of (u32 sw_if_index)
+{
+  if (sw_if_index >= vec_len (lcp_nl_neighs_by_sw_if_index))
+    return NULL;
+  return lcp_nl_neighs_by_sw_if_index[sw_if_index];
+}
+
+void
+lcp_nl_neigh_pair_flush (u32 phy_sw_if_index)
+{
+  u32 *ids;
+
+  while (vec_len (ids = lcp_nl_neighs_of (phy_sw_if_index)))
+    lcp_nl_neigh_free (
+      pool_elt_at_index (lcp_nl_neigh_pool, vec_elt (ids, vec_len (ids) - 1)));
+}
+
+/* Whether VPP still resolves the neighbor to the MAC it was given */
+static int
+lcp_nl_neigh_is_current (const lcp_nl_neigh_t *ne)
+{
+  fib_protocol_t fproto = ip_address_family_to_fib_proto (ne->key.af);
+  ip_adjacency_t *adj;
+  adj_index_t ai;
+
+  ai = adj_nbr_find (fproto, fib_proto_to_link (fproto), &ne->key.ip,
+		     ne->sw_if_index);
+  if (ai == ADJ_INDEX_INVALID)
+    return 0;
+  adj = adj_get (ai);
+
+  return (adj->lookup_next_index == IP_LOOKUP_NEXT_REWRITE &&
+	  adj->rewrite_header.data_bytes >= sizeof (ne->mac) &&
+	  !memcmp (adj->rewrite_header.data, ne->mac.bytes, sizeof (ne->mac)));
+}
+
+/* Returns 1 if applying this RTM_NEWNEIGH would not change VPP: a state
+ * without a valid lladdr, which lcp_nl_neigh_add() ignores, or the MAC and
+ * flags already installed.
+ */
+int
+lcp_nl_neigh_raw_unchanged (struct nlmsghdr *hdr)
+{
+  lcp_nl_neigh_key_t key;
+  lcp_nl_neigh_t *ne;
+  struct ndmsg *ndm;
+  struct nlattr *na;
+  ip_address_t ip;
+  u8 flags;
+
+  if (hdr->nlmsg_type != RTM_NEWNEIGH ||
+      !nlmsg_valid_hdr (hdr, sizeof (*ndm)))
+    return 0;
+  ndm = nlmsg_data (hdr);
+  if (ndm->ndm_family != AF_INET && ndm->ndm_family != AF_INET6)
+    return 0;
+  if (!(na = nlmsg_find_attr (hdr, sizeof (*ndm), NDA_DST)) ||
+      nla_len (na) != (ndm->ndm_family == AF_INET6 ? 16 : 4))
+    return 0;
+
+  ip_address_reset (&ip);
+  ip_address_set (&ip, nla_data (na),
+		  ndm->ndm_family == AF_INET6 ? AF_IP6 : AF_IP4);
+
+  lcp_nl_neigh_mk_key (ndm->ndm_ifindex, &ip, &key);
+  if (!(ne = lcp_nl_neigh_find (&key)) || ne->is_stale)
+    return 0;
+
+  if (!(ndm->ndm_state & NUD_VALID))
+    return 0;
+  if (!(na = nlmsg_find_attr (hdr, sizeof (*ndm), NDA_LLADDR)) ||
+      nla_len (na) != sizeof (ne->mac))
+    return 0;
+  flags = (ndm->ndm_state & (NUD_NOARP | NUD_PERMANENT)) ?
+	    IP_NEIGHBOR_FLAG_STATIC :
+	    IP_NEIGHBOR_FLAG_DYNAMIC;
+
+  return (flags == ne->flags &&
+	  !memcmp (nla_data (na), ne->mac.bytes, sizeof (ne->mac)) &&
+	  lcp_nl_neigh_is_current (ne));
+}
+
+/* Only the neighbors netlink installed are resynced, those of other
+ * interfaces, or added by the API or learned by the dataplane are left
+ * alone. A stale entry is not trusted by lcp_nl_neigh_raw_unchanged(), so
+ * that the dump refreshes it. */
+static void
+lcp_nl_neigh_mark (void)
+{
+  lcp_nl_neigh_t *ne;
+
+  pool_foreach (ne, lcp_nl_neigh_pool)
+    ne->is_stale = 1;
+}
+
+static void
+lcp_nl_neigh_sweep (void)
+{
+  lcp_nl_neigh_t *ne;
+  u32 *stale = NULL, *nei;
+
+  pool_foreach (ne, lcp_nl_neigh_pool)
+    {
+      if (ne->is_stale)
+	vec_add1 (stale, ne - lcp_nl_neigh_pool);
+    }
+  vec_foreach (nei, stale)
+    {
+      ne = pool_elt_at_index (lcp_nl_neigh_pool, *nei);
+      ip_neighbor_del (&ne->ip, ne->sw_if_index);
+      lcp_nl_neigh_free (ne);
+    }
+  vec_free (stale);
+}
+
+/*
+ * Mark all routes and neighbors that were learned from netlink as stale.
+ * While resyncing, every object in the kernel dump refreshes its VPP
+ * counterpart; lcp_nl_resync_sweep() then removes whatever is still stale,
+ * which are the objects whose delete message the kernel dropped.
+ */
+void
+lcp_nl_resync_mark (void)
+{
+  lcp_nl_main_t *nlm = &lcp_nl_main;
+  lcp_nl_table_t *nlt;
+
+  pool_foreach (nlt, lcp_nl_table_pool)
+    {
+      fib_table_mark (nlt->nlt_fib_index, nlt->nlt_proto, nlm->fib_src);
+      fib_table_mark (nlt->nlt_fib_index, nlt->nlt_proto,
+		      nlm->fib_src_dynamic);
+    }
+  lcp_nl_neigh_mark ();
+  lcp_nl_nexthop_mark ();
+}
+
+void
+lcp_nl_resync_sweep (void)
+{
+  lcp_nl_main_t *nlm = &lcp_nl_main;
+  lcp_nl_table_t *nlt;
+
+  pool_foreach (nlt, lcp_nl_table_pool)
+    {
+      fib_table_sweep (nlt->nlt_fib_index, nlt->nlt_proto, nlm->fib_src);
+      fib_table_sweep (nlt->nlt_fib_index, nlt->nlt_proto,
+		       nlm->fib_src_dynamic);
+
+      /* The all 1s entry is not in the kernel dump, put it back if it was
+       * swept */
+      if (FIB_PROTOCOL_IP4 == nlt->nlt_proto && ~0 != nlt->nlt_mfib_index)
+	{
+	  fib_node_index_t fei;
+
+	  fei = fib_table_lookup_exact_match (nlt->nlt_fib_index, &pfx_all1s);
+	  if (FIB_NODE_INDEX_INVALID == fei ||
+	      !fib_entry_is_sourced (fei, nlm->fib_src))
+	    fib_table_entry_special_add (nlt->nlt_fib_index, &pfx_all1s,
+					 nlm->fib_src, FIB_ENTRY_FLAG_LOCAL);
+	}
+    }
+  /* the routes gone stale may have been the last ones of their table */
+  lcp_nl_table_gc_mark_all ();
+  lcp_nl_neigh_sweep ();
+  lcp_nl_nexthop_sweep ();
+}
+
+/*
+ * Link down purge.
+ *
+ * When a link is taken down, the kernel flushes the routes and neighbors
+ * through it, for IPv4 routes without telling anyone. With nl-link-down-purge
+ * lcp_nl_link_add() withdraws them from VPP instead as soon as the link
+ * loses IFF_LOWER_UP, which it does with its carrier as well as when taken
+ * down, and the per-prefix deletes that follow are skipped until it has
+ * IFF_LOWER_UP again. The kernel keeps what it does not flush on a carrier
+ * loss and does not announce it again, so the routes and neighbors of the
+ * namespace are imported again when the link comes back.
+ *
+ * The prefixes given a path via a phy are kept per phy, so that the purge
+ * only looks at those. A route that moved to other paths since is left
+ * in until the purge finds it does not go via the phy anymore.
+ */
+static uword *lcp_nl_purged_sw_if_indexes;
+
+typedef struct lcp_nl_route_via_key_t_
+{
+  u32 table_id;
+  u16 fp_len;
+  u16 fp_proto;
+  ip46_address_t addr;
+} lcp_nl_route_via_key_t;
+
+static mhash_t *lcp_nl_routes_via;
+
+static void
+lcp_nl_route_via_mk_key (const lcp_nl_table_t *nlt, const fib_prefix_t *pfx,
+			 lcp_nl_route_via_key_t *key)
+{
+  clib_memset (key, 0, sizeof (*key));
+  key->table_id = nlt->nlt_id;
+  key->fp_len = pfx->fp_len;
+  key->fp_proto = pfx->fp_proto;
+  key->addr = pfx->fp_addr;
+}
+
+static mhash_t *
+lcp_nl_routes_via_get (u32 sw_if_index)
+{
+  mhash_t *h;
+
+  vec_validate (lcp_nl_routes_via, sw_if_index);
+  h = vec_elt_at_index (lcp_nl_routes_via, sw_if_index);
+  if (!h->hash)
+    mhash_init (h, sizeof (uword), sizeof (lcp_nl_route_via_key_t));
+  return h;
+}
+
+/* Record, or forget, the prefix of r as going via the phys of its paths */
+static void
+lcp_nl_route_via_add_del (const lcp_nl_table_t *nlt, const lcp_nl_route_t *r,
+			  int is_add)
+{
+  const fib_route_path_t *rpath;
+  lcp_nl_route_via_key_t key;
+
+  lcp_nl_route_via_mk_key (nlt, &r->pfx, &key);
+  vec_foreach (rpath, r->np.paths)
+    {
+      if (rpath->frp_sw_if_index == ~0)
+	continue;
+      if (is_add)
+	mhash_set (lcp_nl_routes_via_get (rpath->frp_sw_if_index), &key, 0,
+		   NULL);
+      else if (rpath->frp_sw_if_index < vec_len (lcp_nl_routes_via))
+	mhash_unset (lcp_nl_routes_via_get (rpath->frp_sw_if_index), &key,
+		     NULL);
+    }
+}
+
+void
+lcp_nl_route_pair_flush (u32 phy_sw_if_index)
+{
+  if (phy_sw_if_index < vec_len (lcp_nl_routes_via) &&
+      lcp_nl_routes_via[phy_sw_if_index].hash)
+    mhash_free (&lcp_nl_routes_via[phy_sw_if_index]);
+}
+
+static u32
+lcp_nl_purge_routes (u32 sw_if_index)
+{
+  lcp_nl_main_t *nlm = &lcp_nl_main;
+  fib_route_path_t *rpaths = NULL, *rpath, *via = NULL;
+  fib_source_t srcs[] = { nlm->fib_src, nlm->fib_src_dynamic };
+  lcp_nl_route_via_key_t *keys = NULL, *key;
+  fib_node_index_t fei;
+  lcp_nl_table_t *nlt;
+  fib_prefix_t pfx;
+  u32 n_purged = 0;
+  u8 is_sourced[2];
+  CLIB_UNUSED (uword * v);
+  void *k;
+  int i;
+
+  if (sw_if_index >= vec_len (lcp_nl_routes_via) ||
+      !lcp_nl_routes_via[sw_if_index].hash)
+    return 0;
+
+  /* the removals change the set, collect it first */
+  mhash_foreach (k, v, &lcp_nl_routes_via[sw_if_index],
+		 ({ vec_add1 (keys, *(lcp_nl_route_via_key_t *) k); }));
+  mhash_free (&lcp_nl_routes_via[sw_if_index]);
+
+  vec_foreach (key, keys)
+    {
+      if (!(nlt = lcp_nl_table_find (key->table_id, key->fp_proto)))
+	continue;
+
+      clib_memset (&pfx, 0, sizeof (pfx));
+      pfx.fp_len = key->fp_len;
+      pfx.fp_proto = key->fp_proto;
+      pfx.fp_addr = key->addr;
+      fei = fib_table_lookup_exact_match (nlt->nlt_fib_index, &pfx);
+      if (fei == FIB_NODE_INDEX_INVALID)
+	continue;
+      for (i = 0; i < ARRAY_LEN (srcs); i++)
+	is_sourced[i] = fib_entry_is_sourced (fei, srcs[i]);
+      if (!is_sourced[0] && !is_sourced[1])
+	continue;
+
+      vec_reset_length (rpaths);
+      vec_reset_length (via);
+      fib_entry_encode (fei, &rpaths);
+      vec_foreach (rpath, rpaths)
+	if (rpath->frp_sw_if_index == sw_if_index)
+	  vec_add1 (via, *rpath);
+      if (!vec_len (via))
+	continue;
+
+      /* the entry may be gone after the first removal */
+      for (i = 0; i < ARRAY_LEN (srcs); i++)
+	if (is_sourced[i])
+	  fib_table_entry_path_remove2 (nlt->nlt_fib_index, &pfx, srcs[i],
+					via);
+      n_purged++;
+      lcp_nl_table_gc_mark (nlt);
+    }
+
+  vec_free (keys);
+  vec_free (rpaths);
+  vec_free (via);
+
+  return n_purged;
+}
+
+/* All neighbors learned from netlink go, permanent ones too: their deletes
+ * are skipped like the others, see lcp_nl_neigh_del(). VPP's own are none
+ * of its business */
+static u32
+lcp_nl_purge_neighbors (u32 sw_if_index)
+{
+  lcp_nl_neigh_t *ne;
+  u32 *ids, n_purged = 0, i;
+
+  ids = lcp_nl_neighs_of (sw_if_index);
+  for (i = vec_len (ids); i > 0; i--)
+    {
+      ne = pool_elt_at_index (lcp_nl_neigh_pool, ids[i - 1]);
+      ip_neighbor_del (&ne->ip, sw_if_index);
+      lcp_nl_neigh_free (ne);
+      n_purged++;
+      /* the list lost its element i - 1 */
+      ids = lcp_nl_neighs_of (sw_if_index);
+    }
+
+  return n_purged;
+}
+
+static void
+lcp_nl_link_purge (lcp_itf_pair_t *lip, int is_down)
+{
+  lcp_nl_main_t *nlm = &lcp_nl_main;
+  u32 sw_if_index = lip->lip_phy_sw_if_index;
+  u32 n_routes, n_neighbors;
+
+  if (!is_down)
+    {
+      if (!clib_bitmap_get (lcp_nl_purged_sw_if_indexes, sw_if_index))
+	return;
+      lcp_nl_purged_sw_if_indexes =
+	clib_bitmap_set (lcp_nl_purged_sw_if_indexes, sw_if_index, 0);
+      lcp_nl_ns_current_import ();
+      return;
+    }
+  if (!nlm->link_down_purge ||
+      clib_bitmap_get (lcp_nl_purged_sw_if_indexes, sw_if_index))
+    return;
+
+  n_routes = lcp_nl_purge_routes (sw_if_index);
+  n_neighbors = lcp_nl_purge_neighbors (sw_if_index);
+  lcp_nl_purged_sw_if_indexes =
+    clib_bitmap_set (lcp_nl_purged_sw_if_indexes, sw_if_index, 1);
+  nlm->purge_n_links++;
+  nlm->purge_n_routes += n_routes;
+  nlm->purge_n_neighbors += n_neighbors;
+
+  LCP_NL_INFO ("link_purge: %U purged %u routes %u neighbors",
+	       format_lcp_itf_pair, lip, n_routes, n_neighbors);
+}
+
+/* A delete of what lcp_nl_link_purge() already withdrew */
+static int
+lcp_nl_route_is_purged (lcp_nl_route_t *r)
+{
+  fib_route_path_t *rpath;
+
+  if (!lcp_nl_purged_sw_if_indexes || !vec_len (r->np.paths))
+    return 0;
+  vec_foreach (rpath, r->np.paths)
+    if (!clib_bitmap_get (lcp_nl_purged_sw_if_indexes,
+			  rpath->frp_sw_if_index))
+      return 0;
+
+  return 1;
+}
+
+u8 *
+format_lcp_nl_route (u8 *s, va_list *args)
+{
+  lcp_nl_route_t *r = va_arg (*args, lcp_nl_route_t *);
+  const fib_route_path_t *rpath;
+
+  s = format (s, "%s table %u %U type %u proto %u priority %u",
+	      r->is_add ? "add" : "del", r->table_id, format_fib_prefix,
+	      &r->pfx, r->rtype, r->rproto, r->priority);
+  if (r->nh_id)
+    s = format (s, " nhid %u", r->nh_id);
+  s = format (s, " paths {");
+  vec_foreach (rpath, r->np.paths)
+    s = format (s, " %U;", format_fib_route_path, rpath);
+  s = format (s, " }");
+
+  return s;
+}
+
+/*
+ * Decoding of routes. A route message is turned into an lcp_nl_route_t,
+ * either from the raw netlink message by lcp_nl_route_decode() or from a
+ * libnl object by lcp_nl_route_decode_obj(), and then applied by
+ * lcp_nl_route_apply_add/del(). The paths vector of the lcp_nl_route_t is
+ * reused from one message to the next.
+ */
+static lcp_nl_route_t lcp_nl_route_scratch;
+
+static fib_route_path_t *
+lcp_nl_route_path_alloc (lcp_nl_route_path_parse_t *ctx)
+{
+  fib_route_path_t *path;
+
+  vec_add2 (ctx->paths, path, 1);
+  clib_memset (path, 0, sizeof (*path));
+
+  return (path);
+}
+
+static void
+lcp_nl_route_path_parse (struct rtnl_nexthop *rnh, void *arg)
+{
+  lcp_nl_route_path_parse_t *ctx = arg;
+  fib_route_path_t *path;
+  lcp_itf_pair_t *lip;
+  fib_protocol_t fproto;
+  struct nl_addr *addr;
+
+  /* We do not log a warning/error here, because some routes (like
+   * blackhole/unreach) don't have an interface associated with them.
+   */
+  if (!(lip = lcp_nl_lip_find_by_vif (rtnl_route_nh_get_ifindex (rnh))))
+    {
+      return;
+    }
+
+  path = lcp_nl_route_path_alloc (ctx);
+
+  path->frp_flags = FIB_ROUTE_PATH_FLAG_NONE | ctx->type_flags;
+  path->frp_sw_if_index = lip->lip_phy_sw_if_index;
+  path->frp_weight = rtnl_route_nh_get_weight (rnh);
+  path->frp_preference = ctx->preference;
+
+  addr = rtnl_route_nh_get_gateway (rnh);
+
+  if (addr)
+    fproto =
+      lcp_nl_mk_addr46 (rtnl_route_nh_get_gateway (rnh), &path->frp_addr);
+  else
+    fproto = ctx->route_proto;
+
+  path->frp_proto = fib_proto_to_dpo (fproto);
+
+  if (ctx->is_mcast)
+    path->frp_mitf_flags = MFIB_ITF_FLAG_FORWARD;
+
+  LCP_NL_DBG ("route_path_parse: path %U", format_fib_route_path, path);
+}
+
+/*
+ * blackhole, unreachable, prohibit will not have a next hop in an
+ * RTM_NEWROUTE. Add a path for them.
+ */
+static void
+lcp_nl_route_path_add_special (u8 rtype, lcp_nl_route_path_parse_t *ctx)
+{
+  fib_route_path_t *path;
+
+  if (rtype < RTN_BLACKHOLE)
+    return;
+
+  /* if it already has a path, it does not need us to add one */
+  if (vec_len (ctx->paths) > 0)
+    return;
+
+  path = lcp_nl_route_path_alloc (ctx);
+
+  path->frp_flags = FIB_ROUTE_PATH_FLAG_NONE | ctx->type_flags;
+  path->frp_sw_if_index = ~0;
+  path->frp_proto = fib_proto_to_dpo (ctx->route_proto);
+  path->frp_preference = ctx->preference;
+
+  LCP_NL_DBG ("route_path_add_special: path %U", format_fib_route_path, path);
+}
+
+static void
+lcp_nl_route_init (lcp_nl_route_t *r, int is_add, u8 family, u8 rtype,
+		   u8 rproto, u32 table_id, u32 priority)
+{
+  fib_route_path_t *paths = r->np.paths;
+  fib_protocol_t fproto =
+    (family == AF_INET6) ? FIB_PROTOCOL_IP6 : FIB_PROTOCOL_IP4;
+
+  clib_memset (r, 0, sizeof (*r));
+  vec_reset_length (paths);
+
+  r->is_add = is_add;
+  r->rtype = rtype;
+  r->rproto = rproto;
+  r->table_id = table_id;
+  r->priority = priority;
+  r->pfx.fp_proto = fproto;
+  r->mpfx.fp_proto = fproto;
+
+  r->np.paths = paths;
+  r->np.route_proto = fproto;
+  r->np.is_mcast = (rtype == RTN_MULTICAST);
+  r->np.type_flags = lcp_nl_route_type_frpflags[rtype];
+  r->np.preference = (u8) priority;
+}
+
+static void
+lcp_nl_route_decode_obj (struct rtnl_route *rr, int is_add, lcp_nl_route_t *r)
+{
+  lcp_nl_route_init (r, is_add, rtnl_route_get_family (rr),
+		     rtnl_route_get_type (rr), rtnl_route_get_protocol (rr),
+		     rtnl_route_get_table (rr), rtnl_route_get_priority (rr));
+
+  lcp_nl_mk_route_prefix (rr, &r->pfx);
+  if (r->np.is_mcast)
+    lcp_nl_mk_route_mprefix (rr, &r->mpfx);
+
+  rtnl_route_foreach_nexthop (rr, lcp_nl_route_path_parse, &r->np);
+  lcp_nl_route_path_add_special (r->rtype, &r->np);
+}
+
+/* The address of a nexthop, RTA_GATEWAY or RFC 5549's RTA_VIA for an IPv4
+ * route with an IPv6 nexthop. Returns the protocol of the address. */
+static fib_protocol_t
+lcp_nl_route_nh_addr (fib_protocol_t route_proto, struct rtattr *gw,
+		      struct rtattr *via, ip46_address_t *addr)
+{
+  ip46_address_reset (addr);
+
+  if (gw)
+    {
+      u8 family = (route_proto == FIB_PROTOCOL_IP6) ? AF_INET6 : AF_INET;
+
+      lcp_nl_rta_addr46 (gw, family, addr);
+    }
+  else if (via && RTA_PAYLOAD (via) >= sizeof (struct rtvia))
+    {
+      struct rtvia *v = RTA_DATA (via);
+
+      if (v->rtvia_family == AF_INET6 &&
+	  RTA_PAYLOAD (via) >= sizeof (*v) + sizeof (ip6_address_t))
+	{
+	  clib_memcpy (&addr->ip6, v->rtvia_addr, sizeof (ip6_address_t));
+	  return FIB_PROTOCOL_IP6;
+	}
+      else if (v->rtvia_family == AF_INET &&
+	       RTA_PAYLOAD (via) >= sizeof (*v) + sizeof (ip4_address_t))
+	{
+	  clib_memcpy (&addr->ip4, v->rtvia_addr, sizeof (ip4_address_t));
+	  return FIB_PROTOCOL_IP4;
+	}
+    }
+
+  return route_proto;
+}
+
+static void
+lcp_nl_route_raw_path_add (lcp_nl_route_t *r, u32 ifindex, u32 weight,
+			   fib_protocol_t fproto, const ip46_address_t *addr)
+{
+  fib_route_path_t *path;
+  lcp_itf_pair_t *lip;
+
+  /* no warning, see lcp_nl_route_path_parse() */
+  if (!(lip = lcp_nl_lip_find_by_vif (ifindex)))
+    return;
+
+  path = lcp_nl_route_path_alloc (&r->np);
+
+  path->frp_flags = FIB_ROUTE_PATH_FLAG_NONE | r->np.type_flags;
+  path->frp_sw_if_index = lip->lip_phy_sw_if_index;
+  path->frp_weight = weight;
+  path->frp_preference = r->np.preference;
+  path->frp_addr = *addr;
+  path->frp_proto = fib_proto_to_dpo (fproto);
+
+  if (r->np.is_mcast)
+    path->frp_mitf_flags = MFIB_ITF_FLAG_FORWARD;
+}
+
+/* The attributes of an RTM_NEWROUTE/RTM_DELROUTE */
+typedef struct lcp_nl_route_attrs_t_
+{
+  struct rtmsg *rtm;
+  u32 table_id;
+  u32 priority;
+  u32 oif;
+  u32 nh_id;
+  struct rtattr *dst, *src, *gw, *via, *mp;
+} lcp_nl_route_attrs_t;
+
+/* Touches nothing but the message, decoder threads use it too */
+static int
+lcp_nl_route_attrs_parse (struct nlmsghdr *hdr, lcp_nl_route_attrs_t *a)
+{
+  struct rtattr *rta;
+  struct rtmsg *rtm;
+  int len;
+
+  clib_memset (a, 0, sizeof (*a));
+
+  if (hdr->nlmsg_len < NLMSG_LENGTH (sizeof (*rtm)))
+    return -1;
+  rtm = NLMSG_DATA (hdr);
+  if (rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6)
+    return -1;
+  if (rtm->rtm_type >= __RTN_MAX)
+    return -1;
+
+  a->rtm = rtm;
+  a->table_id = rtm->rtm_table;
+  len = RTM_PAYLOAD (hdr);
+  for (rta = RTM_RTA (rtm); RTA_OK (rta, len); rta = RTA_NEXT (rta, len))
+    {
+      switch (rta->rta_type)
+	{
+	case RTA_TABLE:
+	  if (RTA_PAYLOAD (rta) >= sizeof (u32))
+	    a->table_id = *(u32 *) RTA_DATA (rta);
+	  break;
+	case RTA_PRIORITY:
+	  if (RTA_PAYLOAD (rta) >= sizeof (u32))
+	    a->priority = *(u32 *) RTA_DATA (rta);
+	  break;
+	case RTA_DST:
+	  a->dst = rta;
+	  break;
+	case RTA_SRC:
+	  a->src = rta;
+	  break;
+	case RTA_OIF:
+	  if (RTA_PAYLOAD (rta) >= sizeof (u32))
+	    a->oif = *(u32 *) RTA_DATA (rta);
+	  break;
+	case RTA_GATEWAY:
+	  a->gw = rta;
+	  break;
+	case RTA_VIA:
+	  a->via = rta;
+	  break;
+	case RTA_MULTIPATH:
+	  a->mp = rta;
+	  break;
+	case RTA_NH_ID:
+	  if (RTA_PAYLOAD (rta) >= sizeof (u32))
+	    a->nh_id = *(u32 *) RTA_DATA (rta);
+	  break;
+	}
+    }
+
+  return 0;
 }
 
+/* The gateway and via of one path of an RTA_MULTIPATH */
 static void
-lcp_nl_route_path_parse (struct rtnl_nexthop *rnh, void *arg)
+lcp_nl_rtnh_attrs (struct rtnexthop *rtnh, struct rtattr **gw,
+		   struct rtattr **via)
 {
-  lcp_nl_route_path_parse_t *ctx = arg;
-  fib_route_path_t *path;
-  lcp_itf_pair_t *lip;
-  fib_protocol_t fproto;
-  struct nl_addr *addr;
+  struct rtattr *a = RTNH_DATA (rtnh);
+  int alen = rtnh->rtnh_len - sizeof (*rtnh);
 
-  /* We do not log a warning/error here, because some routes (like
-   * blackhole/unreach) don't have an interface associated with them.
-   */
-  if (!(lip = lcp_itf_pair_get (
-	  lcp_itf_pair_find_by_vif (rtnl_route_nh_get_ifindex (rnh)))))
+  *gw = *via = NULL;
+  for (; RTA_OK (a, alen); a = RTA_NEXT (a, alen))
     {
-      return;
+      if (a->rta_type == RTA_GATEWAY)
+	*gw = a;
+      else if (a->rta_type == RTA_VIA)
+	*via = a;
     }
+}
 
-  vec_add2 (ctx->paths, path, 1);
-
-  path->frp_flags = FIB_ROUTE_PATH_FLAG_NONE | ctx->type_flags;
-  path->frp_sw_if_index = lip->lip_phy_sw_if_index;
-  path->frp_weight = rtnl_route_nh_get_weight (rnh);
-  path->frp_preference = ctx->preference;
-
-  addr = rtnl_route_nh_get_gateway (rnh);
-
-  if (addr)
-    fproto =
-      lcp_nl_mk_addr46 (rtnl_route_nh_get_gateway (rnh), &path->frp_addr);
-  else
-    fproto = ctx->route_proto;
-
-  path->frp_proto = fib_proto_to_dpo (fproto);
+static int
+lcp_nl_route_prefix_decode (const lcp_nl_route_attrs_t *a, lcp_nl_route_t *r)
+{
+  u8 family = a->rtm->rtm_family;
 
-  if (ctx->is_mcast)
-    path->frp_mitf_flags = MFIB_ITF_FLAG_FORWARD;
+  r->pfx.fp_len = a->rtm->rtm_dst_len;
+  r->mpfx.fp_len = a->rtm->rtm_dst_len;
+  if (a->dst)
+    {
+      if (lcp_nl_rta_addr46 (a->dst, family, &r->pfx.fp_addr))
+	return -1;
+      r->mpfx.fp_grp_addr = r->pfx.fp_addr;
+    }
+  if (a->src && lcp_nl_rta_addr46 (a->src, family, &r->mpfx.fp_src_addr))
+    return -1;
 
-  LCP_NL_DBG ("route_path_parse: path %U", format_fib_route_path, path);
+  return 0;
 }
 
 /*
- * blackhole, unreachable, prohibit will not have a next hop in an
- * RTM_NEWROUTE. Add a path for them.
+ * Decode an RTM_NEWROUTE/RTM_DELROUTE without libnl. Returns -1 for
+ * messages it does not handle, which are left to libnl.
  */
-static void
-lcp_nl_route_path_add_special (struct rtnl_route *rr,
-			       lcp_nl_route_path_parse_t *ctx)
+int
+lcp_nl_route_decode (struct nlmsghdr *hdr, lcp_nl_route_t *r)
 {
-  fib_route_path_t *path;
+  lcp_nl_route_attrs_t a;
+  struct rtattr *gw, *via;
+  ip46_address_t addr;
+  fib_protocol_t fproto;
 
-  if (rtnl_route_get_type (rr) < RTN_BLACKHOLE)
-    return;
+  if (lcp_nl_route_attrs_parse (hdr, &a) < 0)
+    return -1;
 
-  /* if it already has a path, it does not need us to add one */
-  if (vec_len (ctx->paths) > 0)
-    return;
+  lcp_nl_route_init (r, hdr->nlmsg_type == RTM_NEWROUTE, a.rtm->rtm_family,
+		     a.rtm->rtm_type, a.rtm->rtm_protocol, a.table_id,
+		     a.priority);
+  if (lcp_nl_route_prefix_decode (&a, r) < 0)
+    return -1;
+  r->nh_id = a.nh_id;
 
-  vec_add2 (ctx->paths, path, 1);
+  /* the path via the nexthop object is added by lcp_nl_route_apply_add(),
+   * the kernel may still include the nexthop's own paths for
+   * compatibility */
+  if (r->nh_id)
+    return 0;
 
-  path->frp_flags = FIB_ROUTE_PATH_FLAG_NONE | ctx->type_flags;
-  path->frp_sw_if_index = ~0;
-  path->frp_proto = fib_proto_to_dpo (ctx->route_proto);
-  path->frp_preference = ctx->preference;
+  if (a.mp)
+    {
+      struct rtnexthop *rtnh = RTA_DATA (a.mp);
+      int mplen = RTA_PAYLOAD (a.mp);
 
-  LCP_NL_DBG ("route_path_add_special: path %U", format_fib_route_path, path);
+      while (RTNH_OK (rtnh, mplen))
+	{
+	  lcp_nl_rtnh_attrs (rtnh, &gw, &via);
+	  fproto = lcp_nl_route_nh_addr (r->np.route_proto, gw, via, &addr);
+	  lcp_nl_route_raw_path_add (r, rtnh->rtnh_ifindex,
+				     rtnh->rtnh_hops + 1, fproto, &addr);
+
+	  mplen -= RTNH_ALIGN (rtnh->rtnh_len);
+	  rtnh = RTNH_NEXT (rtnh);
+	}
+    }
+  else if (a.oif || a.gw || a.via)
+    {
+      fproto = lcp_nl_route_nh_addr (r->np.route_proto, a.gw, a.via, &addr);
+      lcp_nl_route_raw_path_add (r, a.oif, 1, fproto, &addr);
+    }
+
+  lcp_nl_route_path_add_special (r->rtype, &r->np);
+
+  return 0;
 }
 
-static uint32_t
-lcp_nl_table_k2f (uint32_t k)
+/* Whether the path through ifindex is one that applying the message would
+ * program: it has a pair, which for a delete is not purged */
+static int
+lcp_nl_route_raw_path_applies (u32 ifindex, int is_add)
 {
-  // the kernel's table ID 255 is the default table
-  if (k == 255 || k == 254)
+  lcp_itf_pair_t *lip;
+
+  if (!(lip = lcp_nl_lip_find_by_vif (ifindex)))
     return 0;
-  return k;
+
+  return (is_add || !clib_bitmap_get (lcp_nl_purged_sw_if_indexes,
+				      lip->lip_phy_sw_if_index));
 }
 
-static lcp_nl_table_t *
-lcp_nl_table_add_or_lock (uint32_t id, fib_protocol_t fproto)
+/*
+ * Whether applying the RTM_NEWROUTE/RTM_DELROUTE hdr of the namespace being
+ * applied changes VPP, see lcp_nl_coalesce() in lcpng_netlink.c: a message
+ * that is skipped, or that has no path through a pair, must not elide the
+ * earlier ones for its prefix. Routes via a nexthop object get a path even
+ * before the nexthop resolves, unless it is attached.
+ */
+int
+lcp_nl_route_raw_applies (struct nlmsghdr *hdr)
 {
-  lcp_nl_table_t *nlt;
-  lcp_nl_main_t *nlm = &lcp_nl_main;
+  int is_add = (hdr->nlmsg_type == RTM_NEWROUTE);
+  lcp_nl_route_attrs_t a;
+  lcp_nl_nexthop_t *nh;
 
-  id = lcp_nl_table_k2f (id);
-  nlt = lcp_nl_table_find (id, fproto);
+  if (lcp_nl_route_attrs_parse (hdr, &a) < 0)
+    return 0;
+  if (!lcp_nl_route_type_valid[a.rtm->rtm_type] || (a.table_id == 255) ||
+      lcp_nl_filter_route_ignored (a.rtm->rtm_protocol, a.table_id))
+    return 0;
 
-  if (NULL == nlt)
+  if (a.nh_id)
     {
-      pool_get_zero (lcp_nl_table_pool, nlt);
-
-      nlt->nlt_id = id;
-      nlt->nlt_proto = fproto;
-      nlt->nlt_if_index = ~0;
+      if (!is_add)
+	return 1;
+      nh = lcp_nl_nexthop_find (lcp_nl_main.nl_ns_current, a.nh_id);
+      if (!nh || !lcp_nl_nexthop_is_attached (nh))
+	return 1;
+      return lcp_nl_route_raw_path_applies (nh->ifindex, is_add);
+    }
 
-      nlt->nlt_fib_index = fib_table_find_or_create_and_lock (
-	nlt->nlt_proto, nlt->nlt_id, nlm->fib_src);
-      nlt->nlt_mfib_index = mfib_table_find_or_create_and_lock (
-	nlt->nlt_proto, nlt->nlt_id, MFIB_SOURCE_PLUGIN_LOW);
+  if (a.mp)
+    {
+      struct rtnexthop *rtnh = RTA_DATA (a.mp);
+      int mplen = RTA_PAYLOAD (a.mp);
 
-      hash_set (lcp_nl_table_db[fproto], nlt->nlt_id, nlt - lcp_nl_table_pool);
-      if (FIB_PROTOCOL_IP4 == fproto)
-	{
-	  /* Set the all 1s address in this table to punt */
-	  fib_table_entry_special_add (nlt->nlt_fib_index, &pfx_all1s,
-				       nlm->fib_src, FIB_ENTRY_FLAG_LOCAL);
-
-	  const fib_route_path_t path = {
-	    .frp_proto = DPO_PROTO_IP4,
-	    .frp_addr = zero_addr,
-	    .frp_sw_if_index = ~0,
-	    .frp_fib_index = ~0,
-	    .frp_weight = 1,
-	    .frp_mitf_flags = MFIB_ITF_FLAG_FORWARD,
-	    .frp_flags = FIB_ROUTE_PATH_LOCAL,
-	  };
-	  int ii;
-
-	  for (ii = 0; ii < ARRAY_LEN (ip4_specials); ii++)
-	    {
-	      mfib_table_entry_path_update (
-		nlt->nlt_mfib_index, &ip4_specials[ii], MFIB_SOURCE_PLUGIN_LOW,
-		MFIB_ENTRY_FLAG_NONE, &path);
-	    }
-	}
-      else if (FIB_PROTOCOL_IP6 == fproto)
+      while (RTNH_OK (rtnh, mplen))
 	{
-	  const fib_route_path_t path = {
-	    .frp_proto = DPO_PROTO_IP6,
-	    .frp_addr = zero_addr,
-	    .frp_sw_if_index = ~0,
-	    .frp_fib_index = ~0,
-	    .frp_weight = 1,
-	    .frp_mitf_flags = MFIB_ITF_FLAG_FORWARD,
-	    .frp_flags = FIB_ROUTE_PATH_LOCAL,
-	  };
-	  int ii;
-
-	  for (ii = 0; ii < ARRAY_LEN (ip6_specials); ii++)
-	    {
-	      mfib_table_entry_path_update (
-		nlt->nlt_mfib_index, &ip6_specials[ii], MFIB_SOURCE_PLUGIN_LOW,
-		MFIB_ENTRY_FLAG_NONE, &path);
-	    }
+	  if (lcp_nl_route_raw_path_applies (rtnh->rtnh_ifindex, is_add))
+	    return 1;
+
+	  mplen -= RTNH_ALIGN (rtnh->rtnh_len);
+	  rtnh = RTNH_NEXT (rtnh);
 	}
     }
+  else if ((a.oif || a.gw || a.via) &&
+	   lcp_nl_route_raw_path_applies (a.oif, is_add))
+    return 1;
 
-  nlt->nlt_refs++;
-
-  return (nlt);
+  /* blackhole, unreachable and prohibit routes get a path of their own */
+  return (a.rtm->rtm_type >= RTN_BLACKHOLE);
 }
 
-static void
-lcp_nl_table_unlock (lcp_nl_table_t *nlt)
+/*
+ * Route operations, made by the decoder threads. These decode a route
+ * message into a lcp_nl_route_op_t, which holds everything but the
+ * interfaces of the paths: the pairs are only looked up on the main thread,
+ * which owns them. Decoding touches nothing but the message and the op.
+ * Returns -1 for what lcp_nl_route_decode() would not handle, and for
+ * routes with more paths than an op holds.
+ */
+int
+lcp_nl_route_op_decode (struct nlmsghdr *hdr, lcp_nl_route_op_t *op)
 {
-  lcp_nl_main_t *nlm = &lcp_nl_main;
-  nlt->nlt_refs--;
+  lcp_nl_route_attrs_t a;
+  lcp_nl_route_op_path_t *p;
+  fib_protocol_t route_proto;
+  struct rtattr *gw, *via;
+
+  if (lcp_nl_route_attrs_parse (hdr, &a) < 0)
+    return -1;
+
+  op->is_add = (hdr->nlmsg_type == RTM_NEWROUTE);
+  op->family = a.rtm->rtm_family;
+  op->rtype = a.rtm->rtm_type;
+  op->rproto = a.rtm->rtm_protocol;
+  op->plen = a.rtm->rtm_dst_len;
+  op->n_paths = 0;
+  op->table_id = a.table_id;
+  op->priority = a.priority;
+  op->nh_id = a.nh_id;
+  ip46_address_reset (&op->dst);
+  ip46_address_reset (&op->src);
+  if (a.dst && lcp_nl_rta_addr46 (a.dst, op->family, &op->dst))
+    return -1;
+  if (a.src && lcp_nl_rta_addr46 (a.src, op->family, &op->src))
+    return -1;
+
+  if (op->nh_id)
+    return 0;
 
-  if (0 == nlt->nlt_refs)
+  route_proto =
+    (op->family == AF_INET6) ? FIB_PROTOCOL_IP6 : FIB_PROTOCOL_IP4;
+  if (a.mp)
     {
-      if (FIB_PROTOCOL_IP4 == nlt->nlt_proto)
+      struct rtnexthop *rtnh = RTA_DATA (a.mp);
+      int mplen = RTA_PAYLOAD (a.mp);
+
+      while (RTNH_OK (rtnh, mplen))
 	{
-	  /* Remove the all 1s address in this table to punt */
-	  fib_table_entry_special_remove (nlt->nlt_fib_index, &pfx_all1s,
-					  nlm->fib_src);
+	  if (op->n_paths == LCP_NL_ROUTE_OP_N_PATHS)
+	    return -1;
+	  p = &op->paths[op->n_paths++];
+	  lcp_nl_rtnh_attrs (rtnh, &gw, &via);
+	  p->fproto = lcp_nl_route_nh_addr (route_proto, gw, via, &p->addr);
+	  p->ifindex = rtnh->rtnh_ifindex;
+	  p->weight = rtnh->rtnh_hops + 1;
+
+	  mplen -= RTNH_ALIGN (rtnh->rtnh_len);
+	  rtnh = RTNH_NEXT (rtnh);
 	}
-
-      fib_table_unlock (nlt->nlt_fib_index, nlt->nlt_proto, nlm->fib_src);
-      mfib_table_unlock (nlt->nlt_mfib_index, nlt->nlt_proto, MFIB_SOURCE_PLUGIN_LOW);
-
-      hash_unset (lcp_nl_table_db[nlt->nlt_proto], nlt->nlt_id);
-      pool_put (lcp_nl_table_pool, nlt);
     }
+  else if (a.oif || a.gw || a.via)
+    {
+      p = &op->paths[op->n_paths++];
+      p->fproto = lcp_nl_route_nh_addr (route_proto, a.gw, a.via, &p->addr);
+      p->ifindex = a.oif;
+      p->weight = 1;
+    }
+
+  return 0;
 }
 
-void
-lcp_nl_route_del (struct rtnl_route *rr)
+static void
+lcp_nl_route_op_expand (const lcp_nl_route_op_t *op, lcp_nl_route_t *r)
 {
-  uint32_t table_id;
-  fib_prefix_t pfx;
-  lcp_nl_table_t *nlt;
-  uint8_t rtype, rproto;
+  const lcp_nl_route_op_path_t *p;
+
+  lcp_nl_route_init (r, op->is_add, op->family, op->rtype, op->rproto,
+		     op->table_id, op->priority);
+  r->pfx.fp_len = op->plen;
+  r->pfx.fp_addr = op->dst;
+  r->mpfx.fp_len = op->plen;
+  r->mpfx.fp_grp_addr = op->dst;
+  r->mpfx.fp_src_addr = op->src;
+  r->nh_id = op->nh_id;
+
+  if (r->nh_id)
+    return;
 
-  LCP_NL_DBG ("route_del: netlink %U", format_nl_object, rr);
+  for (p = op->paths; p < op->paths + op->n_paths; p++)
+    lcp_nl_route_raw_path_add (r, p->ifindex, p->weight, p->fproto,
+			       &p->addr);
+  lcp_nl_route_path_add_special (r->rtype, &r->np);
+}
 
-  rtype = rtnl_route_get_type (rr);
-  table_id = rtnl_route_get_table (rr);
-  rproto = rtnl_route_get_protocol (rr);
+static void
+lcp_nl_route_apply_del (lcp_nl_route_t *r)
+{
+  lcp_nl_table_t *nlt;
+  fib_prefix_t *pfx = &r->pfx;
 
-  /* skip unsupported route types and local table */
-  if (!lcp_nl_route_type_valid[rtype] || (table_id == 255))
+  /* skip unsupported route types, local table and configured ignores */
+  if (!lcp_nl_route_type_valid[r->rtype] || (r->table_id == 255) ||
+      lcp_nl_filter_route_ignored (r->rproto, r->table_id))
     return;
 
-  lcp_nl_mk_route_prefix (rr, &pfx);
-  nlt = lcp_nl_table_find (lcp_nl_table_k2f (table_id), pfx.fp_proto);
+  nlt = lcp_nl_table_find (lcp_nl_table_k2f (r->table_id), pfx->fp_proto);
 
   if (NULL == nlt)
     {
       return;
     }
 
-  lcp_nl_route_path_parse_t np = {
-    .route_proto = pfx.fp_proto,
-    .type_flags = lcp_nl_route_type_frpflags[rtype],
-  };
-
-  rtnl_route_foreach_nexthop (rr, lcp_nl_route_path_parse, &np);
-  lcp_nl_route_path_add_special (rr, &np);
-
-  if (0 != vec_len (np.paths))
+  if (r->rtype == RTN_MULTICAST)
     {
-      fib_source_t fib_src = lcp_nl_proto_fib_source (rproto);
+      if (~0 != nlt->nlt_mfib_index && nlt->nlt_n_mroutes &&
+	  MFIB_NODE_INDEX_INVALID !=
+	    mfib_table_lookup_exact_match (nlt->nlt_mfib_index, &r->mpfx))
+	{
+	  LCP_NL_DBG ("route_del: mcast table %d prefix %U", r->table_id,
+		      format_mfib_prefix, &r->mpfx);
+	  mfib_table_entry_delete (nlt->nlt_mfib_index, &r->mpfx,
+				   MFIB_SOURCE_PLUGIN_LOW);
+	  nlt->nlt_n_mroutes--;
+	}
+    }
+  else if ((0 != vec_len (r->np.paths) || r->nh_id) &&
+	   !lcp_nl_route_is_purged (r))
+    {
+      fib_source_t fib_src = lcp_nl_proto_fib_source (r->rproto);
       fib_entry_flag_t entry_flags;
 
-      entry_flags = lcp_nl_mk_route_entry_flags (rtype, table_id, rproto);
-      LCP_NL_DBG ("route_del: table %d prefix %U flags %U",
-		  rtnl_route_get_table (rr), format_fib_prefix, &pfx,
-		  format_fib_entry_flags, entry_flags);
-      if (pfx.fp_proto == FIB_PROTOCOL_IP6)
-	fib_table_entry_delete (nlt->nlt_fib_index, &pfx, fib_src);
+      entry_flags =
+	lcp_nl_mk_route_entry_flags (r->rtype, r->table_id, r->rproto);
+      LCP_NL_DBG ("route_del: table %d prefix %U flags %U", r->table_id,
+		  format_fib_prefix, pfx, format_fib_entry_flags,
+		  entry_flags);
+      /* a route via a nexthop object has that single path */
+      if (pfx->fp_proto == FIB_PROTOCOL_IP6 || r->nh_id)
+	fib_table_entry_delete (nlt->nlt_fib_index, pfx, fib_src);
       else
-	fib_table_entry_path_remove2 (nlt->nlt_fib_index, &pfx, fib_src,
-				      np.paths);
+	fib_table_entry_path_remove2 (nlt->nlt_fib_index, pfx, fib_src,
+				      r->np.paths);
+      lcp_nl_route_via_add_del (nlt, r, 0 /* is_add */);
     }
 
-  vec_free (np.paths);
-
-  lcp_nl_table_unlock (nlt);
+  lcp_nl_table_gc_mark (nlt);
 }
 
-void
-lcp_nl_route_add (struct rtnl_route *rr)
+static void
+lcp_nl_route_apply_add (lcp_nl_route_t *r)
 {
   fib_entry_flag_t entry_flags;
-  uint32_t table_id;
-  fib_prefix_t pfx;
+  fib_prefix_t *pfx = &r->pfx;
   lcp_nl_table_t *nlt;
-  uint8_t rtype, rproto;
-
-  LCP_NL_DBG ("route_add: netlink %U", format_nl_object, rr);
-
-  rtype = rtnl_route_get_type (rr);
-  table_id = rtnl_route_get_table (rr);
-  rproto = rtnl_route_get_protocol (rr);
 
-  /* skip unsupported route types and local table */
-  if (!lcp_nl_route_type_valid[rtype] || (table_id == 255))
+  /* skip unsupported route types, local table and configured ignores */
+  if (!lcp_nl_route_type_valid[r->rtype] || (r->table_id == 255) ||
+      lcp_nl_filter_route_ignored (r->rproto, r->table_id))
     return;
 
-  lcp_nl_mk_route_prefix (rr, &pfx);
-  entry_flags = lcp_nl_mk_route_entry_flags (rtype, table_id, rproto);
+  entry_flags = lcp_nl_mk_route_entry_flags (r->rtype, r->table_id, r->rproto);
 
-  nlt = lcp_nl_table_add_or_lock (table_id, pfx.fp_proto);
   /* Skip any kernel routes and IPv6 LL or multicast routes */
-  if (rproto == RTPROT_KERNEL ||
-      (FIB_PROTOCOL_IP6 == pfx.fp_proto &&
-       (ip6_address_is_multicast (&pfx.fp_addr.ip6) ||
-	ip6_address_is_link_local_unicast (&pfx.fp_addr.ip6))))
+  if (r->rproto == RTPROT_KERNEL ||
+      (FIB_PROTOCOL_IP6 == pfx->fp_proto &&
+       (ip6_address_is_multicast (&pfx->fp_addr.ip6) ||
+	ip6_address_is_link_local_unicast (&pfx->fp_addr.ip6))))
     {
       LCP_NL_DBG ("route_add: skip linklocal table %d prefix %U flags %U",
-		  rtnl_route_get_table (rr), format_fib_prefix, &pfx,
-		  format_fib_entry_flags, entry_flags);
+		  r->table_id, format_fib_prefix, pfx, format_fib_entry_flags,
+		  entry_flags);
       return;
     }
-  lcp_nl_route_path_parse_t np = {
-    .route_proto = pfx.fp_proto,
-    .is_mcast = (rtype == RTN_MULTICAST),
-    .type_flags = lcp_nl_route_type_frpflags[rtype],
-    .preference = (u8) rtnl_route_get_priority (rr),
-  };
 
-  rtnl_route_foreach_nexthop (rr, lcp_nl_route_path_parse, &np);
-  lcp_nl_route_path_add_special (rr, &np);
+  nlt = lcp_nl_table_add (lcp_nl_table_k2f (r->table_id), pfx->fp_proto);
+
+  if (r->nh_id)
+    lcp_nl_route_nexthop_path_add (r);
 
-  if (0 != vec_len (np.paths))
+  if (0 != vec_len (r->np.paths))
     {
-      if (rtype == RTN_MULTICAST)
+      if (r->rtype == RTN_MULTICAST)
 	{
 	  /* it's not clear to me how linux expresses the RPF paramters
 	   * so we'll allow from all interfaces and hope for the best */
-	  mfib_prefix_t mpfx = {};
-
-	  lcp_nl_mk_route_mprefix (rr, &mpfx);
-
 	  LCP_NL_DBG ("route_add: mcast table %d prefix %U flags %U",
-		      rtnl_route_get_table (rr), format_mfib_prefix, &mpfx,
+		      r->table_id, format_mfib_prefix, &r->mpfx,
 		      format_fib_entry_flags, entry_flags);
-	  mfib_table_entry_update (nlt->nlt_mfib_index, &mpfx,
+	  lcp_nl_table_mfib_add (nlt);
+	  if (MFIB_NODE_INDEX_INVALID ==
+	      mfib_table_lookup_exact_match (nlt->nlt_mfib_index, &r->mpfx))
+	    nlt->nlt_n_mroutes++;
+	  mfib_table_entry_update (nlt->nlt_mfib_index, &r->mpfx,
 				   MFIB_SOURCE_PLUGIN_LOW, MFIB_RPF_ID_NONE,
 				   MFIB_ENTRY_FLAG_ACCEPT_ALL_ITF);
 
-	  mfib_table_entry_paths_update (nlt->nlt_mfib_index, &mpfx,
+	  mfib_table_entry_paths_update (nlt->nlt_mfib_index, &r->mpfx,
 					 MFIB_SOURCE_PLUGIN_LOW,
-					 MFIB_ENTRY_FLAG_NONE, np.paths);
+					 MFIB_ENTRY_FLAG_NONE, r->np.paths);
 	}
       else
 	{
 	  fib_source_t fib_src;
 	  const fib_route_path_t *rpath;
 
-	  vec_foreach (rpath, np.paths)
+	  vec_foreach (rpath, r->np.paths)
 	    {
 	      if (fib_route_path_is_attached (rpath))
 		{
@@ -522,26 +2094,153 @@ lcp_nl_route_add (struct rtnl_route *rr)
 		  break;
 		}
 	    }
-	  fib_src = lcp_nl_proto_fib_source (rproto);
+	  fib_src = lcp_nl_proto_fib_source (r->rproto);
 
-	  LCP_NL_DBG ("route_add: table %d prefix %U flags %U",
-		      rtnl_route_get_table (rr), format_fib_prefix, &pfx,
-		      format_fib_entry_flags, entry_flags);
+	  LCP_NL_DBG ("route_add: table %d prefix %U flags %U", r->table_id,
+		      format_fib_prefix, pfx, format_fib_entry_flags,
+		      entry_flags);
 
-	  if (pfx.fp_proto == FIB_PROTOCOL_IP6)
-	    fib_table_entry_path_add2 (nlt->nlt_fib_index, &pfx, fib_src,
-				       entry_flags, np.paths);
+	  /* IPv6 multipath routes come as one message per path, but a
+	   * route via a nexthop object replaces its path */
+	  if (pfx->fp_proto == FIB_PROTOCOL_IP6 && !r->nh_id)
+	    fib_table_entry_path_add2 (nlt->nlt_fib_index, pfx, fib_src,
+				       entry_flags, r->np.paths);
 	  else
-	    fib_table_entry_update (nlt->nlt_fib_index, &pfx, fib_src,
-				    entry_flags, np.paths);
+	    fib_table_entry_update (nlt->nlt_fib_index, pfx, fib_src,
+				    entry_flags, r->np.paths);
+	  lcp_nl_route_via_add_del (nlt, r, 1 /* is_add */);
 	}
     }
   else
-    LCP_NL_WARN ("route_add: No paths table %d prefix %U flags %U netlink %U",
-		 rtnl_route_get_table (rr), format_fib_prefix, &pfx,
-		 format_fib_entry_flags, entry_flags, format_nl_object, rr);
+    {
+      LCP_NL_WARN (
+	"route_add: No paths table %d prefix %U flags %U netlink %U",
+	r->table_id, format_fib_prefix, pfx, format_fib_entry_flags,
+	entry_flags, format_lcp_nl_route, r);
+      lcp_nl_table_gc_mark (nlt);
+    }
+}
+
+static void
+lcp_nl_route_apply (lcp_nl_route_t *r)
+{
+  if (r->is_add)
+    lcp_nl_route_apply_add (r);
+  else
+    lcp_nl_route_apply_del (r);
+}
+
+/*
+ * The kernel announces an IPv6 multipath route, when its paths are
+ * appended one at a time, as one RTM_NEWROUTE per path, and removes it as
+ * one RTM_DELROUTE per path. Consecutive messages for the same route are
+ * collected in lcp_nl_route_pending and applied as a single FIB update
+ * with the complete set of paths (or a single delete) by
+ * lcp_nl_route_flush(), which the caller runs before any other message and
+ * before it releases the barrier.
+ */
+static lcp_nl_route_t lcp_nl_route_pending;
+static u32 lcp_nl_route_n_pending; // messages collected in the above
+
+static int
+lcp_nl_route_can_merge (const lcp_nl_route_t *p, const lcp_nl_route_t *r)
+{
+  return (p->is_add == r->is_add && p->table_id == r->table_id &&
+	  p->rtype == r->rtype && p->rproto == r->rproto &&
+	  p->priority == r->priority && !p->nh_id && !r->nh_id &&
+	  0 == fib_prefix_cmp (&p->pfx, &r->pfx));
+}
+
+void
+lcp_nl_route_flush (void)
+{
+  if (!lcp_nl_route_n_pending)
+    return;
+
+  if (lcp_nl_route_n_pending > 1)
+    LCP_NL_DBG ("route_flush: %u messages as %U", lcp_nl_route_n_pending,
+		format_lcp_nl_route, &lcp_nl_route_pending);
+  lcp_nl_route_apply (&lcp_nl_route_pending);
+  lcp_nl_route_n_pending = 0;
+}
+
+/* Apply a decoded route, or hold it back to be merged with the next */
+static void
+lcp_nl_route_commit (lcp_nl_route_t *r)
+{
+  lcp_nl_route_t tmp;
+
+  LCP_NL_DBG ("route_raw: netlink %U", format_lcp_nl_route, r);
+
+  if (FIB_PROTOCOL_IP6 != r->pfx.fp_proto || r->nh_id ||
+      r->rtype == RTN_MULTICAST)
+    {
+      lcp_nl_route_flush ();
+      lcp_nl_route_apply (r);
+      return;
+    }
+
+  if (lcp_nl_route_n_pending &&
+      lcp_nl_route_can_merge (&lcp_nl_route_pending, r))
+    {
+      if (r->is_add)
+	vec_append (lcp_nl_route_pending.np.paths, r->np.paths);
+      lcp_nl_route_n_pending++;
+      return;
+    }
+
+  /* start collecting from this message, swapping keeps both paths vectors
+   * for reuse */
+  lcp_nl_route_flush ();
+  tmp = lcp_nl_route_pending;
+  lcp_nl_route_pending = *r;
+  *r = tmp;
+  lcp_nl_route_n_pending = 1;
+}
+
+/* The hot path for route messages, see lcp_nl_process_msgs() */
+int
+lcp_nl_route_raw (struct nlmsghdr *hdr)
+{
+  lcp_nl_route_t *r = &lcp_nl_route_scratch;
+
+  if (lcp_nl_route_decode (hdr, r) < 0)
+    return -1;
+
+  lcp_nl_route_commit (r);
+  return 0;
+}
+
+/* Same, for a route a decoder thread already decoded */
+void
+lcp_nl_route_op_raw (const lcp_nl_route_op_t *op)
+{
+  lcp_nl_route_t *r = &lcp_nl_route_scratch;
+
+  lcp_nl_route_op_expand (op, r);
+  lcp_nl_route_commit (r);
+}
+
+void
+lcp_nl_route_del (struct rtnl_route *rr)
+{
+  lcp_nl_route_t *r = &lcp_nl_route_scratch;
+
+  LCP_NL_DBG ("route_del: netlink %U", format_nl_object, rr);
+
+  lcp_nl_route_decode_obj (rr, 0 /* is_add */, r);
+  lcp_nl_route_apply_del (r);
+}
+
+void
+lcp_nl_route_add (struct rtnl_route *rr)
+{
+  lcp_nl_route_t *r = &lcp_nl_route_scratch;
+
+  LCP_NL_DBG ("route_add: netlink %U", format_nl_object, rr);
 
-  vec_free (np.paths);
+  lcp_nl_route_decode_obj (rr, 1 /* is_add */, r);
+  lcp_nl_route_apply_add (r);
 }
 
 // Returns the LIP for a newly created sub-int pair, or
@@ -571,7 +2270,7 @@ lcp_nl_link_add_vlan (struct rtnl_link *rl)
 
   /* Get the LIP of the parent, can be a phy Te3/0/0 or a subint Te3/0/0.1000
    */
-  if (!(parent_lip = lcp_itf_pair_get (lcp_itf_pair_find_by_vif (parent_idx))))
+  if (!(parent_lip = lcp_nl_lip_find_by_vif (parent_idx)))
     {
       LCP_NL_WARN ("link_add_vlan: No LIP for parent of %U", format_nl_object,
 		   rl);
@@ -626,8 +2325,7 @@ lcp_nl_link_add_vlan (struct rtnl_link *rl)
   lcpm->lcp_auto_subint = 0;
 
   /* Generate a subid, take the first available one */
-  if (vnet_sw_interface_get_available_subid (vnm, parent_sw->sup_sw_if_index,
-					     &subid))
+  if (lcp_itf_sub_get_available_subid (parent_sw->sup_sw_if_index, &subid))
     {
       LCP_NL_ERROR ("link_add_vlan: Cannot find available subid on phy %U",
 		    format_vnet_sw_if_index_name, vnm,
@@ -655,8 +2353,8 @@ lcp_nl_link_add_vlan (struct rtnl_link *rl)
   /* Try to use the same subid on the TAP, generate a unique one otherwise. */
   if (vnet_sw_interface_subid_exists (vnm, phy_lip->lip_host_sw_if_index,
 				      subid) &&
-      vnet_sw_interface_get_available_subid (
-	vnm, phy_lip->lip_host_sw_if_index, &subid))
+      lcp_itf_sub_get_available_subid (phy_lip->lip_host_sw_if_index,
+				       &subid))
     {
       LCP_NL_ERROR ("link_add_vlan: Cannot find available subid on host %U",
 		    format_vnet_sw_if_index_name, vnm,
@@ -726,7 +2424,6 @@ static void
 lcp_nl_link_add_vrf (struct rtnl_link *rl)
 {
   u32 table_id;
-  lcp_nl_table_t *nlt;
 
   if (rtnl_link_vrf_get_tableid (rl, &table_id))
     {
@@ -734,10 +2431,34 @@ lcp_nl_link_add_vrf (struct rtnl_link *rl)
       return;
     }
 
-  nlt = lcp_nl_table_add_or_lock (table_id, FIB_PROTOCOL_IP4);
-  nlt->nlt_if_index = rtnl_link_get_ifindex (rl);
+  /* the tables are made when the VRF gets an interface or a route */
+  lcp_nl_vrf_add (lcp_nl_ns_current_name (), rtnl_link_get_ifindex (rl),
+		  table_id);
+}
+
+/* The tables an interface was bound to by lcp_nl_link_set_master() */
+static uword *lcp_nl_vrf_bound[FIB_PROTOCOL_MAX];
+
+static void
+lcp_nl_vrf_bind (fib_protocol_t proto, u32 sw_if_index, u32 table_id)
+{
+  lcp_nl_table_t *nlt;
+  uword *p;
+
+  if ((p = hash_get (lcp_nl_vrf_bound[proto], sw_if_index)))
+    {
+      if (!pool_is_free_index (lcp_nl_table_pool, p[0]))
+	lcp_nl_table_unlock (pool_elt_at_index (lcp_nl_table_pool, p[0]));
+      hash_unset (lcp_nl_vrf_bound[proto], sw_if_index);
+    }
+
+  if (!table_id)
+    return;
 
-  lcp_nl_table_add_or_lock (table_id, FIB_PROTOCOL_IP6);
+  nlt = lcp_nl_table_add (table_id, proto);
+  lcp_nl_table_mfib_add (nlt);
+  lcp_nl_table_lock (nlt);
+  hash_set (lcp_nl_vrf_bound[proto], sw_if_index, nlt - lcp_nl_table_pool);
 }
 
 typedef struct lcp_itf_ip4_addresses_t_ {
@@ -867,10 +2588,45 @@ lcp_itf_addresses_free (lcp_itf_addresses_t *a)
   lcp_itf_ip6_addresses_free (&a->addresses6);
 }
 
+/* Move an interface to another table, with its addresses */
+static void
+lcp_nl_vrf_move (fib_protocol_t proto, u32 sw_if_index, u32 table_id)
+{
+  lcp_itf_addresses_t addresses;
+
+  lcp_itf_addresses_init (&addresses);
+  lcp_itf_addresses_get (&addresses, proto, sw_if_index);
+  lcp_itf_addresses_add_del (&addresses, proto, sw_if_index, 1);
+
+  lcp_nl_vrf_bind (proto, sw_if_index, table_id);
+  lcp_nl_ip_table_bind (proto, sw_if_index, table_id);
+
+  lcp_itf_addresses_add_del (&addresses, proto, sw_if_index, 0);
+  lcp_itf_addresses_free (&addresses);
+}
+
+/* The interfaces still bound to a table that goes away are moved back to
+ * the main table of their namespace, as the kernel does with the members of
+ * a deleted VRF */
+static void
+lcp_nl_vrf_unbind_all (lcp_nl_table_t *nlt)
+{
+  u32 *sw_if_indexes = NULL, *sw_if_index;
+  uword k, v;
+
+  hash_foreach (k, v, lcp_nl_vrf_bound[nlt->nlt_proto], ({
+		  if (v == nlt - lcp_nl_table_pool)
+		    vec_add1 (sw_if_indexes, k);
+		}));
+  vec_foreach (sw_if_index, sw_if_indexes)
+    lcp_nl_vrf_move (nlt->nlt_proto, *sw_if_index, lcp_nl_table_k2f (254));
+  vec_free (sw_if_indexes);
+}
+
 static void
 lcp_nl_link_del_vrf (struct rtnl_link *rl)
 {
-  int proto, refs;
+  int proto;
   u32 table_id;
   lcp_nl_table_t *nlt;
   const char *if_name;
@@ -882,19 +2638,19 @@ lcp_nl_link_del_vrf (struct rtnl_link *rl)
       return;
     }
 
+  lcp_nl_vrf_del (lcp_nl_ns_current_name (), rtnl_link_get_ifindex (rl));
+
+  /* the kernel does not tell about the routes it flushes with the VRF */
   for (proto = FIB_PROTOCOL_IP4; proto <= FIB_PROTOCOL_IP6; proto++)
     {
-      nlt = lcp_nl_table_find (table_id, proto);
+      nlt = lcp_nl_table_find (lcp_nl_table_k2f (table_id), proto);
       if (nlt)
         {
           LCP_NL_NOTICE ("link_del_vrf: Deleting ip%s table %u name %s",
                          proto == FIB_PROTOCOL_IP6 ? "6" : "4",
                          table_id, if_name);
-          do
-            {
-              refs = nlt->nlt_refs;
-              lcp_nl_table_unlock (nlt);
-            } while (refs > 1);
+          lcp_nl_vrf_unbind_all (nlt);
+          lcp_nl_table_free (nlt);
         }
     }
 }
@@ -904,23 +2660,22 @@ lcp_nl_link_set_master (struct rtnl_link *rl, lcp_itf_pair_t *lip)
 {
   int proto;
   u32 old_table_id, new_table_id, vrf_if_index, sw_if_index, old_fib_index;
-  lcp_nl_table_t *nlt;
-  lcp_itf_addresses_t addresses;
 
   vrf_if_index = rtnl_link_get_master (rl);
   if (vrf_if_index)
     {
-      nlt = lcp_nl_table_find_by_if_index (vrf_if_index);
-      if (!nlt)
+      new_table_id =
+	lcp_nl_vrf_find_table_id (lcp_nl_ns_current_name (), vrf_if_index);
+      if (new_table_id == ~0)
         {
           LCP_NL_ERROR ("link_set_master: Cannot find table_id by VRF index:%u",
                         vrf_if_index);
           return;
         }
-      new_table_id = nlt->nlt_id;
+      new_table_id = lcp_nl_table_k2f (new_table_id);
     }
   else
-    new_table_id = 0;
+    new_table_id = lcp_nl_table_k2f (254);
 
   sw_if_index = lip->lip_phy_sw_if_index;
 
@@ -935,15 +2690,18 @@ lcp_nl_link_set_master (struct rtnl_link *rl, lcp_itf_pair_t *lip)
       if (old_table_id == new_table_id)
         continue;
 
-      lcp_itf_addresses_init (&addresses);
-      lcp_itf_addresses_get (&addresses, proto, sw_if_index);
-      lcp_itf_addresses_add_del (&addresses, proto, sw_if_index, 1);
+      lcp_nl_vrf_move (proto, sw_if_index, new_table_id);
+    }
+}
 
-      lcp_nl_ip_table_bind (proto, sw_if_index, new_table_id);
+/* The pair goes away, and with it its hold on the tables */
+static void
+lcp_nl_link_unbind (lcp_itf_pair_t *lip)
+{
+  int proto;
 
-      lcp_itf_addresses_add_del (&addresses, proto, sw_if_index, 0);
-      lcp_itf_addresses_free (&addresses);
-    }
+  for (proto = FIB_PROTOCOL_IP4; proto <= FIB_PROTOCOL_IP6; proto++)
+    lcp_nl_vrf_bind (proto, lip->lip_phy_sw_if_index, 0);
 }
 #else // LCP_HAVE_VRF_SYNC
 static void
@@ -960,6 +2718,11 @@ static void
 lcp_nl_link_set_master (struct rtnl_link *rl, lcp_itf_pair_t *lip)
 {
 }
+
+static void
+lcp_nl_link_unbind (lcp_itf_pair_t *lip)
+{
+}
 #endif // LCP_HAVE_VRF_SYNC
 
 void
@@ -975,14 +2738,14 @@ lcp_nl_link_del (struct rtnl_link *rl)
       return;
     }
 
-  if (!(lip = lcp_itf_pair_get (
-	  lcp_itf_pair_find_by_vif (rtnl_link_get_ifindex (rl)))))
+  if (!(lip = lcp_nl_lip_find_by_vif (rtnl_link_get_ifindex (rl))))
     {
       LCP_NL_WARN ("link_del: No LIP for %U ", format_nl_object, rl);
       return;
     }
 
   LCP_NL_NOTICE ("link_del: Removing %U", format_lcp_itf_pair, lip);
+  lcp_nl_link_unbind (lip);
   lcp_itf_pair_delete (lip->lip_phy_sw_if_index);
 
   if (rtnl_link_is_vlan (rl))
@@ -1075,8 +2838,7 @@ lcp_nl_link_add (struct rtnl_link *rl, void *ctx)
    * may be a request to create a sub-int; so we call add_vlan()
    * to create it and pass its new LIP so we can finish the request.
    */
-  if (!(lip = lcp_itf_pair_get (
-	  lcp_itf_pair_find_by_vif (rtnl_link_get_ifindex (rl)))))
+  if (!(lip = lcp_nl_lip_find_by_vif (rtnl_link_get_ifindex (rl))))
     {
       if (!(lip = lcp_nl_link_add_vlan (rl)))
 	return;
@@ -1093,6 +2855,7 @@ lcp_nl_link_add (struct rtnl_link *rl, void *ctx)
     {
       vnet_sw_interface_admin_down (vnm, lip->lip_phy_sw_if_index);
     }
+  lcp_nl_link_purge (lip, !(IFF_LOWER_UP & rtnl_link_get_flags (rl)));
 
   lcp_nl_link_set_mtu (rl, lip);
   lcp_nl_link_set_lladdr (rl, lip);
@@ -1179,8 +2942,7 @@ lcp_nl_addr_add_del (struct rtnl_addr *ra, int is_del)
   LCP_NL_DBG ("addr_%s: netlink %U", is_del ? "del" : "add", format_nl_object,
 	      ra);
 
-  if (!(lip = lcp_itf_pair_get (
-	  lcp_itf_pair_find_by_vif (rtnl_addr_get_ifindex (ra)))))
+  if (!(lip = lcp_nl_lip_find_by_vif (rtnl_addr_get_ifindex (ra))))
     {
       LCP_NL_WARN ("addr_%s: No LIP for %U ", is_del ? "del" : "add",
 		   format_nl_object, ra);
@@ -1243,8 +3005,7 @@ lcp_nl_neigh_add (struct rtnl_neigh *rn)
 
   LCP_NL_DBG ("neigh_add: netlink %U", format_nl_object, rn);
 
-  if (!(lip = lcp_itf_pair_get (
-	  lcp_itf_pair_find_by_vif (rtnl_neigh_get_ifindex (rn)))))
+  if (!(lip = lcp_nl_lip_find_by_vif (rtnl_neigh_get_ifindex (rn))))
     {
       LCP_NL_WARN ("neigh_add: No LIP for %U ", format_nl_object, rn);
       return;
@@ -1283,6 +3044,7 @@ lcp_nl_neigh_add (struct rtnl_neigh *rn)
 
       if (rv)
 	{
+	  lcp_nl_neigh_unset (rtnl_neigh_get_ifindex (rn), &nh);
 	  LCP_NL_ERROR ("neigh_add: Failed %U lladdr %U iface %U",
 			format_ip_address, &nh, format_mac_address, &mac,
 			format_vnet_sw_if_index_name, vnet_get_main (),
@@ -1290,6 +3052,8 @@ lcp_nl_neigh_add (struct rtnl_neigh *rn)
 	}
       else
 	{
+	  lcp_nl_neigh_set (rtnl_neigh_get_ifindex (rn),
+			    lip->lip_phy_sw_if_index, &nh, &mac, flags);
 	  LCP_NL_INFO ("neigh_add: Added %U lladdr %U iface %U",
 		       format_ip_address, &nh, format_mac_address, &mac,
 		       format_vnet_sw_if_index_name, vnet_get_main (),
@@ -1307,8 +3071,7 @@ lcp_nl_neigh_del (struct rtnl_neigh *rn)
   LCP_NL_DBG ("neigh_del: netlink %U", format_nl_object, rn);
 
   lcp_itf_pair_t *lip;
-  if (!(lip = lcp_itf_pair_get (
-	  lcp_itf_pair_find_by_vif (rtnl_neigh_get_ifindex (rn)))))
+  if (!(lip = lcp_nl_lip_find_by_vif (rtnl_neigh_get_ifindex (rn))))
     {
       LCP_NL_WARN ("neigh_del: No LIP for %U ", format_nl_object, rn);
       return;
@@ -1326,7 +3089,14 @@ lcp_nl_neigh_del (struct rtnl_neigh *rn)
 		  rn);
       return;
     }
+  if (clib_bitmap_get (lcp_nl_purged_sw_if_indexes,
+		       lip->lip_phy_sw_if_index))
+    {
+      LCP_NL_DBG ("neigh_del: ignore purged %U", format_nl_object, rn);
+      return;
+    }
   lcp_nl_mk_ip_addr (rna, &nh);
+  lcp_nl_neigh_unset (rtnl_neigh_get_ifindex (rn), &nh);
   rv = ip_neighbor_del (&nh, lip->lip_phy_sw_if_index);
 
   if (rv == 0 || rv == VNET_API_ERROR_NO_SUCH_ENTRY)
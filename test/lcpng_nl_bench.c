@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2021 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <vlib/vlib.h>
+#include <vlib/unix/plugin.h>
+
+#include <plugins/lcpng/lcpng_netlink.h>
+
+/*
+ * Replay of a netlink recording, as made with 'lcp netlink record', through
+ * the listener of the netlink plugin: messages are queued as the socket
+ * callback would, and applied by the same rounds as the netlink process.
+ * The pairs the recording refers to must exist, see 'test lcp add ... vif'.
+ *
+ * The netlink plugin is a separate plugin, its entry points are looked up
+ * at run time.
+ */
+#define LCP_NL_PLUGIN "lcpng_nl_plugin.so"
+
+typedef int (*lcp_nl_replay_inject_fn_t) (const u8 *ns,
+					  const struct nlmsghdr *hdr);
+typedef u64 (*lcp_nl_replay_run_fn_t) (void);
+
+#define LCP_NL_BENCH_CHUNK_DEF 256
+
+typedef struct lcp_nl_bench_snap_t_
+{
+  u64 latency[NL_HIST_N_BUCKETS];
+  u64 barrier_n_holds;
+  f64 barrier_hold_total;
+  uword heap_used;
+} lcp_nl_bench_snap_t;
+
+static void
+lcp_nl_bench_snap (lcp_nl_main_t *nm, lcp_nl_bench_snap_t *snap)
+{
+  clib_mem_usage_t usage;
+  int i;
+
+  for (i = 0; i < NL_HIST_N_BUCKETS; i++)
+    snap->latency[i] = vlib_get_simple_counter (
+      &nm->hists[LCP_NL_HIST_QUEUE_LATENCY], i);
+  snap->barrier_n_holds = nm->barrier_n_holds;
+  snap->barrier_hold_total = nm->barrier_hold_total;
+  clib_mem_get_heap_usage (clib_mem_get_heap (), &usage);
+  snap->heap_used = usage.bytes_used;
+}
+
+/* Upper bound in usec of the bucket the q-th quantile falls in */
+static u64
+lcp_nl_bench_quantile (const u64 *hist, u64 n, f64 q)
+{
+  u64 seen = 0;
+  int i;
+
+  for (i = 0; i < NL_HIST_N_BUCKETS; i++)
+    {
+      seen += hist[i];
+      if (seen && seen >= q * n)
+	return 2ULL << i;
+    }
+  return 0;
+}
+
+static clib_error_t *
+lcp_nl_bench_replay_command_fn (vlib_main_t *vm, unformat_input_t *input,
+				vlib_cli_command_t *cmd)
+{
+  lcp_nl_replay_inject_fn_t inject;
+  lcp_nl_replay_run_fn_t run;
+  lcp_nl_main_t *nm;
+  lcp_nl_bench_snap_t before, after;
+  lcp_nl_record_hdr_t *hdr;
+  lcp_nl_record_msg_t *rec;
+  clib_error_t *error = 0;
+  u8 *file = 0, *ns = 0, *data = 0, is_realtime = 0;
+  u32 chunk = LCP_NL_BENCH_CHUNK_DEF, n_chunk = 0;
+  u64 n_msgs = 0, n_routes = 0, n_lat = 0, off;
+  u64 d_lat[NL_HIST_N_BUCKETS];
+  f64 start, elapsed, rec_start = 0;
+  struct nlmsghdr *nlh;
+  int i;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "realtime"))
+	is_realtime = 1;
+      else if (unformat (input, "chunk %u", &chunk))
+	;
+      else if (unformat (input, "netns %s", &ns))
+	;
+      else if (unformat (input, "%s", &file))
+	;
+      else
+	{
+	  error = clib_error_return (0, "unknown input `%U'",
+				     format_unformat_error, input);
+	  goto done;
+	}
+    }
+
+  if (!file || !chunk)
+    {
+      error = clib_error_return (0, "a recording and a chunk size of at "
+				    "least 1 are required");
+      goto done;
+    }
+  if (ns)
+    vec_add1 (ns, 0);
+
+  inject = vlib_get_plugin_symbol (LCP_NL_PLUGIN, "lcp_nl_replay_inject");
+  run = vlib_get_plugin_symbol (LCP_NL_PLUGIN, "lcp_nl_replay_run");
+  nm = vlib_get_plugin_symbol (LCP_NL_PLUGIN, "lcp_nl_main");
+  if (!inject || !run || !nm)
+    {
+      error = clib_error_return (0, "%s is not loaded", LCP_NL_PLUGIN);
+      goto done;
+    }
+
+  vec_add1 (file, 0);
+  if ((error = clib_file_contents ((char *) file, &data)))
+    goto done;
+
+  hdr = (lcp_nl_record_hdr_t *) data;
+  if (vec_len (data) < sizeof (*hdr) || hdr->magic != LCP_NL_RECORD_MAGIC ||
+      hdr->version != LCP_NL_RECORD_VERSION)
+    {
+      error = clib_error_return (0, "%s is not a netlink recording", file);
+      goto done;
+    }
+
+  lcp_nl_bench_snap (nm, &before);
+  start = vlib_time_now (vm);
+
+  for (off = sizeof (*hdr); off + sizeof (*rec) <= vec_len (data);
+       off += sizeof (*rec) + rec->len)
+    {
+      rec = (lcp_nl_record_msg_t *) (data + off);
+      if (off + sizeof (*rec) + rec->len > vec_len (data))
+	break;
+      nlh = (struct nlmsghdr *) (rec + 1);
+
+      /* keep the pace of the recording */
+      if (is_realtime)
+	{
+	  if (!n_msgs)
+	    rec_start = rec->ts;
+	  elapsed = vlib_time_now (vm) - start;
+	  if (rec->ts - rec_start > elapsed)
+	    {
+	      run ();
+	      vlib_process_suspend (vm, rec->ts - rec_start - elapsed);
+	    }
+	}
+
+      if (inject (ns, nlh) < 0)
+	{
+	  error = clib_error_return (0, "unable to inject message %llu, is "
+					"a reader thread running?",
+				     n_msgs);
+	  goto done;
+	}
+      n_msgs++;
+      if (nlh->nlmsg_type == RTM_NEWROUTE || nlh->nlmsg_type == RTM_DELROUTE)
+	n_routes++;
+
+      /* as much as one read of the socket would have queued */
+      if (++n_chunk == chunk)
+	{
+	  run ();
+	  n_chunk = 0;
+	}
+    }
+  while (run ())
+    ;
+
+  elapsed = vlib_time_now (vm) - start;
+  lcp_nl_bench_snap (nm, &after);
+
+  for (i = 0; i < NL_HIST_N_BUCKETS; i++)
+    {
+      d_lat[i] = after.latency[i] - before.latency[i];
+      n_lat += d_lat[i];
+    }
+
+  vlib_cli_output (vm, "replayed %llu messages (%llu routes) in %.3f sec",
+		   n_msgs, n_routes, elapsed);
+  vlib_cli_output (vm, "  %.0f messages/s %.0f routes/s",
+		   elapsed > 0 ? n_msgs / elapsed : 0,
+		   elapsed > 0 ? n_routes / elapsed : 0);
+  vlib_cli_output (vm, "  queue latency p50 < %llu usec p99 < %llu usec",
+		   lcp_nl_bench_quantile (d_lat, n_lat, 0.50),
+		   lcp_nl_bench_quantile (d_lat, n_lat, 0.99));
+  vlib_cli_output (vm, "  barrier holds %llu total %.3f ms",
+		   after.barrier_n_holds - before.barrier_n_holds,
+		   1e3 * (after.barrier_hold_total - before.barrier_hold_total));
+  vlib_cli_output (vm, "  heap growth %lld bytes",
+		   (i64) after.heap_used - (i64) before.heap_used);
+
+done:
+  vec_free (file);
+  vec_free (ns);
+  vec_free (data);
+  return error;
+}
+
+VLIB_CLI_COMMAND (lcp_nl_bench_replay_command, static) = {
+  .path = "test lcp netlink replay",
+  .short_help =
+    "test lcp netlink replay <file> [realtime] [chunk <n>] [netns <name>]",
+  .function = lcp_nl_bench_replay_command_fn,
+};
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2021 Cisco and/or its affiliates.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <vlib/vlib.h>
+#include <vnet/vnet.h>
+#include <vnet/pg/pg.h>
+#include <vnet/ethernet/ethernet.h>
+
+#include <plugins/lcpng/lcpng_interface.h>
+
+/*
+ * Packet rate of the linux-cp nodes, with the packet generator.
+ *
+ * Pairs of packet-generator interfaces stand in for the phy and the host,
+ * untagged and dot1q tagged TAP pairs as well as TUN pairs. One stream
+ * sends from the host to the phy and one from the phy to the host, for
+ * every kind of traffic, on a subset of the pairs. The pairs are kept
+ * between runs, so a run with more pairs only adds the missing ones.
+ */
+#define LCP_BENCH_PG_ID_BASE  1000
+#define LCP_BENCH_VLAN	      100
+#define LCP_BENCH_STREAMS_DEF 16
+#define LCP_BENCH_PACKETS_DEF 1000000
+#define LCP_BENCH_SIZE_DEF    128
+#define LCP_BENCH_TIMEOUT     60.0
+
+typedef enum lcp_bench_kind_t_
+{
+  LCP_BENCH_UNTAGGED,
+  LCP_BENCH_TAGGED,
+  LCP_BENCH_TUN,
+  LCP_BENCH_N_KIND,
+} lcp_bench_kind_t;
+
+typedef struct lcp_bench_pair_t_
+{
+  u8 *phy_name;
+  u8 *host_name;
+  /* the interfaces the streams are sent from, the parent of a tagged pair */
+  u8 *phy_pg;
+  u8 *host_pg;
+  u32 phy_sw_if_index;
+  u32 host_sw_if_index;
+  u32 index;
+} lcp_bench_pair_t;
+
+typedef struct lcp_bench_main_t_
+{
+  lcp_bench_pair_t *pairs[LCP_BENCH_N_KIND];
+  u8 **streams;
+  u32 pg_id;
+  u32 n_pairs;
+} lcp_bench_main_t;
+
+static lcp_bench_main_t lcp_bench_main = {
+  .pg_id = LCP_BENCH_PG_ID_BASE,
+};
+
+static char *lcp_bench_nodes[] = {
+  "linux-cp-xc-ip4",	"linux-cp-xc-ip6",  "linux-cp-xc-l3-ip4",
+  "linux-cp-xc-l3-ip6", "linux-cp-punt",    "linux-cp-punt-l3",
+  "linux-cp-arp-phy",	"linux-cp-arp-host",
+};
+
+typedef struct lcp_bench_node_stats_t_
+{
+  u64 calls;
+  u64 vectors;
+  u64 clocks;
+} lcp_bench_node_stats_t;
+
+static void
+lcp_bench_discard_output (uword arg, u8 *buffer, uword len)
+{
+}
+
+/* Run a CLI command, the output of which is dropped */
+static clib_error_t *
+lcp_bench_exec (vlib_main_t *vm, char *fmt, ...)
+{
+  unformat_input_t input;
+  clib_error_t *error;
+  va_list va;
+  u8 *s;
+
+  va_start (va, fmt);
+  s = va_format (0, fmt, &va);
+  va_end (va);
+
+  unformat_init_vector (&input, s);
+  error = vlib_cli_input (vm, &input, lcp_bench_discard_output, 0);
+  unformat_free (&input);
+
+  return error;
+}
+
+static u32
+lcp_bench_sw_if_index (u8 *name)
+{
+  unformat_input_t input;
+  u32 sw_if_index = ~0;
+
+  unformat_init_string (&input, (char *) name, vec_len (name));
+  unformat (&input, "%U", unformat_vnet_sw_interface, vnet_get_main (),
+	    &sw_if_index);
+  unformat_free (&input);
+
+  return sw_if_index;
+}
+
+static u8 *
+format_lcp_bench_mac (u8 *s, va_list *args)
+{
+  u32 sw_if_index = va_arg (*args, u32);
+  vnet_hw_interface_t *hi;
+
+  hi = vnet_get_sup_hw_interface (vnet_get_main (), sw_if_index);
+  return format (s, "%U", format_ethernet_address, hi->hw_address);
+}
+
+static clib_error_t *
+lcp_bench_pg_create (vlib_main_t *vm, lcp_bench_kind_t kind, u8 **pg,
+		     u8 **name)
+{
+  clib_error_t *error;
+  u32 id = lcp_bench_main.pg_id++;
+
+  if ((error = lcp_bench_exec (vm, "create packet-generator interface pg%u%s",
+			       id, kind == LCP_BENCH_TUN ? " mode ip4" : "")))
+    return error;
+  if ((error = lcp_bench_exec (vm, "set interface state pg%u up", id)))
+    return error;
+  *pg = format (0, "pg%u", id);
+  *name = vec_dup (*pg);
+
+  if (kind == LCP_BENCH_TAGGED)
+    {
+      if ((error = lcp_bench_exec (
+	     vm, "create sub-interfaces pg%u %u dot1q %u exact-match", id,
+	     LCP_BENCH_VLAN, LCP_BENCH_VLAN)))
+	return error;
+      if ((error = lcp_bench_exec (vm, "set interface state pg%u.%u up", id,
+				   LCP_BENCH_VLAN)))
+	return error;
+      *name = format (*name, ".%u", LCP_BENCH_VLAN);
+    }
+
+  return 0;
+}
+
+static clib_error_t *
+lcp_bench_pair_create (vlib_main_t *vm, lcp_bench_kind_t kind)
+{
+  lcp_bench_main_t *bm = &lcp_bench_main;
+  lcp_bench_pair_t *bp;
+  clib_error_t *error;
+  u32 i;
+
+  vec_add2 (bm->pairs[kind], bp, 1);
+  bp->index = i = bm->n_pairs++;
+
+  if ((error = lcp_bench_pg_create (vm, kind, &bp->phy_pg, &bp->phy_name)) ||
+      (error = lcp_bench_pg_create (vm, kind, &bp->host_pg, &bp->host_name)))
+    return error;
+  bp->phy_sw_if_index = lcp_bench_sw_if_index (bp->phy_name);
+  bp->host_sw_if_index = lcp_bench_sw_if_index (bp->host_name);
+
+  /* the punted traffic is addressed to the phy */
+  if ((error = lcp_bench_exec (vm, "set interface ip address %v 10.%u.%u.1/24",
+			       bp->phy_name, (i >> 8) & 0xff, i & 0xff)))
+    return error;
+  if (kind != LCP_BENCH_TUN &&
+      (error = lcp_bench_exec (
+	 vm, "set interface ip address %v 2001:db8:%x::1/64", bp->phy_name, i)))
+    return error;
+
+  return lcp_bench_exec (vm, "test lcp add phy %v host %v", bp->phy_name,
+			 bp->host_name);
+}
+
+static clib_error_t *
+lcp_bench_stream (vlib_main_t *vm, u32 limit, u32 size, u8 *rx_name,
+		  char *node, char *fmt, ...)
+{
+  lcp_bench_main_t *bm = &lcp_bench_main;
+  clib_error_t *error;
+  u8 *name, *data;
+  va_list va;
+
+  va_start (va, fmt);
+  data = va_format (0, fmt, &va);
+  va_end (va);
+
+  name = format (0, "lcp-bench-%u", vec_len (bm->streams));
+  error = lcp_bench_exec (vm,
+			  "packet-generator new { name %v limit %u "
+			  "size %u-%u interface %v node %s data { %v } }",
+			  name, limit, size, size, rx_name, node, data);
+  vec_add1 (bm->streams, name);
+  vec_free (data);
+
+  return error;
+}
+
+/* The streams of one pair: what the host sends and what the phy punts */
+static clib_error_t *
+lcp_bench_pair_streams (vlib_main_t *vm, lcp_bench_kind_t kind,
+			lcp_bench_pair_t *bp, u32 limit, u32 size)
+{
+  clib_error_t *error;
+  u8 *vlan = 0;
+  u32 hi = (bp->index >> 8) & 0xff, lo = bp->index & 0xff;
+
+  if (kind == LCP_BENCH_TUN)
+    {
+      if ((error = lcp_bench_stream (
+	     vm, limit, size, bp->host_pg, "ip4-input",
+	     "UDP: 10.%u.%u.2 -> 198.51.100.1 UDP: 1234 -> 5678 incrementing "
+	     "100",
+	     hi, lo)))
+	return error;
+      return lcp_bench_stream (
+	vm, limit, size, bp->phy_pg, "ip4-input",
+	"UDP: 10.%u.%u.2 -> 10.%u.%u.1 UDP: 1234 -> 5678 incrementing 100",
+	hi, lo, hi, lo);
+    }
+
+  if (kind == LCP_BENCH_TAGGED)
+    vlan = format (0, " vlan %u", LCP_BENCH_VLAN);
+
+  /* host to phy */
+  if ((error = lcp_bench_stream (
+	 vm, limit, size, bp->host_pg, "ethernet-input",
+	 "IP4: 02:00:00:00:00:01 -> %U%v UDP: 10.%u.%u.2 -> 198.51.100.1 "
+	 "UDP: 1234 -> 5678 incrementing 100",
+	 format_lcp_bench_mac, bp->host_sw_if_index, vlan, hi, lo)) ||
+      (error = lcp_bench_stream (
+	 vm, limit, size, bp->host_pg, "ethernet-input",
+	 "IP6: 02:00:00:00:00:01 -> %U%v UDP: 2001:db8:%x::2 -> "
+	 "2001:db8:ffff::1 UDP: 1234 -> 5678 incrementing 100",
+	 format_lcp_bench_mac, bp->host_sw_if_index, vlan, bp->index)) ||
+      (error = lcp_bench_stream (
+	 vm, limit, size, bp->host_pg, "ethernet-input",
+	 "ARP: 02:00:00:00:00:01 -> ff:ff:ff:ff:ff:ff%v "
+	 "request: 02:00:00:00:00:01/10.%u.%u.1 -> 00:00:00:00:00:00/10.%u.%u.2",
+	 vlan, hi, lo, hi, lo)))
+    goto done;
+
+  /* phy to host: unknown UDP ports, IKE and ARP */
+  if ((error = lcp_bench_stream (
+	 vm, limit, size, bp->phy_pg, "ethernet-input",
+	 "IP4: 02:00:00:00:00:01 -> %U%v UDP: 10.%u.%u.2 -> 10.%u.%u.1 "
+	 "UDP: 1234 -> 5678 incrementing 100",
+	 format_lcp_bench_mac, bp->phy_sw_if_index, vlan, hi, lo, hi, lo)) ||
+      (error = lcp_bench_stream (
+	 vm, limit, size, bp->phy_pg, "ethernet-input",
+	 "IP4: 02:00:00:00:00:01 -> %U%v UDP: 10.%u.%u.2 -> 10.%u.%u.1 "
+	 "UDP: 4500 -> 4500 hex 0x00000000",
+	 format_lcp_bench_mac, bp->phy_sw_if_index, vlan, hi, lo, hi, lo)) ||
+      (error = lcp_bench_stream (
+	 vm, limit, size, bp->phy_pg, "ethernet-input",
+	 "ARP: 02:00:00:00:00:01 -> ff:ff:ff:ff:ff:ff%v "
+	 "request: 02:00:00:00:00:01/10.%u.%u.2 -> 00:00:00:00:00:00/10.%u.%u.1",
+	 vlan, hi, lo, hi, lo)))
+    goto done;
+
+done:
+  vec_free (vlan);
+  return error;
+}
+
+static void
+lcp_bench_streams_delete (vlib_main_t *vm)
+{
+  lcp_bench_main_t *bm = &lcp_bench_main;
+  u8 **name;
+
+  vec_foreach (name, bm->streams)
+    {
+      clib_error_free (
+	lcp_bench_exec (vm, "packet-generator delete %v", *name));
+      vec_free (*name);
+    }
+  vec_reset_length (bm->streams);
+}
+
+static int
+lcp_bench_pg_busy (void)
+{
+  pg_main_t *pg = &pg_main;
+  uword **enabled;
+
+  vec_foreach (enabled, pg->enabled_streams)
+    if (!clib_bitmap_is_zero (*enabled))
+      return 1;
+  return 0;
+}
+
+static void
+lcp_bench_node_stats (vlib_main_t *vm, u32 node_index,
+		      lcp_bench_node_stats_t *stats)
+{
+  vlib_main_t *ovm;
+  vlib_node_t *n;
+  u32 i;
+
+  clib_memset (stats, 0, sizeof (*stats));
+
+  vlib_worker_thread_barrier_sync (vm);
+  for (i = 0; i < vlib_get_n_threads (); i++)
+    {
+      ovm = vlib_get_main_by_index (i);
+      n = vlib_get_node (ovm, node_index);
+      vlib_node_sync_stats (ovm, n);
+      stats->calls += n->stats_total.calls;
+      stats->vectors += n->stats_total.vectors;
+      stats->clocks += n->stats_total.clocks;
+    }
+  vlib_worker_thread_barrier_release (vm);
+}
+
+static clib_error_t *
+lcp_bench_nodes_command_fn (vlib_main_t *vm, unformat_input_t *input,
+			    vlib_cli_command_t *cmd)
+{
+  lcp_bench_main_t *bm = &lcp_bench_main;
+  u32 n_wanted[LCP_BENCH_N_KIND] = { [LCP_BENCH_UNTAGGED] = 1 };
+  lcp_bench_node_stats_t before[ARRAY_LEN (lcp_bench_nodes)], after, d;
+  u32 n_streams = LCP_BENCH_STREAMS_DEF, n_packets = LCP_BENCH_PACKETS_DEF;
+  u32 size = LCP_BENCH_SIZE_DEF, n_active = 0, limit, kind, i, j;
+  u32 node_index[ARRAY_LEN (lcp_bench_nodes)];
+  clib_error_t *error = 0;
+  vlib_node_t *n;
+  f64 start, elapsed;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "pairs %u", &n_wanted[LCP_BENCH_UNTAGGED]))
+	;
+      else if (unformat (input, "tagged %u", &n_wanted[LCP_BENCH_TAGGED]))
+	;
+      else if (unformat (input, "tun %u", &n_wanted[LCP_BENCH_TUN]))
+	;
+      else if (unformat (input, "streams %u", &n_streams))
+	;
+      else if (unformat (input, "packets %u", &n_packets))
+	;
+      else if (unformat (input, "size %u", &size))
+	;
+      else
+	return clib_error_return (0, "unknown input `%U'",
+				  format_unformat_error, input);
+    }
+
+  for (i = 0; i < ARRAY_LEN (lcp_bench_nodes); i++)
+    {
+      if (!(n = vlib_get_node_by_name (vm, (u8 *) lcp_bench_nodes[i])))
+	return clib_error_return (0, "no node %s, is lcpng_if_plugin.so "
+				     "loaded?",
+				  lcp_bench_nodes[i]);
+      node_index[i] = n->index;
+    }
+
+  for (kind = 0; kind < LCP_BENCH_N_KIND; kind++)
+    while (vec_len (bm->pairs[kind]) < n_wanted[kind])
+      if ((error = lcp_bench_pair_create (vm, kind)))
+	return error;
+
+  for (kind = 0; kind < LCP_BENCH_N_KIND; kind++)
+    n_active += clib_min (n_streams, n_wanted[kind]);
+  if (!n_active || !n_packets)
+    return clib_error_return (0, "nothing to send");
+  limit = clib_max (1, n_packets / n_active);
+
+  /* spread the streams over the pairs of each kind */
+  for (kind = 0; kind < LCP_BENCH_N_KIND; kind++)
+    for (j = 0; j < clib_min (n_streams, n_wanted[kind]); j++)
+      if ((error = lcp_bench_pair_streams (
+	     vm, kind,
+	     &bm->pairs[kind][(u64) j * n_wanted[kind] /
+			      clib_min (n_streams, n_wanted[kind])],
+	     limit, size)))
+	goto done;
+
+  for (i = 0; i < ARRAY_LEN (lcp_bench_nodes); i++)
+    lcp_bench_node_stats (vm, node_index[i], &before[i]);
+
+  start = vlib_time_now (vm);
+  if ((error = lcp_bench_exec (vm, "packet-generator enable-stream")))
+    goto done;
+  while (lcp_bench_pg_busy () &&
+	 vlib_time_now (vm) - start < LCP_BENCH_TIMEOUT)
+    vlib_process_suspend (vm, 10e-3);
+  elapsed = vlib_time_now (vm) - start;
+  clib_error_free (lcp_bench_exec (vm, "packet-generator disable-stream"));
+
+  vlib_cli_output (vm, "%u pairs (%u tagged, %u tun), %u streams of %u "
+		   "packets of %u bytes in %.3f sec",
+		   bm->n_pairs, vec_len (bm->pairs[LCP_BENCH_TAGGED]),
+		   vec_len (bm->pairs[LCP_BENCH_TUN]), vec_len (bm->streams),
+		   limit, size, elapsed);
+  vlib_cli_output (vm, "%-20s %12s %12s %10s %10s", "node", "calls",
+		   "packets", "clk/pkt", "vec/call");
+
+  for (i = 0; i < ARRAY_LEN (lcp_bench_nodes); i++)
+    {
+      lcp_bench_node_stats (vm, node_index[i], &after);
+      d.calls = after.calls - before[i].calls;
+      d.vectors = after.vectors - before[i].vectors;
+      d.clocks = after.clocks - before[i].clocks;
+      vlib_cli_output (vm, "%-20s %12llu %12llu %10.2f %10.2f",
+		       lcp_bench_nodes[i], d.calls, d.vectors,
+		       d.vectors ? (f64) d.clocks / d.vectors : 0,
+		       d.calls ? (f64) d.vectors / d.calls : 0);
+    }
+
+done:
+  lcp_bench_streams_delete (vm);
+  return error;
+}
+
+VLIB_CLI_COMMAND (lcp_bench_nodes_command, static) = {
+  .path = "test lcp bench nodes",
+  .short_help = "test lcp bench nodes [pairs <n>] [tagged <n>] [tun <n>] "
+		"[streams <n>] [packets <n>] [size <bytes>]",
+  .function = lcp_bench_nodes_command_fn,
+};
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
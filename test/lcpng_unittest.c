@@ -37,6 +37,11 @@ lcp_add_pair_command_fn (vlib_main_t *vm, unformat_input_t *input,
     {
       if (unformat (input, "add"))
 	is_add = 1;
+      else if (unformat (input, "vif %u", &host_vif))
+	{
+	  vec_reset_length (host_name);
+	  host_name = format (host_name, host_template, host_vif);
+	}
       else if (unformat (input, "del"))
 	is_add = 0;
       else if (unformat (input, "phy %U", unformat_vnet_sw_interface, vnm,
@@ -80,7 +85,8 @@ lcp_add_pair_command_fn (vlib_main_t *vm, unformat_input_t *input,
 
 VLIB_CLI_COMMAND (test_time_range_command, static) = {
   .path = "test lcp",
-  .short_help = "lcp [add|del] phy <SW_IF_INDEX> host <SW_IF_INDEX>",
+  .short_help =
+    "lcp [add|del] phy <SW_IF_INDEX> host <SW_IF_INDEX> [vif <ifindex>]",
   .function = lcp_add_pair_command_fn,
 };
 